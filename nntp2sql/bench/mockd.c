@@ -0,0 +1,539 @@
+/*
+ * bench/mockd.c
+ *
+ * Loopback NNTP server for benchmarking nntp2sql: serves a synthetic,
+ * deterministic overview corpus over XOVER/OVER, XZVER, HDR and HEAD, with an
+ * optional simulated round-trip time, TLS, COMPRESS DEFLATE and XFEATURE
+ * COMPRESS GZIP.
+ *
+ * Usage:
+ *   nntp2sql-mockd [--port N] [--groups NAME:COUNT[,NAME:COUNT...]]
+ *                  [--rtt-ms MS] [--tls --cert FILE --key FILE] [--overview-holes]
+ *                  [--crosspost N] [--drop-after N]
+ *
+ * --port 0 picks a free port; the port is printed as "listening on N".
+ * --overview-holes leaves every 97th article out of the overview and blanks
+ * the Date column of every 89th, as servers with damaged overview data do.
+ * --crosspost N makes every Nth article one message crossposted to all the
+ * groups that have that article number (the same Message-ID and Xref in
+ * each); the other Message-IDs are then unique to their group.
+ * --drop-after N closes each connection without a reply when its Nth command
+ * arrives, to exercise the client's reconnect and resume paths.
+ * Replies are released RTT after their command arrived, so pipelined commands
+ * overlap the way they would against a distant server.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <zlib.h>
+
+#define MAX_GROUPS 64
+
+typedef struct { char name[128]; int count; } Group;
+
+static Group g_groups[MAX_GROUPS];
+static int g_ngroups = 0;
+static long g_rtt_us = 0;
+static int g_holes = 0;
+static int g_crosspost = 0;
+static int g_drop_after = 0;
+static SSL_CTX *g_tls = NULL;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* growable reply buffer */
+typedef struct { char *p; size_t len, cap; } Buf;
+
+static void buf_put(Buf *b, const char *s, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        char *np = realloc(b->p, cap);
+        if (!np) { perror("realloc"); exit(1); }
+        b->p = np; b->cap = cap;
+    }
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+}
+
+static void buf_line(Buf *b, const char *s) {
+    buf_put(b, s, strlen(s));
+    buf_put(b, "\r\n", 2);
+}
+
+/* Synthetic article n: field lengths vary with n, a quarter of the articles
+   start threads and the rest reference their predecessor. */
+static const char filler[] = "lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor incididunt ut labore";
+
+typedef struct {
+    char subject[256], from[96], date[64], msgid[64], refs[64];
+    int bytes, lines;
+} Article;
+
+static void make_article(const char *group, int n, Article *a) {
+    int xp = g_crosspost > 0 && n % g_crosspost == 0;
+    if (xp) group = "crosspost";
+    int flen = (int)((unsigned)n * 7919u % (sizeof(filler) - 1));
+    snprintf(a->subject, sizeof(a->subject), "%s[%s] thread %d part %d - %.*s",
+             n % 4 ? "Re: " : "", group, n / 4, n % 4, flen, filler);
+    snprintf(a->from, sizeof(a->from), "user%d@example.com (Bench User %d)", n % 997, n % 997);
+    time_t t = (time_t)1700000000 + (time_t)n * 37;
+    struct tm tm; gmtime_r(&t, &tm);
+    strftime(a->date, sizeof(a->date), "%a, %d %b %Y %H:%M:%S +0000", &tm);
+    snprintf(a->msgid, sizeof(a->msgid), "<%d.%x@bench.example>", n, (unsigned)n * 2654435761u);
+    if (g_crosspost > 0 && !xp) {
+        unsigned h = 2166136261u;
+        for (const char *p = group; *p; ++p) h = (h ^ (unsigned char)*p) * 16777619u;
+        snprintf(a->msgid, sizeof(a->msgid), "<%d.%x.%x@bench.example>", n, (unsigned)n * 2654435761u, h);
+    }
+    if (n % 4) snprintf(a->refs, sizeof(a->refs), "<%d.%x@bench.example>", n - 1, (unsigned)(n - 1) * 2654435761u);
+    else a->refs[0] = '\0';
+    a->bytes = 1000 + n % 5000;
+    a->lines = 10 + n % 300;
+}
+
+/* Outgoing replies: each carries the time it may be sent. With an RTT a sender
+   thread releases them in order; without one the reader writes directly. */
+typedef struct Reply { struct Reply *next; long long due; int zstart; Buf b; } Reply;
+
+typedef struct {
+    int fd;
+    SSL *ssl;
+    char rbuf[16384];
+    size_t rpos, rlen;
+    pthread_mutex_t m;
+    pthread_cond_t cv;
+    Reply *head, *tail;
+    int closing;
+    z_stream *zin, *zout;   /* COMPRESS DEFLATE */
+    char zraw[16384];       /* compressed input */
+    size_t zpos, zlen;
+    int xgzip, xterm;       /* XFEATURE COMPRESS GZIP [TERMINATOR] */
+} Client;
+
+static int cl_write_raw(Client *c, const char *p, size_t n) {
+    while (n > 0) {
+        int w = c->ssl ? SSL_write(c->ssl, p, (int)n) : (int)send(c->fd, p, n, MSG_NOSIGNAL);
+        if (w <= 0) return -1;
+        p += w; n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int cl_write(Client *c, const char *p, size_t n) {
+    if (!c->zout) return cl_write_raw(c, p, n);
+    char out[16384];
+    c->zout->next_in = (Bytef*)p; c->zout->avail_in = (uInt)n;
+    do {
+        c->zout->next_out = (Bytef*)out; c->zout->avail_out = sizeof(out);
+        deflate(c->zout, Z_SYNC_FLUSH);
+        if (cl_write_raw(c, out, sizeof(out) - c->zout->avail_out) < 0) return -1;
+    } while (c->zout->avail_out == 0);
+    return 0;
+}
+
+/* output compression starts once the 206 reply itself went out */
+static void cl_zstart(Client *c) {
+    c->zout = calloc(1, sizeof(z_stream));
+    if (!c->zout || deflateInit2(c->zout, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) { perror("deflateInit2"); exit(1); }
+}
+
+static int cl_read_raw(Client *c, char *p, size_t n) {
+    return c->ssl ? SSL_read(c->ssl, p, (int)n) : (int)recv(c->fd, p, n, 0);
+}
+
+static int cl_read(Client *c, char *p, size_t n) {
+    if (!c->zin) return cl_read_raw(c, p, n);
+    for (;;) {
+        if (c->zpos == c->zlen) {
+            int r = cl_read_raw(c, c->zraw, sizeof(c->zraw));
+            if (r <= 0) return r;
+            c->zpos = 0; c->zlen = (size_t)r;
+        }
+        c->zin->next_in = (Bytef*)c->zraw + c->zpos; c->zin->avail_in = (uInt)(c->zlen - c->zpos);
+        c->zin->next_out = (Bytef*)p; c->zin->avail_out = (uInt)n;
+        int rc = inflate(c->zin, Z_SYNC_FLUSH);
+        c->zpos = c->zlen - c->zin->avail_in;
+        if (rc != Z_OK && rc != Z_BUF_ERROR) return -1;
+        if (c->zin->avail_out < n) return (int)(n - c->zin->avail_out);
+    }
+}
+
+static void *sender_main(void *arg) {
+    Client *c = (Client*)arg;
+    for (;;) {
+        pthread_mutex_lock(&c->m);
+        while (!c->head && !c->closing) pthread_cond_wait(&c->cv, &c->m);
+        Reply *r = c->head;
+        if (!r) { pthread_mutex_unlock(&c->m); return NULL; }
+        c->head = r->next;
+        if (!c->head) c->tail = NULL;
+        pthread_mutex_unlock(&c->m);
+        long long d = r->due - now_us();
+        if (d > 0) { struct timespec ts = { d / 1000000, (d % 1000000) * 1000 }; nanosleep(&ts, NULL); }
+        int ok = cl_write(c, r->b.p, r->b.len) == 0;
+        if (r->zstart) cl_zstart(c);
+        free(r->b.p); free(r);
+        if (!ok) return NULL;
+    }
+}
+
+static void send_reply_z(Client *c, Buf *b, long long recv_us, int zstart) {
+    if (g_rtt_us <= 0) { cl_write(c, b->p, b->len); b->len = 0; if (zstart) cl_zstart(c); return; }
+    Reply *r = malloc(sizeof(*r));
+    if (!r) { perror("malloc"); exit(1); }
+    r->next = NULL; r->due = recv_us + g_rtt_us; r->zstart = zstart; r->b = *b;
+    memset(b, 0, sizeof(*b));
+    pthread_mutex_lock(&c->m);
+    if (c->tail) c->tail->next = r; else c->head = r;
+    c->tail = r;
+    pthread_cond_signal(&c->cv);
+    pthread_mutex_unlock(&c->m);
+}
+
+static void send_reply(Client *c, Buf *b, long long recv_us) { send_reply_z(c, b, recv_us, 0); }
+
+/* next CRLF/LF terminated line, NUL-terminated in place; NULL on EOF */
+static char *cl_getline(Client *c) {
+    for (;;) {
+        char *nl = memchr(c->rbuf + c->rpos, '\n', c->rlen - c->rpos);
+        if (nl) {
+            char *line = c->rbuf + c->rpos;
+            c->rpos = (size_t)(nl - c->rbuf) + 1;
+            if (nl > line && nl[-1] == '\r') nl--;
+            *nl = '\0';
+            return line;
+        }
+        if (c->rpos > 0) {
+            memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+            c->rlen -= c->rpos; c->rpos = 0;
+        }
+        if (c->rlen == sizeof(c->rbuf)) return NULL; /* overlong command */
+        size_t room = sizeof(c->rbuf) - c->rlen;
+        int r = cl_read(c, c->rbuf + c->rlen, room);
+        if (r <= 0) return NULL;
+        c->rlen += (size_t)r;
+    }
+}
+
+/* parse "a-b", "a-" or "a" against the selected group's 1..count */
+static void parse_range(const char *s, int count, int *lo, int *hi) {
+    char *end;
+    long a = strtol(s, &end, 10), b = a;
+    if (*end == '-') b = end[1] ? strtol(end + 1, NULL, 10) : count;
+    *lo = a < 1 ? 1 : (int)a;
+    *hi = b > count ? count : (int)b;
+}
+
+/* "bench g:n ...": the groups article n of g is in */
+static void make_xref(const Group *g, int n, char *out, size_t cap) {
+    int l = snprintf(out, cap, "bench");
+    for (int k = 0; k < g_ngroups && l > 0 && (size_t)l < cap; ++k) {
+        const Group *o = &g_groups[k];
+        if (o == g || (g_crosspost > 0 && n % g_crosspost == 0 && n <= o->count))
+            l += snprintf(out + l, cap - (size_t)l, " %s:%d", o->name, n);
+    }
+}
+
+static void put_overview(Buf *b, const Group *g, int lo, int hi) {
+    char tmp[1024], xref[512];
+    for (int n = lo; n <= hi; ++n) {
+        Article a; make_article(g->name, n, &a);
+        if (g_holes && n % 97 == 0) continue;
+        if (g_holes && n % 89 == 0) a.date[0] = '\0';
+        make_xref(g, n, xref, sizeof(xref));
+        int l = snprintf(tmp, sizeof(tmp), "%d\t%s\t%s\t%s\t%s\t%s\t%d\t%d\tXref: %s\r\n",
+                         n, a.subject, a.from, a.date, a.msgid, a.refs, a.bytes, a.lines, xref);
+        buf_put(b, tmp, (size_t)l < sizeof(tmp) ? (size_t)l : sizeof(tmp) - 1);
+    }
+}
+
+/* deflate src into a new buffer (zlib format, or raw with window_bits -15) */
+static Buf zpack(const Buf *src, int window_bits) {
+    Buf z = {0};
+    z_stream s;
+    memset(&s, 0, sizeof(s));
+    if (deflateInit2(&s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) { perror("deflateInit2"); exit(1); }
+    z.cap = deflateBound(&s, src->len) + 1;
+    z.p = malloc(z.cap);
+    if (!z.p) { perror("malloc"); exit(1); }
+    s.next_in = (Bytef*)src->p; s.avail_in = (uInt)src->len;
+    s.next_out = (Bytef*)z.p; s.avail_out = (uInt)z.cap;
+    deflate(&s, Z_FINISH);
+    z.len = z.cap - s.avail_out;
+    deflateEnd(&s);
+    return z;
+}
+
+/* XZVER body: yEnc lines of 128 encoded bytes, dot-stuffed */
+static void put_yenc(Buf *b, const Buf *data) {
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "=ybegin line=128 size=%zu name=xzver", data->len); buf_line(b, tmp);
+    size_t i = 0;
+    while (i < data->len) {
+        size_t o = 0;
+        while (i < data->len && o < 128) {
+            unsigned char ch = (unsigned char)(data->p[i++] + 42);
+            if (ch == 0 || ch == '\n' || ch == '\r' || ch == '=') { tmp[o++] = '='; ch = (unsigned char)(ch + 64); }
+            tmp[o++] = (char)ch;
+        }
+        if (tmp[0] == '.') buf_put(b, ".", 1);
+        buf_put(b, tmp, o);
+        buf_put(b, "\r\n", 2);
+    }
+    snprintf(tmp, sizeof(tmp), "=yend size=%zu", data->len); buf_line(b, tmp);
+}
+
+static void handle(Client *c) {
+    Buf out = {0};
+    char tmp[1024];
+    const Group *cur = NULL;
+    int ncmds = 0;
+    buf_line(&out, "200 nntp2sql-mockd ready");
+    send_reply(c, &out, now_us() - g_rtt_us);
+    for (;;) {
+        char *line = cl_getline(c);
+        if (!line) break;
+        long long t = now_us();
+        char *save = NULL;
+        char *cmd = strtok_r(line, " ", &save), *a1 = strtok_r(NULL, " ", &save), *a2 = strtok_r(NULL, " ", &save);
+        if (!cmd) continue;
+        if (g_drop_after > 0 && ++ncmds >= g_drop_after) break;
+        if (strcasecmp(cmd, "QUIT") == 0) {
+            buf_line(&out, "205 bye");
+            send_reply(c, &out, t);
+            break;
+        } else if (strcasecmp(cmd, "CAPABILITIES") == 0) {
+            buf_line(&out, "101 capability list follows");
+            buf_line(&out, "VERSION 2"); buf_line(&out, "READER"); buf_line(&out, "OVER"); buf_line(&out, "HDR"); buf_line(&out, "LIST ACTIVE");
+            if (!c->zin) buf_line(&out, "COMPRESS DEFLATE");
+            buf_line(&out, "XFEATURE-COMPRESS GZIP TERMINATOR"); buf_line(&out, "XZVER");
+            buf_line(&out, ".");
+        } else if (strcasecmp(cmd, "COMPRESS") == 0) {
+            if (c->zin || !a1 || strcasecmp(a1, "DEFLATE") != 0) { buf_line(&out, "502 compression not available"); send_reply(c, &out, t); continue; }
+            c->zin = calloc(1, sizeof(z_stream));
+            if (!c->zin || inflateInit2(c->zin, -15) != Z_OK) { perror("inflateInit2"); exit(1); }
+            /* anything after the command line is already compressed */
+            c->zlen = c->rlen - c->rpos; c->zpos = 0;
+            memcpy(c->zraw, c->rbuf + c->rpos, c->zlen);
+            c->rpos = c->rlen = 0;
+            buf_line(&out, "206 compression active");
+            send_reply_z(c, &out, t, 1);
+            continue;
+        } else if (strcasecmp(cmd, "XFEATURE") == 0) {
+            char *a3 = strtok_r(NULL, " ", &save);
+            if (a1 && a2 && strcasecmp(a1, "COMPRESS") == 0 && strcasecmp(a2, "GZIP") == 0) {
+                c->xgzip = 1; c->xterm = a3 && strcasecmp(a3, "TERMINATOR") == 0;
+                buf_line(&out, "290 feature enabled");
+            } else buf_line(&out, "500 unknown feature");
+        } else if (strcasecmp(cmd, "MODE") == 0) {
+            buf_line(&out, "200 reader");
+        } else if (strcasecmp(cmd, "AUTHINFO") == 0) {
+            buf_line(&out, a1 && strcasecmp(a1, "USER") == 0 ? "381 password required" : "281 ok");
+        } else if (strcasecmp(cmd, "GROUP") == 0) {
+            cur = NULL;
+            for (int k = 0; a1 && k < g_ngroups; ++k) if (strcmp(g_groups[k].name, a1) == 0) cur = &g_groups[k];
+            if (!cur) buf_line(&out, "411 no such group");
+            else { snprintf(tmp, sizeof(tmp), "211 %d 1 %d %s", cur->count, cur->count, cur->name); buf_line(&out, tmp); }
+        } else if (strcasecmp(cmd, "LIST") == 0) {
+            const char *pat = a1 && strcasecmp(a1, "ACTIVE") == 0 && a2 ? a2 : "*";
+            buf_line(&out, "215 list follows");
+            for (int k = 0; k < g_ngroups; ++k) {
+                if (fnmatch(pat, g_groups[k].name, 0) != 0) continue;
+                snprintf(tmp, sizeof(tmp), "%.127s %d 1 y", g_groups[k].name, g_groups[k].count);
+                buf_line(&out, tmp);
+            }
+            buf_line(&out, ".");
+        } else if (strcasecmp(cmd, "XOVER") == 0 || strcasecmp(cmd, "OVER") == 0 || strcasecmp(cmd, "XZVER") == 0) {
+            if (!cur) buf_line(&out, "412 no group selected");
+            else if (!a1) buf_line(&out, "420 no article selected");
+            else {
+                int lo, hi;
+                parse_range(a1, cur->count, &lo, &hi);
+                if (strcasecmp(cmd, "XZVER") == 0) {
+                    Buf body = {0};
+                    put_overview(&body, cur, lo, hi);
+                    Buf z = zpack(&body, -15);
+                    buf_line(&out, "224 compressed overview follows");
+                    put_yenc(&out, &z);
+                    buf_line(&out, ".");
+                    free(body.p); free(z.p);
+                } else if (c->xgzip) {
+                    Buf body = {0};
+                    put_overview(&body, cur, lo, hi);
+                    buf_line(&body, ".");
+                    Buf z = zpack(&body, 15);
+                    buf_line(&out, "224 overview follows [COMPRESS=GZIP]");
+                    buf_put(&out, z.p, z.len);
+                    if (c->xterm) buf_line(&out, ".");
+                    free(body.p); free(z.p);
+                } else {
+                    buf_line(&out, "224 overview follows");
+                    put_overview(&out, cur, lo, hi);
+                    buf_line(&out, ".");
+                }
+            }
+        } else if (strcasecmp(cmd, "HDR") == 0 || strcasecmp(cmd, "XHDR") == 0) {
+            if (!cur) buf_line(&out, "412 no group selected");
+            else if (!a1 || !a2) buf_line(&out, "501 syntax: HDR field range");
+            else {
+                int lo, hi;
+                parse_range(a2, cur->count, &lo, &hi);
+                buf_line(&out, "225 headers follow");
+                for (int n = lo; n <= hi; ++n) {
+                    Article a; make_article(cur->name, n, &a);
+                    const char *v = strcasecmp(a1, "Subject") == 0 ? a.subject : strcasecmp(a1, "From") == 0 ? a.from :
+                                    strcasecmp(a1, "Date") == 0 ? a.date : strcasecmp(a1, "Message-ID") == 0 ? a.msgid :
+                                    strcasecmp(a1, "References") == 0 ? a.refs : "";
+                    snprintf(tmp, sizeof(tmp), "%d %s", n, v); buf_line(&out, tmp);
+                }
+                buf_line(&out, ".");
+            }
+        } else if (strcasecmp(cmd, "HEAD") == 0) {
+            int n = a1 ? atoi(a1) : 0;
+            if (!cur) buf_line(&out, "412 no group selected");
+            else if (n < 1 || n > cur->count) buf_line(&out, "423 no such article");
+            else {
+                Article a; make_article(cur->name, n, &a);
+                snprintf(tmp, sizeof(tmp), "221 %d %s", n, a.msgid); buf_line(&out, tmp);
+                snprintf(tmp, sizeof(tmp), "Path: bench!not-for-mail"); buf_line(&out, tmp);
+                snprintf(tmp, sizeof(tmp), "From: %s", a.from); buf_line(&out, tmp);
+                snprintf(tmp, sizeof(tmp), "Newsgroups: %s", cur->name); buf_line(&out, tmp);
+                snprintf(tmp, sizeof(tmp), "Subject: %s", a.subject); buf_line(&out, tmp);
+                snprintf(tmp, sizeof(tmp), "Date: %s", a.date); buf_line(&out, tmp);
+                snprintf(tmp, sizeof(tmp), "Message-ID: %s", a.msgid); buf_line(&out, tmp);
+                if (a.refs[0]) { snprintf(tmp, sizeof(tmp), "References: %s", a.refs); buf_line(&out, tmp); }
+                snprintf(tmp, sizeof(tmp), "Lines: %d", a.lines); buf_line(&out, tmp);
+                snprintf(tmp, sizeof(tmp), "Bytes: %d", a.bytes); buf_line(&out, tmp);
+                char xref[512]; make_xref(cur, n, xref, sizeof(xref));
+                snprintf(tmp, sizeof(tmp), "Xref: %s", xref); buf_line(&out, tmp);
+                buf_line(&out, "X-Bench-Note: ..dot-stuffed continuation follows");
+                buf_line(&out, "..");
+                buf_line(&out, ".");
+            }
+        } else {
+            buf_line(&out, "500 unknown command");
+        }
+        send_reply(c, &out, t);
+    }
+    free(out.p);
+}
+
+static void *client_main(void *arg) {
+    Client *c = (Client*)arg;
+    pthread_t sender;
+    int have_sender = 0;
+    if (g_tls) {
+        c->ssl = SSL_new(g_tls);
+        SSL_set_fd(c->ssl, c->fd);
+        if (SSL_accept(c->ssl) != 1) { ERR_print_errors_fp(stderr); goto done; }
+    }
+    if (g_rtt_us > 0) have_sender = pthread_create(&sender, NULL, sender_main, c) == 0;
+    handle(c);
+    if (have_sender) {
+        pthread_mutex_lock(&c->m);
+        c->closing = 1;
+        pthread_cond_signal(&c->cv);
+        pthread_mutex_unlock(&c->m);
+        pthread_join(sender, NULL);
+    }
+done:
+    if (c->ssl) { SSL_shutdown(c->ssl); SSL_free(c->ssl); }
+    close(c->fd);
+    if (c->zin) { inflateEnd(c->zin); free(c->zin); }
+    if (c->zout) { deflateEnd(c->zout); free(c->zout); }
+    while (c->head) { Reply *r = c->head; c->head = r->next; free(r->b.p); free(r); }
+    pthread_mutex_destroy(&c->m);
+    pthread_cond_destroy(&c->cv);
+    free(c);
+    return NULL;
+}
+
+static void parse_groups(const char *spec) {
+    char *dup = strdup(spec), *save = NULL;
+    for (char *tok = strtok_r(dup, ",", &save); tok && g_ngroups < MAX_GROUPS; tok = strtok_r(NULL, ",", &save)) {
+        char *colon = strrchr(tok, ':');
+        Group *g = &g_groups[g_ngroups++];
+        snprintf(g->name, sizeof(g->name), "%.*s", colon ? (int)(colon - tok) : (int)strlen(tok), tok);
+        g->count = colon ? atoi(colon + 1) : 100000;
+    }
+    free(dup);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--port N] [--groups NAME:COUNT[,...]] [--rtt-ms MS] [--tls --cert FILE --key FILE] [--overview-holes] [--crosspost N] [--drop-after N]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int port = 11119, tls = 0;
+    const char *groups = "bench.test:100000", *cert = NULL, *key = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--groups") == 0 && i + 1 < argc) groups = argv[++i];
+        else if (strcmp(argv[i], "--rtt-ms") == 0 && i + 1 < argc) g_rtt_us = atol(argv[++i]) * 1000;
+        else if (strcmp(argv[i], "--tls") == 0) tls = 1;
+        else if (strcmp(argv[i], "--overview-holes") == 0) g_holes = 1;
+        else if (strcmp(argv[i], "--crosspost") == 0 && i + 1 < argc) g_crosspost = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--drop-after") == 0 && i + 1 < argc) g_drop_after = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cert") == 0 && i + 1 < argc) cert = argv[++i];
+        else if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) key = argv[++i];
+        else usage(argv[0]);
+    }
+    parse_groups(groups);
+    signal(SIGPIPE, SIG_IGN);
+    if (tls) {
+        if (!cert || !key) usage(argv[0]);
+        g_tls = SSL_CTX_new(TLS_server_method());
+        if (!g_tls || SSL_CTX_use_certificate_chain_file(g_tls, cert) != 1 ||
+            SSL_CTX_use_PrivateKey_file(g_tls, key, SSL_FILETYPE_PEM) != 1) {
+            ERR_print_errors_fp(stderr);
+            return 1;
+        }
+    }
+
+    int lfd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+    struct sockaddr_in sa;
+    socklen_t sl = sizeof(sa);
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET; sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK); sa.sin_port = htons((unsigned short)port);
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(lfd, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(lfd, 256) < 0) { perror("bind/listen"); return 1; }
+    getsockname(lfd, (struct sockaddr*)&sa, &sl);
+    printf("listening on %d\n", ntohs(sa.sin_port));
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) { if (errno == EINTR) continue; perror("accept"); return 1; }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Client *c = calloc(1, sizeof(*c));
+        if (!c) { close(fd); continue; }
+        c->fd = fd;
+        pthread_mutex_init(&c->m, NULL);
+        pthread_cond_init(&c->cv, NULL);
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, client_main, c) != 0) { close(fd); free(c); continue; }
+        pthread_detach(tid);
+    }
+}
@@ -0,0 +1,109 @@
+#!/bin/sh
+# Benchmark driver: runs nntp2sql against the loopback mock server for each
+# backend and scenario and prints rows/s and MB/s per run.
+#
+#   bench/run_bench.sh [NNTP2SQL] [MOCKD]      (or: make bench)
+#
+# Environment:
+#   ARTICLES     articles per scenario (default 100000)
+#   RTT_MS       simulated round-trip times to try (default "0 20")
+#   TLS          "0", "1" or "0 1" (default 0); TLS uses a throwaway self-signed cert
+#   BACKENDS     any of "sqlite mysql postgres" (default sqlite)
+#   BENCH_FLAGS  extra nntp2sql flags (default "--upsert --batch-size 5000")
+#   BENCH_DB_NAME, BENCH_DB_HOST, BENCH_DB_PORT, BENCH_DB_USER, BENCH_DB_PASS
+#                connection for mysql/postgres (database nntp2sql_bench by default)
+#
+# Every scenario reads its own group, so runs against a persistent server
+# database insert fresh rows instead of updating the previous run's.
+
+NNTP2SQL=${1:-./nntp2sql}
+MOCKD=${2:-./nntp2sql-mockd}
+ARTICLES=${ARTICLES:-100000}
+RTT_MS=${RTT_MS:-"0 20"}
+TLS=${TLS:-0}
+BACKENDS=${BACKENDS:-sqlite}
+BENCH_FLAGS=${BENCH_FLAGS:-"--upsert --batch-size 5000"}
+BENCH_DB_NAME=${BENCH_DB_NAME:-nntp2sql_bench}
+
+# name|flags
+SCENARIOS="xover-t1|--headers-only --threads 1
+xover-t4|--headers-only --threads 4 --xover-chunk 5000
+head-t4-d1|--threads 4 --pipeline-depth 1 --no-overview
+head-t4-d16|--threads 4 --pipeline-depth 16 --no-overview
+over-t4|--threads 4 --pipeline-depth 16
+head-ev-c64|--threads 64 --event-loop 2 --pipeline-depth 16 --no-overview"
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/nntp2sql-bench.XXXXXX") || exit 1
+MOCK_PID=
+cleanup() {
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+case " $TLS " in *" 1 "*)
+    openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=localhost \
+        -keyout "$WORK/key.pem" -out "$WORK/cert.pem" >/dev/null 2>&1 || { echo "openssl req failed" >&2; exit 1; }
+esac
+
+# groups bench.s1 .. bench.sN, one per run
+NRUNS=0
+for b in $BACKENDS; do for r in $RTT_MS; do for t in $TLS; do
+    NRUNS=$((NRUNS + $(printf '%s\n' "$SCENARIOS" | wc -l)))
+done; done; done
+BENCH_GROUPS=$(awk -v n="$NRUNS" -v c="$ARTICLES" 'BEGIN { for (i = 1; i <= n; i++) printf "%sbench.s%d:%d", (i > 1 ? "," : ""), i, c }')
+
+start_mock() { # rtt tls
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null && wait "$MOCK_PID" 2>/dev/null
+    set -- --port 0 --groups "$BENCH_GROUPS" --rtt-ms "$1" $([ "$2" = 1 ] && echo "--tls --cert $WORK/cert.pem --key $WORK/key.pem")
+    "$MOCKD" "$@" >"$WORK/mock.out" 2>"$WORK/mock.err" &
+    MOCK_PID=$!
+    for _ in 1 2 3 4 5 6 7 8 9 10; do
+        PORT=$(sed -n 's/^listening on //p' "$WORK/mock.out")
+        [ -n "$PORT" ] && return 0
+        sleep 0.2
+    done
+    echo "mock server did not start:" >&2; cat "$WORK/mock.err" >&2; exit 1
+}
+
+db_args() { # backend
+    case "$1" in
+        sqlite) rm -f "$WORK/bench.db"; echo "--db-type sqlite --db-name $WORK/bench.db" ;;
+        mysql|postgres)
+            echo "--db-type $1 --db-name $BENCH_DB_NAME" \
+                 ${BENCH_DB_HOST:+--db-host $BENCH_DB_HOST} ${BENCH_DB_PORT:+--db-port $BENCH_DB_PORT} \
+                 ${BENCH_DB_USER:+--db-user $BENCH_DB_USER} ${BENCH_DB_PASS:+--db-pass $BENCH_DB_PASS} ;;
+        *) echo "unknown backend $1" >&2; exit 1 ;;
+    esac
+}
+
+printf '%-9s %-12s %4s %4s %10s %10s %9s %8s\n' backend scenario rtt tls rows rows/s MB/s secs
+for backend in $BACKENDS; do
+    for rtt in $RTT_MS; do
+        for tls in $TLS; do
+            start_mock "$rtt" "$tls"
+            printf '%s\n' "$SCENARIOS" | while IFS='|' read -r name flags; do
+                # runs are numbered in the same order the groups were generated
+                idx=$(cat "$WORK/run" 2>/dev/null || echo 0); idx=$((idx + 1)); echo "$idx" >"$WORK/run"
+                # shellcheck disable=SC2046,SC2086
+                "$NNTP2SQL" --host 127.0.0.1 --port "$PORT" $([ "$tls" = 1 ] && echo --ssl) \
+                    $(db_args "$backend") --init-db --group "bench.s$idx" $flags $BENCH_FLAGS \
+                    --stats-interval 86400 --log "$WORK/run.log" >/dev/null 2>"$WORK/run.err"
+                rc=$?
+                stats=$(grep '^{"uptime_ms"' "$WORK/run.log" | tail -n 1)
+                rm -f "$WORK/run.log"
+                if [ $rc -ne 0 ] || [ -z "$stats" ]; then
+                    printf '%-9s %-12s %4s %4s  failed (exit %d): %s\n' "$backend" "$name" "$rtt" "$tls" $rc "$(tail -n 1 "$WORK/run.err")"
+                    continue
+                fi
+                printf '%s\n' "$stats" | awk -v b="$backend" -v n="$name" -v r="$rtt" -v t="$tls" '{
+                    ms = $0; sub(/.*"uptime_ms":/, "", ms); sub(/,.*/, "", ms)
+                    by = $0; sub(/.*"bytes_rx":/, "", by); sub(/,.*/, "", by)
+                    rw = $0; sub(/.*"rows":/, "", rw); sub(/,.*/, "", rw)
+                    s = ms / 1000.0; if (s <= 0) s = 0.001
+                    printf "%-9s %-12s %4s %4s %10d %10.0f %9.2f %8.2f\n", b, n, r, t, rw, rw / s, by / s / 1e6, s
+                }'
+            done
+        done
+    done
+done
@@ -1,4 +1,5 @@
 #include <gtk/gtk.h>
+#include <ctype.h>
 #include <sqlite3.h>
 #include <mysql/mysql.h>
 #ifdef HAVE_PQ
@@ -6,120 +7,441 @@
 #endif
 
 static GtkWidget *entry;
-static GListStore *store;
 typedef enum { V_SQLITE, V_MYSQL, V_PG } VDbType;
 static VDbType vtype;
-static sqlite3 *sdb;
+static sqlite3 *sdb;             /* the shard being read */
+static sqlite3 **shard_db = &sdb;
+static int nshards = 1;
 static MYSQL *mydb;
 #ifdef HAVE_PQ
 static PGconn *pgdb;
 #endif
 
-typedef struct {
+/* Rows are fetched a page at a time on a worker thread as the list view
+   asks for items near the end of what is loaded. Browsing and LIKE
+   searches page by key, (group_name, artnum) over the unique index, so
+   every page costs the same however far down the user has scrolled;
+   ranked full-text results have no key and page by OFFSET. A SQLite
+   database split by nntp2sql --shards is read one shard file after the
+   other: each page carries the shard it starts in, so groups come shard
+   by shard and ranked results are ranked within their shard. */
+#define PAGE_ROWS 200
+#define SEARCH_DELAY_MS 200
+
+/* The select list, FROM clause and author column for the database's
+   articles layout (see layout_detect()). v2 joins groups, and authors
+   when they are interned; its pages still carry the group name as key
+   but scan (group_id, artnum), so groups come in the order they were
+   first stored rather than by name. */
+static char row_cols[320], from_sql[160];
+static const char *acol = "a.author";
+static int v2, v2_intern;
+
+/* the group half of a keyset condition: op is =, > or >= (first page,
+   with "") against the group name parameter */
+static void group_cond(char *out, size_t n, const char *op){
+    const char *groups = vtype == V_MYSQL ? "`groups`" : "groups";
+    if (!v2) snprintf(out, n, "a.group_name %s ?", op);
+    else if (strcmp(op, ">=") == 0) snprintf(out, n, "a.group_id >= (SELECT MIN(id) FROM %s WHERE name >= ?)", groups);
+    else snprintf(out, n, "a.group_id %s (SELECT id FROM %s WHERE name = ?)", op, groups);
+}
+
+#define V_TYPE_ROW (v_row_get_type())
+G_DECLARE_FINAL_TYPE(VRow, v_row, V, ROW, GObject)
+
+struct _VRow {
+    GObject parent;
     int artnum;
+    int shard;
+    char *group;
     char *subject;
     char *author;
     char *date;
-} Row;
+};
 
-static void row_free(Row *r){
-    if (!r) return;
+G_DEFINE_TYPE(VRow, v_row, G_TYPE_OBJECT)
+
+static void v_row_finalize(GObject *o){
+    VRow *r = V_ROW(o);
+    g_free(r->group);
     g_free(r->subject);
     g_free(r->author);
     g_free(r->date);
-    g_free(r);
+    G_OBJECT_CLASS(v_row_parent_class)->finalize(o);
+}
+
+static void v_row_class_init(VRowClass *c){ G_OBJECT_CLASS(c)->finalize = v_row_finalize; }
+static void v_row_init(VRow *r){ (void)r; }
+
+typedef enum { Q_ALL, Q_FTS, Q_LIKE } QMode;
+
+/* One page request, filled in by the worker and handed back to the main
+   loop. gen tags the search it belongs to; pages of an older search are
+   dropped. */
+typedef struct {
+    guint gen;
+    GCancellable *cancel;
+    char *filter;
+    QMode mode;
+    char *after_group;          /* NULL on the first page */
+    char after_artnum[24];
+    int shard;                  /* where the page starts; the worker moves on */
+    guint offset;               /* rows already loaded from that shard */
+    GPtrArray *rows;
+} Page;
+
+#define V_TYPE_MODEL (v_model_get_type())
+G_DECLARE_FINAL_TYPE(VModel, v_model, V, MODEL, GObject)
+
+struct _VModel {
+    GObject parent;
+    GPtrArray *rows;
+    guint gen;
+    GCancellable *cancel;
+    char *filter;
+    QMode mode;
+    gboolean pending;
+    gboolean exhausted;
+    guint tail_rows;            /* loaded rows from the last row's shard */
+};
+
+static GThreadPool *pool;       /* one thread: the DB handle is never shared */
+
+static void request_page(VModel *m){
+    if (m->pending || m->exhausted) return;
+    Page *p = g_new0(Page, 1);
+    p->gen = m->gen;
+    p->cancel = g_object_ref(m->cancel);
+    p->filter = g_strdup(m->filter);
+    p->mode = m->mode;
+    p->offset = m->tail_rows;
+    if (m->rows->len){
+        VRow *last = g_ptr_array_index(m->rows, m->rows->len - 1);
+        p->shard = last->shard;
+        p->after_group = g_strdup(last->group);
+        snprintf(p->after_artnum, sizeof(p->after_artnum), "%d", last->artnum);
+    }
+    p->rows = g_ptr_array_new_with_free_func(g_object_unref);
+    m->pending = TRUE;
+    g_thread_pool_push(pool, p, NULL);
+}
+
+static GType v_model_get_item_type(GListModel *l){ (void)l; return V_TYPE_ROW; }
+static guint v_model_get_n_items(GListModel *l){ return V_MODEL(l)->rows->len; }
+
+static gpointer v_model_get_item(GListModel *l, guint pos){
+    VModel *m = V_MODEL(l);
+    if (pos + PAGE_ROWS / 2 >= m->rows->len) request_page(m);
+    if (pos >= m->rows->len) return NULL;
+    return g_object_ref(g_ptr_array_index(m->rows, pos));
+}
+
+static void v_model_iface_init(GListModelInterface *i){
+    i->get_item_type = v_model_get_item_type;
+    i->get_n_items = v_model_get_n_items;
+    i->get_item = v_model_get_item;
+}
+
+G_DEFINE_TYPE_WITH_CODE(VModel, v_model, G_TYPE_OBJECT, G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, v_model_iface_init))
+
+static void v_model_finalize(GObject *o){
+    VModel *m = V_MODEL(o);
+    g_ptr_array_unref(m->rows);
+    g_object_unref(m->cancel);
+    g_free(m->filter);
+    G_OBJECT_CLASS(v_model_parent_class)->finalize(o);
+}
+
+static void v_model_class_init(VModelClass *c){ G_OBJECT_CLASS(c)->finalize = v_model_finalize; }
+
+static void v_model_init(VModel *m){
+    m->rows = g_ptr_array_new_with_free_func(g_object_unref);
+    m->cancel = g_cancellable_new();
+    m->filter = g_strdup("");
+}
+
+static VModel *model;
+
+#ifdef HAVE_PQ
+static GMutex pg_cancel_lock;
+static PGcancel *pg_cancel;     /* set while the worker waits on the server */
+#endif
+
+/* Abandon whatever the worker is doing for the current search. */
+static void v_model_stop(VModel *m){
+    g_cancellable_cancel(m->cancel);
+#ifdef HAVE_PQ
+    g_mutex_lock(&pg_cancel_lock);
+    if (pg_cancel){ char err[256]; PQcancel(pg_cancel, err, sizeof(err)); }
+    g_mutex_unlock(&pg_cancel_lock);
+#endif
+}
+
+static void v_model_set_filter(VModel *m, const char *filter){
+    v_model_stop(m);
+    g_object_unref(m->cancel);
+    m->cancel = g_cancellable_new();
+    m->gen++;
+    m->pending = m->exhausted = FALSE;
+    m->tail_rows = 0;
+    g_free(m->filter);
+    m->filter = g_strdup(filter ? filter : "");
+    m->mode = *m->filter ? Q_FTS : Q_ALL;
+    guint n = m->rows->len;
+    g_ptr_array_set_size(m->rows, 0);
+    if (n) g_list_model_items_changed(G_LIST_MODEL(m), 0, n, 0);
+    request_page(m);
+}
+
+static gboolean page_done(gpointer data){
+    Page *p = data;
+    if (p->gen == model->gen){
+        guint pos = model->rows->len, n = p->rows->len;
+        for (guint i = 0; i < n; i++){
+            VRow *r = g_ptr_array_index(p->rows, i);
+            VRow *last = model->rows->len ? g_ptr_array_index(model->rows, model->rows->len - 1) : NULL;
+            model->tail_rows = last && last->shard == r->shard ? model->tail_rows + 1 : 1;
+            g_ptr_array_add(model->rows, g_object_ref(r));
+        }
+        model->mode = p->mode;
+        model->pending = FALSE;
+        model->exhausted = n < PAGE_ROWS;
+        if (n) g_list_model_items_changed(G_LIST_MODEL(model), pos, 0, n);
+    }
+    g_object_unref(p->cancel);
+    g_free(p->filter);
+    g_free(p->after_group);
+    g_ptr_array_unref(p->rows);
+    g_free(p);
+    return G_SOURCE_REMOVE;
+}
+
+static void page_add(Page *p, const char *group, const char *artnum, const char *subject, const char *author, const char *date){
+    VRow *r = g_object_new(V_TYPE_ROW, NULL);
+    r->group = g_strdup(group ? group : "");
+    r->artnum = artnum ? atoi(artnum) : 0;
+    r->shard = p->shard;
+    r->subject = g_strdup(subject ? subject : "");
+    r->author = g_strdup(author ? author : "");
+    r->date = g_strdup(date ? date : "");
+    g_ptr_array_add(p->rows, r);
 }
 
-static void store_clear(){
-    guint n = g_list_model_get_n_items(G_LIST_MODEL(store));
-    for (guint i = 0; i < n; i++){
-        Row *r = g_list_model_get_item(G_LIST_MODEL(store), 0);
-        row_free(r);
-        g_list_store_remove(store, 0);
+/* Search goes through the full-text index db_init_schema() creates
+   (SQLite FTS5, MySQL FULLTEXT, Postgres GIN on a tsvector), best match
+   first. Every word of the filter must match as a prefix; punctuation
+   separates words, so the query syntax of each engine never reaches it.
+   Without an index (older databases, FTS5 not compiled in) the search
+   falls back to LIKE. Returns 0 when the filter has no words. */
+static int fts_terms(const char *in, char *out, size_t n, const char *pre, const char *post, const char *sep){
+    size_t len = 0;
+    int words = 0;
+    out[0] = '\0';
+    while (*in){
+        while (*in && !(isalnum((unsigned char)*in) || (unsigned char)*in >= 0x80)) in++;
+        const char *w = in;
+        while (*in && (isalnum((unsigned char)*in) || (unsigned char)*in >= 0x80)) in++;
+        if (in == w) break;
+        int k = snprintf(out + len, n - len, "%s%s%.*s%s", words ? sep : "", pre, (int)(in - w), w, post);
+        if (k < 0 || (size_t)k >= n - len){ out[len] = '\0'; break; }
+        len += (size_t)k;
+        words++;
     }
+    return len > 0;
 }
 
-static void load_rows_sqlite(sqlite3 *db, const char *filter){
-    store_clear();
-    const char *sql = filter && *filter ?
-        "SELECT artnum, subject, author, date FROM articles WHERE subject LIKE ? OR author LIKE ? ORDER BY artnum LIMIT 1000" :
-        "SELECT artnum, subject, author, date FROM articles ORDER BY artnum LIMIT 1000";
+/* Each runner takes SQL with ? placeholders and string parameters and
+   appends the rows (row_cols) to the page. Returns the row count, or -1
+   when the statement fails. */
+static int sqlite_progress(void *cancel){ return g_cancellable_is_cancelled(cancel); }
+
+static int run_sqlite(const char *sql, const char **pv, int n, Page *p){
     sqlite3_stmt *st = NULL;
-    if (sqlite3_prepare_v2(db, sql, -1, &st, NULL) != SQLITE_OK) return;
-    if (filter && *filter){
-        char like[256]; snprintf(like, sizeof(like), "%%%s%%", filter);
-        sqlite3_bind_text(st, 1, like, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(st, 2, like, -1, SQLITE_TRANSIENT);
-    }
-    while (sqlite3_step(st) == SQLITE_ROW){
-        Row *r = g_new0(Row, 1);
-        r->artnum = sqlite3_column_int(st, 0);
-        r->subject = g_strdup((const char*)sqlite3_column_text(st, 1));
-        r->author = g_strdup((const char*)sqlite3_column_text(st, 2));
-        r->date = g_strdup((const char*)sqlite3_column_text(st, 3));
-        g_list_store_append(store, r);
+    if (sqlite3_prepare_v2(sdb, sql, -1, &st, NULL) != SQLITE_OK) return -1;
+    for (int i = 0; i < n; i++) sqlite3_bind_text(st, i + 1, pv[i], -1, SQLITE_TRANSIENT);
+    int got = 0, rc;
+    while ((rc = sqlite3_step(st)) == SQLITE_ROW){
+        page_add(p, (const char*)sqlite3_column_text(st, 0), (const char*)sqlite3_column_text(st, 1),
+                 (const char*)sqlite3_column_text(st, 2), (const char*)sqlite3_column_text(st, 3),
+                 (const char*)sqlite3_column_text(st, 4));
+        got++;
     }
     sqlite3_finalize(st);
+    return rc == SQLITE_DONE || rc == SQLITE_INTERRUPT ? got : -1;
 }
 
-static void load_rows_mysql(MYSQL *db, const char *filter){
-    store_clear();
-    char q[1024];
-    if (filter && *filter){
-        char esc[512]; mysql_real_escape_string(db, esc, filter, (unsigned long)strlen(filter));
-        snprintf(q, sizeof(q), "SELECT artnum, subject, author, date FROM articles WHERE subject LIKE '%%%s%%' OR author LIKE '%%%s%%' ORDER BY artnum LIMIT 1000", esc, esc);
-    } else {
-        snprintf(q, sizeof(q), "SELECT artnum, subject, author, date FROM articles ORDER BY artnum LIMIT 1000");
+static int run_mysql(const char *sql, const char **pv, int n, Page *p){
+    GString *q = g_string_new(NULL);
+    int k = 0;
+    for (const char *s = sql; *s; s++){
+        if (*s != '?' || k >= n){ g_string_append_c(q, *s); continue; }
+        size_t len = strlen(pv[k]);
+        char *esc = g_malloc(len * 2 + 1);
+        mysql_real_escape_string(mydb, esc, pv[k++], (unsigned long)len);
+        g_string_append_printf(q, "'%s'", esc);
+        g_free(esc);
     }
-    if (mysql_query(db, q)) return;
-    MYSQL_RES *res = mysql_store_result(db); if (!res) return;
+    int rc = mysql_real_query(mydb, q->str, (unsigned long)q->len);
+    g_string_free(q, TRUE);
+    if (rc) return -1;
+    MYSQL_RES *res = mysql_use_result(mydb); if (!res) return -1;
+    /* the server finishes the statement regardless; stop reading early */
+    int got = 0;
     MYSQL_ROW row;
-    while ((row = mysql_fetch_row(res))){
-        Row *r = g_new0(Row, 1);
-        r->artnum = row[0] ? atoi(row[0]) : 0;
-        r->subject = g_strdup(row[1] ? row[1] : "");
-        r->author = g_strdup(row[2] ? row[2] : "");
-        r->date = g_strdup(row[3] ? row[3] : "");
-        g_list_store_append(store, r);
+    while (!g_cancellable_is_cancelled(p->cancel) && (row = mysql_fetch_row(res))){
+        page_add(p, row[0], row[1], row[2], row[3], row[4]);
+        got++;
     }
     mysql_free_result(res);
+    return got;
 }
 
 #ifdef HAVE_PQ
-static void load_rows_pg(PGconn *db, const char *filter){
-    store_clear();
-    PGresult *res;
-    if (filter && *filter){
-        const char *params[1] = { filter };
-        res = PQexecParams(db,
-            "SELECT artnum, subject, author, date FROM articles WHERE subject ILIKE '%'||$1||'%' OR author ILIKE '%'||$1||'%' ORDER BY artnum LIMIT 1000",
-            1, NULL, params, NULL, NULL, 0);
-    } else {
-        res = PQexec(db, "SELECT artnum, subject, author, date FROM articles ORDER BY artnum LIMIT 1000");
-    }
-    if (PQresultStatus(res) != PGRES_TUPLES_OK){ PQclear(res); return; }
-    int n = PQntuples(res);
-    for (int i=0;i<n;i++){
-        Row *r = g_new0(Row, 1);
-        r->artnum = atoi(PQgetvalue(res, i, 0));
-        r->subject = g_strdup(PQgetvalue(res, i, 1));
-        r->author = g_strdup(PQgetvalue(res, i, 2));
-        r->date = g_strdup(PQgetvalue(res, i, 3));
-        g_list_store_append(store, r);
+#define PG_FTS_DOC "to_tsvector('simple', coalesce(a.subject,'') || ' ' || coalesce(a.author,''))"
+#define PG_FTS_SUBJECT "to_tsvector('simple', coalesce(a.subject,''))"
+#define PG_FTS_NAME "to_tsvector('simple', au.name)"
+
+static int run_pg(const char *sql, const char **pv, int n, Page *p){
+    GString *q = g_string_new(NULL);
+    int k = 0;
+    for (const char *s = sql; *s; s++){
+        if (*s == '?') g_string_append_printf(q, "$%d", ++k);
+        else g_string_append_c(q, *s);
     }
+    PGcancel *pc = PQgetCancel(pgdb);
+    g_mutex_lock(&pg_cancel_lock); pg_cancel = pc; g_mutex_unlock(&pg_cancel_lock);
+    PGresult *res = g_cancellable_is_cancelled(p->cancel) ? NULL :
+        PQexecParams(pgdb, q->str, n, NULL, pv, NULL, NULL, 0);
+    g_mutex_lock(&pg_cancel_lock); pg_cancel = NULL; g_mutex_unlock(&pg_cancel_lock);
+    PQfreeCancel(pc);
+    g_string_free(q, TRUE);
+    if (!res) return 0;
+    if (PQresultStatus(res) != PGRES_TUPLES_OK){ PQclear(res); return -1; }
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; i++)
+        page_add(p, PQgetvalue(res, i, 0), PQgetvalue(res, i, 1), PQgetvalue(res, i, 2), PQgetvalue(res, i, 3), PQgetvalue(res, i, 4));
     PQclear(res);
+    return rows;
 }
 #endif
 
-static void on_search(GtkEditable *e, gpointer data){
-    const char *txt = gtk_editable_get_text(GTK_EDITABLE(entry));
-    if (vtype == V_SQLITE) load_rows_sqlite(sdb, txt);
-    else if (vtype == V_MYSQL) load_rows_mysql(mydb, txt);
+static int run(const char *sql, const char **pv, int n, Page *p){
+    if (vtype == V_SQLITE) return run_sqlite(sql, pv, n, p);
+    if (vtype == V_MYSQL) return run_mysql(sql, pv, n, p);
+    #ifdef HAVE_PQ
+    if (vtype == V_PG) return run_pg(sql, pv, n, p);
+    #endif
+    return -1;
+}
+
+/* interned authors: the subject and author-name matches each read their own
+   index, and the ids they find are joined to the rows and ranked together.
+   An OR between the two tables could use neither index. */
+static void fts_union_sql(char *sql, size_t n, const char *subject_hits, const char *name_hits, int want, unsigned offset){
+    snprintf(sql, n, "SELECT %s FROM %s JOIN (SELECT id, SUM(r) AS r FROM (%s UNION ALL %s) u GROUP BY id) m ON m.id = a.id "
+             "ORDER BY m.r DESC, a.id LIMIT %d OFFSET %u", row_cols, from_sql, subject_hits, name_hits, want, offset);
+}
+
+static int fetch_fts(Page *p){
+    char terms[512], sql[2048];
+    int want = PAGE_ROWS - (int)p->rows->len;
+    const char *pv[4] = { terms, terms, terms, terms };
+    if (vtype == V_SQLITE){
+        if (!fts_terms(p->filter, terms, sizeof(terms), "\"", "\"*", " ")) return -1;
+        snprintf(sql, sizeof(sql), "SELECT %s FROM %s JOIN articles_fts ON articles_fts.rowid = a.id "
+                 "WHERE articles_fts MATCH ? ORDER BY bm25(articles_fts), a.id LIMIT %d OFFSET %u", row_cols, from_sql, want, p->offset);
+        return run(sql, pv, 1, p);
+    }
+    if (vtype == V_MYSQL){
+        if (!fts_terms(p->filter, terms, sizeof(terms), "+", "*", " ")) return -1;
+        if (v2_intern)
+            fts_union_sql(sql, sizeof(sql),
+                "SELECT a.id, MATCH(a.subject) AGAINST (? IN BOOLEAN MODE) AS r FROM articles a WHERE MATCH(a.subject) AGAINST (? IN BOOLEAN MODE)",
+                "SELECT a.id, MATCH(au.name) AGAINST (? IN BOOLEAN MODE) FROM authors au JOIN articles a ON a.author_id = au.id "
+                "WHERE MATCH(au.name) AGAINST (? IN BOOLEAN MODE)", want, p->offset);
+        else
+            snprintf(sql, sizeof(sql), "SELECT %s FROM %s WHERE MATCH(a.subject, a.author) AGAINST (? IN BOOLEAN MODE) "
+                     "ORDER BY MATCH(a.subject, a.author) AGAINST (? IN BOOLEAN MODE) DESC, a.id LIMIT %d OFFSET %u", row_cols, from_sql, want, p->offset);
+        return run(sql, pv, v2_intern ? 4 : 2, p);
+    }
     #ifdef HAVE_PQ
-    else if (vtype == V_PG) load_rows_pg(pgdb, txt);
+    if (!fts_terms(p->filter, terms, sizeof(terms), "", ":*", " & ")) return -1;
+    /* the WHERE expressions are those of the indexes in db_init_fts(): Postgres
+       only uses an expression index for the identical expression */
+    if (v2_intern)
+        fts_union_sql(sql, sizeof(sql),
+            "SELECT a.id, ts_rank(" PG_FTS_SUBJECT ", to_tsquery('simple', ?)) AS r FROM articles a WHERE " PG_FTS_SUBJECT " @@ to_tsquery('simple', ?)",
+            "SELECT a.id, ts_rank(" PG_FTS_NAME ", to_tsquery('simple', ?)) FROM authors au JOIN articles a ON a.author_id = au.id "
+            "WHERE " PG_FTS_NAME " @@ to_tsquery('simple', ?)", want, p->offset);
+    else
+        snprintf(sql, sizeof(sql), "SELECT %s FROM %s WHERE " PG_FTS_DOC " @@ to_tsquery('simple', ?) "
+                 "ORDER BY ts_rank(" PG_FTS_DOC ", to_tsquery('simple', ?)) DESC, a.id LIMIT %d OFFSET %u", row_cols, from_sql, want, p->offset);
+    return run(sql, pv, v2_intern ? 4 : 2, p);
+    #else
+    return -1;
     #endif
 }
 
+/* Finish the group the last page ended in, then continue with the groups
+   after it. Both halves are plain range scans of idx_articles_group_artnum. */
+static void fetch_keyset(Page *p){
+    char cond[96] = "";
+    if (p->mode == Q_LIKE) snprintf(cond, sizeof(cond), " AND (a.subject %s ? OR %s %s ?)", vtype == V_PG ? "ILIKE" : "LIKE", acol, vtype == V_PG ? "ILIKE" : "LIKE");
+    char *like = p->mode == Q_LIKE ? g_strdup_printf("%%%s%%", p->filter) : NULL;
+    char sql[1024], gc[96];
+    int got = 0, want = PAGE_ROWS - (int)p->rows->len;
+    if (p->after_group){
+        const char *pv[4] = { p->after_group, p->after_artnum, like, like };
+        group_cond(gc, sizeof(gc), "=");
+        snprintf(sql, sizeof(sql), "SELECT %s FROM %s WHERE %s AND a.artnum > ?%s ORDER BY a.artnum LIMIT %d", row_cols, from_sql, gc, cond, want);
+        got = run(sql, pv, like ? 4 : 2, p);
+    }
+    if (got >= 0 && got < want && !g_cancellable_is_cancelled(p->cancel)){
+        const char *pv[3] = { p->after_group ? p->after_group : "", like, like };
+        group_cond(gc, sizeof(gc), p->after_group ? ">" : ">=");
+        snprintf(sql, sizeof(sql), "SELECT %s FROM %s WHERE %s%s ORDER BY %s, a.artnum LIMIT %d",
+                 row_cols, from_sql, gc, cond, v2 ? "a.group_id" : "a.group_name", want - got);
+        run(sql, pv, like ? 3 : 1, p);
+    }
+    g_free(like);
+}
+
+static void fetch_page(gpointer data, gpointer unused){
+    Page *p = data;
+    (void)unused;
+    if (vtype == V_MYSQL) mysql_thread_init();
+    while (!g_cancellable_is_cancelled(p->cancel)){
+        if (vtype == V_SQLITE){ sdb = shard_db[p->shard]; sqlite3_progress_handler(sdb, 1000, sqlite_progress, p->cancel); }
+        /* no usable index (or no words to look up): fall back to LIKE */
+        if (p->mode == Q_FTS && fetch_fts(p) < 0 && p->offset == 0 && !g_cancellable_is_cancelled(p->cancel)) p->mode = Q_LIKE;
+        if (p->mode != Q_FTS) fetch_keyset(p);
+        if (vtype == V_SQLITE) sqlite3_progress_handler(sdb, 0, NULL, NULL);
+        /* the shard is done: fill the page from the next one */
+        if (p->rows->len >= PAGE_ROWS || p->shard + 1 >= nshards) break;
+        p->shard++;
+        p->offset = 0;
+        g_free(p->after_group); p->after_group = NULL;
+    }
+    g_idle_add(page_done, p);
+}
+
+/* Typing cancels the running query at once; the new one starts when the
+   text has been still for SEARCH_DELAY_MS. */
+static guint search_timer;
+
+static gboolean search_fire(gpointer data){
+    (void)data;
+    search_timer = 0;
+    v_model_set_filter(model, gtk_editable_get_text(GTK_EDITABLE(entry)));
+    return G_SOURCE_REMOVE;
+}
+
+static void on_search(GtkEditable *e, gpointer data){
+    v_model_stop(model);
+    if (search_timer) g_source_remove(search_timer);
+    search_timer = g_timeout_add(SEARCH_DELAY_MS, search_fire, NULL);
+}
+
 static GMainLoop *app_loop = NULL;
 static gboolean on_close(GtkWindow *win, gpointer data){
     if (app_loop){ g_main_loop_quit(app_loop); }
@@ -146,7 +468,7 @@ static void setup_cb(GtkSignalListItemFactory *f, GtkListItem *item, gpointer u)
 }
 
 static void bind_cb(GtkSignalListItemFactory *f, GtkListItem *item, gpointer u){
-    Row *r = (Row*)gtk_list_item_get_item(item);
+    VRow *r = (VRow*)gtk_list_item_get_item(item);
     GtkWidget *l_art = GTK_WIDGET(g_object_get_data(G_OBJECT(item), "l_art"));
     GtkWidget *l_subject = GTK_WIDGET(g_object_get_data(G_OBJECT(item), "l_subject"));
     GtkWidget *l_author = GTK_WIDGET(g_object_get_data(G_OBJECT(item), "l_author"));
@@ -158,11 +480,91 @@ static void bind_cb(GtkSignalListItemFactory *f, GtkListItem *item, gpointer u){
     gtk_label_set_text(GTK_LABEL(l_date), (r && r->date) ? r->date : "");
 }
 
+/* 1 if sql runs against the open database */
+static int probe(const char *sql){
+    if (vtype == V_SQLITE){
+        sqlite3_stmt *st = NULL;
+        int ok = sqlite3_prepare_v2(sdb, sql, -1, &st, NULL) == SQLITE_OK;
+        sqlite3_finalize(st);
+        return ok;
+    }
+    if (vtype == V_MYSQL){
+        if (mysql_query(mydb, sql)) return 0;
+        MYSQL_RES *r = mysql_store_result(mydb);
+        if (r) mysql_free_result(r);
+        return 1;
+    }
+    #ifdef HAVE_PQ
+    PGresult *r = PQexec(pgdb, sql);
+    int ok = PQresultStatus(r) == PGRES_TUPLES_OK;
+    PQclear(r);
+    return ok;
+    #else
+    return 0;
+    #endif
+}
+
+/* v1 keeps group_name and the Date: text in articles; v2 has group_id,
+   the date as an epoch and perhaps author_id (nntp2sql --schema-v2) */
+static void layout_detect(void){
+    if (!probe("SELECT group_id FROM articles LIMIT 0")){
+        snprintf(row_cols, sizeof(row_cols), "a.group_name, a.artnum, a.subject, a.author, a.date");
+        snprintf(from_sql, sizeof(from_sql), "articles a");
+        return;
+    }
+    v2 = 1;
+    v2_intern = probe("SELECT author_id FROM articles LIMIT 0");
+    const char *date = vtype == V_SQLITE ? "COALESCE(a.date_raw, strftime('%Y-%m-%d %H:%M:%S', a.date, 'unixepoch'))" :
+                       vtype == V_MYSQL ? "COALESCE(a.date_raw, DATE_FORMAT(DATE_ADD('1970-01-01', INTERVAL a.date SECOND), '%Y-%m-%d %H:%i:%s'))" :
+                       "COALESCE(a.date_raw, to_char(to_timestamp(a.date) AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS'))";
+    if (v2_intern) acol = "au.name";
+    snprintf(row_cols, sizeof(row_cols), "g.name, a.artnum, a.subject, %s, %s", acol, date);
+    snprintf(from_sql, sizeof(from_sql), "articles a JOIN %s g ON g.id = a.group_id%s", vtype == V_MYSQL ? "`groups`" : "groups",
+             v2_intern ? " LEFT JOIN authors au ON au.id = a.author_id" : "");
+}
+
+/* nntp2sql --shards: conn is a manifest listing the shard files, which
+   are relative to its directory */
+static int open_shards(const char *manifest){
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(sdb, "SELECT path FROM shards ORDER BY shard", -1, &st, NULL) != SQLITE_OK) return 1;
+    GPtrArray *dbs = g_ptr_array_new();
+    char *dir = g_path_get_dirname(manifest);
+    int ok = 1;
+    while (ok && sqlite3_step(st) == SQLITE_ROW){
+        const char *f = (const char*)sqlite3_column_text(st, 0);
+        char *path = g_path_is_absolute(f) ? g_strdup(f) : g_build_filename(dir, f, NULL);
+        sqlite3 *h = NULL;
+        if (sqlite3_open_v2(path, &h, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK){
+            sqlite3_busy_timeout(h, 2000);
+            g_ptr_array_add(dbs, h);
+        } else { g_printerr("cannot open shard %s\n", path); sqlite3_close(h); ok = 0; }
+        g_free(path);
+    }
+    sqlite3_finalize(st);
+    g_free(dir);
+    if (!ok || dbs->len == 0){
+        for (guint k = 0; k < dbs->len; k++) sqlite3_close(g_ptr_array_index(dbs, k));
+        g_ptr_array_free(dbs, TRUE);
+        return ok ? 1 : 0;
+    }
+    sqlite3_close(sdb);
+    nshards = (int)dbs->len;
+    shard_db = (sqlite3**)g_ptr_array_free(dbs, FALSE);
+    sdb = shard_db[0];
+    return 1;
+}
+
 int main(int argc, char **argv){
     if (argc < 3){ g_printerr("usage: viewer --db-type {sqlite|mysql|postgres} <conn>\n  sqlite: path/to.db\n  mysql: host,db,user,pass[,port]\n  postgres: conninfo string\n"); return 2; }
     if (strcmp(argv[1], "--db-type") != 0){ g_printerr("first arg must be --db-type\n"); return 2; }
     const char *type = argv[2]; const char *conn = argv[3];
-    if (strcmp(type, "sqlite") == 0){ vtype = V_SQLITE; if (sqlite3_open(conn, &sdb) != SQLITE_OK){ g_printerr("sqlite open failed\n"); return 1; } }
+    if (strcmp(type, "sqlite") == 0){
+        vtype = V_SQLITE;
+        if (sqlite3_open(conn, &sdb) != SQLITE_OK){ g_printerr("sqlite open failed\n"); return 1; }
+        sqlite3_busy_timeout(sdb, 2000); /* a WAL database under ingestion (--sqlite-profile) stays readable */
+        if (!open_shards(conn)) return 1;
+    }
     else if (strcmp(type, "mysql") == 0){ vtype = V_MYSQL; mydb = mysql_init(NULL); if (!mydb){ g_printerr("mysql init failed\n"); return 1; }
         /* parse host,db,user,pass[,port] */
         char buf[512]; strncpy(buf, conn, sizeof(buf)-1); buf[sizeof(buf)-1]='\0';
@@ -174,6 +576,7 @@ int main(int argc, char **argv){
     else if (strcmp(type, "postgres") == 0){ vtype = V_PG; pgdb = PQconnectdb(conn); if (PQstatus(pgdb) != CONNECTION_OK){ g_printerr("postgres connect failed: %s\n", PQerrorMessage(pgdb)); return 1; } }
     #endif
     else { g_printerr("unknown db type\n"); return 2; }
+    layout_detect();
     gtk_init();
     GtkWidget *win = gtk_window_new(); gtk_window_set_title(GTK_WINDOW(win), "NNTP Viewer"); gtk_window_set_default_size(GTK_WINDOW(win), 800, 480);
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
@@ -181,29 +584,29 @@ int main(int argc, char **argv){
     entry = gtk_entry_new(); gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "Search subject/author...");
     gtk_box_append(GTK_BOX(box), entry);
     g_signal_connect(entry, "changed", G_CALLBACK(on_search), NULL);
-    store = g_list_store_new(G_TYPE_POINTER);
+    model = g_object_new(V_TYPE_MODEL, NULL);
+    pool = g_thread_pool_new(fetch_page, NULL, 1, FALSE, NULL);
 
     GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
 
     g_signal_connect(factory, "setup", G_CALLBACK(setup_cb), NULL);
     g_signal_connect(factory, "bind", G_CALLBACK(bind_cb), NULL);
 
-    GtkSelectionModel *sel = GTK_SELECTION_MODEL(gtk_no_selection_new(G_LIST_MODEL(store)));
+    GtkSelectionModel *sel = GTK_SELECTION_MODEL(gtk_no_selection_new(G_LIST_MODEL(g_object_ref(model))));
     GtkWidget *view = gtk_list_view_new(sel, factory);
 
     GtkWidget *sw = gtk_scrolled_window_new(); gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(sw), view);
     gtk_box_append(GTK_BOX(box), sw);
-    if (vtype == V_SQLITE) load_rows_sqlite(sdb, NULL);
-    else if (vtype == V_MYSQL) load_rows_mysql(mydb, NULL);
-    #ifdef HAVE_PQ
-    else if (vtype == V_PG) load_rows_pg(pgdb, NULL);
-    #endif
+    v_model_set_filter(model, NULL);
     g_signal_connect(win, "close-request", G_CALLBACK(on_close), NULL);
     gtk_widget_set_visible(win, TRUE);
     app_loop = g_main_loop_new(NULL, FALSE);
     g_main_loop_run(app_loop);
     g_main_loop_unref(app_loop);
-    if (vtype == V_SQLITE) sqlite3_close(sdb);
+    /* drop queued pages and wait for the running one before closing the DB */
+    v_model_stop(model);
+    g_thread_pool_free(pool, TRUE, TRUE);
+    if (vtype == V_SQLITE) for (int k = 0; k < nshards; k++) sqlite3_close(shard_db[k]);
     else if (vtype == V_MYSQL) mysql_close(mydb);
     #ifdef HAVE_PQ
     else if (vtype == V_PG) PQfinish(pgdb);
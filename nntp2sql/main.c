@@ -6,7 +6,7 @@
  *   sqlite3, mariadb/mysql
  *
  * Build (example):
- *   gcc -o nntp2sql main.c -lssl -lcrypto -lsqlite3 -lmysqlclient
+ *   gcc -o nntp2sql main.c -lssl -lcrypto -lz -lsqlite3 -lmysqlclient
  *
  * Note: link only the DB libs you need. Adjust include/library paths as required.
  *
@@ -24,7 +24,7 @@
  * and concurrency considerations.
  */
 
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,10 +34,18 @@
 #include <errno.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <ctype.h>
 #include <fcntl.h>
 #include <time.h>
+#include <signal.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <fnmatch.h>
 
 /* Optional DB client headers */
 #include <sqlite3.h>
@@ -46,12 +54,30 @@
 #include <libpq-fe.h>     /* PostgreSQL */
 #endif
 #include <pthread.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define SCAN_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+#if defined(__linux__)
+#define EV_EPOLL 1
+#include <sys/epoll.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#define EV_KQUEUE 1
+#include <sys/event.h>
+#else
+#include <poll.h>
+#endif
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <zlib.h>
 #include "src/export_html.h" /* HTML export declarations */
 
 #define BUFSZ 8192
+#define PROGRESS_MAX 200 /* widest progress bar */
 
 /* Simple logging */
 typedef enum {
@@ -73,6 +99,20 @@ typedef enum {
 static FILE *g_log = NULL;
 static int g_verbose = 0;
 static int g_upsert = 0; /* when enabled: update-then-insert if missing */
+static int g_schema_v2 = 0;      /* new databases get the v2 articles layout */
+static int g_intern_authors = 0; /* ... with authors in their own table */
+static int g_keep_date_text = 0; /* v2: also store the Date: text (date_raw) */
+static int g_migrate_schema = 0; /* convert a v1 database to v2 */
+static int g_dedup = 0;          /* store crossposts once, keyed on Message-ID */
+enum { SQLITE_PROFILE_DEFAULT, SQLITE_PROFILE_BULK, SQLITE_PROFILE_ONLINE };
+static const char *sqlite_profile_names[] = { "default", "bulk", "online" };
+static int g_sqlite_profile = SQLITE_PROFILE_DEFAULT; /* --sqlite-profile, applied by db_open() */
+static int g_sqlite_checkpoint = -1; /* WAL pages between automatic checkpoints; -1 = the profile's */
+typedef struct { char *pattern; int shard; } ShardRule;
+static int g_shards = 0;             /* --shards N: a new database is split N ways */
+static ShardRule *g_shard_rules;     /* --shard-map FILE, first match wins */
+static int g_nshard_rules;
+static volatile sig_atomic_t g_stop = 0; /* set by SIGINT/SIGTERM: finish up and commit */
 
 static const char *describe_error(AppError e) {
     switch (e) {
@@ -101,7 +141,10 @@ static void log_open(const char *path) {
     }
 }
 
+static void stats_stop(void);
+
 static void log_close(void) {
+    stats_stop(); /* the --stats-interval thread writes to g_log */
     if (g_log) { fclose(g_log); g_log = NULL; }
 }
 
@@ -133,13 +176,409 @@ static void fatal(AppError code, const char *fmt, ...) {
     exit(code);
 }
 
+static void on_stop_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Run metrics: relaxed atomic counters and log2 latency histograms (bucket k
+   counts samples below 2^k microseconds). Dumped as JSON lines every
+   --stats-interval seconds and/or served in Prometheus text format on
+   --metrics-port; nothing is timed unless one of them is on. */
+#define HIST_BUCKETS 32
+
+typedef struct {
+    unsigned long long n, sum_us, max_us;
+    unsigned long long b[HIST_BUCKETS];
+} Hist;
+
+enum { LAT_GROUP, LAT_XOVER, LAT_HEAD, LAT_PARSE, LAT_DB_ROW, LAT_DB_COMMIT, LAT_COUNT };
+static const char *const lat_names[LAT_COUNT] = {
+    "nntp_group", "nntp_xover", "nntp_head", "xover_parse", "db_row", "db_commit"
+};
+
+static struct {
+    Hist lat[LAT_COUNT];
+    unsigned long long bytes_rx, bytes_inflated, rows, retries, connects, queue_depth, queue_max;
+    unsigned long long crossposts, heads_skipped; /* --dedup */
+    unsigned long long reconnects;
+} g_stats;
+static int g_stats_on = 0;
+static long long g_stats_t0;
+
+#define STAT_ADD(field, v) __atomic_add_fetch(&g_stats.field, (unsigned long long)(v), __ATOMIC_RELAXED)
+
+static long long stat_t0(void) { return g_stats_on ? now_us() : 0; }
+
+static void stat_lat(int which, long long t0) {
+    if (!g_stats_on) return;
+    long long d = now_us() - t0;
+    unsigned long long us = d > 0 ? (unsigned long long)d : 0;
+    Hist *h = &g_stats.lat[which];
+    int k = us ? 64 - __builtin_clzll(us) : 0;
+    if (k >= HIST_BUCKETS) k = HIST_BUCKETS - 1;
+    __atomic_add_fetch(&h->n, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum_us, us, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->b[k], 1, __ATOMIC_RELAXED);
+    unsigned long long mx = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    while (us > mx && !__atomic_compare_exchange_n(&h->max_us, &mx, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static void stat_gauge_queue(unsigned long long depth) {
+    __atomic_store_n(&g_stats.queue_depth, depth, __ATOMIC_RELAXED);
+    if (depth > __atomic_load_n(&g_stats.queue_max, __ATOMIC_RELAXED)) __atomic_store_n(&g_stats.queue_max, depth, __ATOMIC_RELAXED);
+}
+
+#define LD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+/* upper bound (us) of the bucket holding quantile q */
+static unsigned long long hist_quantile(const Hist *h, double q) {
+    unsigned long long n = LD(h->n), seen = 0;
+    if (!n) return 0;
+    for (int k = 0; k < HIST_BUCKETS; ++k) {
+        seen += LD(h->b[k]);
+        if (seen >= q * n) return 1ULL << k;
+    }
+    return LD(h->max_us);
+}
+
+static size_t stats_json(char *out, size_t cap) {
+    size_t n = 0;
+#define PUT(...) do { if (n < cap) n += (size_t)snprintf(out + n, cap - n, __VA_ARGS__); } while (0)
+    PUT("{\"uptime_ms\":%lld,\"bytes_rx\":%llu,\"bytes_inflated\":%llu,\"rows\":%llu,\"retries\":%llu,\"connects\":%llu,"
+        "\"queue_depth\":%llu,\"queue_max\":%llu,\"crossposts\":%llu,\"heads_skipped\":%llu,\"reconnects\":%llu", now_ms() - g_stats_t0, LD(g_stats.bytes_rx),
+        LD(g_stats.bytes_inflated), LD(g_stats.rows), LD(g_stats.retries), LD(g_stats.connects), LD(g_stats.queue_depth), LD(g_stats.queue_max),
+        LD(g_stats.crossposts), LD(g_stats.heads_skipped), LD(g_stats.reconnects));
+    for (int k = 0; k < LAT_COUNT; ++k) {
+        const Hist *h = &g_stats.lat[k];
+        PUT(",\"%s\":{\"count\":%llu,\"sum_us\":%llu,\"max_us\":%llu,\"p50_us\":%llu,\"p99_us\":%llu}",
+            lat_names[k], LD(h->n), LD(h->sum_us), LD(h->max_us), hist_quantile(h, 0.50), hist_quantile(h, 0.99));
+    }
+    PUT("}\n");
+    return n < cap ? n : cap - 1;
+}
+
+static size_t stats_prometheus(char *out, size_t cap) {
+    size_t n = 0;
+    static const struct { const char *name, *type; } ctr[10] = {
+        { "nntp2sql_received_bytes_total", "counter" }, { "nntp2sql_inflated_bytes_total", "counter" },
+        { "nntp2sql_rows_total", "counter" },
+        { "nntp2sql_retries_total", "counter" }, { "nntp2sql_connects_total", "counter" },
+        { "nntp2sql_queue_depth", "gauge" }, { "nntp2sql_queue_depth_max", "gauge" },
+        { "nntp2sql_crossposts_total", "counter" }, { "nntp2sql_heads_skipped_total", "counter" },
+        { "nntp2sql_reconnects_total", "counter" },
+    };
+    unsigned long long v[10] = { LD(g_stats.bytes_rx), LD(g_stats.bytes_inflated), LD(g_stats.rows), LD(g_stats.retries),
+                                LD(g_stats.connects), LD(g_stats.queue_depth), LD(g_stats.queue_max),
+                                LD(g_stats.crossposts), LD(g_stats.heads_skipped), LD(g_stats.reconnects) };
+    for (int k = 0; k < 10; ++k) PUT("# TYPE %s %s\n%s %llu\n", ctr[k].name, ctr[k].type, ctr[k].name, v[k]);
+    for (int k = 0; k < LAT_COUNT; ++k) {
+        const Hist *h = &g_stats.lat[k];
+        unsigned long long cum = 0;
+        PUT("# TYPE nntp2sql_%s_seconds histogram\n", lat_names[k]);
+        for (int b = 0; b < HIST_BUCKETS - 1; ++b) {
+            cum += LD(h->b[b]);
+            PUT("nntp2sql_%s_seconds_bucket{le=\"%g\"} %llu\n", lat_names[k], (double)(1ULL << b) / 1e6, cum);
+        }
+        PUT("nntp2sql_%s_seconds_bucket{le=\"+Inf\"} %llu\n", lat_names[k], LD(h->n));
+        PUT("nntp2sql_%s_seconds_sum %g\nnntp2sql_%s_seconds_count %llu\n", lat_names[k], LD(h->sum_us) / 1e6, lat_names[k], LD(h->n));
+    }
+#undef PUT
+    return n < cap ? n : cap - 1;
+}
+
+#define STATS_BUFSZ (64 * 1024)
+
+static void stats_dump(void) {
+    char buf[4096];
+    size_t n = stats_json(buf, sizeof(buf));
+    FILE *out = g_log ? g_log : stderr;
+    fwrite(buf, 1, n, out);
+    fflush(out);
+}
+
+static pthread_t g_stats_tid;
+static int g_stats_running; /* the interval thread exists and is joined by stats_stop */
+static int g_stats_quit;
+static pthread_mutex_t g_stats_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_stats_cv = PTHREAD_COND_INITIALIZER;
+
+static void *stats_interval_main(void *arg) {
+    int secs = *(int*)arg;
+    pthread_mutex_lock(&g_stats_m);
+    for (;;) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += secs;
+        int rc = 0;
+        while (!g_stats_quit && rc != ETIMEDOUT) rc = pthread_cond_timedwait(&g_stats_cv, &g_stats_m, &until);
+        if (g_stats_quit) break;
+        stats_dump();
+    }
+    pthread_mutex_unlock(&g_stats_m);
+    return NULL;
+}
+
+/* wake and join the interval thread */
+static void stats_stop(void) {
+    if (!g_stats_running) return;
+    pthread_mutex_lock(&g_stats_m);
+    g_stats_quit = 1;
+    pthread_cond_signal(&g_stats_cv);
+    pthread_mutex_unlock(&g_stats_m);
+    pthread_join(g_stats_tid, NULL);
+    g_stats_running = 0;
+}
+
+/* minimal HTTP/1.0 responder: every request gets the metrics */
+#define STATS_HTTP_TIMEOUT_S 2
+
+static void *stats_http_main(void *arg) {
+    int lfd = *(int*)arg;
+    char *body = malloc(STATS_BUFSZ);
+    if (!body) return NULL;
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) { if (errno == EINTR) continue; break; }
+        /* one listener thread: a client that sends nothing must not hold it */
+        struct timeval tv = { STATS_HTTP_TIMEOUT_S, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        char req[1024];
+        if (recv(fd, req, sizeof(req), 0) <= 0) { close(fd); continue; }
+        size_t n = stats_prometheus(body, STATS_BUFSZ);
+        char hdr[128];
+        int hl = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", n);
+        if (send(fd, hdr, (size_t)hl, MSG_NOSIGNAL) == hl) (void)send(fd, body, n, MSG_NOSIGNAL);
+        close(fd);
+    }
+    free(body);
+    return NULL;
+}
+
+static int g_stats_interval = 0;
+
+/* start the JSON dumper and/or the metrics listener. metrics is [ADDR:]PORT;
+   without an address only loopback is served. The dumper is joined again by
+   stats_stop, the listener lives until exit */
+static void stats_start(int interval, const char *metrics) {
+    static int s_lfd;
+    pthread_t tid;
+    if (interval <= 0 && !metrics) return;
+    g_stats_on = 1;
+    g_stats_t0 = now_ms();
+    if (interval > 0) {
+        g_stats_interval = interval;
+        g_stats_running = pthread_create(&g_stats_tid, NULL, stats_interval_main, &g_stats_interval) == 0;
+    }
+    if (metrics) {
+        struct sockaddr_in sa;
+        char addr[64] = "127.0.0.1";
+        const char *colon = strrchr(metrics, ':'), *pstr = metrics;
+        int one = 1;
+        if (colon) { snprintf(addr, sizeof(addr), "%.*s", (int)(colon - metrics), metrics); pstr = colon + 1; }
+        int port = atoi(pstr);
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET; sa.sin_port = htons((unsigned short)port);
+        if (port <= 0 || port > 65535 || inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+            warnf("metrics endpoint %s: expected [ADDR:]PORT with an IPv4 address", metrics);
+            return;
+        }
+        s_lfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (s_lfd < 0 || setsockopt(s_lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+            bind(s_lfd, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(s_lfd, 16) < 0) {
+            warnf("metrics endpoint %s:%d: %s", addr, port, strerror(errno));
+            if (s_lfd >= 0) close(s_lfd);
+            return;
+        }
+        infof("serving metrics on %s:%d", addr, port);
+        if (pthread_create(&tid, NULL, stats_http_main, &s_lfd) == 0) pthread_detach(tid);
+    }
+}
+
+/* final JSON line for runs shorter than the interval */
+static void stats_finish(void) {
+    stats_stop();
+    if (g_stats_interval > 0) stats_dump();
+}
+
+/* Receive-path byte scanner: one pass over p[0..n) finds the first '\n'
+   (returns its offset, or n) and records the offsets of up to maxtabs '\t'
+   before it. The vector versions test 16/32 bytes per step; scan_init() picks
+   the best one the CPU supports, all of them give the scalar result. */
+typedef size_t (*scan_fn)(const char *p, size_t n, unsigned *tabs, int maxtabs, int *ntabs);
+
+static size_t scan_scalar_from(const char *p, size_t i, size_t n, unsigned *tabs, int maxtabs, int *nt) {
+    if (*nt >= maxtabs) {
+        const char *nl = memchr(p + i, '\n', n - i);
+        return nl ? (size_t)(nl - p) : n;
+    }
+    for (; i < n; ++i) {
+        if (p[i] == '\n') break;
+        if (p[i] == '\t' && *nt < maxtabs) tabs[(*nt)++] = (unsigned)i;
+    }
+    return i;
+}
+
+static size_t scan_scalar(const char *p, size_t n, unsigned *tabs, int maxtabs, int *ntabs) {
+    *ntabs = 0;
+    return scan_scalar_from(p, 0, n, tabs, maxtabs, ntabs);
+}
+
+#if defined(SCAN_X86) || defined(SCAN_NEON)
+/* consume one block's match masks (match k at bit k << sh); returns 1 and sets
+   *end once the block holds the newline */
+static inline int scan_masks(size_t base, uint64_t nl, uint64_t tab, int sh,
+                             unsigned *tabs, int maxtabs, int *nt, size_t *end) {
+    if (nl) tab &= (nl & (0 - nl)) - 1; /* only tabs before the newline */
+    while (tab && *nt < maxtabs) {
+        tabs[(*nt)++] = (unsigned)(base + ((unsigned)__builtin_ctzll(tab) >> sh));
+        tab &= tab - 1;
+    }
+    if (nl) { *end = base + ((unsigned)__builtin_ctzll(nl) >> sh); return 1; }
+    return 0;
+}
+#endif
+
+#ifdef SCAN_X86
+static size_t scan_sse2(const char *p, size_t n, unsigned *tabs, int maxtabs, int *ntabs) {
+    const __m128i vnl = _mm_set1_epi8('\n'), vtab = _mm_set1_epi8('\t');
+    size_t i = 0, end;
+    *ntabs = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        uint64_t nl = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vnl));
+        uint64_t tab = *ntabs < maxtabs ? (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vtab)) : 0;
+        if (scan_masks(i, nl, tab, 0, tabs, maxtabs, ntabs, &end)) return end;
+    }
+    return scan_scalar_from(p, i, n, tabs, maxtabs, ntabs);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *p, size_t n, unsigned *tabs, int maxtabs, int *ntabs) {
+    const __m256i vnl = _mm256_set1_epi8('\n'), vtab = _mm256_set1_epi8('\t');
+    size_t i = 0, end;
+    *ntabs = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        uint64_t nl = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vnl));
+        uint64_t tab = *ntabs < maxtabs ? (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vtab)) : 0;
+        if (scan_masks(i, nl, tab, 0, tabs, maxtabs, ntabs, &end)) return end;
+    }
+    return scan_scalar_from(p, i, n, tabs, maxtabs, ntabs);
+}
+#endif
+
+#ifdef SCAN_NEON
+/* NEON has no movemask: narrowing each 16-bit lane by 4 leaves one nibble per
+   byte, and keeping the top bit of each nibble gives match k at bit 4k + 3 */
+static inline uint64_t neon_mask(uint8x16_t eq) {
+    uint8x8_t m = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(m), 0) & 0x8888888888888888ULL;
+}
+
+static size_t scan_neon(const char *p, size_t n, unsigned *tabs, int maxtabs, int *ntabs) {
+    const uint8x16_t vnl = vdupq_n_u8('\n'), vtab = vdupq_n_u8('\t');
+    size_t i = 0, end;
+    *ntabs = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p + i);
+        uint64_t nl = neon_mask(vceqq_u8(v, vnl));
+        uint64_t tab = *ntabs < maxtabs ? neon_mask(vceqq_u8(v, vtab)) : 0;
+        if (scan_masks(i, nl, tab, 2, tabs, maxtabs, ntabs, &end)) return end;
+    }
+    return scan_scalar_from(p, i, n, tabs, maxtabs, ntabs);
+}
+#endif
+
+static scan_fn g_scan = scan_scalar;
+
+#if defined(SCAN_X86) || defined(SCAN_NEON)
+/* run fn and the scalar scanner over every start offset and length up to a
+   few blocks (so unaligned heads and partial tails are covered), on buffers
+   without separators, with sparse ones and with dense ones; 1 if all agree */
+static int scan_agrees(scan_fn fn) {
+    static const int limits[] = { 1, 7, 64 };
+    char buf[128];
+    unsigned ta[64], tb[64];
+    uint32_t x = 0x2545f491u;
+    for (int round = 0; round < 8; ++round) {
+        for (size_t k = 0; k < sizeof(buf); ++k) {
+            x = x * 1103515245u + 12345u;
+            unsigned r = (x >> 16) & 63;
+            switch (round % 4) {
+            case 0: buf[k] = 'a'; break;
+            case 1: buf[k] = r < 8 ? '\t' : 'a'; break;
+            case 2: buf[k] = r == 0 ? '\n' : r < 8 ? '\t' : 'a'; break;
+            default: buf[k] = r < 4 ? '\n' : r < 24 ? '\t' : 'a'; break;
+            }
+        }
+        for (size_t off = 0; off < 32; ++off) {
+            for (size_t n = 0; off + n <= sizeof(buf); ++n) {
+                for (int l = 0; l < 3; ++l) {
+                    int na = 0, nb = 0;
+                    size_t ea = fn(buf + off, n, ta, limits[l], &na);
+                    size_t eb = scan_scalar(buf + off, n, tb, limits[l], &nb);
+                    if (ea != eb || na != nb || memcmp(ta, tb, sizeof(unsigned) * (size_t)na) != 0) return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+#endif
+
+/* pick the scanner once at startup and check it against the scalar one;
+   returns its name for the log */
+static const char *scan_init(void) {
+    const char *name = "scalar";
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { g_scan = scan_avx2; name = "avx2"; }
+    else { g_scan = scan_sse2; name = "sse2"; }
+#elif defined(SCAN_NEON)
+    g_scan = scan_neon; name = "neon";
+#endif
+#if defined(SCAN_X86) || defined(SCAN_NEON)
+    if (!scan_agrees(g_scan)) {
+        warnf("%s line scanner disagrees with the scalar one; using scalar", name);
+        g_scan = scan_scalar; name = "scalar";
+    }
+#endif
+    return name;
+}
+
 /* Network/SSL wrapper */
 
+#define CONN_RBUFSZ (128 * 1024) /* per-connection receive buffer */
+
 typedef struct {
     int sock;
-    SSL_CTX *ctx;
     SSL *ssl;
     int use_ssl;
+    char *rbuf;  /* receive buffer, allocated on first read */
+    size_t rcap; /* allocated size of rbuf */
+    size_t rpos; /* first unconsumed byte */
+    size_t rlen; /* end of buffered data */
+    /* COMPRESS DEFLATE (RFC 8054): everything after the 206 reply is a raw
+       deflate stream in both directions; rbuf then holds inflated bytes */
+    z_stream *zin, *zout;
+    char *zbuf;  /* received, still compressed */
+    size_t zpos, zlen;
+    int zfull;   /* the last inflate filled its output: zlib may hold more */
+    int xgzip;   /* XFEATURE COMPRESS GZIP enabled: overview replies are zlib blocks */
 } Conn;
 
 static int tcp_connect(const char *host, const char *port) {
@@ -155,7 +594,12 @@ static int tcp_connect(const char *host, const char *port) {
     for (rp = res; rp != NULL; rp = rp->ai_next) {
         fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
         if (fd == -1) continue;
-        if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0) break;
+        if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0) {
+            /* pipelined commands must not wait behind Nagle for the previous reply's ACK */
+            int one = 1; setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            STAT_ADD(connects, 1);
+            break;
+        }
         close(fd);
         fd = -1;
     }
@@ -175,51 +619,272 @@ static void conn_init(Conn *c) {
 static void conn_cleanup(Conn *c) {
     if (!c) return;
     if (c->ssl) { SSL_shutdown(c->ssl); SSL_free(c->ssl); c->ssl = NULL; }
-    if (c->ctx) { SSL_CTX_free(c->ctx); c->ctx = NULL; }
     if (c->sock >= 0) close(c->sock);
+    c->sock = -1;
+    free(c->rbuf); c->rbuf = NULL;
+    c->rcap = c->rpos = c->rlen = 0;
+    if (c->zin) { inflateEnd(c->zin); free(c->zin); c->zin = NULL; }
+    if (c->zout) { deflateEnd(c->zout); free(c->zout); c->zout = NULL; }
+    free(c->zbuf); c->zbuf = NULL;
+    c->zpos = c->zlen = 0;
+    c->zfull = c->xgzip = 0;
+}
+
+static ssize_t conn_recv(Conn *c, char *buf, size_t len) {
+    ssize_t r = c->use_ssl ? SSL_read(c->ssl, buf, (int)len) : recv(c->sock, buf, len, 0);
+    if (r > 0) STAT_ADD(bytes_rx, r);
+    return r;
+}
+
+#define CONN_ZBUFSZ (64 * 1024)
+
+/* COMPRESS DEFLATE: inflate into buf, reading more of the stream as needed */
+static ssize_t conn_recv_inflate(Conn *c, char *buf, size_t len) {
+    for (;;) {
+        if (c->zpos == c->zlen && !c->zfull) {
+            ssize_t r = conn_recv(c, c->zbuf, CONN_ZBUFSZ);
+            if (r <= 0) return -1;
+            c->zpos = 0; c->zlen = (size_t)r;
+        }
+        z_stream *z = c->zin;
+        z->next_in = (Bytef*)c->zbuf + c->zpos; z->avail_in = (uInt)(c->zlen - c->zpos);
+        z->next_out = (Bytef*)buf; z->avail_out = (uInt)len;
+        int rc = inflate(z, Z_SYNC_FLUSH);
+        c->zpos = c->zlen - z->avail_in;
+        c->zfull = z->avail_out == 0;
+        if (rc != Z_OK && rc != Z_BUF_ERROR) { warnf("COMPRESS DEFLATE stream error: %s", z->msg ? z->msg : "inflate failed"); return -1; }
+        size_t got = len - z->avail_out;
+        if (got) { STAT_ADD(bytes_inflated, got); return (ssize_t)got; }
+    }
+}
+
+/* refill the receive buffer: compact unread bytes to the front (growing the
+   buffer if a single line fills it) and issue one SSL_read/recv for as much as fits */
+static ssize_t conn_fill(Conn *c) {
+    if (!c->rbuf) {
+        c->rbuf = malloc(CONN_RBUFSZ);
+        if (!c->rbuf) return -1;
+        c->rcap = CONN_RBUFSZ; c->rpos = c->rlen = 0;
+    }
+    if (c->rpos > 0) {
+        if (c->rlen > c->rpos) memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+        c->rlen -= c->rpos; c->rpos = 0;
+    }
+    if (c->rlen == c->rcap) {
+        char *nb = realloc(c->rbuf, c->rcap * 2);
+        if (!nb) return -1;
+        c->rbuf = nb; c->rcap *= 2;
+    }
+    size_t room = c->rcap - c->rlen;
+    ssize_t r = c->zin ? conn_recv_inflate(c, c->rbuf + c->rlen, room) : conn_recv(c, c->rbuf + c->rlen, room);
+    if (r <= 0) return -1;
+    c->rlen += (size_t)r;
+    return r;
+}
+
+/* return a view of the next buffered line with CRLF stripped and NUL-terminated in
+   place; *line stays valid until the next read on this connection. Returns line
+   length or -1 on EOF/error. */
+static ssize_t conn_getline(Conn *c, char **line) {
+    size_t scanned = 0;
+    for (;;) {
+        if (c->rbuf && c->rlen > c->rpos + scanned) {
+            char *start = c->rbuf + c->rpos;
+            size_t avail = c->rlen - c->rpos - scanned;
+            int nt;
+            size_t off = g_scan(start + scanned, avail, NULL, 0, &nt);
+            if (off < avail) {
+                size_t l = scanned + off;
+                c->rpos += l + 1;
+                if (l && start[l-1] == '\r') l--;
+                start[l] = '\0';
+                *line = start;
+                return (ssize_t)l;
+            }
+            scanned = c->rlen - c->rpos;
+        }
+        if (conn_fill(c) < 0) return -1;
+    }
 }
 
 /* read one line (CRLF terminated) into buf (null-terminated) */
 static ssize_t conn_readline(Conn *c, char *buf, size_t bufsz) {
-    size_t pos = 0;
-    while (pos + 1 < bufsz) {
-        char ch;
-        ssize_t r = c->use_ssl ? SSL_read(c->ssl, &ch, 1) : recv(c->sock, &ch, 1, 0);
-        if (r <= 0) return -1;
-        buf[pos++] = ch;
-        if (pos >= 2 && buf[pos-2] == '\r' && buf[pos-1] == '\n') break;
-    }
-    buf[pos] = '\0';
-    return (ssize_t)pos;
-}
-
-/* read multiline dot-terminated response; caller must free returned char*; lines are '\n' separated */
-static char *conn_read_multiline(Conn *c) {
-    size_t cap = 8192, len = 0;
-    char *out = malloc(cap);
-    if (!out) return NULL;
-    out[0] = '\0';
-    char line[BUFSZ];
+    char *line;
+    ssize_t l = conn_getline(c, &line);
+    if (l < 0) return -1;
+    size_t n = (size_t)l;
+    if (n + 3 > bufsz) n = bufsz > 3 ? bufsz - 3 : 0;
+    memcpy(buf, line, n);
+    buf[n++] = '\r'; buf[n++] = '\n'; buf[n] = '\0';
+    return (ssize_t)n;
+}
+
+/* stream a multiline dot-terminated response: cb receives each unstuffed line
+   (NUL-terminated, valid only during the call) straight from the receive buffer.
+   Returns the number of lines delivered, or -1 if the connection failed. */
+typedef void (*line_cb)(char *line, size_t len, void *arg);
+
+static long conn_read_multiline_each(Conn *c, line_cb cb, void *arg) {
+    long n = 0;
     while (1) {
-        if (conn_readline(c, line, sizeof(line)) <= 0) { free(out); return NULL; }
-        /* strip CRLF */
-        size_t l = strlen(line);
-        while (l && (line[l-1] == '\r' || line[l-1] == '\n')) line[--l] = '\0';
-        if (strcmp(line, ".") == 0) break;
-        /* handle transparent dot-stuffing */
-        if (line[0] == '.' ) memmove(line, line+1, strlen(line));
-        size_t need = len + l + 2;
-        if (need > cap) {
-            cap = need * 2;
-            out = realloc(out, cap);
-            if (!out) return NULL;
-        }
-        memcpy(out + len, line, l);
-        len += l;
-        out[len++] = '\n';
-        out[len] = '\0';
+        char *line;
+        ssize_t r = conn_getline(c, &line);
+        if (r < 0) return -1;
+        size_t l = (size_t)r;
+        if (l == 1 && line[0] == '.') break;
+        if (l && line[0] == '.') { line++; l--; }
+        cb(line, l, arg);
+        n++;
     }
-    return out;
+    return n;
+}
+
+/* Inflated overview text, split into lines for a line_cb. Lines are handed
+   over from buf the same way conn_read_multiline_each hands them from rbuf. */
+typedef struct {
+    z_stream z;
+    char *buf;
+    size_t len, cap;
+    line_cb cb;
+    void *arg;
+    long n;
+    int done; /* "." seen inside the compressed data */
+} ZLines;
+
+static void zlines_emit(ZLines *zl, int flush) {
+    size_t pos = 0;
+    while (pos < zl->len) {
+        int nt;
+        size_t avail = zl->len - pos;
+        size_t off = g_scan(zl->buf + pos, avail, NULL, 0, &nt);
+        if (off == avail && !flush) break;
+        char *line = zl->buf + pos;
+        size_t l = off;
+        pos += off < avail ? off + 1 : off;
+        if (l && line[l-1] == '\r') l--;
+        line[l] = '\0';
+        if (zl->done) continue;
+        if (l == 1 && line[0] == '.') { zl->done = 1; continue; }
+        if (l && line[0] == '.') { line++; l--; }
+        zl->cb(line, l, zl->arg);
+        zl->n++;
+    }
+    if (pos) memmove(zl->buf, zl->buf + pos, zl->len - pos);
+    zl->len -= pos;
+}
+
+/* inflate n bytes of input; returns Z_STREAM_END, Z_OK, or -1 on a corrupt stream */
+static int zlines_feed(ZLines *zl, const char *in, size_t n, size_t *used) {
+    z_stream *z = &zl->z;
+    z->next_in = (Bytef*)in; z->avail_in = (uInt)n;
+    for (;;) {
+        if (zl->cap - zl->len < 16384) {
+            size_t cap = zl->cap ? zl->cap * 2 : 65536;
+            char *nb = realloc(zl->buf, cap + 1);
+            if (!nb) return -1;
+            zl->buf = nb; zl->cap = cap;
+        }
+        z->next_out = (Bytef*)zl->buf + zl->len; z->avail_out = (uInt)(zl->cap - zl->len);
+        int rc = inflate(z, Z_NO_FLUSH);
+        size_t got = zl->cap - zl->len - z->avail_out;
+        zl->len += got;
+        STAT_ADD(bytes_inflated, got);
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+            warnf("compressed overview: %s", z->msg ? z->msg : "inflate failed");
+            return -1;
+        }
+        zlines_emit(zl, rc == Z_STREAM_END);
+        if (rc == Z_STREAM_END || (z->avail_in == 0 && z->avail_out > 0)) {
+            if (used) *used = n - z->avail_in;
+            return rc == Z_STREAM_END ? Z_STREAM_END : Z_OK;
+        }
+    }
+}
+
+static int zlines_init(ZLines *zl, int window_bits, line_cb cb, void *arg) {
+    memset(zl, 0, sizeof(*zl));
+    zl->cb = cb; zl->arg = arg;
+    return inflateInit2(&zl->z, window_bits) == Z_OK;
+}
+
+static long zlines_end(ZLines *zl, int ok) {
+    inflateEnd(&zl->z);
+    free(zl->buf);
+    return ok ? zl->n : -1;
+}
+
+/* XFEATURE COMPRESS GZIP reply: a zlib/gzip block holding the dot-terminated
+   overview, then (TERMINATOR) a plain "." line */
+static long conn_read_multiline_gzip(Conn *c, line_cb cb, void *arg) {
+    ZLines zl;
+    if (!zlines_init(&zl, 15 + 32, cb, arg)) return -1;
+    int rc = Z_OK;
+    while (rc == Z_OK) {
+        if (!c->rbuf || c->rpos == c->rlen) { if (conn_fill(c) < 0) return zlines_end(&zl, 0); }
+        size_t used = 0;
+        rc = zlines_feed(&zl, c->rbuf + c->rpos, c->rlen - c->rpos, &used);
+        c->rpos += used;
+    }
+    if (rc < 0) return zlines_end(&zl, 0);
+    char *line;
+    ssize_t r = conn_getline(c, &line);
+    if (r < 0) return zlines_end(&zl, 0);
+    if (!(r == 1 && line[0] == '.')) warnf("compressed overview: missing terminator");
+    return zlines_end(&zl, 1);
+}
+
+/* XZVER reply: dot-terminated yEnc lines carrying a raw deflate stream of the
+   overview */
+static long conn_read_multiline_xzver(Conn *c, line_cb cb, void *arg) {
+    ZLines zl;
+    if (!zlines_init(&zl, -15, cb, arg)) return -1;
+    int rc = Z_OK;
+    for (;;) {
+        char *line;
+        ssize_t r = conn_getline(c, &line);
+        if (r < 0) return zlines_end(&zl, 0);
+        size_t l = (size_t)r;
+        if (l == 1 && line[0] == '.') break;
+        if (l && line[0] == '.') { line++; l--; }
+        if (l >= 2 && line[0] == '=' && line[1] == 'y') continue; /* =ybegin, =ypart, =yend */
+        if (rc != Z_OK) continue;
+        size_t o = 0;
+        for (size_t i = 0; i < l; ++i) {
+            unsigned char ch = (unsigned char)line[i];
+            if (ch == '=' && i + 1 < l) ch = (unsigned char)(line[++i] - 64);
+            line[o++] = (char)(ch - 42);
+        }
+        rc = zlines_feed(&zl, line, o, NULL);
+    }
+    if (rc < 0) return zlines_end(&zl, 0);
+    if (rc != Z_STREAM_END) zlines_emit(&zl, 1);
+    return zlines_end(&zl, 1);
+}
+
+static int conn_write_raw(Conn *c, const char *buf, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t w;
+        if (c->use_ssl) w = SSL_write(c->ssl, buf + off, (int)(len - off));
+        else w = send(c->sock, buf + off, len - off, 0);
+        if (w <= 0) return -1;
+        off += (size_t)w;
+    }
+    return 0;
+}
+
+/* write all of buf (deflated and flushed under COMPRESS DEFLATE); returns len, or -1 on error */
+static ssize_t conn_write(Conn *c, const char *buf, size_t len) {
+    if (!c->zout) return conn_write_raw(c, buf, len) < 0 ? -1 : (ssize_t)len;
+    char out[16384];
+    z_stream *z = c->zout;
+    z->next_in = (Bytef*)buf; z->avail_in = (uInt)len;
+    do {
+        z->next_out = (Bytef*)out; z->avail_out = sizeof(out);
+        if (deflate(z, Z_SYNC_FLUSH) == Z_STREAM_ERROR) return -1;
+        if (conn_write_raw(c, out, sizeof(out) - z->avail_out) < 0) return -1;
+    } while (z->avail_out == 0);
+    return (ssize_t)len;
 }
 
 static ssize_t conn_sendf(Conn *c, const char *fmt, ...) {
@@ -234,142 +899,584 @@ static ssize_t conn_sendf(Conn *c, const char *fmt, ...) {
         if (len + 2 >= sizeof(buf)) return -1;
         buf[len++] = '\r'; buf[len++] = '\n'; buf[len] = '\0';
     }
-    if (c->use_ssl) {
-        int r = SSL_write(c->ssl, buf, (int)len);
-        return r;
-    } else {
-        return send(c->sock, buf, len, 0);
-    }
+    return conn_write(c, buf, len);
+}
+
+/* One client SSL_CTX is shared by every connection: it is configured once in
+   main() before any thread starts and only read afterwards. The newest
+   session the server hands out is kept so later handshakes (worker threads,
+   reconnects) resume it instead of running a full handshake. */
+static SSL_CTX *g_ssl_ctx = NULL;
+static SSL_SESSION *g_ssl_session = NULL;
+static const char *g_ssl_host = NULL; /* SNI; sessions are only valid for this server */
+static pthread_mutex_t g_ssl_m = PTHREAD_MUTEX_INITIALIZER;
+
+static int ssl_new_session(SSL *ssl, SSL_SESSION *sess) {
+    (void)ssl;
+    pthread_mutex_lock(&g_ssl_m);
+    if (g_ssl_session) SSL_SESSION_free(g_ssl_session);
+    g_ssl_session = sess; /* returning 1 keeps the reference */
+    pthread_mutex_unlock(&g_ssl_m);
+    return 1;
 }
 
 /* initialize SSL for client */
-static void ssl_init(void) {
+static int ssl_init(const char *host) {
+    if (g_ssl_ctx) return 1;
     SSL_library_init();
     SSL_load_error_strings();
     OpenSSL_add_all_algorithms();
+    g_ssl_ctx = SSL_CTX_new(TLS_client_method());
+    if (!g_ssl_ctx) return 0;
+    SSL_CTX_set_session_cache_mode(g_ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(g_ssl_ctx, ssl_new_session);
+    g_ssl_host = host;
+    return 1;
 }
 
-/* start tls on existing conn */
-static int conn_starttls(Conn *c) {
-    if (c->use_ssl) return 1;
-    ssl_init();
-    c->ctx = SSL_CTX_new(TLS_client_method());
-    if (!c->ctx) return 0;
-    c->ssl = SSL_new(c->ctx);
+static void ssl_cleanup(void) {
+    if (g_ssl_session) { SSL_SESSION_free(g_ssl_session); g_ssl_session = NULL; }
+    if (g_ssl_ctx) { SSL_CTX_free(g_ssl_ctx); g_ssl_ctx = NULL; }
+}
+
+/* TLS handshake on c->sock with the shared context, resuming if we can */
+/* SSL object for c's socket, offering the shared session for resumption */
+static int conn_tls_begin(Conn *c) {
+    if (!g_ssl_ctx) return 0;
+    c->ssl = SSL_new(g_ssl_ctx);
     if (!c->ssl) return 0;
     if (!SSL_set_fd(c->ssl, c->sock)) return 0;
+    if (g_ssl_host) SSL_set_tlsext_host_name(c->ssl, g_ssl_host);
+    pthread_mutex_lock(&g_ssl_m);
+    if (g_ssl_session) SSL_set_session(c->ssl, g_ssl_session);
+    pthread_mutex_unlock(&g_ssl_m);
+    return 1;
+}
+
+static void conn_tls_done(Conn *c) {
+    c->use_ssl = 1;
+    infof("TLS %s handshake (%s)", SSL_session_reused(c->ssl) ? "resumed" : "full", SSL_get_version(c->ssl));
+}
+
+static int conn_tls_connect(Conn *c) {
+    if (!conn_tls_begin(c)) return 0;
     if (SSL_connect(c->ssl) <= 0) {
         ERR_print_errors_fp(stderr);
         return 0;
     }
-    c->use_ssl = 1;
+    conn_tls_done(c);
     return 1;
 }
 
+/* start tls on existing conn */
+static int conn_starttls(Conn *c) {
+    if (c->use_ssl) return 1;
+    c->rpos = c->rlen = 0; /* nothing may be buffered across the TLS upgrade */
+    return conn_tls_connect(c);
+}
+
 /* DB abstraction: using declarations from src/db.h via export_html */
 
-/* Iteration helpers for article queries by group */
-static sqlite3_stmt *sqlite_q_stmt = NULL;
-int db_query_articles_begin(DB *db, const char *group_name){
+/* Iteration helpers for article queries by group. Rows are streamed:
+   MySQL through mysql_use_result(), Postgres in single-row mode, so an
+   export holds one row at a time however large the group is. */
+/* one iterator over a group in artnum order: the article columns, or just
+   artnum (keys), optionally only rows after artnum `after` and at most
+   `limit` of them (keyset pagination) */
+/* the query for group name placeholder g and the after/limit placeholders
+   (NULL when unused); returns its length like snprintf. v2 rows come back
+   with the author name and the date as text as in v1 (date_raw when kept,
+   else the epoch as YYYY-MM-DD HH:MM:SS UTC). With a crossposts table the
+   copies stored under another group are merged in by artnum; each side is
+   limited on its own so a keyset page stays an index range scan. */
+static size_t db_query_sql(const DB *db, int keys, const char *g, const char *after, const char *limit, char *out, size_t cap) {
+    size_t n = 0;
+#define PUT(...) do { int w_ = snprintf(out ? out + n : NULL, n < cap ? cap - n : 0, __VA_ARGS__); if (w_ > 0) n += (size_t)w_; } while (0)
+    int my = db->type == DB_MYSQL;
+    const char *rest = "subject, author, date", *mine = "group_name = ", *end = "", *copy = "x.group_name = c.group_name";
+    if (db->schema == 2) {
+        rest = !db->intern_authors ? "subject, author, " : my ? "subject, (SELECT name FROM `authors` WHERE id = author_id) AS author, " :
+               "subject, (SELECT name FROM authors WHERE id = author_id) AS author, ";
+        mine = my ? "group_id = (SELECT id FROM `groups` WHERE name = " : "group_id = (SELECT id FROM groups WHERE name = ";
+        end = ")";
+        copy = my ? "x.group_id = (SELECT id FROM `groups` WHERE name = c.group_name)" : "x.group_id = (SELECT id FROM groups WHERE name = c.group_name)";
+    }
+    const char *date = db->schema != 2 ? "" :
+                       db->type == DB_SQLITE ? "COALESCE(date_raw, strftime('%Y-%m-%d %H:%M:%S', date, 'unixepoch')) AS date" :
+                       my ? "COALESCE(date_raw, DATE_FORMAT(DATE_ADD('1970-01-01', INTERVAL date SECOND), '%Y-%m-%d %H:%i:%s')) AS date" :
+                       "COALESCE(date_raw, to_char(to_timestamp(date) AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS')) AS date";
+    if (!db->crossposts) {
+        PUT("SELECT artnum%s%s%s FROM articles WHERE ", keys ? "" : ", ", keys ? "" : rest, keys ? "" : date);
+        PUT("%s%s%s", mine, g, end);
+        if (after) PUT(" AND artnum > %s", after);
+        PUT(" ORDER BY artnum");
+        if (limit) PUT(" LIMIT %s", limit);
+        return n;
+    }
+    PUT("SELECT * FROM (SELECT * FROM (SELECT artnum%s%s%s FROM articles WHERE ", keys ? "" : ", ", keys ? "" : rest, keys ? "" : date);
+    PUT("%s%s%s", mine, g, end);
+    if (after) PUT(" AND artnum > %s", after);
+    if (limit) PUT(" ORDER BY artnum LIMIT %s", limit);
+    /* the copy's own placement wins if an older run stored it as well */
+    PUT(") t1 UNION ALL SELECT * FROM (SELECT c.artnum%s%s%s FROM crossposts c JOIN articles a ON a.id = "
+        "(SELECT MIN(id) FROM articles WHERE message_id = c.message_id) WHERE c.group_name = %s",
+        keys ? "" : ", ", keys ? "" : rest, keys ? "" : date, g);
+    if (after) PUT(" AND c.artnum > %s", after);
+    PUT(" AND NOT EXISTS (SELECT 1 FROM articles x WHERE %s AND x.artnum = c.artnum)", copy);
+    if (limit) PUT(" ORDER BY c.artnum LIMIT %s", limit);
+    PUT(") t2) t ORDER BY artnum");
+    if (limit) PUT(" LIMIT %s", limit);
+#undef PUT
+    return n;
+}
+
+static DB *db_route(DB *db, const char *group);
+
+static int db_query_begin(DB *db, int keys, const char *group_name, long long after, int limit){
+    db_query_articles_end(db);
+    if (db->nshards) {
+        db->q_shard = db_route(db, group_name);
+        return db_query_begin(db->q_shard, keys, group_name, after, limit);
+    }
+    db->q_keys = keys;
+    /* numbered placeholders: group, then after and limit when used */
+    const char *mark = db->type == DB_POSTGRES ? "$" : "?";
+    char ph[3][8], ab[24], lb[16];
+    for (int k = 0; k < 3; ++k) snprintf(ph[k], sizeof(ph[k]), "%s%d", mark, k + 1);
+    snprintf(ab, sizeof(ab), "%lld", after); snprintf(lb, sizeof(lb), "%d", limit);
+    const char *g = ph[0], *pa = after > 0 ? ph[1] : NULL, *pl = limit > 0 ? ph[after > 0 ? 2 : 1] : NULL;
+    char *esc = NULL;
+    if (db->type == DB_MYSQL) {
+        size_t gl = strlen(group_name);
+        esc = malloc(gl * 2 + 3);
+        if (!esc) return 0;
+        esc[0] = '\'';
+        unsigned long el = mysql_real_escape_string(db->mysql, esc + 1, group_name, (unsigned long)gl);
+        esc[el + 1] = '\''; esc[el + 2] = '\0';
+        g = esc; pa = after > 0 ? ab : NULL; pl = limit > 0 ? lb : NULL;
+    }
+    size_t need = db_query_sql(db, keys, g, pa, pl, NULL, 0) + 1;
+    char *sql = malloc(need);
+    if (!sql) { free(esc); return 0; }
+    db_query_sql(db, keys, g, pa, pl, sql, need);
+    free(esc);
+    int ok = 0;
     if (db->type == DB_SQLITE){
-        const char *sql = "SELECT artnum, subject, author, date FROM articles WHERE group_name = ? ORDER BY artnum";
-        if (sqlite_q_stmt) { sqlite3_finalize(sqlite_q_stmt); sqlite_q_stmt = NULL; }
-        if (sqlite3_prepare_v2(db->sqlite, sql, -1, &sqlite_q_stmt, NULL) != SQLITE_OK) return 0;
-        if (sqlite3_bind_text(sqlite_q_stmt, 1, group_name, -1, SQLITE_TRANSIENT) != SQLITE_OK) return 0;
-        return 1;
+        if (sqlite3_prepare_v2(db->sqlite, sql, -1, &db->q_stmt, NULL) != SQLITE_OK) warnf("sqlite query failed: %s", sqlite3_errmsg(db->sqlite));
+        else {
+            int k = 1;
+            ok = sqlite3_bind_text(db->q_stmt, k++, group_name, -1, SQLITE_TRANSIENT) == SQLITE_OK;
+            if (ok && after > 0) ok = sqlite3_bind_int64(db->q_stmt, k++, after) == SQLITE_OK;
+            if (ok && limit > 0) ok = sqlite3_bind_int(db->q_stmt, k++, limit) == SQLITE_OK;
+            if (!ok) db_query_articles_end(db);
+        }
     } else if (db->type == DB_MYSQL){
-        /* Use simple query; caller will fetch using mysql_use_result */
-        char esc[512]; mysql_real_escape_string(db->mysql, esc, group_name, (unsigned long)strlen(group_name));
-        char q[1024]; snprintf(q, sizeof(q), "SELECT artnum, subject, author, date FROM articles WHERE group_name='%s' ORDER BY artnum", esc);
-        if (mysql_query(db->mysql, q)) { warnf("mysql query failed: %s", mysql_error(db->mysql)); return 0; }
-        return 1;
+        if (mysql_query(db->mysql, sql)) warnf("mysql query failed: %s", mysql_error(db->mysql));
+        else if (!(db->q_res = mysql_use_result(db->mysql))) warnf("mysql_use_result failed: %s", mysql_error(db->mysql));
+        else ok = 1;
     }
-    return 0;
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl){
+        PGconn *pgc = (PGconn*)db->impl;
+        const char *pv[3] = { group_name, after > 0 ? ab : lb, lb };
+        int np = 1 + (after > 0) + (limit > 0);
+        if (!PQsendQueryParams(pgc, sql, np, NULL, pv, NULL, NULL, 0)) warnf("postgres query failed: %s", PQerrorMessage(pgc));
+        else {
+            db->q_pg_active = 1;
+            if (!PQsetSingleRowMode(pgc)) { warnf("postgres single-row mode failed"); db_query_articles_end(db); }
+            else ok = 1;
+        }
+    }
+#endif
+    free(sql);
+    return ok;
+}
+
+int db_query_articles_begin(DB *db, const char *group_name){
+    return db_query_begin(db, 0, group_name, 0, 0);
+}
+
+int db_query_articles_page_begin(DB *db, const char *group_name, long long after, int limit){
+    return db_query_begin(db, 0, group_name, after, limit);
+}
+
+int db_query_artnums_begin(DB *db, const char *group_name){
+    return db_query_begin(db, 1, group_name, 0, 0);
 }
 
 int db_query_articles_next(DB *db, DBRow *out){
+    if (db->q_shard) return db_query_articles_next(db->q_shard, out);
     if (db->type == DB_SQLITE){
-        int rc = sqlite3_step(sqlite_q_stmt);
-        if (rc != SQLITE_ROW) return 0;
-        out->artnum = sqlite3_column_int64(sqlite_q_stmt, 0);
-        out->subject = (const char*)sqlite3_column_text(sqlite_q_stmt, 1);
-        out->author  = (const char*)sqlite3_column_text(sqlite_q_stmt, 2);
-        out->date    = (const char*)sqlite3_column_text(sqlite_q_stmt, 3);
+        if (!db->q_stmt || sqlite3_step(db->q_stmt) != SQLITE_ROW) return 0;
+        out->artnum = sqlite3_column_int64(db->q_stmt, 0);
+        if (db->q_keys) return 1;
+        out->subject = (const char*)sqlite3_column_text(db->q_stmt, 1);
+        out->author  = (const char*)sqlite3_column_text(db->q_stmt, 2);
+        out->date    = (const char*)sqlite3_column_text(db->q_stmt, 3);
         return 1;
     } else if (db->type == DB_MYSQL){
-        static MYSQL_RES *res = NULL; static MYSQL_ROW row;
-        static int initialized = 0;
-        if (!initialized){ res = mysql_store_result(db->mysql); initialized = 1; }
-        if (!res) return 0;
-        row = mysql_fetch_row(res);
-        if (!row) return 0;
+        if (!db->q_res) return 0;
+        MYSQL_ROW row = mysql_fetch_row(db->q_res);
+        if (!row) {
+            if (mysql_errno(db->mysql)) warnf("mysql fetch failed: %s", mysql_error(db->mysql));
+            return 0;
+        }
         out->artnum = row[0] ? atoll(row[0]) : 0;
+        if (db->q_keys) return 1;
         out->subject = row[1]; out->author = row[2]; out->date = row[3];
         return 1;
     }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES){
+        PGconn *pgc = (PGconn*)db->impl;
+        if (db->q_pg) { PQclear((PGresult*)db->q_pg); db->q_pg = NULL; }
+        if (!db->q_pg_active) return 0;
+        PGresult *r = PQgetResult(pgc);
+        if (r && PQresultStatus(r) == PGRES_SINGLE_TUPLE) {
+            db->q_pg = r;
+            out->artnum = atoll(PQgetvalue(r, 0, 0));
+            if (!db->q_keys) { out->subject = PQgetvalue(r, 0, 1); out->author = PQgetvalue(r, 0, 2); out->date = PQgetvalue(r, 0, 3); }
+            return 1;
+        }
+        /* the zero-row PGRES_TUPLES_OK that ends the set, or an error */
+        if (r && PQresultStatus(r) != PGRES_TUPLES_OK) warnf("postgres query failed: %s", PQresultErrorMessage(r));
+        PQclear(r);
+        while ((r = PQgetResult(pgc)) != NULL) PQclear(r);
+        db->q_pg_active = 0;
+        return 0;
+    }
+#endif
     return 0;
 }
 
 void db_query_articles_end(DB *db){
-    if (db->type == DB_SQLITE){
-        if (sqlite_q_stmt) { sqlite3_finalize(sqlite_q_stmt); sqlite_q_stmt = NULL; }
-    } else if (db->type == DB_MYSQL){
-        MYSQL_RES *res = mysql_store_result(db->mysql); /* ensure drained */
-        if (res) mysql_free_result(res);
+    if (db->q_shard) { db_query_articles_end(db->q_shard); db->q_shard = NULL; }
+    if (db->q_stmt) { sqlite3_finalize(db->q_stmt); db->q_stmt = NULL; }
+    if (db->q_res) { mysql_free_result(db->q_res); db->q_res = NULL; } /* discards unread rows */
+#ifdef HAVE_PQ
+    if (db->q_pg) { PQclear((PGresult*)db->q_pg); db->q_pg = NULL; }
+    if (db->q_pg_active) {
+        /* stop the server sending the rest, then drain the connection */
+        PGconn *pgc = (PGconn*)db->impl;
+        PGcancel *cn = PQgetCancel(pgc);
+        char eb[256];
+        if (cn) { PQcancel(cn, eb, sizeof(eb)); PQfreeCancel(cn); }
+        PGresult *r;
+        while ((r = PQgetResult(pgc)) != NULL) PQclear(r);
+        db->q_pg_active = 0;
     }
+#endif
 }
 
+static void db_build_indexes(DB *db);
+
+static void db_shards_close(DB *db);
+
 void db_close(DB *db) {
     if (!db) return;
+    db_query_articles_end(db);
+    if (db->nshards) db_shards_close(db);
+    db_bulk_flush(db);
+    db_commit(db);
+    if (db->defer_indexes) db_build_indexes(db);
+    if (db->bulk.sqlite_stmt) sqlite3_finalize(db->bulk.sqlite_stmt);
+    free(db->bulk.rows); free(db->bulk.pool);
+    free(db->ranges);
     if (db->type == DB_SQLITE) {
         if (db->sqlite_insert_article) sqlite3_finalize(db->sqlite_insert_article);
         if (db->sqlite_insert_group) sqlite3_finalize(db->sqlite_insert_group);
         if (db->sqlite_article_ins) sqlite3_finalize(db->sqlite_article_ins);
         if (db->sqlite_group_ins) sqlite3_finalize(db->sqlite_group_ins);
+        if (db->sqlite_article_upsert) sqlite3_finalize(db->sqlite_article_upsert);
+        if (db->sqlite_group_upsert) sqlite3_finalize(db->sqlite_group_upsert);
+        if (db->sqlite_author_ins) sqlite3_finalize(db->sqlite_author_ins);
+        if (db->sqlite_crosspost_ins) sqlite3_finalize(db->sqlite_crosspost_ins);
+        /* copy what the WAL holds without waiting on readers such as the viewer */
+        if (g_sqlite_profile) sqlite3_wal_checkpoint_v2(db->sqlite, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
     } else if (db->type == DB_MYSQL) {
         if (db->mysql_insert_article) mysql_stmt_close(db->mysql_insert_article);
         if (db->mysql_article_ins) mysql_stmt_close(db->mysql_article_ins);
+        if (db->mysql_article_upsert) mysql_stmt_close(db->mysql_article_upsert);
     }
     if (db->sqlite) sqlite3_close(db->sqlite);
     if (db->mysql) mysql_close(db->mysql);
-    /* no postgres */
+#ifdef HAVE_PQ
+    if (db->type == DB_POSTGRES && db->impl) PQfinish((PGconn*)db->impl);
+#endif
     memset(db, 0, sizeof(*db));
 }
 
-static void db_exec(DB *db, const char *sql) {
-    if (db->type == DB_SQLITE) {
-        char *err = NULL;
-        if (sqlite3_exec(db->sqlite, sql, NULL, NULL, &err) != SQLITE_OK) {
-            warnf("sqlite exec error: %s", err ? err : "unknown");
-            if (err) sqlite3_free(err);
-        }
-    } else if (db->type == DB_MYSQL) {
-        if (mysql_query(db->mysql, sql)) {
-            warnf("mysql exec error: %s", mysql_error(db->mysql));
+/* days since 1970-01-01 of a proleptic Gregorian date */
+static long long days_from_civil(long long y, int m, int d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+/* Date: header -> seconds since the epoch, UTC. Takes RFC 5322 dates and
+   their obsolete forms (no weekday, two-digit years, named zones) as well
+   as the asctime() layout some old servers produce. 0 when no date and time
+   can be made out; timezone comments like "(UTC)" are skipped. */
+static int news_date_epoch(const char *s, size_t n, long long *out) {
+    static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+    static const struct { const char *name; int hours; } zones[] = {
+        { "gmt", 0 }, { "ut", 0 }, { "utc", 0 }, { "z", 0 }, { "est", -5 }, { "edt", -4 }, { "cst", -6 },
+        { "cdt", -5 }, { "mst", -7 }, { "mdt", -6 }, { "pst", -8 }, { "pdt", -7 }
+    };
+    int day = -1, mon = -1, hh = -1, mi = 0, ss = 0, off = 0;
+    long long year = -1;
+    const char *p = s, *e = s + n;
+    while (p < e) {
+        while (p < e && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char *t = p;
+        while (p < e && *p != ' ' && *p != '\t' && *p != ',') p++;
+        size_t tl = (size_t)(p - t);
+        if (tl == 0) break;
+        if (isdigit((unsigned char)t[0]) && memchr(t, ':', tl)) {
+            int f[3] = { 0, 0, 0 }, k = 0;
+            for (const char *q = t; q < p && k < 3; q++) {
+                if (*q == ':') k++;
+                else if (isdigit((unsigned char)*q)) f[k] = f[k] * 10 + (*q - '0');
+                else break;
+            }
+            hh = f[0]; mi = f[1]; ss = f[2];
+        } else if (isdigit((unsigned char)t[0])) {
+            long long v = 0;
+            size_t k = 0;
+            for (; k < tl && isdigit((unsigned char)t[k]); k++) v = v * 10 + (t[k] - '0');
+            if (k < tl) continue;
+            if (tl <= 2 && day < 0) day = (int)v;
+            else if (year < 0) year = tl >= 4 ? v : tl == 3 ? v + 1900 : v < 50 ? v + 2000 : v + 1900;
+        } else if ((t[0] == '+' || t[0] == '-') && tl == 5 && isdigit((unsigned char)t[1])) {
+            int v = atoi(t + 1);
+            off = (v / 100) * 3600 + (v % 100) * 60;
+            if (t[0] == '-') off = -off;
+        } else if (isalpha((unsigned char)t[0])) {
+            char w[4] = { 0, 0, 0, 0 };
+            for (size_t k = 0; k < 3 && k < tl; k++) w[k] = (char)tolower((unsigned char)t[k]);
+            const char *m = tl >= 3 ? strstr(months, w) : NULL;
+            if (m && mon < 0 && (m - months) % 3 == 0) { mon = (int)(m - months) / 3 + 1; continue; }
+            for (size_t z = 0; z < sizeof(zones) / sizeof(zones[0]); z++)
+                if (tl == strlen(zones[z].name) && strncasecmp(t, zones[z].name, tl) == 0) off = zones[z].hours * 3600;
         }
     }
+    if (day < 1 || day > 31 || mon < 1 || year < 0 || hh < 0 || hh > 23 || mi > 59 || ss > 60) return 0;
+    *out = days_from_civil(year, mon, day) * 86400 + hh * 3600 + mi * 60 + ss - off;
+    return 1;
 }
 
-/* Basic escaping for SQL insertion; for production use prepared statements. */
-char *db_escape(DB *db, const char *s) {
-    if (!s) return strdup("");
+/* 1 if sql runs against this database; used to look for tables and columns */
+static int db_probe(DB *db, const char *sql) {
     if (db->type == DB_SQLITE) {
-        /* simple safe allocator: replace single quote with two single quotes */
-        size_t n = strlen(s);
-        size_t cap = n * 2 + 3;
-        char *out = malloc(cap);
-        char *p = out;
-        *p++ = '\'';
-        for (; *s; s++) {
-            if (*s == '\'') { *p++ = '\''; *p++ = '\''; }
-            else *p++ = *s;
-        }
-        *p++ = '\'';
-        *p++ = '\0';
-        return out;
+        sqlite3_stmt *st = NULL;
+        int ok = sqlite3_prepare_v2(db->sqlite, sql, -1, &st, NULL) == SQLITE_OK;
+        sqlite3_finalize(st);
+        return ok;
     } else if (db->type == DB_MYSQL) {
-        unsigned long len = (unsigned long)strlen(s);
-        char *buf = malloc(len*2 + 3);
+        if (mysql_query(db->mysql, sql)) return 0;
+        MYSQL_RES *r = mysql_store_result(db->mysql);
+        if (r) mysql_free_result(r);
+        return 1;
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGresult *r = PQexec((PGconn*)db->impl, sql);
+        int ok = PQresultStatus(r) == PGRES_TUPLES_OK;
+        PQclear(r);
+        return ok;
+    }
+#endif
+    return 0;
+}
+
+static void db_detect_layout(DB *db) {
+    db->schema = db_probe(db, "SELECT group_id FROM articles LIMIT 0") ? 2 :
+                 db_probe(db, "SELECT group_name FROM articles LIMIT 0") ? 1 : 0;
+    db->intern_authors = db->schema == 2 && db_probe(db, "SELECT author_id FROM articles LIMIT 0");
+    db->crossposts = db_probe(db, "SELECT artnum FROM crossposts LIMIT 0");
+}
+
+/* --sqlite-profile, per connection before any table exists: bulk trades
+   durability for load speed (a power loss mid-load can corrupt the file), online
+   keeps every commit safe. Both use WAL so readers never block the writer. */
+static void db_sqlite_profile(DB *db) {
+    if (g_sqlite_profile == SQLITE_PROFILE_DEFAULT) return;
+    int bulk = g_sqlite_profile == SQLITE_PROFILE_BULK;
+    char sql[384], *err = NULL;
+    snprintf(sql, sizeof(sql),
+        "PRAGMA page_size=%d; PRAGMA journal_mode=WAL; PRAGMA synchronous=%s; PRAGMA cache_size=%d; "
+        "PRAGMA mmap_size=%lld; PRAGMA temp_store=MEMORY; PRAGMA wal_autocheckpoint=%d;",
+        bulk ? 8192 : 4096, bulk ? "OFF" : "NORMAL", bulk ? -262144 : -65536, bulk ? 1LL << 30 : 256LL << 20,
+        g_sqlite_checkpoint >= 0 ? g_sqlite_checkpoint : bulk ? 10000 : 1000);
+    if (sqlite3_exec(db->sqlite, sql, NULL, NULL, &err) != SQLITE_OK) {
+        warnf("sqlite profile %s: %s", sqlite_profile_names[g_sqlite_profile], err ? err : "unknown");
+        sqlite3_free(err);
+    }
+    sqlite3_busy_timeout(db->sqlite, 5000);
+}
+
+static int db_shards_open(DB *db);
+
+/* connect to the database cf names; 0 (after a warning) on failure */
+int db_open(DB *db, const DBConf *cf) {
+    memset(db, 0, sizeof(*db));
+    db->type = cf->type;
+    db->conf = cf;
+    if (db->type == DB_SQLITE) {
+        if (sqlite3_open(cf->name, &db->sqlite) != SQLITE_OK) {
+            warnf("sqlite open failed: %s", sqlite3_errmsg(db->sqlite));
+            sqlite3_close(db->sqlite); db->sqlite = NULL;
+            return 0;
+        }
+        db_sqlite_profile(db);
+        db_detect_layout(db);
+        /* a sharded database: this file is the manifest */
+        if (db_probe(db, "SELECT path FROM shards LIMIT 0")) return db_shards_open(db);
+        return 1;
+    } else if (db->type == DB_MYSQL) {
+        db->mysql = mysql_init(NULL);
+        if (!db->mysql) { warnf("mysql_init failed"); return 0; }
+        if (!mysql_real_connect(db->mysql, cf->host ? cf->host : "localhost", cf->user ? cf->user : "root",
+                                cf->pass ? cf->pass : "", cf->name, cf->port ? atoi(cf->port) : 3306, NULL, 0)) {
+            warnf("mysql connect failed: %s", mysql_error(db->mysql));
+            mysql_close(db->mysql); db->mysql = NULL;
+            return 0;
+        }
+        db_detect_layout(db);
+        return 1;
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES) {
+        char conninfo[512];
+        snprintf(conninfo, sizeof(conninfo), "host=%s port=%s dbname=%s user=%s password=%s",
+                 cf->host ? cf->host : "localhost",
+                 cf->port ? cf->port : "5432",
+                 cf->name ? cf->name : "postgres",
+                 cf->user ? cf->user : "postgres",
+                 cf->pass ? cf->pass : "");
+        PGconn *pgc = PQconnectdb(conninfo);
+        if (PQstatus(pgc) != CONNECTION_OK) { warnf("postgres connect failed: %s", PQerrorMessage(pgc)); PQfinish(pgc); return 0; }
+        db->impl = pgc;
+        db_detect_layout(db);
+        return 1;
+    }
+#endif
+    warnf("PostgreSQL support not built in");
+    return 0;
+}
+
+static int db_exec(DB *db, const char *sql) {
+    if (db->type == DB_SQLITE) {
+        char *err = NULL;
+        if (sqlite3_exec(db->sqlite, sql, NULL, NULL, &err) != SQLITE_OK) {
+            warnf("sqlite exec error: %s", err ? err : "unknown");
+            if (err) sqlite3_free(err);
+            return -1;
+        }
+    } else if (db->type == DB_MYSQL) {
+        if (mysql_query(db->mysql, sql)) {
+            warnf("mysql exec error: %s", mysql_error(db->mysql));
+            return -1;
+        }
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGresult *r = PQexec((PGconn*)db->impl, sql);
+        int ok = PQresultStatus(r) == PGRES_COMMAND_OK || PQresultStatus(r) == PGRES_TUPLES_OK;
+        if (!ok) warnf("postgres exec error: %s", PQerrorMessage((PGconn*)db->impl));
+        PQclear(r);
+        if (!ok) return -1;
+    }
+#endif
+    return 0;
+}
+
+/* Postgres aborts the whole transaction on its first failed statement, so a
+   batch keeps the savepoint "row" behind the last row that was stored: a
+   failure rolls back to it and loses only the writes since. Returns -1 when
+   it did, 0 when the savepoint moved forward (or nothing is needed). */
+static int db_pg_row_end(DB *db) {
+#ifdef HAVE_PQ
+    if (db->type != DB_POSTGRES || !db->in_txn || !db->impl) return 0;
+    if (PQtransactionStatus((PGconn*)db->impl) == PQTRANS_INERROR) {
+        db_exec(db, "ROLLBACK TO SAVEPOINT row");
+        db->bulk.pg_staged = 0; /* the stage table may have been created since */
+        return -1;
+    }
+    db_exec(db, "RELEASE SAVEPOINT row; SAVEPOINT row");
+#else
+    (void)db;
+#endif
+    return 0;
+}
+
+/* Transaction batching: with batch_size > 0, article writes are grouped into
+   one transaction that commits every batch_size rows or batch_ms milliseconds. */
+void db_begin(DB *db) {
+    for (int k = 0; k < db->nshards; ++k) db_begin(&db->shard[k]);
+    if (db->nshards || db->in_txn) return;
+    db_exec(db, db->type == DB_SQLITE ? "BEGIN" : "START TRANSACTION");
+    if (db->type == DB_POSTGRES) db_exec(db, "SAVEPOINT row");
+    db->in_txn = 1;
+    db->batch_pending = 0;
+    db->batch_started_ms = now_ms();
+}
+
+static void db_write_ranges(DB *db);
+static void db_write_high_water(DB *db);
+
+void db_commit(DB *db) {
+    for (int k = 0; k < db->nshards; ++k) db_commit(&db->shard[k]);
+    if (!db->in_txn) return;
+    long long t0 = stat_t0();
+    db_bulk_flush(db);
+    if (db_pg_row_end(db) < 0) db->writes_failed++;
+    db_write_ranges(db); /* same transaction as the rows they cover */
+    db_write_high_water(db);
+    /* a mark that failed to write only means a refetch, not the batch */
+    if (db_pg_row_end(db) < 0) warnf("postgres: fetch marks of this batch not stored");
+    db_exec(db, "COMMIT");
+    stat_lat(LAT_DB_COMMIT, t0);
+    infof("committed batch of %d rows", db->batch_pending);
+    db->in_txn = 0;
+    db->batch_pending = 0;
+}
+
+/* commit an open batch that has been open for longer than batch_ms */
+static void db_batch_tick(DB *db) {
+    for (int k = 0; k < db->nshards; ++k) db_batch_tick(&db->shard[k]);
+    if (db->in_txn && db->batch_ms > 0 && now_ms() - db->batch_started_ms >= db->batch_ms) db_commit(db);
+}
+
+static void db_batch_row_done(DB *db) {
+    if (!db->in_txn) return;
+    db->batch_pending++;
+    if (db->batch_pending >= db->batch_size) db_commit(db);
+    else db_batch_tick(db);
+}
+
+/* Basic escaping for SQL insertion; for production use prepared statements. */
+char *db_escape(DB *db, const char *s) {
+    if (!s) return strdup("");
+    if (db->type == DB_SQLITE) {
+        /* simple safe allocator: replace single quote with two single quotes */
+        size_t n = strlen(s);
+        size_t cap = n * 2 + 3;
+        char *out = malloc(cap);
+        char *p = out;
+        *p++ = '\'';
+        for (; *s; s++) {
+            if (*s == '\'') { *p++ = '\''; *p++ = '\''; }
+            else *p++ = *s;
+        }
+        *p++ = '\'';
+        *p++ = '\0';
+        return out;
+    } else if (db->type == DB_MYSQL) {
+        unsigned long len = (unsigned long)strlen(s);
+        char *buf = malloc(len*2 + 3);
         mysql_real_escape_string(db->mysql, buf, s, len);
         /* wrap in quotes */
         char *out = malloc(strlen(buf) + 3);
@@ -377,28 +1484,273 @@ char *db_escape(DB *db, const char *s) {
         free(buf);
         return out;
     }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        char *lit = PQescapeLiteral((PGconn*)db->impl, s, strlen(s));
+        char *out = strdup(lit ? lit : "''");
+        PQfreemem(lit);
+        return out;
+    }
+#endif
     return strdup("''");
 }
 
+/* Schema v2 (--schema-v2, or --migrate-schema for an existing database):
+   articles carry group_id into groups instead of the group name, the date
+   as an epoch integer with an index on (group_id, date), the Date: text only
+   with --keep-date-text (date_raw), and with --intern-authors an author_id
+   into authors in place of the author text. Writers still bind the group
+   and author by name; the statements look the keys up. */
+enum { V2_INSERT, V2_UPSERT, V2_UPDATE };
+
+/* the expression that stores the group (author = 0) or author key for a
+   name bound at placeholder ph */
+static const char *v2_key(const DB *db, int author, const char *ph, char *buf, size_t n) {
+    if (author && !db->intern_authors) snprintf(buf, n, "%s", ph);
+    else if (author) snprintf(buf, n, db->type == DB_MYSQL ? "(SELECT id FROM `authors` WHERE name=LEFT(%s,255))" : "(SELECT id FROM authors WHERE name=%s)", ph);
+    else snprintf(buf, n, db->type == DB_MYSQL ? "(SELECT id FROM `groups` WHERE name=%s)" : "(SELECT id FROM groups WHERE name=%s)", ph);
+    return buf;
+}
+
+/* the clause that resolves a duplicate (group_id, artnum): update with
+   --upsert, otherwise keep the stored row (MySQL: the caller says IGNORE) */
+static void v2_conflict_sql(const DB *db, int upsert, char *out, size_t n) {
+    const char *a = db->intern_authors ? "author_id" : "author";
+    if (db->type == DB_MYSQL)
+        snprintf(out, n, !upsert ? " ON DUPLICATE KEY UPDATE artnum=artnum" : " ON DUPLICATE KEY UPDATE subject=VALUES(subject), %s=VALUES(%s), date_raw=VALUES(date_raw), "
+                 "message_id=VALUES(message_id), refs=VALUES(refs), bytes=VALUES(bytes), line_count=VALUES(line_count), date=VALUES(date)", a, a);
+    else if (upsert)
+        snprintf(out, n, " ON CONFLICT (group_id, artnum) DO UPDATE SET subject=excluded.subject, %s=excluded.%s, date_raw=excluded.date_raw, "
+                 "message_id=excluded.message_id, refs=excluded.refs, bytes=excluded.bytes, line_count=excluded.line_count, date=excluded.date", a, a);
+    else snprintf(out, n, " ON CONFLICT (group_id, artnum) DO NOTHING");
+}
+
+/* Single-row v2 statements. Parameters keep the v1 order (the UPDATE's
+   subject..line_count, group, artnum; the INSERT's artnum..line_count,
+   group) with the epoch appended as number 10, so binding code is shared.
+   MySQL placeholders are positional: its UPDATE takes the epoch before
+   the group. */
+static void v2_article_sql(const DB *db, int kind, char *out, size_t n) {
+    char ph[11][8], akey[96], gkey[96], conflict[512];
+    for (int k = 1; k <= 10; ++k) {
+        if (db->type == DB_MYSQL) snprintf(ph[k], sizeof(ph[k]), "?");
+        else snprintf(ph[k], sizeof(ph[k]), "%s%d", db->type == DB_POSTGRES ? "$" : "?", k);
+    }
+    const char *acol = db->intern_authors ? "author_id" : "author";
+    const char *tbl = db->type == DB_MYSQL ? "`articles`" : "articles";
+    if (kind == V2_UPDATE) {
+        snprintf(out, n, "UPDATE %s SET subject=%s, %s=%s, date_raw=%s, message_id=%s, refs=%s, bytes=%s, line_count=%s, date=%s WHERE group_id=%s AND artnum=%s",
+                 tbl, ph[1], acol, v2_key(db, 1, ph[2], akey, sizeof(akey)), ph[3], ph[4], ph[5], ph[6], ph[7], ph[10],
+                 v2_key(db, 0, ph[8], gkey, sizeof(gkey)), ph[9]);
+        return;
+    }
+    v2_conflict_sql(db, 1, conflict, sizeof(conflict));
+    snprintf(out, n, "INSERT INTO %s (artnum, subject, %s, date_raw, message_id, refs, bytes, line_count, group_id, date) VALUES (%s,%s,%s,%s,%s,%s,%s,%s,%s,%s)%s",
+             tbl, acol, ph[1], ph[2], v2_key(db, 1, ph[3], akey, sizeof(akey)), ph[4], ph[5], ph[6], ph[7], ph[8],
+             v2_key(db, 0, ph[9], gkey, sizeof(gkey)), ph[10], kind == V2_UPSERT ? conflict : "");
+}
+
 /* Create tables */
+/* Full-text search over subject and author for the viewer. SQLite keeps an
+   external-content FTS5 table in step with articles through triggers, so
+   every insert path (prepared, bulk, upsert) updates it; MySQL has an InnoDB
+   FULLTEXT index and Postgres a GIN expression index, both maintained by
+   the server. Creating the index on an existing database indexes its
+   current rows once. With --intern-authors the SQLite index reads the
+   articles_text view and the server indexes cover authors.name apart,
+   with an articles(author_id) index to get from a matched name to its rows.
+   The viewer repeats these expressions exactly (gui/viewer.c). */
+#define PG_FTS_DOC "to_tsvector('simple', coalesce(subject,'') || ' ' || coalesce(author,''))"
+#define PG_FTS_SUBJECT "to_tsvector('simple', coalesce(subject,''))"
+#define PG_FTS_NAME "to_tsvector('simple', name)"
+
+static void db_init_fts(DB *db) {
+    if (db->type == DB_SQLITE) {
+        sqlite3_stmt *probe = NULL;
+        int exists = 0;
+        if (sqlite3_prepare_v2(db->sqlite, "SELECT 1 FROM sqlite_master WHERE name='articles_fts'", -1, &probe, NULL) == SQLITE_OK)
+            exists = sqlite3_step(probe) == SQLITE_ROW;
+        sqlite3_finalize(probe);
+        if (exists) return;
+        char *err = NULL;
+        if (db->intern_authors)
+            db_exec(db, "CREATE VIEW IF NOT EXISTS articles_text AS SELECT a.id AS id, a.subject AS subject, au.name AS author "
+                        "FROM articles a LEFT JOIN authors au ON au.id = a.author_id");
+        if (sqlite3_exec(db->sqlite, db->intern_authors ?
+                         "CREATE VIRTUAL TABLE articles_fts USING fts5(subject, author, content='articles_text', content_rowid='id')" :
+                         "CREATE VIRTUAL TABLE articles_fts USING fts5(subject, author, content='articles', content_rowid='id')",
+                         NULL, NULL, &err) != SQLITE_OK) {
+            infof("sqlite FTS5 unavailable, viewer search falls back to LIKE: %s", err ? err : "unknown");
+            sqlite3_free(err);
+            return;
+        }
+        const char *na = db->intern_authors ? "(SELECT name FROM authors WHERE id = new.author_id)" : "new.author";
+        const char *oa = db->intern_authors ? "(SELECT name FROM authors WHERE id = old.author_id)" : "old.author";
+        char sql[1536];
+        snprintf(sql, sizeof(sql),
+            "CREATE TRIGGER IF NOT EXISTS articles_fts_ai AFTER INSERT ON articles BEGIN "
+            "INSERT INTO articles_fts(rowid, subject, author) VALUES (new.id, new.subject, %s); END;"
+            "CREATE TRIGGER IF NOT EXISTS articles_fts_ad AFTER DELETE ON articles BEGIN "
+            "INSERT INTO articles_fts(articles_fts, rowid, subject, author) VALUES ('delete', old.id, old.subject, %s); END;"
+            "CREATE TRIGGER IF NOT EXISTS articles_fts_au AFTER UPDATE OF subject, %s ON articles BEGIN "
+            "INSERT INTO articles_fts(articles_fts, rowid, subject, author) VALUES ('delete', old.id, old.subject, %s); "
+            "INSERT INTO articles_fts(rowid, subject, author) VALUES (new.id, new.subject, %s); END;",
+            na, oa, db->intern_authors ? "author_id" : "author", oa, na);
+        db_exec(db, sql);
+        infof("sqlite: building the full-text index");
+        db_exec(db, "INSERT INTO articles_fts(articles_fts) VALUES ('rebuild')");
+    } else if (db->type == DB_MYSQL) {
+        if (mysql_query(db->mysql, db->intern_authors ?
+                        "ALTER TABLE `articles` ADD FULLTEXT INDEX `ft_articles_text` (`subject`);" :
+                        "ALTER TABLE `articles` ADD FULLTEXT INDEX `ft_articles_text` (`subject`, `author`);")) {
+            /* duplicate key name on existing tables -> non-fatal */
+            const char *err = mysql_error(db->mysql);
+            if (err && *err) infof("mysql fulltext index note: %s", err);
+        }
+        if (db->intern_authors && mysql_query(db->mysql, "ALTER TABLE `authors` ADD FULLTEXT INDEX `ft_authors_name` (`name`);")) {
+            const char *err = mysql_error(db->mysql);
+            if (err && *err) infof("mysql fulltext index note: %s", err);
+        }
+        /* the viewer goes from the authors a name matched to their articles */
+        if (db->intern_authors && mysql_query(db->mysql, "ALTER TABLE `articles` ADD INDEX `idx_articles_author` (`author_id`);")) {
+            const char *err = mysql_error(db->mysql);
+            if (err && *err) infof("mysql author index note: %s", err);
+        }
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGresult *r = PQexec((PGconn*)db->impl, db->intern_authors ?
+            "CREATE INDEX IF NOT EXISTS idx_articles_fts ON articles USING GIN (" PG_FTS_SUBJECT ");"
+            "CREATE INDEX IF NOT EXISTS idx_authors_fts ON authors USING GIN (" PG_FTS_NAME ");"
+            "CREATE INDEX IF NOT EXISTS idx_articles_author ON articles (author_id);" :
+            "CREATE INDEX IF NOT EXISTS idx_articles_fts ON articles USING GIN (" PG_FTS_DOC ");");
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres fulltext index error: %s", PQerrorMessage((PGconn*)db->impl));
+        PQclear(r);
+    }
+#endif
+}
+
+static void db_migrate_begin(DB *db);
+static void db_migrate_copy(DB *db);
+
+/* --dedup: an article crossposted to several groups is stored once, under the
+   first group it is seen in; every other group:artnum it has is a crossposts
+   row naming its Message-ID. The reader merges those back into each group. */
+static void db_init_crossposts(DB *db) {
+    if (db->type == DB_SQLITE) {
+        db_exec(db, "CREATE TABLE IF NOT EXISTS crossposts (group_name TEXT, artnum INTEGER, message_id TEXT, PRIMARY KEY (group_name, artnum));");
+        if (!db->defer_indexes) db_exec(db, "CREATE INDEX IF NOT EXISTS idx_articles_message_id ON articles(message_id);");
+        if (sqlite3_prepare_v2(db->sqlite, "INSERT OR IGNORE INTO crossposts (group_name, artnum, message_id) VALUES (?,?,?)",
+                               -1, &db->sqlite_crosspost_ins, NULL) != SQLITE_OK)
+            warnf("sqlite prepare crosspost-insert failed: %s", sqlite3_errmsg(db->sqlite));
+    } else if (db->type == DB_MYSQL) {
+        if (mysql_query(db->mysql, "CREATE TABLE IF NOT EXISTS `crossposts` (`group_name` VARCHAR(255), `artnum` INT, `message_id` TEXT, "
+                                   "PRIMARY KEY (`group_name`,`artnum`)) ENGINE=InnoDB;"))
+            fatal(ERR_DB_SCHEMA, "mysql schema error (crossposts): %s", mysql_error(db->mysql));
+        if (mysql_query(db->mysql, "ALTER TABLE `articles` ADD KEY `idx_articles_message_id` (`message_id`(191));"))
+            infof("mysql index add note: %s", mysql_error(db->mysql)); /* exists already */
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        db_exec(db, "CREATE TABLE IF NOT EXISTS crossposts (group_name TEXT, artnum INT, message_id TEXT, PRIMARY KEY (group_name, artnum));"
+                    "CREATE INDEX IF NOT EXISTS idx_articles_message_id ON articles(message_id);");
+    }
+#endif
+    db->crossposts = 1;
+}
+
+/* the resume journal: article ranges finished above groups.high_water */
+static void db_init_journal(DB *db) {
+    if (db->type == DB_SQLITE) {
+        db_exec(db, "CREATE TABLE IF NOT EXISTS fetched_ranges (group_name TEXT, lo INTEGER, hi INTEGER, PRIMARY KEY (group_name, lo));");
+    } else if (db->type == DB_MYSQL) {
+        if (mysql_query(db->mysql, "CREATE TABLE IF NOT EXISTS `fetched_ranges` (`group_name` VARCHAR(255), `lo` INT, `hi` INT, "
+                                   "PRIMARY KEY (`group_name`,`lo`)) ENGINE=InnoDB;"))
+            fatal(ERR_DB_SCHEMA, "mysql schema error (fetched_ranges): %s", mysql_error(db->mysql));
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        db_exec(db, "CREATE TABLE IF NOT EXISTS fetched_ranges (group_name TEXT, lo INT, hi INT, PRIMARY KEY (group_name, lo));");
+    }
+#endif
+}
+
+static void db_shards_create(DB *db);
+static void db_shards_init(DB *db);
+
+#ifdef HAVE_PQ
+/* --shards: the hash partitions of a partitioned Postgres articles table */
+static void pg_partitions(PGconn *pgc, int parts) {
+    for (int k = 0; k < parts; ++k) {
+        char sql[160];
+        snprintf(sql, sizeof(sql), "CREATE TABLE IF NOT EXISTS articles_p%d PARTITION OF articles FOR VALUES WITH (MODULUS %d, REMAINDER %d)", k, parts, k);
+        PGresult *r = PQexec(pgc, sql);
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres schema error (articles_p%d): %s", k, PQerrorMessage(pgc));
+        PQclear(r);
+    }
+}
+#endif
+
 void db_init_schema(DB *db) {
     /* Note: MySQL reserves GROUPS, REFERENCES, LINES. Avoid reserved words: use article_count, refs, line_count. Quote MySQL identifiers. */
+    if (g_shards && !db->nshards && !db->is_shard && db->type == DB_SQLITE) db_shards_create(db);
+    if (db->nshards && db->type == DB_SQLITE) {
+        /* a manifest: the tables are in the shards */
+        if (g_shards && g_shards != db->nshards) warnf("%s has %d shards; --shards %d ignored", db->conf->name, db->nshards, g_shards);
+        db_shards_init(db);
+        return;
+    }
+    int migrate = db->schema == 1 && g_migrate_schema;
+    /* bulk profile: a database loaded from scratch gets its secondary indexes at the end */
+    db->defer_indexes = db->type == DB_SQLITE && g_sqlite_profile == SQLITE_PROFILE_BULK && (db->schema == 0 || migrate);
+    if (migrate) db_migrate_begin(db);
+    else if (db->schema == 1 && (g_schema_v2 || g_intern_authors))
+        infof("database has the v1 articles layout; --migrate-schema converts it");
+    /* --shards on MySQL/Postgres: a new articles table is partitioned by group */
+    int part = db->schema == 0 && g_shards > 1 && !db->is_shard ? g_shards : 0;
+    if (db->schema == 0) {
+        db->schema = g_schema_v2 || g_intern_authors || migrate ? 2 : 1;
+        db->intern_authors = db->schema == 2 && g_intern_authors;
+    }
+    int v2 = db->schema == 2;
+    char v2sql[3][1024];
+    if (v2) for (int k = V2_INSERT; k <= V2_UPDATE; ++k) v2_article_sql(db, k, v2sql[k], sizeof(v2sql[k]));
+    char sql[1024];
     if (db->type == DB_SQLITE) {
         db_exec(db,
-            "CREATE TABLE IF NOT EXISTS groups (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT UNIQUE, article_count INTEGER, first INTEGER, last INTEGER);"
-        );
-        db_exec(db,
-            "CREATE TABLE IF NOT EXISTS articles (id INTEGER PRIMARY KEY AUTOINCREMENT, artnum INTEGER, subject TEXT, author TEXT, date TEXT, message_id TEXT, refs TEXT, bytes INTEGER, line_count INTEGER, group_name TEXT);"
+            "CREATE TABLE IF NOT EXISTS groups (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT UNIQUE, article_count INTEGER, first INTEGER, last INTEGER, high_water INTEGER DEFAULT 0);"
         );
-        db_exec(db,
-            "CREATE UNIQUE INDEX IF NOT EXISTS idx_articles_group_artnum ON articles(group_name, artnum);"
-        );
-        if (sqlite3_prepare_v2(db->sqlite,
+        /* databases created before high_water existed */
+        sqlite3_stmt *probe = NULL;
+        if (sqlite3_prepare_v2(db->sqlite, "SELECT high_water FROM groups LIMIT 0", -1, &probe, NULL) != SQLITE_OK) {
+            db_exec(db, "ALTER TABLE groups ADD COLUMN high_water INTEGER DEFAULT 0");
+        }
+        sqlite3_finalize(probe);
+        if (v2) {
+            if (db->intern_authors) db_exec(db, "CREATE TABLE IF NOT EXISTS authors (id INTEGER PRIMARY KEY, name TEXT UNIQUE);");
+            snprintf(sql, sizeof(sql),
+                "CREATE TABLE IF NOT EXISTS articles (id INTEGER PRIMARY KEY AUTOINCREMENT, group_id INTEGER NOT NULL REFERENCES groups(id), artnum INTEGER, date INTEGER, "
+                "subject TEXT, %s, message_id TEXT, refs TEXT, bytes INTEGER, line_count INTEGER, date_raw TEXT);"
+                "CREATE UNIQUE INDEX IF NOT EXISTS idx_articles_group_artnum ON articles(group_id, artnum);%s",
+                db->intern_authors ? "author_id INTEGER REFERENCES authors(id)" : "author TEXT",
+                db->defer_indexes ? "" : "CREATE INDEX IF NOT EXISTS idx_articles_group_date ON articles(group_id, date);");
+            db_exec(db, sql);
+            if (db->intern_authors && sqlite3_prepare_v2(db->sqlite, "INSERT OR IGNORE INTO authors (name) VALUES (?)", -1, &db->sqlite_author_ins, NULL) != SQLITE_OK)
+                warnf("sqlite prepare author-insert failed: %s", sqlite3_errmsg(db->sqlite));
+        } else {
+            db_exec(db,
+                "CREATE TABLE IF NOT EXISTS articles (id INTEGER PRIMARY KEY AUTOINCREMENT, artnum INTEGER, subject TEXT, author TEXT, date TEXT, message_id TEXT, refs TEXT, bytes INTEGER, line_count INTEGER, group_name TEXT);"
+            );
+            db_exec(db,
+                "CREATE UNIQUE INDEX IF NOT EXISTS idx_articles_group_artnum ON articles(group_name, artnum);"
+            );
+        }
+        if (sqlite3_prepare_v2(db->sqlite, v2 ? v2sql[V2_UPDATE] :
             "UPDATE articles SET subject=?, author=?, date=?, message_id=?, refs=?, bytes=?, line_count=? WHERE group_name=? AND artnum=?",
             -1, &db->sqlite_insert_article, NULL) != SQLITE_OK) {
             warnf("sqlite prepare article-update failed: %s", sqlite3_errmsg(db->sqlite));
         }
-        if (sqlite3_prepare_v2(db->sqlite,
+        if (sqlite3_prepare_v2(db->sqlite, v2 ? v2sql[V2_INSERT] :
             "INSERT INTO articles (artnum, subject, author, date, message_id, refs, bytes, line_count, group_name) VALUES (?,?,?,?,?,?,?,?,?)",
             -1, &db->sqlite_article_ins, NULL) != SQLITE_OK) {
             warnf("sqlite prepare article-insert failed: %s", sqlite3_errmsg(db->sqlite));
@@ -420,35 +1772,81 @@ void db_init_schema(DB *db) {
             -1, &db->sqlite_group_ins, NULL) != SQLITE_OK) {
             warnf("sqlite prepare group-insert failed: %s", sqlite3_errmsg(db->sqlite));
         }
+        /* native upserts need SQLite >= 3.24; without them we keep update-then-insert */
+        if (sqlite3_prepare_v2(db->sqlite, v2 ? v2sql[V2_UPSERT] :
+            "INSERT INTO articles (artnum, subject, author, date, message_id, refs, bytes, line_count, group_name) VALUES (?,?,?,?,?,?,?,?,?) "
+            "ON CONFLICT(group_name, artnum) DO UPDATE SET subject=excluded.subject, author=excluded.author, date=excluded.date, "
+            "message_id=excluded.message_id, refs=excluded.refs, bytes=excluded.bytes, line_count=excluded.line_count",
+            -1, &db->sqlite_article_upsert, NULL) != SQLITE_OK) {
+            infof("sqlite native article upsert unavailable: %s", sqlite3_errmsg(db->sqlite));
+        }
+        if (sqlite3_prepare_v2(db->sqlite,
+            "INSERT INTO groups (name, article_count, first, last) VALUES (?,?,?,?) "
+            "ON CONFLICT(name) DO UPDATE SET article_count=excluded.article_count, first=excluded.first, last=excluded.last",
+            -1, &db->sqlite_group_upsert, NULL) != SQLITE_OK) {
+            infof("sqlite native group upsert unavailable: %s", sqlite3_errmsg(db->sqlite));
+        }
     } else if (db->type == DB_MYSQL) {
-        if (mysql_query(db->mysql, "CREATE TABLE IF NOT EXISTS `groups` (id INT AUTO_INCREMENT PRIMARY KEY, name VARCHAR(255) UNIQUE, article_count INT, first INT, last INT) ENGINE=InnoDB;")) {
+        if (mysql_query(db->mysql, "CREATE TABLE IF NOT EXISTS `groups` (id INT AUTO_INCREMENT PRIMARY KEY, name VARCHAR(255) UNIQUE, article_count INT, first INT, last INT, high_water INT DEFAULT 0) ENGINE=InnoDB;")) {
             fatal(ERR_DB_SCHEMA, "mysql schema error (groups): %s", mysql_error(db->mysql));
         }
-        /* include unique key in table create for fresh databases */
-        if (mysql_query(db->mysql, "CREATE TABLE IF NOT EXISTS `articles` (id INT AUTO_INCREMENT PRIMARY KEY, `artnum` INT, `subject` TEXT, `author` TEXT, `date` TEXT, `message_id` TEXT, `refs` TEXT, `bytes` INT, `line_count` INT, `group_name` VARCHAR(255), UNIQUE KEY `idx_articles_group_artnum` (`group_name`,`artnum`)) ENGINE=InnoDB;")) {
-            fatal(ERR_DB_SCHEMA, "mysql schema error (articles): %s", mysql_error(db->mysql));
-        }
-        /* for existing tables, try to add the unique key; ignore error if it exists */
-        if (mysql_query(db->mysql, "ALTER TABLE `articles` ADD UNIQUE KEY `idx_articles_group_artnum` (`group_name`,`artnum`);")) {
-            /* duplicate key name or existing index -> non-fatal */
+        if (mysql_query(db->mysql, "ALTER TABLE `groups` ADD COLUMN `high_water` INT DEFAULT 0;")) {
+            /* duplicate column on existing tables -> non-fatal */
             const char *err = mysql_error(db->mysql);
-            if (err && *err) {
-                infof("mysql index add note: %s", err);
+            if (err && *err) infof("mysql column add note: %s", err);
+        }
+        if (v2) {
+            if (db->intern_authors && mysql_query(db->mysql, "CREATE TABLE IF NOT EXISTS `authors` (id INT AUTO_INCREMENT PRIMARY KEY, name VARCHAR(255), UNIQUE KEY `idx_authors_name` (name)) ENGINE=InnoDB;"))
+                fatal(ERR_DB_SCHEMA, "mysql schema error (authors): %s", mysql_error(db->mysql));
+            /* partitioned tables take no foreign keys, and every unique key holds the partition column */
+            snprintf(sql, sizeof(sql),
+                "CREATE TABLE IF NOT EXISTS `articles` (id INT AUTO_INCREMENT%s, `group_id` INT NOT NULL, `artnum` INT, `date` BIGINT, `subject` TEXT, %s, "
+                "`message_id` TEXT, `refs` TEXT, `bytes` INT, `line_count` INT, `date_raw` TEXT, UNIQUE KEY `idx_articles_group_artnum` (`group_id`,`artnum`), "
+                "KEY `idx_articles_group_date` (`group_id`,`date`), %s) ENGINE=InnoDB",
+                part ? "" : " PRIMARY KEY", db->intern_authors ? "`author_id` INT" : "`author` TEXT",
+                part ? "PRIMARY KEY (id, `group_id`)" : "FOREIGN KEY (`group_id`) REFERENCES `groups` (id)");
+            if (part) snprintf(sql + strlen(sql), sizeof(sql) - strlen(sql), " PARTITION BY KEY (`group_id`) PARTITIONS %d", part);
+            if (mysql_query(db->mysql, sql)) fatal(ERR_DB_SCHEMA, "mysql schema error (articles): %s", mysql_error(db->mysql));
+        }
+        else {
+            /* include unique key in table create for fresh databases */
+            snprintf(sql, sizeof(sql), "CREATE TABLE IF NOT EXISTS `articles` (id INT AUTO_INCREMENT%s, `artnum` INT, `subject` TEXT, `author` TEXT, `date` TEXT, `message_id` TEXT, `refs` TEXT, `bytes` INT, `line_count` INT, `group_name` VARCHAR(255), UNIQUE KEY `idx_articles_group_artnum` (`group_name`,`artnum`)%s) ENGINE=InnoDB",
+                     part ? "" : " PRIMARY KEY", part ? ", PRIMARY KEY (id, `group_name`)" : "");
+            if (part) snprintf(sql + strlen(sql), sizeof(sql) - strlen(sql), " PARTITION BY KEY (`group_name`) PARTITIONS %d", part);
+            if (mysql_query(db->mysql, sql)) {
+                fatal(ERR_DB_SCHEMA, "mysql schema error (articles): %s", mysql_error(db->mysql));
+            }
+            /* for existing tables, try to add the unique key; ignore error if it exists */
+            else if (mysql_query(db->mysql, "ALTER TABLE `articles` ADD UNIQUE KEY `idx_articles_group_artnum` (`group_name`,`artnum`);")) {
+                /* duplicate key name or existing index -> non-fatal */
+                const char *err = mysql_error(db->mysql);
+                if (err && *err) {
+                    infof("mysql index add note: %s", err);
+                }
             }
         }
         db->mysql_insert_article = mysql_stmt_init(db->mysql);
         if (!db->mysql_insert_article) warnf("mysql_stmt_init failed for article");
-        const char *art_sql = "UPDATE `articles` SET `subject`=?, `author`=?, `date`=?, `message_id`=?, `refs`=?, `bytes`=?, `line_count`=? WHERE `group_name`=? AND `artnum`=?";
+        const char *art_sql = v2 ? v2sql[V2_UPDATE] : "UPDATE `articles` SET `subject`=?, `author`=?, `date`=?, `message_id`=?, `refs`=?, `bytes`=?, `line_count`=? WHERE `group_name`=? AND `artnum`=?";
         if (mysql_stmt_prepare(db->mysql_insert_article, art_sql, (unsigned long)strlen(art_sql))) {
             fatal(ERR_DB_PREPARE, "mysql prepare article-update failed: %s", mysql_error(db->mysql));
         }
         db->mysql_article_ins = mysql_stmt_init(db->mysql);
         if (!db->mysql_article_ins) warnf("mysql_stmt_init failed for article-insert");
-        const char *art_ins = "INSERT INTO `articles` (`artnum`, `subject`, `author`, `date`, `message_id`, `refs`, `bytes`, `line_count`, `group_name`) VALUES (?,?,?,?,?,?,?,?,?)";
+        const char *art_ins = v2 ? v2sql[V2_INSERT] : "INSERT INTO `articles` (`artnum`, `subject`, `author`, `date`, `message_id`, `refs`, `bytes`, `line_count`, `group_name`) VALUES (?,?,?,?,?,?,?,?,?)";
         if (db->mysql_article_ins && mysql_stmt_prepare(db->mysql_article_ins, art_ins, (unsigned long)strlen(art_ins))) {
             warnf("mysql prepare article-insert failed: %s", mysql_error(db->mysql));
             mysql_stmt_close(db->mysql_article_ins); db->mysql_article_ins = NULL;
         }
+        db->mysql_article_upsert = mysql_stmt_init(db->mysql);
+        const char *art_ups = v2 ? v2sql[V2_UPSERT] :
+            "INSERT INTO `articles` (`artnum`, `subject`, `author`, `date`, `message_id`, `refs`, `bytes`, `line_count`, `group_name`) VALUES (?,?,?,?,?,?,?,?,?) "
+            "ON DUPLICATE KEY UPDATE `subject`=VALUES(`subject`), `author`=VALUES(`author`), `date`=VALUES(`date`), `message_id`=VALUES(`message_id`), "
+            "`refs`=VALUES(`refs`), `bytes`=VALUES(`bytes`), `line_count`=VALUES(`line_count`)";
+        if (db->mysql_article_upsert && mysql_stmt_prepare(db->mysql_article_upsert, art_ups, (unsigned long)strlen(art_ups))) {
+            warnf("mysql prepare article-upsert failed: %s", mysql_error(db->mysql));
+            mysql_stmt_close(db->mysql_article_upsert); db->mysql_article_upsert = NULL;
+        }
         /* MySQL group upsert uses quoted table/columns */
     }
 #ifdef HAVE_PQ
@@ -457,14 +1855,171 @@ void db_init_schema(DB *db) {
         if (!pgc) return;
         PGresult *r;
         r = PQexec(pgc, "CREATE TABLE IF NOT EXISTS groups (id SERIAL PRIMARY KEY, name TEXT UNIQUE, article_count INT, first INT, last INT);"); PQclear(r);
-        r = PQexec(pgc, "CREATE TABLE IF NOT EXISTS articles (id SERIAL PRIMARY KEY, artnum INT, subject TEXT, author TEXT, date TEXT, message_id TEXT, refs TEXT, bytes INT, line_count INT, group_name TEXT);"); PQclear(r);
-        r = PQexec(pgc, "CREATE UNIQUE INDEX IF NOT EXISTS idx_articles_group_artnum ON articles(group_name, artnum);"); PQclear(r);
+        r = PQexec(pgc, "ALTER TABLE groups ADD COLUMN IF NOT EXISTS high_water INT DEFAULT 0;"); PQclear(r);
+        if (v2) {
+            if (db->intern_authors) { r = PQexec(pgc, "CREATE TABLE IF NOT EXISTS authors (id SERIAL PRIMARY KEY, name TEXT UNIQUE);"); PQclear(r); }
+            snprintf(sql, sizeof(sql),
+                "CREATE TABLE IF NOT EXISTS articles (id SERIAL%s, group_id INT NOT NULL REFERENCES groups(id), artnum INT, date BIGINT, bytes INT, line_count INT, "
+                "%s, subject TEXT, message_id TEXT, refs TEXT, date_raw TEXT%s)%s;",
+                part ? "" : " PRIMARY KEY", db->intern_authors ? "author_id INT REFERENCES authors(id)" : "author TEXT",
+                part ? ", PRIMARY KEY (group_id, id)" : "", part ? " PARTITION BY HASH (group_id)" : "");
+            r = PQexec(pgc, sql);
+            if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres schema error (articles): %s", PQerrorMessage(pgc));
+            PQclear(r);
+            pg_partitions(pgc, part);
+            r = PQexec(pgc, "CREATE UNIQUE INDEX IF NOT EXISTS idx_articles_group_artnum ON articles(group_id, artnum);"
+                            "CREATE INDEX IF NOT EXISTS idx_articles_group_date ON articles(group_id, date);");
+            PQclear(r);
+        } else {
+            snprintf(sql, sizeof(sql), "CREATE TABLE IF NOT EXISTS articles (id SERIAL%s, artnum INT, subject TEXT, author TEXT, date TEXT, message_id TEXT, refs TEXT, bytes INT, line_count INT, group_name TEXT%s)%s;",
+                     part ? "" : " PRIMARY KEY", part ? ", PRIMARY KEY (group_name, id)" : "", part ? " PARTITION BY HASH (group_name)" : "");
+            r = PQexec(pgc, sql);
+            if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres schema error (articles): %s", PQerrorMessage(pgc));
+            PQclear(r);
+            pg_partitions(pgc, part);
+            r = PQexec(pgc, "CREATE UNIQUE INDEX IF NOT EXISTS idx_articles_group_artnum ON articles(group_name, artnum);"); PQclear(r);
+        }
+        if (!db->pg_prepared) {
+            PGresult *ra = v2 ? PQprepare(pgc, "article_upsert", v2sql[V2_UPSERT], 10, NULL) : PQprepare(pgc, "article_upsert",
+                "INSERT INTO articles (artnum, subject, author, date, message_id, refs, bytes, line_count, group_name) VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9) "
+                "ON CONFLICT (group_name, artnum) DO UPDATE SET subject=EXCLUDED.subject, author=EXCLUDED.author, date=EXCLUDED.date, "
+                "message_id=EXCLUDED.message_id, refs=EXCLUDED.refs, bytes=EXCLUDED.bytes, line_count=EXCLUDED.line_count", 9, NULL);
+            PGresult *rg = PQprepare(pgc, "group_upsert",
+                "INSERT INTO groups (name, article_count, first, last) VALUES ($1,$2,$3,$4) "
+                "ON CONFLICT (name) DO UPDATE SET article_count=EXCLUDED.article_count, first=EXCLUDED.first, last=EXCLUDED.last", 4, NULL);
+            if (PQresultStatus(ra) == PGRES_COMMAND_OK && PQresultStatus(rg) == PGRES_COMMAND_OK) db->pg_prepared = 1;
+            else warnf("postgres prepare upsert failed: %s", PQerrorMessage(pgc));
+            PQclear(ra); PQclear(rg);
+        }
     }
 #endif
+    if (migrate) db_migrate_copy(db);
+    if (!db->defer_indexes) db_init_fts(db);
+    if (g_dedup) db_init_crossposts(db);
+    db_init_journal(db);
+    if (g_shards && !db->nshards && !db->is_shard) {
+        db_shards_create(db);
+        db_shards_init(db);
+    }
+}
+
+/* --sqlite-profile bulk: the indexes db_init_schema() left out are built from
+   the loaded rows in one pass each. The (group, artnum) key is never deferred;
+   every upsert and update resolves through it. */
+static void db_build_indexes(DB *db) {
+    db->defer_indexes = 0;
+    infof("sqlite: building deferred indexes");
+    if (db->schema == 2) db_exec(db, "CREATE INDEX IF NOT EXISTS idx_articles_group_date ON articles(group_id, date);");
+    if (db->crossposts) db_exec(db, "CREATE INDEX IF NOT EXISTS idx_articles_message_id ON articles(message_id);");
+    db_init_fts(db);
 }
 
 /* Insert group info */
+/* growable SQL text used for multi-row statements */
+typedef struct { char *s; size_t len, cap; } SqlBuf;
+
+static void sqlbuf_put(SqlBuf *sb, const char *p, size_t n) {
+    if (sb->len + n + 1 > sb->cap) {
+        size_t cap = sb->cap ? sb->cap : 64 * 1024;
+        while (cap < sb->len + n + 1) cap *= 2;
+        char *ns = realloc(sb->s, cap);
+        if (!ns) fatal(ERR_RUNTIME, "Out of memory building SQL");
+        sb->s = ns; sb->cap = cap;
+    }
+    memcpy(sb->s + sb->len, p, n);
+    sb->len += n;
+    sb->s[sb->len] = '\0';
+}
+
+static void sqlbuf_puts(SqlBuf *sb, const char *p) { sqlbuf_put(sb, p, strlen(p)); }
+
+static void sqlbuf_put_mysql_strn(SqlBuf *sb, MYSQL *m, const char *s, size_t n) {
+    char stack[1024];
+    char *esc = (n * 2 + 1 <= sizeof(stack)) ? stack : malloc(n * 2 + 1);
+    if (!esc) fatal(ERR_RUNTIME, "Out of memory building SQL");
+    unsigned long el = mysql_real_escape_string(m, esc, s, (unsigned long)n);
+    sqlbuf_put(sb, "'", 1); sqlbuf_put(sb, esc, el); sqlbuf_put(sb, "'", 1);
+    if (esc != stack) free(esc);
+}
+
+static void sqlbuf_put_mysql_str(SqlBuf *sb, MYSQL *m, const char *s) { sqlbuf_put_mysql_strn(sb, m, s, strlen(s)); }
+
+/* v2 rows find their group and author keys by name; these make sure the
+   rows exist. NOT EXISTS first so a known name does not use up an id. */
+static void db_group_ensure(DB *db, const char *name) {
+    if (db->type == DB_SQLITE) {
+        sqlite3_stmt *st = NULL;
+        if (sqlite3_prepare_v2(db->sqlite, "INSERT OR IGNORE INTO groups (name) VALUES (?)", -1, &st, NULL) == SQLITE_OK &&
+            sqlite3_bind_text(st, 1, name, -1, SQLITE_STATIC) == SQLITE_OK && sqlite3_step(st) == SQLITE_DONE) {
+            sqlite3_finalize(st);
+            return;
+        }
+        warnf("sqlite group insert failed: %s", sqlite3_errmsg(db->sqlite));
+        sqlite3_finalize(st);
+    } else if (db->type == DB_MYSQL) {
+        char *n = db_escape(db, name), sql[1200];
+        snprintf(sql, sizeof(sql), "INSERT IGNORE INTO `groups` (name) SELECT %s FROM DUAL WHERE NOT EXISTS (SELECT 1 FROM `groups` WHERE name=%s)", n, n);
+        if (mysql_query(db->mysql, sql)) warnf("mysql group insert error: %s", mysql_error(db->mysql));
+        free(n);
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGconn *pgc = (PGconn*)db->impl;
+        const char *v[1] = { name };
+        PGresult *r = PQexecParams(pgc, "INSERT INTO groups (name) SELECT $1::text WHERE NOT EXISTS (SELECT 1 FROM groups WHERE name=$1::text) "
+                                   "ON CONFLICT (name) DO NOTHING", 1, NULL, v, NULL, NULL, 0);
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres group insert error: %s", PQerrorMessage(pgc));
+        PQclear(r);
+    }
+#endif
+}
+
+static void db_v2_author(DB *db, const char *name, size_t len) {
+    if (db->type == DB_SQLITE && db->sqlite_author_ins) {
+        sqlite3_stmt *st = db->sqlite_author_ins;
+        if (sqlite3_bind_text(st, 1, name, (int)len, SQLITE_STATIC) != SQLITE_OK || sqlite3_step(st) != SQLITE_DONE)
+            warnf("sqlite author insert failed: %s", sqlite3_errmsg(db->sqlite));
+        sqlite3_reset(st); sqlite3_clear_bindings(st);
+    } else if (db->type == DB_MYSQL) {
+        SqlBuf sb = {0};
+        sqlbuf_puts(&sb, "INSERT IGNORE INTO `authors` (name) SELECT LEFT(");
+        sqlbuf_put_mysql_str(&sb, db->mysql, name);
+        sqlbuf_puts(&sb, ",255) FROM DUAL WHERE NOT EXISTS (SELECT 1 FROM `authors` WHERE name=LEFT(");
+        sqlbuf_put_mysql_str(&sb, db->mysql, name);
+        sqlbuf_puts(&sb, ",255))");
+        if (mysql_real_query(db->mysql, sb.s, (unsigned long)sb.len)) warnf("mysql author insert error: %s", mysql_error(db->mysql));
+        free(sb.s);
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGconn *pgc = (PGconn*)db->impl;
+        const char *v[1] = { name };
+        PGresult *r = PQexecParams(pgc, "INSERT INTO authors (name) SELECT $1::text WHERE NOT EXISTS (SELECT 1 FROM authors WHERE name=$1::text) "
+                                   "ON CONFLICT (name) DO NOTHING", 1, NULL, v, NULL, NULL, 0);
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres author insert error: %s", PQerrorMessage(pgc));
+        PQclear(r);
+    }
+#endif
+}
+
+static DB *db_shard_assign(DB *db, const char *group);
+
 void db_insert_group(DB *db, const char *name, int count, int first, int last) {
+    if (db->nshards) db = db_shard_assign(db, name);
+    if (db->schema == 2) db_group_ensure(db, name);
+    if (db->type == DB_SQLITE && g_upsert && db->sqlite_group_upsert) {
+        sqlite3_stmt *st = db->sqlite_group_upsert;
+        if (sqlite3_bind_text(st, 1, name, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
+            sqlite3_bind_int(st, 2, count) != SQLITE_OK ||
+            sqlite3_bind_int(st, 3, first) != SQLITE_OK ||
+            sqlite3_bind_int(st, 4, last) != SQLITE_OK) {
+            warnf("sqlite bind group-upsert failed: %s", sqlite3_errmsg(db->sqlite));
+        } else if (sqlite3_step(st) != SQLITE_DONE) {
+            warnf("sqlite group upsert step failed: %s", sqlite3_errmsg(db->sqlite));
+        }
+        sqlite3_reset(st); sqlite3_clear_bindings(st);
+        return;
+    }
     if (db->type == DB_SQLITE && db->sqlite_insert_group) {
         if (sqlite3_bind_int(db->sqlite_insert_group, 1, count) != SQLITE_OK ||
             sqlite3_bind_int(db->sqlite_insert_group, 2, first) != SQLITE_OK ||
@@ -503,6 +2058,12 @@ void db_insert_group(DB *db, const char *name, int count, int first, int last) {
         char esc_name[512];
         mysql_real_escape_string(db->mysql, esc_name, name, (unsigned long)strlen(name));
         char sql[1024];
+        if (g_upsert) {
+            snprintf(sql, sizeof(sql), "INSERT INTO `groups` (name,article_count,first,last) VALUES ('%s',%d,%d,%d) "
+                     "ON DUPLICATE KEY UPDATE article_count=VALUES(article_count), first=VALUES(first), last=VALUES(last)", esc_name, count, first, last);
+            if (mysql_query(db->mysql, sql)) warnf("mysql group upsert error: %s", mysql_error(db->mysql));
+            return;
+        }
         snprintf(sql, sizeof(sql), "UPDATE `groups` SET article_count=%d, first=%d, last=%d WHERE name='%s'", count, first, last, esc_name);
         if (mysql_query(db->mysql, sql)) {
             warnf("mysql group update error: %s", mysql_error(db->mysql));
@@ -528,109 +2089,353 @@ void db_insert_group(DB *db, const char *name, int count, int first, int last) {
         const char *pupd[4]; char cbuf[16], fbuf[16], lbuf[16];
         snprintf(cbuf,sizeof(cbuf),"%d",count); snprintf(fbuf,sizeof(fbuf),"%d",first); snprintf(lbuf,sizeof(lbuf),"%d",last);
         pupd[0]=cbuf; pupd[1]=fbuf; pupd[2]=lbuf; pupd[3]=name;
-        PGresult *r = PQexecParams(pgc, "UPDATE groups SET article_count=$1, first=$2, last=$3 WHERE name=$4", 4, NULL, pupd, NULL, NULL, 0);
-        int ok = (PQresultStatus(r)==PGRES_COMMAND_OK); PQclear(r);
-        if (!ok && g_upsert){
+        if (g_upsert && db->pg_prepared) {
             const char *pins[4]; pins[0]=name; pins[1]=cbuf; pins[2]=fbuf; pins[3]=lbuf;
-            r = PQexecParams(pgc, "INSERT INTO groups (name, article_count, first, last) VALUES ($1,$2,$3,$4)", 4, NULL, pins, NULL, NULL, 0);
+            PGresult *r = PQexecPrepared(pgc, "group_upsert", 4, pins, NULL, NULL, 0);
+            if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres group upsert error: %s", PQerrorMessage(pgc));
             PQclear(r);
+            return;
+        }
+        PGresult *r = PQexecParams(pgc, "UPDATE groups SET article_count=$1, first=$2, last=$3 WHERE name=$4", 4, NULL, pupd, NULL, NULL, 0);
+        int ok = (PQresultStatus(r)==PGRES_COMMAND_OK);
+        /* a successful UPDATE that matched nothing still reports COMMAND_OK */
+        int updated = ok && atoi(PQcmdTuples(r)) > 0;
+        if (!ok) warnf("postgres group update error: %s", PQerrorMessage(pgc));
+        PQclear(r);
+        if (ok && !updated) {
+            if (g_upsert) {
+                const char *pins[4]; pins[0]=name; pins[1]=cbuf; pins[2]=fbuf; pins[3]=lbuf;
+                r = PQexecParams(pgc, "INSERT INTO groups (name, article_count, first, last) VALUES ($1,$2,$3,$4)", 4, NULL, pins, NULL, NULL, 0);
+                if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres group insert error: %s", PQerrorMessage(pgc));
+                else infof("group inserted: %s", name);
+                PQclear(r);
+            } else {
+                warnf("group not found for update: %s", name);
+            }
         }
         return;
     }
     #endif
 }
 
-/* Insert article header data */
-void db_insert_article(DB *db, const char *group, int artnum, const char *subject,
-                              const char *author, const char *date, const char *message_id,
-                              const char *references, int bytes, int lines) {
-    if (db->type == DB_SQLITE && db->sqlite_insert_article) {
-        if (sqlite3_bind_text(db->sqlite_insert_article, 1, subject, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-            sqlite3_bind_text(db->sqlite_insert_article, 2, author, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-            sqlite3_bind_text(db->sqlite_insert_article, 3, date, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-            sqlite3_bind_text(db->sqlite_insert_article, 4, message_id, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-            sqlite3_bind_text(db->sqlite_insert_article, 5, references, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-            sqlite3_bind_int(db->sqlite_insert_article, 6, bytes) != SQLITE_OK ||
-            sqlite3_bind_int(db->sqlite_insert_article, 7, lines) != SQLITE_OK ||
-            sqlite3_bind_text(db->sqlite_insert_article, 8, group, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-            sqlite3_bind_int(db->sqlite_insert_article, 9, artnum) != SQLITE_OK) {
-            warnf("sqlite bind article-update failed: %s", sqlite3_errmsg(db->sqlite));
-            sqlite3_reset(db->sqlite_insert_article); sqlite3_clear_bindings(db->sqlite_insert_article); return;
-        }
-        if (sqlite3_step(db->sqlite_insert_article) != SQLITE_DONE) {
-            warnf("sqlite article update step failed: %s", sqlite3_errmsg(db->sqlite));
+/* Incremental sync: groups.high_water is the highest article number below
+   which the whole fetched range has been stored. */
+/* one integer column of a groups row; 0 when the group is unknown */
+static int db_group_int(DB *db, const char *group, const char *col) {
+    int v = 0;
+    char q[128];
+    db = db_route(db, group);
+    if (db->type == DB_SQLITE) {
+        sqlite3_stmt *st = NULL;
+        snprintf(q, sizeof(q), "SELECT %s FROM groups WHERE name=?", col);
+        if (sqlite3_prepare_v2(db->sqlite, q, -1, &st, NULL) != SQLITE_OK) {
+            warnf("sqlite groups.%s query failed: %s", col, sqlite3_errmsg(db->sqlite));
+            return 0;
         }
-        int ch = sqlite3_changes(db->sqlite);
-        sqlite3_reset(db->sqlite_insert_article); sqlite3_clear_bindings(db->sqlite_insert_article);
-        if (ch == 0) {
-            if (g_upsert && db->sqlite_article_ins) {
-                if (sqlite3_bind_int(db->sqlite_article_ins, 1, artnum) != SQLITE_OK ||
-                    sqlite3_bind_text(db->sqlite_article_ins, 2, subject, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-                    sqlite3_bind_text(db->sqlite_article_ins, 3, author, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-                    sqlite3_bind_text(db->sqlite_article_ins, 4, date, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-                    sqlite3_bind_text(db->sqlite_article_ins, 5, message_id, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-                    sqlite3_bind_text(db->sqlite_article_ins, 6, references, -1, SQLITE_TRANSIENT) != SQLITE_OK ||
-                    sqlite3_bind_int(db->sqlite_article_ins, 7, bytes) != SQLITE_OK ||
-                    sqlite3_bind_int(db->sqlite_article_ins, 8, lines) != SQLITE_OK ||
-                    sqlite3_bind_text(db->sqlite_article_ins, 9, group, -1, SQLITE_TRANSIENT) != SQLITE_OK) {
-                    warnf("sqlite bind article-insert failed: %s", sqlite3_errmsg(db->sqlite));
-                    sqlite3_reset(db->sqlite_article_ins); sqlite3_clear_bindings(db->sqlite_article_ins);
-                } else {
-                    if (sqlite3_step(db->sqlite_article_ins) != SQLITE_DONE) {
-                        warnf("sqlite article insert step failed: %s", sqlite3_errmsg(db->sqlite));
-                    }
-                    sqlite3_reset(db->sqlite_article_ins); sqlite3_clear_bindings(db->sqlite_article_ins);
-                    infof("article inserted: %s #%d", group, artnum);
-                }
-            } else {
-                warnf("article not found for update: %s #%d", group, artnum);
-            }
+        sqlite3_bind_text(st, 1, group, -1, SQLITE_STATIC);
+        if (sqlite3_step(st) == SQLITE_ROW) v = sqlite3_column_int(st, 0);
+        sqlite3_finalize(st);
+    } else if (db->type == DB_MYSQL) {
+        char esc_name[512], sql[1024];
+        mysql_real_escape_string(db->mysql, esc_name, group, (unsigned long)strlen(group));
+        snprintf(sql, sizeof(sql), "SELECT `%s` FROM `groups` WHERE name='%s'", col, esc_name);
+        if (mysql_query(db->mysql, sql)) { warnf("mysql groups.%s query failed: %s", col, mysql_error(db->mysql)); return 0; }
+        MYSQL_RES *res = mysql_store_result(db->mysql);
+        if (res) {
+            MYSQL_ROW row = mysql_fetch_row(res);
+            if (row && row[0]) v = atoi(row[0]);
+            mysql_free_result(res);
         }
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGconn *pgc = (PGconn*)db->impl;
+        const char *pv[1] = { group };
+        snprintf(q, sizeof(q), "SELECT %s FROM groups WHERE name=$1", col);
+        PGresult *r = PQexecParams(pgc, q, 1, NULL, pv, NULL, NULL, 0);
+        if (PQresultStatus(r) == PGRES_TUPLES_OK) { if (PQntuples(r) > 0 && !PQgetisnull(r, 0, 0)) v = atoi(PQgetvalue(r, 0, 0)); }
+        else warnf("postgres groups.%s query failed: %s", col, PQerrorMessage(pgc));
+        PQclear(r);
+    }
+#endif
+    return v;
+}
+
+int db_get_high_water(DB *db, const char *group) {
+    return db_group_int(db, group, "high_water");
+}
+
+int db_get_group_last(DB *db, const char *group) {
+    return db_group_int(db, group, "last");
+}
+
+static void db_write_high_water(DB *db) {
+    if (!db->hw_pending || !db->hw_group) return;
+    if (db->writes_failed) {
+        /* some article below the mark may be missing */
+        if (!db->hw_held++) warnf("article writes failed; high-water marks are left unchanged so a rerun fetches again");
+        infof("high-water mark for %s not advanced to %d", db->hw_group, db->hw_pending);
+        db->hw_pending = 0;
         return;
     }
-    if (db->type == DB_MYSQL && db->mysql_insert_article) {
-        MYSQL_BIND b[9]; memset(b, 0, sizeof(b));
-        unsigned long sl = (unsigned long)strlen(subject);
-        unsigned long al = (unsigned long)strlen(author);
-        unsigned long dl = (unsigned long)strlen(date);
-        unsigned long ml = (unsigned long)strlen(message_id);
-        unsigned long rl = (unsigned long)strlen(references);
-        unsigned long gl = (unsigned long)strlen(group);
-        b[0].buffer_type = MYSQL_TYPE_STRING; b[0].buffer=(void*)subject; b[0].buffer_length=sl;
+    char sql[1024], hwbuf[16];
+    snprintf(hwbuf, sizeof(hwbuf), "%d", db->hw_pending);
+    if (db->type == DB_SQLITE) {
+        char *esc = db_escape(db, db->hw_group);
+        snprintf(sql, sizeof(sql), "UPDATE groups SET high_water=%s WHERE name=%s AND COALESCE(high_water,0) < %s;"
+                 "DELETE FROM fetched_ranges WHERE group_name=%s AND hi <= %s", hwbuf, esc, hwbuf, esc, hwbuf);
+        free(esc);
+        db_exec(db, sql);
+    } else if (db->type == DB_MYSQL) {
+        char esc_name[512];
+        mysql_real_escape_string(db->mysql, esc_name, db->hw_group, (unsigned long)strlen(db->hw_group));
+        snprintf(sql, sizeof(sql), "UPDATE `groups` SET high_water=%s WHERE name='%s' AND COALESCE(high_water,0) < %s", hwbuf, esc_name, hwbuf);
+        db_exec(db, sql);
+        snprintf(sql, sizeof(sql), "DELETE FROM `fetched_ranges` WHERE group_name='%s' AND hi <= %s", esc_name, hwbuf);
+        db_exec(db, sql);
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        const char *pv[2] = { hwbuf, db->hw_group };
+        PGresult *r = PQexecParams((PGconn*)db->impl, "UPDATE groups SET high_water=$1 WHERE name=$2 AND COALESCE(high_water,0) < $1", 2, NULL, pv, NULL, NULL, 0);
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres high-water update error: %s", PQerrorMessage((PGconn*)db->impl));
+        PQclear(r);
+        r = PQexecParams((PGconn*)db->impl, "DELETE FROM fetched_ranges WHERE group_name=$2 AND hi <= $1", 2, NULL, pv, NULL, NULL, 0);
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres range journal error: %s", PQerrorMessage((PGconn*)db->impl));
+        PQclear(r);
+    }
+#endif
+    infof("high-water mark for %s: %d", db->hw_group, db->hw_pending);
+    db->hw_pending = 0;
+}
+
+/* the ranges db_note_range() collected; a new high-water mark deletes those
+   below it, so fetched_ranges only keeps what finished out of order. None
+   is written once an article write has failed: it might be in the range */
+static void db_write_ranges(DB *db) {
+    for (int k = 0; k < db->nranges && !db->writes_failed; ++k) {
+        const DBRange *r = &db->ranges[k];
+        char sql[1024], lo[16], hi[16];
+        snprintf(lo, sizeof(lo), "%d", r->lo); snprintf(hi, sizeof(hi), "%d", r->hi);
+        if (db->type == DB_SQLITE || db->type == DB_MYSQL) {
+            char *esc = db_escape(db, r->group);
+            snprintf(sql, sizeof(sql), db->type == DB_SQLITE ? "INSERT OR REPLACE INTO fetched_ranges (group_name, lo, hi) VALUES (%s,%s,%s)" :
+                     "REPLACE INTO `fetched_ranges` (group_name, lo, hi) VALUES (%s,%s,%s)", esc, lo, hi);
+            free(esc);
+            db_exec(db, sql);
+        }
+#ifdef HAVE_PQ
+        else if (db->type == DB_POSTGRES && db->impl) {
+            const char *pv[3] = { r->group, lo, hi };
+            PGresult *res = PQexecParams((PGconn*)db->impl, "INSERT INTO fetched_ranges (group_name, lo, hi) VALUES ($1,$2,$3) "
+                                         "ON CONFLICT (group_name, lo) DO UPDATE SET hi=EXCLUDED.hi", 3, NULL, pv, NULL, NULL, 0);
+            if (PQresultStatus(res) != PGRES_COMMAND_OK) warnf("postgres range journal error: %s", PQerrorMessage((PGconn*)db->impl));
+            PQclear(res);
+        }
+#endif
+    }
+    db->nranges = 0;
+}
+
+/* record that articles lo..hi of group are stored (or given up for good);
+   journaled like the high-water mark, which later absorbs the range */
+void db_note_range(DB *db, const char *group, int lo, int hi) {
+    db = db_route(db, group);
+    if (db->nranges == db->ranges_cap) {
+        int ncap = db->ranges_cap ? db->ranges_cap * 2 : 16;
+        DBRange *nr = realloc(db->ranges, sizeof(DBRange) * ncap);
+        if (!nr) { warnf("Out of memory journaling %s %d-%d", group, lo, hi); return; }
+        db->ranges = nr; db->ranges_cap = ncap;
+    }
+    DBRange *r = &db->ranges[db->nranges++];
+    r->group = group; r->lo = lo; r->hi = hi;
+    if (!db->in_txn) {
+        db_bulk_flush(db);
+        db_write_ranges(db);
+    }
+}
+
+/* record that every article of this run up to artnum is stored; written with
+   the next commit, or at once (after the bulk buffer) in autocommit mode */
+void db_set_high_water(DB *db, const char *group, int artnum) {
+    db = db_route(db, group);
+    if (db->hw_group && strcmp(db->hw_group, group) != 0) db_write_high_water(db); /* one pending mark per group */
+    db->hw_group = group;
+    if (artnum > db->hw_pending) db->hw_pending = artnum;
+    if (!db->in_txn) {
+        db_bulk_flush(db);
+        db_write_high_water(db);
+    }
+}
+
+/* Insert article header data */
+static int sqlite_bind_epoch(sqlite3_stmt *st, int v2, int dated, long long epoch) {
+    if (!v2) return SQLITE_OK;
+    return dated ? sqlite3_bind_int64(st, 10, epoch) : sqlite3_bind_null(st, 10);
+}
+
+static void mysql_bind_epoch(MYSQL_BIND *b, int at, int dated, long long *epoch) {
+    memset(&b[at], 0, sizeof(b[at]));
+    b[at].buffer_type = dated ? MYSQL_TYPE_LONGLONG : MYSQL_TYPE_NULL;
+    b[at].buffer = (void*)epoch;
+}
+
+static void db_write_article(DB *db, const DBArticle *art) {
+    const char *group = art->group, *subject = art->subject, *author = art->author, *date = art->date;
+    const char *message_id = art->message_id, *references = art->refs;
+    int artnum = art->artnum, bytes = art->bytes, lines = art->lines;
+    /* v2: the epoch goes in as parameter 10 (NULL when the date does not
+       parse) and the Date: text only with --keep-date-text */
+    int v2 = db->schema == 2;
+    long long epoch = 0;
+    int dated = v2 && news_date_epoch(date, art->date_len, &epoch);
+    const char *draw = v2 && !g_keep_date_text ? NULL : date;
+    char ebuf[24];
+    snprintf(ebuf, sizeof(ebuf), "%lld", epoch);
+    if (db->intern_authors) db_v2_author(db, author, art->author_len);
+    if (db->type == DB_SQLITE && g_upsert && db->sqlite_article_upsert) {
+        sqlite3_stmt *st = db->sqlite_article_upsert;
+        if (sqlite3_bind_int(st, 1, artnum) != SQLITE_OK ||
+            sqlite3_bind_text(st, 2, subject, (int)art->subject_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(st, 3, author, (int)art->author_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(st, 4, draw, (int)art->date_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(st, 5, message_id, (int)art->message_id_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(st, 6, references, (int)art->refs_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int(st, 7, bytes) != SQLITE_OK ||
+            sqlite3_bind_int(st, 8, lines) != SQLITE_OK ||
+            sqlite3_bind_text(st, 9, group, (int)art->group_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite_bind_epoch(st, v2, dated, epoch) != SQLITE_OK) {
+            warnf("sqlite bind article-upsert failed: %s", sqlite3_errmsg(db->sqlite));
+            db->writes_failed++;
+        } else if (sqlite3_step(st) != SQLITE_DONE) {
+            warnf("sqlite article upsert step failed: %s", sqlite3_errmsg(db->sqlite));
+            db->writes_failed++;
+        }
+        sqlite3_reset(st); sqlite3_clear_bindings(st);
+        return;
+    }
+    if (db->type == DB_MYSQL && g_upsert && db->mysql_article_upsert) {
+        MYSQL_BIND bi[10]; memset(bi, 0, sizeof(bi));
+        bi[0].buffer_type = MYSQL_TYPE_LONG; bi[0].buffer=(void*)&artnum;
+        bi[1].buffer_type = MYSQL_TYPE_STRING; bi[1].buffer=(void*)subject; bi[1].buffer_length=(unsigned long)art->subject_len;
+        bi[2].buffer_type = MYSQL_TYPE_STRING; bi[2].buffer=(void*)author; bi[2].buffer_length=(unsigned long)art->author_len;
+        bi[3].buffer_type = draw ? MYSQL_TYPE_STRING : MYSQL_TYPE_NULL; bi[3].buffer=(void*)draw; bi[3].buffer_length=(unsigned long)art->date_len;
+        bi[4].buffer_type = MYSQL_TYPE_STRING; bi[4].buffer=(void*)message_id; bi[4].buffer_length=(unsigned long)art->message_id_len;
+        bi[5].buffer_type = MYSQL_TYPE_STRING; bi[5].buffer=(void*)references; bi[5].buffer_length=(unsigned long)art->refs_len;
+        bi[6].buffer_type = MYSQL_TYPE_LONG; bi[6].buffer=(void*)&bytes;
+        bi[7].buffer_type = MYSQL_TYPE_LONG; bi[7].buffer=(void*)&lines;
+        bi[8].buffer_type = MYSQL_TYPE_STRING; bi[8].buffer=(void*)group; bi[8].buffer_length=(unsigned long)art->group_len;
+        if (v2) mysql_bind_epoch(bi, 9, dated, &epoch);
+        if (mysql_stmt_bind_param(db->mysql_article_upsert, bi)) {
+            warnf("mysql bind article-upsert failed: %s", mysql_stmt_error(db->mysql_article_upsert));
+            db->writes_failed++;
+        } else if (mysql_stmt_execute(db->mysql_article_upsert)) {
+            warnf("mysql execute article-upsert failed: %s", mysql_stmt_error(db->mysql_article_upsert));
+            db->writes_failed++;
+        }
+        mysql_stmt_reset(db->mysql_article_upsert);
+        return;
+    }
+    if (db->type == DB_SQLITE && db->sqlite_insert_article) {
+        if (sqlite3_bind_text(db->sqlite_insert_article, 1, subject, (int)art->subject_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(db->sqlite_insert_article, 2, author, (int)art->author_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(db->sqlite_insert_article, 3, draw, (int)art->date_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(db->sqlite_insert_article, 4, message_id, (int)art->message_id_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(db->sqlite_insert_article, 5, references, (int)art->refs_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int(db->sqlite_insert_article, 6, bytes) != SQLITE_OK ||
+            sqlite3_bind_int(db->sqlite_insert_article, 7, lines) != SQLITE_OK ||
+            sqlite3_bind_text(db->sqlite_insert_article, 8, group, (int)art->group_len, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int(db->sqlite_insert_article, 9, artnum) != SQLITE_OK ||
+            sqlite_bind_epoch(db->sqlite_insert_article, v2, dated, epoch) != SQLITE_OK) {
+            warnf("sqlite bind article-update failed: %s", sqlite3_errmsg(db->sqlite));
+            db->writes_failed++;
+            sqlite3_reset(db->sqlite_insert_article); sqlite3_clear_bindings(db->sqlite_insert_article); return;
+        }
+        if (sqlite3_step(db->sqlite_insert_article) != SQLITE_DONE) {
+            warnf("sqlite article update step failed: %s", sqlite3_errmsg(db->sqlite));
+            db->writes_failed++;
+        }
+        int ch = sqlite3_changes(db->sqlite);
+        sqlite3_reset(db->sqlite_insert_article); sqlite3_clear_bindings(db->sqlite_insert_article);
+        if (ch == 0) {
+            if (g_upsert && db->sqlite_article_ins) {
+                if (sqlite3_bind_int(db->sqlite_article_ins, 1, artnum) != SQLITE_OK ||
+                    sqlite3_bind_text(db->sqlite_article_ins, 2, subject, (int)art->subject_len, SQLITE_STATIC) != SQLITE_OK ||
+                    sqlite3_bind_text(db->sqlite_article_ins, 3, author, (int)art->author_len, SQLITE_STATIC) != SQLITE_OK ||
+                    sqlite3_bind_text(db->sqlite_article_ins, 4, draw, (int)art->date_len, SQLITE_STATIC) != SQLITE_OK ||
+                    sqlite3_bind_text(db->sqlite_article_ins, 5, message_id, (int)art->message_id_len, SQLITE_STATIC) != SQLITE_OK ||
+                    sqlite3_bind_text(db->sqlite_article_ins, 6, references, (int)art->refs_len, SQLITE_STATIC) != SQLITE_OK ||
+                    sqlite3_bind_int(db->sqlite_article_ins, 7, bytes) != SQLITE_OK ||
+                    sqlite3_bind_int(db->sqlite_article_ins, 8, lines) != SQLITE_OK ||
+                    sqlite3_bind_text(db->sqlite_article_ins, 9, group, (int)art->group_len, SQLITE_STATIC) != SQLITE_OK ||
+                    sqlite_bind_epoch(db->sqlite_article_ins, v2, dated, epoch) != SQLITE_OK) {
+                    warnf("sqlite bind article-insert failed: %s", sqlite3_errmsg(db->sqlite));
+                    db->writes_failed++;
+                    sqlite3_reset(db->sqlite_article_ins); sqlite3_clear_bindings(db->sqlite_article_ins);
+                } else {
+                    if (sqlite3_step(db->sqlite_article_ins) != SQLITE_DONE) {
+                        warnf("sqlite article insert step failed: %s", sqlite3_errmsg(db->sqlite));
+                        db->writes_failed++;
+                    }
+                    sqlite3_reset(db->sqlite_article_ins); sqlite3_clear_bindings(db->sqlite_article_ins);
+                    infof("article inserted: %s #%d", group, artnum);
+                }
+            } else {
+                warnf("article not found for update: %s #%d", group, artnum);
+                db->writes_failed++;
+            }
+        }
+        return;
+    }
+    if (db->type == DB_MYSQL && db->mysql_insert_article) {
+        MYSQL_BIND b[10]; memset(b, 0, sizeof(b));
+        unsigned long sl = (unsigned long)art->subject_len;
+        unsigned long al = (unsigned long)art->author_len;
+        unsigned long dl = (unsigned long)art->date_len;
+        unsigned long ml = (unsigned long)art->message_id_len;
+        unsigned long rl = (unsigned long)art->refs_len;
+        unsigned long gl = (unsigned long)art->group_len;
+        b[0].buffer_type = MYSQL_TYPE_STRING; b[0].buffer=(void*)subject; b[0].buffer_length=sl;
         b[1].buffer_type = MYSQL_TYPE_STRING; b[1].buffer=(void*)author; b[1].buffer_length=al;
-        b[2].buffer_type = MYSQL_TYPE_STRING; b[2].buffer=(void*)date; b[2].buffer_length=dl;
+        b[2].buffer_type = draw ? MYSQL_TYPE_STRING : MYSQL_TYPE_NULL; b[2].buffer=(void*)draw; b[2].buffer_length=dl;
         b[3].buffer_type = MYSQL_TYPE_STRING; b[3].buffer=(void*)message_id; b[3].buffer_length=ml;
         b[4].buffer_type = MYSQL_TYPE_STRING; b[4].buffer=(void*)references; b[4].buffer_length=rl;
         b[5].buffer_type = MYSQL_TYPE_LONG; b[5].buffer=(void*)&bytes;
         b[6].buffer_type = MYSQL_TYPE_LONG; b[6].buffer=(void*)&lines;
         b[7].buffer_type = MYSQL_TYPE_STRING; b[7].buffer=(void*)group; b[7].buffer_length=gl;
         b[8].buffer_type = MYSQL_TYPE_LONG; b[8].buffer=(void*)&artnum;
+        if (v2) { memmove(b + 8, b + 7, 2 * sizeof(*b)); mysql_bind_epoch(b, 7, dated, &epoch); }
         if (mysql_stmt_bind_param(db->mysql_insert_article, b)) {
             warnf("mysql bind article-update failed: %s", mysql_stmt_error(db->mysql_insert_article));
+            db->writes_failed++;
             mysql_stmt_reset(db->mysql_insert_article); return;
         }
         if (mysql_stmt_execute(db->mysql_insert_article)) {
             warnf("mysql execute article-update failed: %s", mysql_stmt_error(db->mysql_insert_article));
+            db->writes_failed++;
         }
         my_ulonglong ch = mysql_stmt_affected_rows(db->mysql_insert_article);
         mysql_stmt_reset(db->mysql_insert_article);
         if (ch == 0) {
             if (g_upsert && db->mysql_article_ins) {
-                MYSQL_BIND bi[9]; memset(bi, 0, sizeof(bi));
+                MYSQL_BIND bi[10]; memset(bi, 0, sizeof(bi));
                 bi[0].buffer_type = MYSQL_TYPE_LONG; bi[0].buffer=(void*)&artnum;
                 bi[1].buffer_type = MYSQL_TYPE_STRING; bi[1].buffer=(void*)subject; bi[1].buffer_length=sl;
                 bi[2].buffer_type = MYSQL_TYPE_STRING; bi[2].buffer=(void*)author; bi[2].buffer_length=al;
-                bi[3].buffer_type = MYSQL_TYPE_STRING; bi[3].buffer=(void*)date; bi[3].buffer_length=dl;
+                bi[3].buffer_type = draw ? MYSQL_TYPE_STRING : MYSQL_TYPE_NULL; bi[3].buffer=(void*)draw; bi[3].buffer_length=dl;
                 bi[4].buffer_type = MYSQL_TYPE_STRING; bi[4].buffer=(void*)message_id; bi[4].buffer_length=ml;
                 bi[5].buffer_type = MYSQL_TYPE_STRING; bi[5].buffer=(void*)references; bi[5].buffer_length=rl;
                 bi[6].buffer_type = MYSQL_TYPE_LONG; bi[6].buffer=(void*)&bytes;
                 bi[7].buffer_type = MYSQL_TYPE_LONG; bi[7].buffer=(void*)&lines;
                 bi[8].buffer_type = MYSQL_TYPE_STRING; bi[8].buffer=(void*)group; bi[8].buffer_length=gl;
+                if (v2) mysql_bind_epoch(bi, 9, dated, &epoch);
                 if (mysql_stmt_bind_param(db->mysql_article_ins, bi)) {
                     warnf("mysql bind article-insert failed: %s", mysql_stmt_error(db->mysql_article_ins));
+                    db->writes_failed++;
                     mysql_stmt_reset(db->mysql_article_ins);
                 } else if (mysql_stmt_execute(db->mysql_article_ins)) {
                     warnf("mysql execute article-insert failed: %s", mysql_stmt_error(db->mysql_article_ins));
+                    db->writes_failed++;
                     mysql_stmt_reset(db->mysql_article_ins);
                 } else {
                     mysql_stmt_reset(db->mysql_article_ins);
@@ -638,6 +2443,7 @@ void db_insert_article(DB *db, const char *group, int artnum, const char *subjec
                 }
             } else {
                 warnf("article not found for update: %s #%d", group, artnum);
+                db->writes_failed++;
             }
         }
         return;
@@ -647,17 +2453,39 @@ void db_insert_article(DB *db, const char *group, int artnum, const char *subjec
         PGconn *pgc = (PGconn*)db->impl; if (!pgc) return;
         char bbuf[16], lbuf[16], abuf[16];
         snprintf(bbuf,sizeof(bbuf),"%d",bytes); snprintf(lbuf,sizeof(lbuf),"%d",lines); snprintf(abuf,sizeof(abuf),"%d",artnum);
-        const char *upd[9] = { subject, author, date, message_id, references, bbuf, lbuf, group, abuf };
-        PGresult *r = PQexecParams(pgc,
-            "UPDATE articles SET subject=$1, author=$2, date=$3, message_id=$4, refs=$5, bytes=$6, line_count=$7 WHERE group_name=$8 AND artnum=$9",
-            9, NULL, upd, NULL, NULL, 0);
-        int ok = (PQresultStatus(r)==PGRES_COMMAND_OK); PQclear(r);
-        if (!ok && g_upsert){
-            const char *ins[9] = { abuf, subject, author, date, message_id, references, bbuf, lbuf, group };
-            r = PQexecParams(pgc,
-                "INSERT INTO articles (artnum, subject, author, date, message_id, refs, bytes, line_count, group_name) VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9)",
-                9, NULL, ins, NULL, NULL, 0);
+        const char *eval = dated ? ebuf : NULL;
+        char v2sql[1024];
+        if (v2 && !(g_upsert && db->pg_prepared)) v2_article_sql(db, V2_UPDATE, v2sql, sizeof(v2sql));
+        if (g_upsert && db->pg_prepared) {
+            const char *ups[10] = { abuf, subject, author, draw, message_id, references, bbuf, lbuf, group, eval };
+            PGresult *r = PQexecPrepared(pgc, "article_upsert", v2 ? 10 : 9, ups, NULL, NULL, 0);
+            if (PQresultStatus(r) != PGRES_COMMAND_OK) { warnf("postgres article upsert error: %s", PQerrorMessage(pgc)); db->writes_failed++; }
             PQclear(r);
+            return;
+        }
+        const char *upd[10] = { subject, author, draw, message_id, references, bbuf, lbuf, group, abuf, eval };
+        PGresult *r = PQexecParams(pgc, v2 ? v2sql :
+            "UPDATE articles SET subject=$1, author=$2, date=$3, message_id=$4, refs=$5, bytes=$6, line_count=$7 WHERE group_name=$8 AND artnum=$9",
+            v2 ? 10 : 9, NULL, upd, NULL, NULL, 0);
+        int ok = (PQresultStatus(r)==PGRES_COMMAND_OK);
+        /* a successful UPDATE that matched nothing still reports COMMAND_OK */
+        int updated = ok && atoi(PQcmdTuples(r)) > 0;
+        if (!ok) { warnf("postgres article update error: %s", PQerrorMessage(pgc)); db->writes_failed++; }
+        PQclear(r);
+        if (ok && !updated) {
+            if (g_upsert) {
+                const char *ins[10] = { abuf, subject, author, draw, message_id, references, bbuf, lbuf, group, eval };
+                if (v2) v2_article_sql(db, V2_INSERT, v2sql, sizeof(v2sql));
+                r = PQexecParams(pgc, v2 ? v2sql :
+                    "INSERT INTO articles (artnum, subject, author, date, message_id, refs, bytes, line_count, group_name) VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9)",
+                    v2 ? 10 : 9, NULL, ins, NULL, NULL, 0);
+                if (PQresultStatus(r) != PGRES_COMMAND_OK) { warnf("postgres article insert error: %s", PQerrorMessage(pgc)); db->writes_failed++; }
+                else infof("article inserted: %s #%d", group, artnum);
+                PQclear(r);
+            } else {
+                warnf("article not found for update: %s #%d", group, artnum);
+                db->writes_failed++;
+            }
         }
         return;
     }
@@ -670,345 +2498,3230 @@ void db_insert_article(DB *db, const char *group, int artnum, const char *subjec
     char *m = db_escape(db, message_id);
     char *r = db_escape(db, references);
     char sql[4096];
+    if (v2) {
+        size_t kn = strlen(a) + strlen(g) + 64;
+        char *ak = malloc(kn), *gk = malloc(kn);
+        if (!ak || !gk) fatal(ERR_RUNTIME, "Out of memory");
+        v2_key(db, 1, a, ak, kn); v2_key(db, 0, g, gk, kn);
+        const char *acol = db->intern_authors ? "author_id" : "author", *dr = draw ? d : "NULL", *ep = dated ? ebuf : "NULL";
+        snprintf(sql, sizeof(sql), "UPDATE articles SET subject=%s, %s=%s, date_raw=%s, message_id=%s, refs=%s, bytes=%d, line_count=%d, date=%s WHERE group_id=%s AND artnum=%d;",
+                 s, acol, ak, dr, m, r, bytes, lines, ep, gk, artnum);
+        int failed = db_exec(db, sql);
+        if (g_upsert) {
+            snprintf(sql, sizeof(sql), "INSERT INTO articles (artnum, subject, %s, date_raw, message_id, refs, bytes, line_count, group_id, date) VALUES (%d,%s,%s,%s,%s,%s,%d,%d,%s,%s);",
+                     acol, artnum, s, ak, dr, m, r, bytes, lines, gk, ep);
+            if (db_exec(db, sql) == 0) failed = 0; /* the UPDATE may have matched nothing */
+        }
+        if (failed) db->writes_failed++;
+        free(ak); free(gk);
+        free(g); free(s); free(a); free(d); free(m); free(r);
+        return;
+    }
     snprintf(sql, sizeof(sql),
              "UPDATE `articles` SET `subject`=%s, `author`=%s, `date`=%s, `message_id`=%s, `refs`=%s, `bytes`=%d, `line_count`=%d WHERE `group_name`=%s AND `artnum`=%d;",
              s, a, d, m, r, bytes, lines, g, artnum);
-    db_exec(db, sql);
+    int failed = db_exec(db, sql);
     if (g_upsert) {
         snprintf(sql, sizeof(sql),
             "INSERT INTO `articles` (`artnum`, `subject`, `author`, `date`, `message_id`, `refs`, `bytes`, `line_count`, `group_name`) VALUES (%d,%s,%s,%s,%s,%s,%d,%d,%s);",
             artnum, s, a, d, m, r, bytes, lines, g);
-        db_exec(db, sql);
+        if (db_exec(db, sql) == 0) failed = 0;
     }
+    if (failed) db->writes_failed++;
     free(g); free(s); free(a); free(d); free(m); free(r);
 }
 
-/* NNTP commands */
+/* Bulk writer. Rows are always inserted; with --upsert existing rows are
+   updated, otherwise they are left untouched (a backfill never fails on a
+   duplicate (group_name, artnum)). */
+#define ARTICLE_COLS "artnum, subject, author, date, message_id, refs, bytes, line_count, group_name"
 
-/* read server greeting */
+static size_t bulk_intern(DBBulk *b, const char *s, size_t len) {
+    size_t n = len + 1;
+    if (b->pool_len + n > b->pool_cap) {
+        size_t cap = b->pool_cap ? b->pool_cap : 64 * 1024;
+        while (cap < b->pool_len + n) cap *= 2;
+        char *np = realloc(b->pool, cap);
+        if (!np) fatal(ERR_RUNTIME, "Out of memory in bulk writer");
+        b->pool = np; b->pool_cap = cap;
+    }
+    size_t off = b->pool_len;
+    memcpy(b->pool + off, s, len);
+    b->pool[off + len] = '\0';
+    b->pool_len += n;
+    return off;
+}
 
-/* Authenticate using AUTHINFO USER/PASS */
-static int nntp_auth(Conn *c, const char *user, const char *pass) {
-    char resp[BUFSZ];
-    conn_sendf(c, "AUTHINFO USER %s", user);
-    if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
-    int code = atoi(resp);
-    if (code == 381) {
-        conn_sendf(c, "AUTHINFO PASS %s", pass);
-        if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
-        return atoi(resp);
+static void db_bulk_add(DB *db, const DBArticle *a) {
+    DBBulk *b = &db->bulk;
+    if (!b->rows) {
+        b->rows = malloc(sizeof(DBBulkRow) * b->cap);
+        if (!b->rows) fatal(ERR_RUNTIME, "Out of memory in bulk writer");
+    }
+    DBBulkRow *r = &b->rows[b->n++];
+    r->artnum = a->artnum; r->bytes = a->bytes; r->lines = a->lines;
+    r->group = bulk_intern(b, a->group, a->group_len);
+    r->subject = bulk_intern(b, a->subject, a->subject_len);
+    r->author = bulk_intern(b, a->author, a->author_len);
+    r->date = bulk_intern(b, a->date, a->date_len);
+    r->message_id = bulk_intern(b, a->message_id, a->message_id_len);
+    r->refs = bulk_intern(b, a->refs, a->refs_len);
+    r->dated = db->schema == 2 && news_date_epoch(a->date, a->date_len, &r->epoch);
+}
+
+/* v2 multi-row INSERT up to VALUES */
+static void bulk_v2_head(DB *db, SqlBuf *sb, const char *verb) {
+    char head[256];
+    snprintf(head, sizeof(head), "%s INTO %s (artnum, subject, %s, date_raw, message_id, refs, bytes, line_count, group_id, date) VALUES ",
+             verb, db->type == DB_MYSQL ? "`articles`" : "articles", db->intern_authors ? "author_id" : "author");
+    sqlbuf_puts(sb, head);
+}
+
+static sqlite3_stmt *bulk_sqlite_prepare(DB *db, int rows) {
+    SqlBuf sb = {0};
+    if (db->schema == 2) {
+        char tup[256], akey[96], gkey[96], conflict[512];
+        snprintf(tup, sizeof(tup), "(?,?,%s,?,?,?,?,?,%s,?)", v2_key(db, 1, "?", akey, sizeof(akey)), v2_key(db, 0, "?", gkey, sizeof(gkey)));
+        bulk_v2_head(db, &sb, "INSERT");
+        for (int i = 0; i < rows; ++i) { if (i) sqlbuf_put(&sb, ",", 1); sqlbuf_puts(&sb, tup); }
+        v2_conflict_sql(db, g_upsert, conflict, sizeof(conflict));
+        sqlbuf_puts(&sb, conflict);
+    } else {
+    sqlbuf_puts(&sb, "INSERT INTO articles (" ARTICLE_COLS ") VALUES ");
+    for (int i = 0; i < rows; ++i) sqlbuf_puts(&sb, i ? ",(?,?,?,?,?,?,?,?,?)" : "(?,?,?,?,?,?,?,?,?)");
+    sqlbuf_puts(&sb, g_upsert ?
+        " ON CONFLICT(group_name, artnum) DO UPDATE SET subject=excluded.subject, author=excluded.author, date=excluded.date, "
+        "message_id=excluded.message_id, refs=excluded.refs, bytes=excluded.bytes, line_count=excluded.line_count" :
+        " ON CONFLICT(group_name, artnum) DO NOTHING");
+    }
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(db->sqlite, sb.s, (int)sb.len, &st, NULL) != SQLITE_OK) {
+        warnf("sqlite prepare bulk insert (%d rows) failed: %s", rows, sqlite3_errmsg(db->sqlite));
+        st = NULL;
+    }
+    free(sb.s);
+    return st;
+}
+
+static void bulk_flush_sqlite(DB *db) {
+    DBBulk *b = &db->bulk;
+    int v2 = db->schema == 2;
+    int per = sqlite3_limit(db->sqlite, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / (v2 ? 10 : 9);
+    if (per > b->cap) per = b->cap;
+    if (per < 1) per = 1;
+    for (int at = 0; at < b->n; at += per) {
+        int rows = (b->n - at < per) ? b->n - at : per;
+        sqlite3_stmt *st;
+        if (rows == per) {
+            if (!b->sqlite_stmt || b->sqlite_rows != per) {
+                if (b->sqlite_stmt) sqlite3_finalize(b->sqlite_stmt);
+                b->sqlite_stmt = bulk_sqlite_prepare(db, per);
+                b->sqlite_rows = per;
+            }
+            st = b->sqlite_stmt;
+        } else {
+            st = bulk_sqlite_prepare(db, rows);
+        }
+        if (!st) { db->writes_failed++; return; }
+        int k = 1;
+        for (int i = at; i < at + rows; ++i) {
+            DBBulkRow *r = &b->rows[i];
+            if (db->intern_authors) db_v2_author(db, b->pool + r->author, strlen(b->pool + r->author));
+            sqlite3_bind_int(st, k++, r->artnum);
+            sqlite3_bind_text(st, k++, b->pool + r->subject, -1, SQLITE_STATIC);
+            sqlite3_bind_text(st, k++, b->pool + r->author, -1, SQLITE_STATIC);
+            if (v2 && !g_keep_date_text) sqlite3_bind_null(st, k++);
+            else sqlite3_bind_text(st, k++, b->pool + r->date, -1, SQLITE_STATIC);
+            sqlite3_bind_text(st, k++, b->pool + r->message_id, -1, SQLITE_STATIC);
+            sqlite3_bind_text(st, k++, b->pool + r->refs, -1, SQLITE_STATIC);
+            sqlite3_bind_int(st, k++, r->bytes);
+            sqlite3_bind_int(st, k++, r->lines);
+            sqlite3_bind_text(st, k++, b->pool + r->group, -1, SQLITE_STATIC);
+            if (!v2) continue;
+            if (r->dated) sqlite3_bind_int64(st, k++, r->epoch);
+            else sqlite3_bind_null(st, k++);
+        }
+        if (sqlite3_step(st) != SQLITE_DONE) { warnf("sqlite bulk insert failed: %s", sqlite3_errmsg(db->sqlite)); db->writes_failed++; }
+        sqlite3_reset(st); sqlite3_clear_bindings(st);
+        if (st != b->sqlite_stmt) sqlite3_finalize(st);
+    }
+}
+
+/* run one bulk statement. Rows the server truncated or converted only raise
+   warnings, so report those as well; notes and 1287 (VALUES() in ON DUPLICATE
+   KEY UPDATE is deprecated on 8.0) say nothing about the rows */
+static void bulk_mysql_query(DB *db, const SqlBuf *sb, const char *what) {
+    if (mysql_real_query(db->mysql, sb->s, (unsigned long)sb->len)) {
+        warnf("mysql %s failed: %s", what, mysql_error(db->mysql));
+        db->writes_failed++;
+        return;
+    }
+    if (mysql_warning_count(db->mysql) == 0 || mysql_query(db->mysql, "SHOW WARNINGS")) return;
+    MYSQL_RES *res = mysql_store_result(db->mysql);
+    if (!res) return;
+    MYSQL_ROW row;
+    int nw = 0;
+    char first[256] = "";
+    while ((row = mysql_fetch_row(res)) != NULL) {
+        if (!row[0] || !row[1] || strcmp(row[0], "Note") == 0 || atoi(row[1]) == 1287) continue;
+        if (nw++ == 0) snprintf(first, sizeof(first), "%s", row[2] ? row[2] : "");
+    }
+    mysql_free_result(res);
+    if (nw) warnf("mysql %s: %d warning(s), first: %s", what, nw, first);
+}
+
+/* the server's max_allowed_packet, read once per connection, less room for
+   the protocol header: no bulk statement may be longer */
+static size_t bulk_mysql_packet(DB *db) {
+    DBBulk *b = &db->bulk;
+    if (!b->mysql_packet) {
+        unsigned long v = 0;
+        if (mysql_query(db->mysql, "SELECT @@max_allowed_packet") == 0) {
+            MYSQL_RES *res = mysql_store_result(db->mysql);
+            MYSQL_ROW row = res ? mysql_fetch_row(res) : NULL;
+            if (row && row[0]) v = strtoul(row[0], NULL, 10);
+            if (res) mysql_free_result(res);
+        }
+        if (v == 0) { warnf("mysql max_allowed_packet unknown; bulk statements kept under 1 MiB"); v = 1UL << 20; }
+        b->mysql_packet = v > 4096 ? v - 1024 : v;
+    }
+    return b->mysql_packet;
+}
+
+typedef void (*BulkRowSql)(DB *db, SqlBuf *sb, const DBBulkRow *r);
+
+/* send head, the batch's rows joined by sep, then tail; a batch that would
+   not fit in max_allowed_packet is split over as many statements as needed */
+static void bulk_mysql_send(DB *db, const char *head, const char *sep, BulkRowSql row_sql, const char *tail, const char *what) {
+    DBBulk *b = &db->bulk;
+    size_t limit = bulk_mysql_packet(db), hl = strlen(head), sl = strlen(sep), tl = strlen(tail);
+    SqlBuf sb = {0}, rb = {0};
+    int rows = 0;
+    for (int i = 0; i < b->n; ++i) {
+        rb.len = 0;
+        row_sql(db, &rb, &b->rows[i]);
+        if (rows && sb.len + sl + rb.len + tl > limit) {
+            sqlbuf_put(&sb, tail, tl);
+            bulk_mysql_query(db, &sb, what);
+            rows = 0;
+        }
+        if (rows == 0) { sb.len = 0; sqlbuf_put(&sb, head, hl); }
+        else sqlbuf_put(&sb, sep, sl);
+        sqlbuf_put(&sb, rb.s, rb.len);
+        rows++;
+    }
+    if (rows) { sqlbuf_put(&sb, tail, tl); bulk_mysql_query(db, &sb, what); }
+    free(sb.s); free(rb.s);
+}
+
+static void bulk_mysql_author_row(DB *db, SqlBuf *sb, const DBBulkRow *r) {
+    sqlbuf_puts(sb, "SELECT LEFT(");
+    sqlbuf_put_mysql_str(sb, db->mysql, db->bulk.pool + r->author);
+    sqlbuf_puts(sb, ",255) AS n");
+}
+
+static void bulk_mysql_v2_row(DB *db, SqlBuf *sb, const DBBulkRow *r) {
+    const char *pool = db->bulk.pool;
+    char num[64];
+    snprintf(num, sizeof(num), "(%d,", r->artnum); sqlbuf_puts(sb, num);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->subject); sqlbuf_put(sb, ",", 1);
+    if (db->intern_authors) sqlbuf_puts(sb, "(SELECT id FROM `authors` WHERE name=LEFT(");
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->author);
+    sqlbuf_puts(sb, db->intern_authors ? ",255)),": ",");
+    if (g_keep_date_text) sqlbuf_put_mysql_str(sb, db->mysql, pool + r->date);
+    else sqlbuf_puts(sb, "NULL");
+    sqlbuf_put(sb, ",", 1);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->message_id); sqlbuf_put(sb, ",", 1);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->refs);
+    snprintf(num, sizeof(num), ",%d,%d,(SELECT id FROM `groups` WHERE name=", r->bytes, r->lines); sqlbuf_puts(sb, num);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->group);
+    if (r->dated) snprintf(num, sizeof(num), "),%lld)", r->epoch);
+    else snprintf(num, sizeof(num), "),NULL)");
+    sqlbuf_puts(sb, num);
+}
+
+static void bulk_flush_mysql_v2(DB *db) {
+    SqlBuf head = {0};
+    char conflict[512];
+    /* v2: the authors of a batch not yet in authors first */
+    if (db->intern_authors)
+        bulk_mysql_send(db, "INSERT INTO `authors` (name) SELECT DISTINCT n FROM (", " UNION ALL ", bulk_mysql_author_row,
+                        ") x WHERE NOT EXISTS (SELECT 1 FROM `authors` a WHERE a.name = x.n) ON DUPLICATE KEY UPDATE name=name", "author insert");
+    bulk_v2_head(db, &head, "INSERT");
+    v2_conflict_sql(db, g_upsert, conflict, sizeof(conflict));
+    bulk_mysql_send(db, head.s, ",", bulk_mysql_v2_row, conflict, "bulk insert");
+    free(head.s);
+}
+
+static void bulk_mysql_row(DB *db, SqlBuf *sb, const DBBulkRow *r) {
+    const char *pool = db->bulk.pool;
+    char num[64];
+    snprintf(num, sizeof(num), "(%d,", r->artnum); sqlbuf_puts(sb, num);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->subject); sqlbuf_put(sb, ",", 1);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->author); sqlbuf_put(sb, ",", 1);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->date); sqlbuf_put(sb, ",", 1);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->message_id); sqlbuf_put(sb, ",", 1);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->refs);
+    snprintf(num, sizeof(num), ",%d,%d,", r->bytes, r->lines); sqlbuf_puts(sb, num);
+    sqlbuf_put_mysql_str(sb, db->mysql, pool + r->group); sqlbuf_put(sb, ")", 1);
+}
+
+static void bulk_flush_mysql(DB *db) {
+    if (db->schema == 2) { bulk_flush_mysql_v2(db); return; }
+    /* a duplicate is a no-op update rather than INSERT IGNORE, which would hide every other row error too */
+    bulk_mysql_send(db, "INSERT INTO `articles` (`artnum`, `subject`, `author`, `date`, `message_id`, `refs`, `bytes`, `line_count`, `group_name`) VALUES ",
+                    ",", bulk_mysql_row, g_upsert ?
+                    " ON DUPLICATE KEY UPDATE `subject`=VALUES(`subject`), `author`=VALUES(`author`), `date`=VALUES(`date`), "
+                    "`message_id`=VALUES(`message_id`), `refs`=VALUES(`refs`), `bytes`=VALUES(`bytes`), `line_count`=VALUES(`line_count`)" :
+                    " ON DUPLICATE KEY UPDATE `artnum`=`artnum`", "bulk insert");
+}
+
+#ifdef HAVE_PQ
+/* COPY text format: escape backslash, tab, newline and carriage return */
+static void sqlbuf_put_copy_str(SqlBuf *sb, const char *s) {
+    const char *run = s;
+    for (; *s; s++) {
+        const char *rep = NULL;
+        if (*s == '\\') rep = "\\\\"; else if (*s == '\t') rep = "\\t"; else if (*s == '\n') rep = "\\n"; else if (*s == '\r') rep = "\\r";
+        if (rep) { sqlbuf_put(sb, run, (size_t)(s - run)); sqlbuf_put(sb, rep, 2); run = s + 1; }
+    }
+    sqlbuf_put(sb, run, (size_t)(s - run));
+}
+
+/* v2: staged rows join groups (and authors) for their keys */
+static int bulk_merge_pg_v2(DB *db) {
+    char sql[1536], conflict[512];
+    if (db->intern_authors &&
+        db_exec(db, "INSERT INTO authors (name) SELECT DISTINCT s.author FROM articles_stage s "
+                    "WHERE NOT EXISTS (SELECT 1 FROM authors a WHERE a.name = s.author) ON CONFLICT (name) DO NOTHING")) return -1;
+    v2_conflict_sql(db, g_upsert, conflict, sizeof(conflict));
+    snprintf(sql, sizeof(sql),
+        "INSERT INTO articles (artnum, subject, %s, date_raw, message_id, refs, bytes, line_count, group_id, date) "
+        "SELECT DISTINCT ON (s.group_name, s.artnum) s.artnum, s.subject, %s, %s, s.message_id, s.refs, s.bytes, s.line_count, g.id, s.epoch "
+        "FROM articles_stage s JOIN groups g ON g.name = s.group_name%s%s",
+        db->intern_authors ? "author_id" : "author", db->intern_authors ? "au.id" : "s.author", g_keep_date_text ? "s.date" : "NULL",
+        db->intern_authors ? " JOIN authors au ON au.name = s.author" : "", conflict);
+    return db_exec(db, sql);
+}
+
+/* COPY rows at..at+n-1 into the stage table and merge them into articles;
+   -1 if any of it failed. Inside a batch this runs under the savepoint
+   "bulk", so a failure leaves the transaction usable. */
+static int bulk_pg_rows(DB *db, int at, int n) {
+    DBBulk *b = &db->bulk;
+    PGconn *pgc = (PGconn*)db->impl;
+    int v2 = db->schema == 2, failed = 0;
+    if (db->in_txn) db_exec(db, "SAVEPOINT bulk");
+    PGresult *r = PQexec(pgc, v2 ? "COPY articles_stage (" ARTICLE_COLS ", epoch) FROM STDIN" : "COPY articles_stage (" ARTICLE_COLS ") FROM STDIN");
+    if (PQresultStatus(r) != PGRES_COPY_IN) { warnf("postgres COPY failed: %s", PQerrorMessage(pgc)); failed = 1; }
+    PQclear(r);
+    if (!failed) {
+        SqlBuf sb = {0};
+        char num[64];
+        for (int i = at; i < at + n; ++i) {
+            DBBulkRow *row = &b->rows[i];
+            snprintf(num, sizeof(num), "%d\t", row->artnum); sqlbuf_puts(&sb, num);
+            sqlbuf_put_copy_str(&sb, b->pool + row->subject); sqlbuf_put(&sb, "\t", 1);
+            sqlbuf_put_copy_str(&sb, b->pool + row->author); sqlbuf_put(&sb, "\t", 1);
+            sqlbuf_put_copy_str(&sb, b->pool + row->date); sqlbuf_put(&sb, "\t", 1);
+            sqlbuf_put_copy_str(&sb, b->pool + row->message_id); sqlbuf_put(&sb, "\t", 1);
+            sqlbuf_put_copy_str(&sb, b->pool + row->refs);
+            snprintf(num, sizeof(num), "\t%d\t%d\t", row->bytes, row->lines); sqlbuf_puts(&sb, num);
+            sqlbuf_put_copy_str(&sb, b->pool + row->group);
+            if (v2 && row->dated) { snprintf(num, sizeof(num), "\t%lld", row->epoch); sqlbuf_puts(&sb, num); }
+            else if (v2) sqlbuf_puts(&sb, "\t\\N");
+            sqlbuf_put(&sb, "\n", 1);
+        }
+        if (PQputCopyData(pgc, sb.s ? sb.s : "", (int)sb.len) != 1 || PQputCopyEnd(pgc, NULL) != 1) {
+            warnf("postgres COPY data failed: %s", PQerrorMessage(pgc));
+            failed = 1;
+        }
+        free(sb.s);
+        while ((r = PQgetResult(pgc)) != NULL) {
+            if (PQresultStatus(r) != PGRES_COMMAND_OK) { warnf("postgres COPY failed: %s", PQerrorMessage(pgc)); failed = 1; }
+            PQclear(r);
+        }
+    }
+    if (!failed && v2) failed = bulk_merge_pg_v2(db) != 0;
+    /* DISTINCT ON: ON CONFLICT DO UPDATE may not touch the same row twice in one statement */
+    else if (!failed) failed = db_exec(db, g_upsert ?
+        "INSERT INTO articles (" ARTICLE_COLS ") SELECT DISTINCT ON (group_name, artnum) " ARTICLE_COLS " FROM articles_stage "
+        "ON CONFLICT (group_name, artnum) DO UPDATE SET subject=EXCLUDED.subject, author=EXCLUDED.author, date=EXCLUDED.date, "
+        "message_id=EXCLUDED.message_id, refs=EXCLUDED.refs, bytes=EXCLUDED.bytes, line_count=EXCLUDED.line_count" :
+        "INSERT INTO articles (" ARTICLE_COLS ") SELECT " ARTICLE_COLS " FROM articles_stage ON CONFLICT (group_name, artnum) DO NOTHING") != 0;
+    if (db->in_txn) db_exec(db, failed ? "ROLLBACK TO SAVEPOINT bulk; RELEASE SAVEPOINT bulk" : "RELEASE SAVEPOINT bulk");
+    db_exec(db, "TRUNCATE articles_stage");
+    return failed ? -1 : 0;
+}
+
+static void bulk_flush_pg(DB *db) {
+    DBBulk *b = &db->bulk;
+    if (!db->impl) return;
+    if (!b->pg_staged) {
+        db_exec(db, "CREATE TEMP TABLE IF NOT EXISTS articles_stage (artnum INT, subject TEXT, author TEXT, date TEXT, message_id TEXT, refs TEXT, bytes INT, line_count INT, group_name TEXT, epoch BIGINT)");
+        b->pg_staged = 1;
+    }
+    if (bulk_pg_rows(db, 0, b->n) == 0) return;
+    if (b->n == 1) { db->writes_failed++; return; }
+    /* one bad row fails the whole statement: redo them one at a time so only it is lost */
+    warnf("postgres bulk insert of %d rows failed; retrying row by row", b->n);
+    for (int i = 0; i < b->n; ++i)
+        if (bulk_pg_rows(db, i, 1)) db->writes_failed++;
+}
+#endif
+
+void db_bulk_flush(DB *db) {
+    for (int k = 0; k < db->nshards; ++k) db_bulk_flush(&db->shard[k]);
+    DBBulk *b = &db->bulk;
+    if (b->n == 0) return;
+    if (db->type == DB_SQLITE) bulk_flush_sqlite(db);
+    else if (db->type == DB_MYSQL) bulk_flush_mysql(db);
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES) bulk_flush_pg(db);
+#endif
+    infof("bulk flushed %d rows", b->n);
+    b->n = 0;
+    b->pool_len = 0;
+}
+
+/* --migrate-schema, first half: the v1 table moves aside as articles_v1
+   together with whatever would collide with the v2 objects (index names,
+   which Postgres keeps per schema, and SQLite's FTS table and triggers).
+   The copy runs in the same transaction; MySQL commits its DDL itself. */
+static void db_migrate_begin(DB *db) {
+    infof("migrating articles to the v2 layout");
+    db_begin(db);
+    if (db->type == DB_SQLITE)
+        db_exec(db, "DROP TRIGGER IF EXISTS articles_fts_ai; DROP TRIGGER IF EXISTS articles_fts_ad; DROP TRIGGER IF EXISTS articles_fts_au;"
+                    "DROP TABLE IF EXISTS articles_fts; DROP VIEW IF EXISTS articles_text; DROP INDEX IF EXISTS idx_articles_group_artnum;"
+                    "ALTER TABLE articles RENAME TO articles_v1;");
+    else if (db->type == DB_MYSQL)
+        db_exec(db, "RENAME TABLE `articles` TO `articles_v1`");
+    else
+        db_exec(db, "DROP INDEX IF EXISTS idx_articles_fts; DROP INDEX IF EXISTS idx_articles_group_artnum; ALTER TABLE articles RENAME TO articles_v1;");
+    db->schema = 0;
+}
+
+#define MIGRATE_CHUNK 5000
+
+/* one articles_v1 row as id, artnum, subject, author, date, message_id,
+   refs, bytes, line_count, group_name; NULL columns are "" */
+static void migrate_row(DB *db, long long *after, const char *f[10]) {
+    *after = atoll(f[0]);
+    if (!*f[9]) return;
+    DBArticle a;
+    a.artnum = atoi(f[1]); a.bytes = atoi(f[7]); a.lines = atoi(f[8]);
+    a.subject = f[2]; a.author = f[3]; a.date = f[4]; a.message_id = f[5]; a.refs = f[6]; a.group = f[9];
+    a.subject_len = strlen(a.subject); a.author_len = strlen(a.author); a.date_len = strlen(a.date);
+    a.message_id_len = strlen(a.message_id); a.refs_len = strlen(a.refs); a.group_len = strlen(a.group);
+    a.xref = ""; a.xref_len = 0;
+    db_bulk_add(db, &a);
+}
+
+/* the next MIGRATE_CHUNK rows after id *after into the bulk writer */
+static int migrate_chunk(DB *db, long long *after) {
+    char sql[256];
+    const char *f[10];
+    int n = 0;
+    snprintf(sql, sizeof(sql), "SELECT id, artnum, subject, author, date, message_id, refs, bytes, line_count, group_name FROM %s WHERE id > %lld ORDER BY id LIMIT %d",
+             db->type == DB_MYSQL ? "`articles_v1`" : "articles_v1", *after, MIGRATE_CHUNK);
+    if (db->type == DB_SQLITE) {
+        sqlite3_stmt *st = NULL;
+        if (sqlite3_prepare_v2(db->sqlite, sql, -1, &st, NULL) != SQLITE_OK) fatal(ERR_DB_SCHEMA, "sqlite migrate read failed: %s", sqlite3_errmsg(db->sqlite));
+        while (sqlite3_step(st) == SQLITE_ROW) {
+            for (int k = 0; k < 10; ++k) { f[k] = (const char*)sqlite3_column_text(st, k); if (!f[k]) f[k] = ""; }
+            migrate_row(db, after, f); n++;
+        }
+        sqlite3_finalize(st);
+    } else if (db->type == DB_MYSQL) {
+        MYSQL_RES *res;
+        if (mysql_query(db->mysql, sql) || !(res = mysql_store_result(db->mysql))) fatal(ERR_DB_SCHEMA, "mysql migrate read failed: %s", mysql_error(db->mysql));
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(res))) {
+            for (int k = 0; k < 10; ++k) f[k] = row[k] ? row[k] : "";
+            migrate_row(db, after, f); n++;
+        }
+        mysql_free_result(res);
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES) {
+        PGconn *pgc = (PGconn*)db->impl;
+        PGresult *r = PQexec(pgc, sql);
+        if (PQresultStatus(r) != PGRES_TUPLES_OK) fatal(ERR_DB_SCHEMA, "postgres migrate read failed: %s", PQerrorMessage(pgc));
+        for (int i = 0; i < PQntuples(r); ++i) {
+            for (int k = 0; k < 10; ++k) f[k] = PQgetvalue(r, i, k);
+            migrate_row(db, after, f); n++;
+        }
+        PQclear(r);
+    }
+#endif
+    return n;
+}
+
+/* second half: copy articles_v1 through the bulk writer, drop it, commit */
+static void db_migrate_copy(DB *db) {
+    if (db->type == DB_SQLITE) db_exec(db, "INSERT OR IGNORE INTO groups (name) SELECT DISTINCT group_name FROM articles_v1 WHERE group_name IS NOT NULL");
+    else if (db->type == DB_MYSQL) db_exec(db, "INSERT IGNORE INTO `groups` (name) SELECT DISTINCT group_name FROM `articles_v1` WHERE group_name IS NOT NULL");
+    else db_exec(db, "INSERT INTO groups (name) SELECT DISTINCT group_name FROM articles_v1 WHERE group_name IS NOT NULL ON CONFLICT (name) DO NOTHING");
+    int cap = db->bulk.cap;
+    long long after = 0, total = 0;
+    int n;
+    db->bulk.cap = MIGRATE_CHUNK;
+    while ((n = migrate_chunk(db, &after)) > 0) {
+        db_bulk_flush(db);
+        total += n;
+        if (total % (20 * MIGRATE_CHUNK) == 0) infof("migrated %lld articles", total);
+    }
+    free(db->bulk.rows); db->bulk.rows = NULL;
+    db->bulk.cap = cap;
+    db_exec(db, db->type == DB_MYSQL ? "DROP TABLE `articles_v1`" : "DROP TABLE articles_v1");
+    db_commit(db);
+    infof("migrated %lld articles to the v2 layout%s", total, db->type == DB_SQLITE ? "; VACUUM returns the old table's pages to the file system" : "");
+}
+
+/* Crosspost filter (--dedup): 64-bit fingerprints of the Message-IDs stored,
+   each with the fingerprint of the group:artnum it is stored under, and of
+   the group:artnums recorded as crossposts. Preloaded from the database at
+   startup; the DB writer adds to them, fetch threads look up which articles
+   need no HEAD. A fingerprint collision (odds about n^2 / 2^65) would take
+   one article for a crosspost. */
+typedef struct { unsigned long long *key, *val; size_t n, cap; } FpMap;
+
+static FpMap g_xp_ids, g_xp_placed;
+static pthread_mutex_t g_xp_m = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long fp_mix(unsigned long long h) {
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL; h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL; h ^= h >> 33;
+    return h ? h : 1; /* 0 marks an empty slot */
+}
+
+static unsigned long long fp_str(const char *s, size_t n) {
+    unsigned long long h = 0xcbf29ce484222325ULL; /* FNV-1a */
+    for (size_t i = 0; i < n; ++i) { h ^= (unsigned char)s[i]; h *= 0x100000001b3ULL; }
+    return h;
+}
+
+static unsigned long long fp_placement(const char *group, size_t len, int artnum) {
+    return fp_mix(fp_str(group, len) ^ ((unsigned long long)(unsigned)artnum * 0x9e3779b97f4a7c15ULL));
+}
+
+static void fpmap_put(FpMap *m, unsigned long long k, unsigned long long v) {
+    if ((m->n + 1) * 10 > m->cap * 7) {
+        size_t nc = m->cap ? m->cap * 2 : 1 << 16;
+        FpMap g = { calloc(nc, sizeof(unsigned long long)), calloc(nc, sizeof(unsigned long long)), 0, nc };
+        if (!g.key || !g.val) fatal(ERR_RUNTIME, "Out of memory growing the crosspost filter");
+        for (size_t i = 0; i < m->cap; ++i) if (m->key[i]) fpmap_put(&g, m->key[i], m->val[i]);
+        free(m->key); free(m->val);
+        *m = g;
+    }
+    size_t i = (size_t)k & (m->cap - 1);
+    while (m->key[i] && m->key[i] != k) i = (i + 1) & (m->cap - 1);
+    if (!m->key[i]) { m->key[i] = k; m->n++; }
+    m->val[i] = v;
+}
+
+static int fpmap_get(const FpMap *m, unsigned long long k, unsigned long long *v) {
+    if (!m->cap) return 0;
+    size_t i = (size_t)k & (m->cap - 1);
+    while (m->key[i]) {
+        if (m->key[i] == k) { if (v) *v = m->val[i]; return 1; }
+        i = (i + 1) & (m->cap - 1);
+    }
+    return 0;
+}
+
+/* group:artnum is known to be a crosspost of a stored article: no HEAD needed */
+static int dedup_placed(const char *group, int artnum) {
+    pthread_mutex_lock(&g_xp_m);
+    int hit = fpmap_get(&g_xp_placed, fp_placement(group, strlen(group), artnum), NULL);
+    pthread_mutex_unlock(&g_xp_m);
+    return hit;
+}
+
+/* a's Message-ID is stored under another group:artnum */
+static int dedup_copy(const DBArticle *a) {
+    unsigned long long at;
+    if (!a->message_id_len) return 0;
+    pthread_mutex_lock(&g_xp_m);
+    int hit = fpmap_get(&g_xp_ids, fp_mix(fp_str(a->message_id, a->message_id_len)), &at) &&
+              at != fp_placement(a->group, a->group_len, a->artnum);
+    pthread_mutex_unlock(&g_xp_m);
+    return hit;
+}
+
+static void db_crosspost_write(DB *db, const char *group, size_t glen, int artnum, const char *msgid, size_t mlen) {
+    char gb[256];
+    if (glen >= sizeof(gb)) return;
+    memcpy(gb, group, glen); gb[glen] = '\0';
+    if (db->type == DB_SQLITE && db->sqlite_crosspost_ins) {
+        sqlite3_stmt *st = db->sqlite_crosspost_ins;
+        if (sqlite3_bind_text(st, 1, gb, (int)glen, SQLITE_STATIC) != SQLITE_OK || sqlite3_bind_int(st, 2, artnum) != SQLITE_OK ||
+            sqlite3_bind_text(st, 3, msgid, (int)mlen, SQLITE_STATIC) != SQLITE_OK || sqlite3_step(st) != SQLITE_DONE)
+            warnf("sqlite crosspost insert failed: %s", sqlite3_errmsg(db->sqlite));
+        sqlite3_reset(st); sqlite3_clear_bindings(st);
+    } else if (db->type == DB_MYSQL) {
+        SqlBuf sb = {0};
+        char num[24];
+        sqlbuf_puts(&sb, "INSERT IGNORE INTO `crossposts` (`group_name`, `artnum`, `message_id`) VALUES (");
+        sqlbuf_put_mysql_strn(&sb, db->mysql, gb, glen);
+        snprintf(num, sizeof(num), ",%d,", artnum); sqlbuf_puts(&sb, num);
+        sqlbuf_put_mysql_strn(&sb, db->mysql, msgid, mlen);
+        sqlbuf_puts(&sb, ")");
+        if (mysql_real_query(db->mysql, sb.s, (unsigned long)sb.len)) warnf("mysql crosspost insert error: %s", mysql_error(db->mysql));
+        free(sb.s);
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGconn *pgc = (PGconn*)db->impl;
+        char num[16];
+        snprintf(num, sizeof(num), "%d", artnum);
+        const char *v[3] = { gb, num, msgid }; /* msgid is NUL-terminated where it is stored */
+        PGresult *r = PQexecParams(pgc, "INSERT INTO crossposts (group_name, artnum, message_id) VALUES ($1,$2,$3) ON CONFLICT DO NOTHING",
+                                   3, NULL, v, NULL, NULL, 0);
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) warnf("postgres crosspost insert error: %s", PQerrorMessage(pgc));
+        PQclear(r);
+    }
+#endif
+}
+
+/* the next group:artnum of a's Xref value ("server g1:n1 g2:n2 ...") other
+   than a's own; *p starts at NULL */
+static int xref_next(const DBArticle *a, const char **p, const char **g, size_t *gl, int *n) {
+    const char *q = *p, *end = a->xref + a->xref_len;
+    if (!q) {
+        for (q = a->xref; q < end && *q == ' '; q++) {}
+        while (q < end && *q != ' ') q++; /* server name */
+    }
+    while (q < end) {
+        while (q < end && *q == ' ') q++;
+        const char *t = q;
+        while (q < end && *q != ' ') q++;
+        const char *colon = memchr(t, ':', (size_t)(q - t));
+        if (!colon || colon == t) continue;
+        *g = t; *gl = (size_t)(colon - t); *n = atoi(colon + 1);
+        if (*n <= 0 || (*gl == a->group_len && memcmp(t, a->group, *gl) == 0)) continue;
+        *p = q;
+        return 1;
+    }
+    *p = q;
+    return 0;
+}
+
+/* fetch side: a's other groups need no HEAD from now on; the writer stores
+   their crossposts rows with a, which is queued ahead of this group's marks */
+static void dedup_note_xref(const DBArticle *a) {
+    const char *p = NULL, *g;
+    size_t gl;
+    int n;
+    if (!a->xref_len || !a->message_id_len) return;
+    pthread_mutex_lock(&g_xp_m);
+    while (xref_next(a, &p, &g, &gl, &n)) fpmap_put(&g_xp_placed, fp_placement(g, gl, n), 0);
+    pthread_mutex_unlock(&g_xp_m);
+}
+
+/* writer side: crossposts rows for a's other groups but the one it is
+   stored under (placement fingerprint `stored`) */
+static void dedup_xref(DB *db, const DBArticle *a, unsigned long long stored) {
+    const char *p = NULL, *g;
+    size_t gl;
+    int n;
+    dedup_note_xref(a);
+    while (xref_next(a, &p, &g, &gl, &n))
+        if (fp_placement(g, gl, n) != stored) db_crosspost_write(db, g, gl, n, a->message_id, a->message_id_len);
+}
+
+/* stream the rows of sql to cb, NULL columns as ""; 0 if the query failed */
+static int db_each_row(DB *db, const char *sql, int ncols, void (*cb)(const char **f, void *arg), void *arg) {
+    const char *f[4];
+    if (db->type == DB_SQLITE) {
+        sqlite3_stmt *st = NULL;
+        if (sqlite3_prepare_v2(db->sqlite, sql, -1, &st, NULL) != SQLITE_OK) { warnf("sqlite query failed: %s", sqlite3_errmsg(db->sqlite)); return 0; }
+        while (sqlite3_step(st) == SQLITE_ROW) {
+            for (int k = 0; k < ncols; ++k) { f[k] = (const char*)sqlite3_column_text(st, k); if (!f[k]) f[k] = ""; }
+            cb(f, arg);
+        }
+        sqlite3_finalize(st);
+        return 1;
+    } else if (db->type == DB_MYSQL) {
+        MYSQL_RES *res;
+        if (mysql_query(db->mysql, sql) || !(res = mysql_use_result(db->mysql))) { warnf("mysql query failed: %s", mysql_error(db->mysql)); return 0; }
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(res))) {
+            for (int k = 0; k < ncols; ++k) f[k] = row[k] ? row[k] : "";
+            cb(f, arg);
+        }
+        mysql_free_result(res);
+        return 1;
+    }
+#ifdef HAVE_PQ
+    else if (db->type == DB_POSTGRES && db->impl) {
+        PGconn *pgc = (PGconn*)db->impl;
+        if (!PQsendQuery(pgc, sql) || !PQsetSingleRowMode(pgc)) { warnf("postgres query failed: %s", PQerrorMessage(pgc)); return 0; }
+        PGresult *r;
+        int ok = 1;
+        while ((r = PQgetResult(pgc)) != NULL) {
+            if (PQresultStatus(r) == PGRES_SINGLE_TUPLE) {
+                for (int k = 0; k < ncols; ++k) f[k] = PQgetvalue(r, 0, k);
+                cb(f, arg);
+            } else if (PQresultStatus(r) != PGRES_TUPLES_OK) {
+                warnf("postgres query failed: %s", PQresultErrorMessage(r));
+                ok = 0;
+            }
+            PQclear(r);
+        }
+        return ok;
+    }
+#endif
+    return 0;
+}
+
+static void dedup_load_id(const char **f, void *arg) {
+    (void)arg;
+    if (!*f[0]) return;
+    fpmap_put(&g_xp_ids, fp_mix(fp_str(f[0], strlen(f[0]))), fp_placement(f[1], strlen(f[1]), atoi(f[2])));
+}
+
+static void dedup_load_placed(const char **f, void *arg) {
+    (void)arg;
+    fpmap_put(&g_xp_placed, fp_placement(f[0], strlen(f[0]), atoi(f[1])), 0);
+}
+
+/* fill the crosspost filter from the database; before any worker starts */
+static void db_dedup_load(DB *db) {
+    long long t0 = now_ms();
+    int ok = db_each_row(db, db->schema != 2 ? "SELECT message_id, group_name, artnum FROM articles" :
+                         db->type == DB_MYSQL ? "SELECT a.message_id, g.name, a.artnum FROM articles a JOIN `groups` g ON g.id = a.group_id" :
+                         "SELECT a.message_id, g.name, a.artnum FROM articles a JOIN groups g ON g.id = a.group_id", 3, dedup_load_id, NULL) &&
+             db_each_row(db, "SELECT group_name, artnum FROM crossposts", 2, dedup_load_placed, NULL);
+    if (!ok) fatal(ERR_DB_SCHEMA, "Cannot load known Message-IDs for --dedup");
+    infof("dedup: %zu Message-IDs and %zu crossposts known (%lld ms, %zu KiB)", g_xp_ids.n, g_xp_placed.n, now_ms() - t0,
+          (g_xp_ids.cap + g_xp_placed.cap) * 2 * sizeof(unsigned long long) / 1024);
+}
+
+typedef struct { DBRange *v; int n, cap; } RangeList;
+
+static void range_load_row(const char **f, void *arg) {
+    RangeList *rl = (RangeList*)arg;
+    int lo = atoi(f[0]), hi = atoi(f[1]);
+    if (rl->n && lo <= rl->v[rl->n - 1].hi + 1) { /* rows come by lo: merge touching ranges */
+        if (hi > rl->v[rl->n - 1].hi) rl->v[rl->n - 1].hi = hi;
+        return;
+    }
+    if (rl->n == rl->cap) {
+        int ncap = rl->cap ? rl->cap * 2 : 16;
+        DBRange *nv = realloc(rl->v, sizeof(DBRange) * ncap);
+        if (!nv) return;
+        rl->v = nv; rl->cap = ncap;
+    }
+    rl->v[rl->n].group = NULL; rl->v[rl->n].lo = lo; rl->v[rl->n].hi = hi;
+    rl->n++;
+}
+
+/* the journaled ranges of group ending at or after first, merged, in order;
+   *out is malloc'ed */
+static int db_load_ranges(DB *db, const char *group, int first, DBRange **out) {
+    RangeList rl = {0};
+    db = db_route(db, group);
+    char sql[1024], *esc = db_escape(db, group);
+    snprintf(sql, sizeof(sql), "SELECT lo, hi FROM fetched_ranges WHERE group_name=%s AND hi >= %d ORDER BY lo", esc, first);
+    free(esc);
+    db_each_row(db, sql, 2, range_load_row, &rl);
+    *out = rl.v;
+    return rl.n;
+}
+
+/* Sharded storage (--shards): a set of complete databases, each holding some
+   of the groups together with their high-water marks and journal, so every
+   shard commits on its own and gets its own writer thread. With SQLite each
+   shard is a file and the one named by --db-name is only the manifest: the
+   shards table lists the files, shard_map the shard every group was given.
+   MySQL and Postgres shards are connections to the one database, whose
+   articles table is partitioned by group when --shards creates it. A group
+   keeps its shard; a new one takes the first --shard-map rule matching it,
+   else a hash of its name. */
+/* the slot of group in shard_groups, or where it would go (*found = 0) */
+static int db_shard_find(const DB *db, const char *group, int *found) {
+    int lo = 0, hi = db->nshard_groups;
+    *found = 0;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2, c = strcmp(db->shard_groups[mid].group, group);
+        if (c == 0) { *found = 1; return mid; }
+        if (c < 0) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static void db_shard_remember(DB *db, const char *group, int shard) {
+    int found, at = db_shard_find(db, group, &found);
+    if (found) return;
+    if (db->nshard_groups == db->shard_groups_cap) {
+        int ncap = db->shard_groups_cap ? db->shard_groups_cap * 2 : 64;
+        DBShardGroup *ng = realloc(db->shard_groups, sizeof(*ng) * ncap);
+        if (!ng) fatal(ERR_RUNTIME, "Out of memory mapping groups to shards");
+        db->shard_groups = ng; db->shard_groups_cap = ncap;
+    }
+    char *name = strdup(group);
+    if (!name) fatal(ERR_RUNTIME, "Out of memory mapping groups to shards");
+    memmove(&db->shard_groups[at + 1], &db->shard_groups[at], sizeof(DBShardGroup) * (db->nshard_groups - at));
+    db->shard_groups[at].group = name; db->shard_groups[at].shard = shard;
+    db->nshard_groups++;
+}
+
+int db_shard_of(DB *db, const char *group) {
+    if (db->nshards == 0) return 0;
+    int found, at = db_shard_find(db, group, &found);
+    if (found) return db->shard_groups[at].shard;
+    for (int k = 0; k < g_nshard_rules; ++k)
+        if (g_shard_rules[k].shard < db->nshards && fnmatch(g_shard_rules[k].pattern, group, 0) == 0) return g_shard_rules[k].shard;
+    return (int)(fp_mix(fp_str(group, strlen(group))) % (unsigned long long)db->nshards);
+}
+
+/* the handle that stores group */
+static DB *db_route(DB *db, const char *group) {
+    return db->nshards ? &db->shard[db_shard_of(db, group)] : db;
+}
+
+/* db_insert_group(): the group's shard is settled (and recorded in the
+   manifest) before any of its rows is written. Only the main thread registers
+   groups, before the writers start, so lookups need no lock. */
+static DB *db_shard_assign(DB *db, const char *group) {
+    int found, k;
+    db_shard_find(db, group, &found);
+    if (!found) {
+        k = db_shard_of(db, group);
+        db_shard_remember(db, group, k);
+        if (db->type == DB_SQLITE) {
+            char sql[1024], *esc = db_escape(db, group);
+            snprintf(sql, sizeof(sql), "INSERT OR IGNORE INTO shard_map (group_name, shard) VALUES (%s,%d)", esc, k);
+            free(esc);
+            db_exec(db, sql);
+        }
+        infof("group %s: shard %d", group, k);
+    }
+    return db_route(db, group);
+}
+
+/* shard files sit next to the manifest: news.db keeps news.0.db, news.1.db, ... */
+static char *shard_file(const char *manifest, int k) {
+    const char *base = strrchr(manifest, '/');
+    base = base ? base + 1 : manifest;
+    const char *dot = strrchr(base, '.');
+    size_t stem = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+    size_t n = strlen(base) + 16;
+    char *out = malloc(n);
+    if (!out) fatal(ERR_RUNTIME, "Out of memory naming shard files");
+    snprintf(out, n, "%.*s.%d%s", (int)stem, base, k, base + stem);
+    return out;
+}
+
+/* a manifest entry, which is relative to the manifest's directory */
+static char *shard_path(const char *manifest, const char *file) {
+    const char *slash = strrchr(manifest, '/');
+    size_t dl = file[0] == '/' || !slash ? 0 : (size_t)(slash - manifest) + 1;
+    char *out = malloc(dl + strlen(file) + 1);
+    if (!out) fatal(ERR_RUNTIME, "Out of memory naming shard files");
+    memcpy(out, manifest, dl);
+    strcpy(out + dl, file);
+    return out;
+}
+
+typedef struct { DB *db; char **v; int n, cap; } ShardFiles;
+
+static void shard_file_row(const char **f, void *arg) {
+    ShardFiles *sf = arg;
+    if (sf->n == sf->cap) {
+        int ncap = sf->cap ? sf->cap * 2 : 8;
+        char **nv = realloc(sf->v, sizeof(char*) * ncap);
+        if (!nv) return;
+        sf->v = nv; sf->cap = ncap;
+    }
+    sf->v[sf->n++] = shard_path(sf->db->conf->name, f[0]);
+}
+
+static void shard_map_row(const char **f, void *arg) {
+    DB *db = arg;
+    int k = atoi(f[1]);
+    if (k >= 0 && k < db->nshards) db_shard_remember(db, f[0], k);
+}
+
+/* db_open() of a SQLite manifest: open every shard it lists */
+static int db_shards_open(DB *db) {
+    ShardFiles sf = { db, NULL, 0, 0 };
+    db_each_row(db, "SELECT path FROM shards ORDER BY shard", 1, shard_file_row, &sf);
+    if (sf.n == 0) { warnf("%s lists no shards", db->conf->name); db_close(db); return 0; }
+    db->shard = calloc(sf.n, sizeof(DB));
+    db->shard_conf = calloc(sf.n, sizeof(DBConf));
+    if (!db->shard || !db->shard_conf) fatal(ERR_RUNTIME, "Out of memory opening shards");
+    for (int k = 0; k < sf.n; ++k) {
+        db->shard_conf[k] = *db->conf;
+        db->shard_conf[k].name = sf.v[k];
+    }
+    free(sf.v);
+    db->nshards = sf.n;
+    for (int k = 0; k < db->nshards; ++k) {
+        if (!db_open(&db->shard[k], &db->shard_conf[k])) {
+            warnf("cannot open shard %d (%s)", k, db->shard_conf[k].name);
+            db_close(db);
+            return 0;
+        }
+        db->shard[k].is_shard = 1;
+    }
+    db_each_row(db, "SELECT group_name, shard FROM shard_map", 2, shard_map_row, db);
+    infof("%s: %d shards, %d groups", db->conf->name, db->nshards, db->nshard_groups);
+    return 1;
+}
+
+/* db_init_schema() with --shards: a new SQLite database becomes a manifest of
+   g_shards files; MySQL and Postgres open the writer connections */
+static void db_shards_create(DB *db) {
+    if (db->type == DB_SQLITE) {
+        if (db->schema != 0) fatal(ERR_CONFIG, "%s already holds articles; --shards needs a new database", db->conf->name);
+        db_exec(db, "CREATE TABLE IF NOT EXISTS shards (shard INTEGER PRIMARY KEY, path TEXT NOT NULL);"
+                    "CREATE TABLE IF NOT EXISTS shard_map (group_name TEXT PRIMARY KEY, shard INTEGER NOT NULL);");
+        for (int k = 0; k < g_shards; ++k) {
+            char sql[1024], *file = shard_file(db->conf->name, k), *esc = db_escape(db, file);
+            snprintf(sql, sizeof(sql), "INSERT OR IGNORE INTO shards (shard, path) VALUES (%d,%s)", k, esc);
+            free(esc); free(file);
+            db_exec(db, sql);
+        }
+        if (!db_shards_open(db)) fatal(ERR_DB_CONNECT, "Cannot open the shards of %s", db->conf->name);
+        return;
+    }
+    db->shard = calloc(g_shards, sizeof(DB));
+    if (!db->shard) fatal(ERR_RUNTIME, "Out of memory opening shards");
+    for (int k = 0; k < g_shards; ++k) {
+        if (!db_open(&db->shard[k], db->conf)) fatal(ERR_DB_CONNECT, "Cannot open shard connection %d", k);
+        db->shard[k].is_shard = 1;
+        db->nshards = k + 1;
+    }
+}
+
+/* the schema of every shard */
+static void db_shards_init(DB *db) {
+    for (int k = 0; k < db->nshards; ++k) db_init_schema(&db->shard[k]);
+}
+
+static void db_shards_close(DB *db) {
+    int n = db->nshards;
+    db->nshards = 0;
+    for (int k = 0; k < n; ++k) db_close(&db->shard[k]);
+    if (db->shard_conf) for (int k = 0; k < n; ++k) free((char*)db->shard_conf[k].name);
+    for (int k = 0; k < db->nshard_groups; ++k) free(db->shard_groups[k].group);
+    free(db->shard); free(db->shard_conf); free(db->shard_groups);
+    db->shard = NULL; db->shard_conf = NULL; db->shard_groups = NULL;
+    db->nshard_groups = db->shard_groups_cap = 0;
+}
+
+/* store-time check: 1 if a went into crossposts instead of articles */
+static int db_dedup(DB *db, const DBArticle *a) {
+    if (!a->message_id_len) return 0;
+    unsigned long long id = fp_mix(fp_str(a->message_id, a->message_id_len)), here = fp_placement(a->group, a->group_len, a->artnum), at;
+    pthread_mutex_lock(&g_xp_m);
+    int known = fpmap_get(&g_xp_ids, id, &at);
+    if (!known) fpmap_put(&g_xp_ids, id, here);
+    pthread_mutex_unlock(&g_xp_m);
+    if (a->xref_len) dedup_xref(db, a, known ? at : here); /* also for a crosspost: its groups were noted as it was fetched */
+    if (known && at != here) {
+        db_crosspost_write(db, a->group, a->group_len, a->artnum, a->message_id, a->message_id_len);
+        STAT_ADD(crossposts, 1);
+        return 1;
+    }
+    return 0;
+}
+
+void db_store_article(DB *db, const DBArticle *a) {
+    long long t0 = stat_t0();
+    db = db_route(db, a->group);
+    if (db->batch_size > 0) db_begin(db);
+    if (g_dedup && db_dedup(db, a)) {
+        if (db_pg_row_end(db) < 0) db->writes_failed++;
+        stat_lat(LAT_DB_ROW, t0);
+        db_batch_row_done(db);
+        return;
+    }
+    int sent = 1;
+    if (db->bulk.cap > 0) {
+        db_bulk_add(db, a);
+        if (db->bulk.n >= db->bulk.cap) db_bulk_flush(db);
+        else sent = g_dedup; /* only buffered: the savepoint still stands */
+    } else {
+        db_write_article(db, a);
+    }
+    if (sent && db_pg_row_end(db) < 0) db->writes_failed++;
+    stat_lat(LAT_DB_ROW, t0);
+    STAT_ADD(rows, 1);
+    db_batch_row_done(db);
+}
+
+void db_insert_article(DB *db, const char *group, int artnum, const char *subject,
+                       const char *author, const char *date, const char *message_id,
+                       const char *references, int bytes, int lines) {
+    DBArticle a;
+    a.group = group ? group : ""; a.subject = subject ? subject : ""; a.author = author ? author : "";
+    a.date = date ? date : ""; a.message_id = message_id ? message_id : ""; a.refs = references ? references : "";
+    a.group_len = strlen(a.group); a.subject_len = strlen(a.subject); a.author_len = strlen(a.author);
+    a.date_len = strlen(a.date); a.message_id_len = strlen(a.message_id); a.refs_len = strlen(a.refs);
+    a.artnum = artnum; a.bytes = bytes; a.lines = lines;
+    a.xref = ""; a.xref_len = 0;
+    db_store_article(db, &a);
+}
+
+/* NNTP commands */
+
+/* read server greeting */
+
+/* Authenticate using AUTHINFO USER/PASS */
+static int nntp_auth(Conn *c, const char *user, const char *pass) {
+    char resp[BUFSZ];
+    conn_sendf(c, "AUTHINFO USER %s", user);
+    if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
+    int code = atoi(resp);
+    if (code == 381) {
+        conn_sendf(c, "AUTHINFO PASS %s", pass);
+        if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
+        return atoi(resp);
+    }
+    return code;
+}
+
+/* request STARTTLS */
+static int nntp_starttls(Conn *c) {
+    char resp[BUFSZ];
+    conn_sendf(c, "STARTTLS");
+    if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
+    return atoi(resp);
+}
+
+/* what the server advertised in CAPABILITIES; read-only once workers start */
+static struct { int over, hdr, deflate, xgzip, xzver; } g_caps;
+
+enum { COMPRESS_OFF, COMPRESS_AUTO, COMPRESS_DEFLATE, COMPRESS_GZIP, COMPRESS_XZVER };
+static const char *compress_names[] = { "off", "auto", "deflate", "gzip", "xzver" };
+static int g_compress = COMPRESS_OFF; /* --compress, resolved against g_caps before workers start */
+static int g_xzver = 0;               /* cleared (once, atomically) if the server rejects XZVER */
+
+static void caps_line(char *line, size_t len, void *arg) {
+    (void)len; (void)arg;
+    char *save = NULL;
+    char *w = strtok_r(line, " \t", &save);
+    if (!w) return;
+    if (strcasecmp(w, "OVER") == 0) g_caps.over = 1;
+    else if (strcasecmp(w, "HDR") == 0) g_caps.hdr = 1;
+    else if (strcasecmp(w, "XZVER") == 0) g_caps.xzver = 1;
+    else if (strcasecmp(w, "COMPRESS") == 0 || strcasecmp(w, "XFEATURE-COMPRESS") == 0) {
+        int x = w[0] == 'X' || w[0] == 'x';
+        for (char *a; (a = strtok_r(NULL, " \t", &save)) != NULL; ) {
+            if (!x && strcasecmp(a, "DEFLATE") == 0) g_caps.deflate = 1;
+            if (x && strcasecmp(a, "GZIP") == 0) g_caps.xgzip = 1;
+        }
+    }
+}
+
+/* CAPABILITIES (RFC 3977); servers without it simply advertise nothing */
+static int nntp_capabilities(Conn *c) {
+    char buf[BUFSZ];
+    conn_sendf(c, "CAPABILITIES");
+    if (conn_readline(c, buf, sizeof(buf)) <= 0) return -1;
+    int code = atoi(buf);
+    if (code != 101) return code;
+    if (conn_read_multiline_each(c, caps_line, NULL) < 0) return -1;
+    return code;
+}
+
+/* pick the --compress mechanism for this server: auto prefers stream-wide
+   COMPRESS DEFLATE, then XFEATURE GZIP overview; explicit modes are tried
+   even when not advertised (XFEATURE and XZVER usually are not) */
+static void compress_resolve(void) {
+    if (g_compress == COMPRESS_AUTO)
+        g_compress = g_caps.deflate ? COMPRESS_DEFLATE : g_caps.xgzip ? COMPRESS_GZIP : COMPRESS_OFF;
+    g_xzver = g_compress == COMPRESS_XZVER;
+}
+
+/* the server accepted COMPRESS DEFLATE: both directions are raw deflate
+   from here on; 0 on allocation failure */
+static int conn_deflate_start(Conn *c) {
+    c->zin = calloc(1, sizeof(z_stream)); c->zout = calloc(1, sizeof(z_stream));
+    c->zbuf = malloc(CONN_ZBUFSZ);
+    if (!c->zin || !c->zout || !c->zbuf) return 0;
+    if (inflateInit2(c->zin, -15) != Z_OK) { free(c->zin); c->zin = NULL; return 0; }
+    if (deflateInit2(c->zout, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) { free(c->zout); c->zout = NULL; return 0; }
+    /* whatever followed the 206 line is already compressed */
+    c->zpos = 0; c->zlen = c->rbuf ? c->rlen - c->rpos : 0;
+    if (c->zlen > CONN_ZBUFSZ) return 0;
+    if (c->zlen) memcpy(c->zbuf, c->rbuf + c->rpos, c->zlen);
+    c->rpos = c->rlen = 0;
+    return 1;
+}
+
+/* enable the negotiated compression on c. Returns 1 when enabled (or nothing
+   to do), 0 when the server declined, -1 on connection failure. */
+static int conn_compress(Conn *c) {
+    char resp[BUFSZ];
+    if (g_compress == COMPRESS_DEFLATE) {
+        conn_sendf(c, "COMPRESS DEFLATE");
+        if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
+        if (atoi(resp) != 206) { warnf("COMPRESS DEFLATE rejected: %s", resp); return 0; }
+        return conn_deflate_start(c) ? 1 : -1;
+    }
+    if (g_compress == COMPRESS_GZIP) {
+        conn_sendf(c, "XFEATURE COMPRESS GZIP TERMINATOR");
+        if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
+        if (atoi(resp) != 290) { warnf("XFEATURE COMPRESS GZIP rejected: %s", resp); return 0; }
+        c->xgzip = 1;
+    }
+    return 1;
+}
+
+static int nntp_group(Conn *c, const char *group, int *count, int *first, int *last) {
+    char buf[BUFSZ];
+    long long t0 = stat_t0();
+    conn_sendf(c, "GROUP %s", group);
+    if (conn_readline(c, buf, sizeof(buf)) <= 0) return -1;
+    stat_lat(LAT_GROUP, t0);
+    int code = atoi(buf);
+    if (code >= 200 && code < 300) {
+        /* parse: 211 <count> <first> <last> <groupname> */
+        int cnt=0, f=0, l=0;
+        sscanf(buf, "%*d %d %d %d", &cnt, &f, &l);
+        if (count) *count = cnt;
+        if (first) *first = f;
+        if (last) *last = l;
+    }
+    return code;
+}
+
+/* fetch XOVER (OVER when advertised) for a range, handing each overview line
+   to cb as it arrives; returns the number of lines, -1 on connection failure,
+   or -2 when the server rejected the command */
+static long nntp_xover_each(Conn *c, int first, int last, line_cb cb, void *arg) {
+    char buf[BUFSZ];
+    int xz = __atomic_load_n(&g_xzver, __ATOMIC_RELAXED);
+    long long t0 = stat_t0();
+    conn_sendf(c, "%s %d-%d", xz ? "XZVER" : g_caps.over ? "OVER" : "XOVER", first, last);
+    if (conn_readline(c, buf, sizeof(buf)) <= 0) return -1;
+    stat_lat(LAT_XOVER, t0); /* time to the first reply line */
+    int code = atoi(buf);
+    if (xz && code >= 500) {
+        if (__atomic_exchange_n(&g_xzver, 0, __ATOMIC_RELAXED)) warnf("XZVER rejected (%s); using XOVER", buf);
+        return nntp_xover_each(c, first, last, cb, arg);
+    }
+    if (code < 200 || code >= 300) {
+        warnf("XOVER rejected: %s", buf);
+        return -2;
+    }
+    if (xz) return conn_read_multiline_xzver(c, cb, arg);
+    if (c->xgzip && strstr(buf, "COMPRESS=GZIP")) return conn_read_multiline_gzip(c, cb, arg);
+    return conn_read_multiline_each(c, cb, arg);
+}
+
+/* HEAD reply parsed line by line straight from the receive buffer. Only the
+   wanted header values are copied, into a scratch buffer the worker reuses
+   for every article; no per-field allocation. */
+typedef struct {
+    DBArticle a;
+    char *buf;
+    size_t len, cap;
+    size_t off[6]; /* subject, from, date, message-id, references, xref; SIZE_MAX = absent */
+    size_t raw;    /* reply bytes received, for the transfer rate */
+} HeadParse;
+
+static const struct { const char *name; size_t len; } head_fields[6] = {
+    { "Subject:", 8 }, { "From:", 5 }, { "Date:", 5 }, { "Message-ID:", 11 }, { "References:", 11 }, { "Xref:", 5 }
+};
+
+static void head_parse_line(char *line, size_t len, void *arg) {
+    HeadParse *hp = (HeadParse*)arg;
+    char *end = line + len;
+    hp->raw += len + 2;
+    while (line < end && isspace((unsigned char)*line)) line++;
+    size_t n = (size_t)(end - line);
+    if (n >= 6 && strncasecmp(line, "Lines:", 6) == 0) { hp->a.lines = atoi(line + 6); return; }
+    if (n >= 6 && strncasecmp(line, "Bytes:", 6) == 0) { hp->a.bytes = atoi(line + 6); return; }
+    for (int k = 0; k < 5 + g_dedup; ++k) {
+        size_t hl = head_fields[k].len;
+        if (n < hl || strncasecmp(line, head_fields[k].name, hl) != 0) continue;
+        char *v = line + hl;
+        while (v < end && *v == ' ') v++;
+        size_t vl = (size_t)(end - v);
+        if (hp->len + vl + 1 > hp->cap) {
+            size_t cap = hp->cap ? hp->cap : 4096;
+            while (cap < hp->len + vl + 1) cap *= 2;
+            char *nb = realloc(hp->buf, cap);
+            if (!nb) return;
+            hp->buf = nb; hp->cap = cap;
+        }
+        memcpy(hp->buf + hp->len, v, vl);
+        hp->buf[hp->len + vl] = '\0';
+        hp->off[k] = hp->len;
+        hp->len += vl + 1;
+        return;
+    }
+}
+
+/* read the reply to one pipelined HEAD into hp. Returns 1 on
+   success; *io_err is set when the connection failed. */
+static int nntp_head_reply(Conn *c, int artnum, HeadParse *hp, int *io_err) {
+    char buf[BUFSZ];
+    *io_err = 0;
+    ssize_t n = conn_readline(c, buf, sizeof(buf));
+    if (n <= 0) { *io_err = 1; return 0; }
+    int code = atoi(buf);
+    if (code < 200 || code >= 300) {
+        warnf("HEAD rejected for %d: %s", artnum, buf);
+        return 0;
+    }
+    hp->len = 0;
+    hp->raw = (size_t)n;
+    hp->a.bytes = 0; hp->a.lines = 0;
+    for (int k = 0; k < 6; ++k) hp->off[k] = (size_t)-1;
+    if (conn_read_multiline_each(c, head_parse_line, hp) < 0) { *io_err = 1; return 0; }
+    const char **dst[6] = { &hp->a.subject, &hp->a.author, &hp->a.date, &hp->a.message_id, &hp->a.refs, &hp->a.xref };
+    size_t *dlen[6] = { &hp->a.subject_len, &hp->a.author_len, &hp->a.date_len, &hp->a.message_id_len, &hp->a.refs_len, &hp->a.xref_len };
+    for (int k = 0; k < 6; ++k) {
+        if (hp->off[k] == (size_t)-1) { *dst[k] = ""; *dlen[k] = 0; }
+        else { *dst[k] = hp->buf + hp->off[k]; *dlen[k] = strlen(*dst[k]); }
+    }
+    hp->a.artnum = artnum;
+    return 1;
+}
+
+/* split an XOVER line in place: tabs become NULs and the fields are views into
+   the line (article-number, subject, from, date, message-id, references,
+   bytes, lines, and for --dedup an Xref:full field; the rest is ignored).
+   Empty fields stay in position. */
+static void parse_xover_line(char *line, size_t len, DBArticle *a) {
+    char *f[9];
+    size_t fl[9];
+    unsigned tabs[8];
+    int nt, n;
+    g_scan(line, len, tabs, 7 + g_dedup, &nt); /* all field separators in one pass */
+    for (n = 0; n <= nt; ++n) {
+        size_t lo = n ? tabs[n - 1] + 1 : 0, hi = n < nt ? tabs[n] : len;
+        f[n] = line + lo; fl[n] = hi - lo;
+        if (n < nt) line[hi] = '\0';
+    }
+    for (; n < 9; ++n) { f[n] = line + len; fl[n] = 0; } /* line[len] is the NUL */
+    a->artnum = atoi(f[0]);
+    a->subject = f[1]; a->subject_len = fl[1];
+    a->author = f[2]; a->author_len = fl[2];
+    a->date = f[3]; a->date_len = fl[3];
+    a->message_id = f[4]; a->message_id_len = fl[4];
+    a->refs = f[5]; a->refs_len = fl[5];
+    a->bytes = atoi(f[6]);
+    a->lines = atoi(f[7]);
+    a->xref = line + len; a->xref_len = 0;
+    if (fl[8] > 5 && strncasecmp(f[8], "Xref:", 5) == 0) {
+        char *x = f[8] + 5, *xe = strchr(x, '\t'); /* a later extra field ends it */
+        while (*x == ' ') x++;
+        a->xref = x; a->xref_len = xe ? (size_t)(xe - x) : (size_t)(f[8] + fl[8] - x);
+    }
+}
+
+/* Range claiming: workers take consecutive [lo, hi] slices of the article
+   range with one atomic fetch-add, so memory is O(1) and claims never block.
+   Finished slices are reported back so the contiguous high-water mark can
+   advance even when slices complete out of order. */
+typedef struct {
+    long long next; /* 64-bit: overshooting claims must not wrap */
+    int first;
+    int last;
+    int chunk;
+    pthread_mutex_t m;
+    long long done_upto; /* slices [0, done_upto) are finished */
+    long long *done;     /* finished slices beyond done_upto */
+    int ndone, done_cap;
+    long long *skip;     /* resumed: [from, to] slice pairs an earlier run finished */
+    int nskip;
+} ChunkCursor;
+
+static void chunk_init(ChunkCursor *cc, int first, int last, int chunk) {
+    memset(cc, 0, sizeof(*cc));
+    cc->next = first; cc->first = first; cc->last = last; cc->chunk = chunk > 0 ? chunk : 1;
+    pthread_mutex_init(&cc->m, NULL);
+}
+
+/* the last slice of the skipped run holding slice idx, or -1 */
+static long long chunk_skipped(const ChunkCursor *cc, long long idx) {
+    for (int k = 0; k < cc->nskip; ++k) if (idx >= cc->skip[2*k] && idx <= cc->skip[2*k+1]) return cc->skip[2*k+1];
+    return -1;
+}
+
+static int chunk_claim(ChunkCursor *cc, int *lo, int *hi) {
+    long long start;
+    do {
+        start = __atomic_fetch_add(&cc->next, (long long)cc->chunk, __ATOMIC_RELAXED);
+        if (start > cc->last) return 0;
+    } while (cc->nskip && chunk_skipped(cc, (start - cc->first) / cc->chunk) >= 0);
+    *lo = (int)start;
+    *hi = (cc->last - start < cc->chunk) ? cc->last : (int)(start + cc->chunk - 1);
+    return 1;
+}
+
+/* move done_upto over the finished slices that follow it */
+static void chunk_advance(ChunkCursor *cc) {
+    for (;;) {
+        long long to = cc->nskip ? chunk_skipped(cc, cc->done_upto) : -1;
+        if (to >= 0) { cc->done_upto = to + 1; continue; }
+        int k = 0;
+        while (k < cc->ndone && cc->done[k] != cc->done_upto) k++;
+        if (k == cc->ndone) return;
+        cc->done_upto++; cc->done[k] = cc->done[--cc->ndone];
+    }
+}
+
+/* the last article of the first upto slices; 0 for none */
+static int chunk_high_water(const ChunkCursor *cc, long long upto) {
+    if (upto == 0) return 0;
+    long long hw = (long long)cc->first + upto * cc->chunk - 1;
+    return hw > cc->last ? cc->last : (int)hw;
+}
+
+/* mark the slice starting at lo finished; returns the new high-water article
+   number if the contiguous finished prefix grew, else 0 */
+static int chunk_done(ChunkCursor *cc, int lo) {
+    long long idx = ((long long)lo - cc->first) / cc->chunk;
+    long long before;
+    pthread_mutex_lock(&cc->m);
+    before = cc->done_upto;
+    if (idx != cc->done_upto) {
+        if (cc->ndone == cc->done_cap) {
+            int ncap = cc->done_cap ? cc->done_cap * 2 : 16;
+            long long *nd = realloc(cc->done, sizeof(long long) * ncap);
+            if (!nd) { pthread_mutex_unlock(&cc->m); return 0; }
+            cc->done = nd; cc->done_cap = ncap;
+        }
+        cc->done[cc->ndone++] = idx;
+    } else {
+        cc->done_upto++;
+        chunk_advance(cc);
+    }
+    long long upto = cc->done_upto;
+    pthread_mutex_unlock(&cc->m);
+    return upto == before ? 0 : chunk_high_water(cc, upto);
+}
+
+/* the last article of the slice starting at lo */
+static int chunk_slice_hi(const ChunkCursor *cc, int lo) {
+    return cc->last - lo < cc->chunk ? cc->last : lo + cc->chunk - 1;
+}
+
+/* --incremental: slices lying wholly inside a range (sorted, merged) that an
+   interrupted run journaled are not claimed again; returns the articles
+   skipped. Before any worker starts. */
+static long long chunk_resume(ChunkCursor *cc, const DBRange *r, int n) {
+    long long nsl = ((long long)cc->last - cc->first) / cc->chunk + 1, skipped = 0;
+    long long *sk = malloc(sizeof(long long) * 2 * (n > 0 ? n : 1));
+    if (!sk) return 0;
+    cc->skip = sk;
+    for (int k = 0; k < n; ++k) {
+        long long from = r[k].lo <= cc->first ? 0 : ((long long)r[k].lo - cc->first + cc->chunk - 1) / cc->chunk;
+        long long to = r[k].hi >= cc->last ? nsl - 1 : ((long long)r[k].hi - cc->first + 1) / cc->chunk - 1;
+        if (from > to) continue;
+        sk[2*cc->nskip] = from; sk[2*cc->nskip+1] = to; cc->nskip++;
+        long long hi = (long long)cc->first + (to + 1) * cc->chunk - 1;
+        skipped += (hi > cc->last ? cc->last : hi) - (cc->first + from * cc->chunk) + 1;
+    }
+    chunk_advance(cc);
+    return skipped;
+}
+
+/* --incremental: load group's journal into cc, storing the high-water mark
+   if the skipped slices extend it; returns the articles left out */
+static long long chunk_resume_group(ChunkCursor *cc, DB *db, const char *group) {
+    DBRange *r = NULL;
+    int n = db_load_ranges(db, group, cc->first, &r);
+    long long skipped = n ? chunk_resume(cc, r, n) : 0;
+    free(r);
+    int hw = chunk_high_water(cc, cc->done_upto);
+    if (hw) db_set_high_water(db, group, hw);
+    if (skipped) infof("resume: %s: %lld articles already fetched by an interrupted run", group, skipped);
+    return skipped;
+}
+
+static void chunk_destroy(ChunkCursor *cc) {
+    free(cc->done); free(cc->skip);
+    pthread_mutex_destroy(&cc->m);
+}
+
+/* Rows are bump-allocated from per-producer arena blocks. A block counts the
+   rows still queued in it plus one reference held by its producer while it is
+   the current block; the writer drops a row's reference once it is stored and
+   the last one returns the block to the writer's pool. Steady-state ingestion
+   thus allocates nothing per article. */
+#define ARENA_BLOCK (64 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next; /* pool link */
+    int refs;
+    size_t cap, used;        /* bytes of data after the header */
+} ArenaBlock;
+
+/* Parsed article handed from fetch threads to the DB writer; the struct and
+   all of its strings are one arena allocation. */
+typedef struct {
+    int mark; /* not an article: 1 = high-water mark a.artnum, 2 = range a.artnum..hi finished */
+    int hi;
+    ArenaBlock *blk;
+    DBArticle a; /* a.group is not copied: group names outlive the writer */
+} ArticleRow;
+
+/* Bounded lock-free MPSC ring (sequence-numbered slots): fetch threads push
+   rows, the single writer thread pops them. Producers back off when full. */
+#define ROWQ_CAP 4096 /* power of two */
+
+typedef struct {
+    size_t seq;
+    ArticleRow *row;
+} RowSlot;
+
+typedef struct {
+    RowSlot slots[ROWQ_CAP];
+    size_t tail; /* next slot producers claim */
+    size_t head; /* next slot the writer reads; writer-only */
+} RowQueue;
+
+static void rowq_init(RowQueue *q) {
+    for (size_t k = 0; k < ROWQ_CAP; ++k) { q->slots[k].seq = k; q->slots[k].row = NULL; }
+    q->tail = 0; q->head = 0;
+}
+
+static void rowq_push(RowQueue *q, ArticleRow *row) {
+    size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        RowSlot *slot = &q->slots[pos & (ROWQ_CAP - 1)];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        long dif = (long)(seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->row = row;
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return;
+            }
+        } else if (dif < 0) {
+            sched_yield(); /* full: wait for the writer */
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static ArticleRow *rowq_pop(RowQueue *q) {
+    RowSlot *slot = &q->slots[q->head & (ROWQ_CAP - 1)];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != q->head + 1) return NULL;
+    ArticleRow *row = slot->row;
+    __atomic_store_n(&slot->seq, q->head + ROWQ_CAP, __ATOMIC_RELEASE);
+    q->head++;
+    return row;
+}
+
+/* DB writer threads: one per shard (a single one unsharded), each owning its
+   shard's handle (and its batching) for the run and fed by its own queue */
+struct DBWriter;
+
+typedef struct {
+    DB *db;
+    RowQueue q;
+    pthread_t tid;
+    struct DBWriter *w;
+} WriterLane;
+
+typedef struct DBWriter {
+    DB *db;              /* the handle passed to db_writer_start() */
+    WriterLane *lanes;
+    int nlanes;
+    int done;
+    pthread_mutex_t pool_m;
+    ArenaBlock *pool; /* free arena blocks, shared by the lanes */
+} DBWriter;
+
+static void block_release(DBWriter *w, ArenaBlock *b) {
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    if (b->cap != ARENA_BLOCK) { free(b); return; } /* one oversized row */
+    pthread_mutex_lock(&w->pool_m);
+    b->next = w->pool; w->pool = b;
+    pthread_mutex_unlock(&w->pool_m);
+}
+
+static void *db_writer_main(void *arg) {
+    WriterLane *l = (WriterLane*)arg;
+    DBWriter *w = l->w;
+    int idle = 0;
+    for (;;) {
+        int done = __atomic_load_n(&w->done, __ATOMIC_ACQUIRE);
+        ArticleRow *r = rowq_pop(&l->q);
+        if (r) {
+            if (g_stats_on) stat_gauge_queue(__atomic_load_n(&l->q.tail, __ATOMIC_RELAXED) - l->q.head);
+            if (r->mark == 1) db_set_high_water(l->db, r->a.group, r->a.artnum);
+            else if (r->mark == 2) db_note_range(l->db, r->a.group, r->a.artnum, r->hi);
+            else db_store_article(l->db, &r->a);
+            block_release(w, r->blk);
+            idle = 0;
+            continue;
+        }
+        if (done) break;
+        if (idle == 0 && g_stats_on) stat_gauge_queue(0);
+        if (++idle < 64) { sched_yield(); continue; }
+        struct timespec ts = { 0, 500000 }; nanosleep(&ts, NULL);
+        db_batch_tick(l->db);
+    }
+    return NULL;
+}
+
+static DBWriter *db_writer_start(DB *db) {
+    DBWriter *w = malloc(sizeof(*w));
+    int n = db->nshards ? db->nshards : 1;
+    if (!w || !(w->lanes = malloc(sizeof(WriterLane) * n))) fatal(ERR_RUNTIME, "Out of memory allocating DB writer");
+    w->db = db; w->nlanes = n; w->done = 0;
+    pthread_mutex_init(&w->pool_m, NULL); w->pool = NULL;
+    for (int k = 0; k < n; ++k) {
+        WriterLane *l = &w->lanes[k];
+        l->db = db->nshards ? &db->shard[k] : db;
+        l->w = w;
+        rowq_init(&l->q);
+        if (pthread_create(&l->tid, NULL, db_writer_main, l) != 0) fatal(ERR_RUNTIME, "pthread_create failed for DB writer");
+    }
+    return w;
+}
+
+/* call after all producers have finished: drains the queues and joins */
+static void db_writer_stop(DBWriter *w) {
+    __atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+    for (int k = 0; k < w->nlanes; ++k) pthread_join(w->lanes[k].tid, NULL);
+    while (w->pool) { ArenaBlock *b = w->pool; w->pool = b->next; free(b); }
+    pthread_mutex_destroy(&w->pool_m);
+    free(w->lanes);
+    free(w);
+}
+
+/* a fetch thread's current arena block; arena_close() before the thread
+   stops producing */
+typedef struct {
+    DBWriter *w;
+    ArenaBlock *cur;
+    const char *lane_group; /* the group lane_q was looked up for */
+    RowQueue *lane_q;
+} RowArena;
+
+/* the queue of the writer that stores group's rows */
+static RowQueue *arena_queue(RowArena *ar, const char *group) {
+    if (ar->w->nlanes == 1) return &ar->w->lanes[0].q;
+    if (group != ar->lane_group) {
+        ar->lane_q = &ar->w->lanes[db_shard_of(ar->w->db, group)].q;
+        ar->lane_group = group;
+    }
+    return ar->lane_q;
+}
+
+static void *arena_alloc(RowArena *ar, size_t n, ArenaBlock **blk) {
+    n = (n + 15) & ~(size_t)15;
+    ArenaBlock *b = ar->cur;
+    if (!b || b->used + n > b->cap) {
+        if (b) block_release(ar->w, b);
+        b = NULL;
+        if (n <= ARENA_BLOCK) {
+            pthread_mutex_lock(&ar->w->pool_m);
+            if ((b = ar->w->pool) != NULL) ar->w->pool = b->next;
+            pthread_mutex_unlock(&ar->w->pool_m);
+        }
+        if (!b) {
+            size_t cap = n > ARENA_BLOCK ? n : ARENA_BLOCK;
+            b = malloc(sizeof(ArenaBlock) + cap);
+            if (!b) { ar->cur = NULL; return NULL; }
+            b->cap = cap;
+        }
+        b->used = 0; b->refs = 1;
+        ar->cur = b;
+    }
+    void *p = (char*)(b + 1) + b->used;
+    b->used += n;
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    *blk = b;
+    return p;
+}
+
+static void arena_close(RowArena *ar) {
+    if (ar->cur) block_release(ar->w, ar->cur);
+    ar->cur = NULL;
+}
+
+static ArticleRow *row_pack(RowArena *ar, const DBArticle *a) {
+    const char *src[6] = { a->subject, a->author, a->date, a->message_id, a->refs, a->xref };
+    size_t len[6] = { a->subject_len, a->author_len, a->date_len, a->message_id_len, a->refs_len, a->xref_len };
+    size_t total = sizeof(ArticleRow);
+    for (int k = 0; k < 6; ++k) total += len[k] + 1;
+    ArenaBlock *blk;
+    ArticleRow *r = arena_alloc(ar, total, &blk);
+    if (!r) return NULL;
+    r->a = *a; r->mark = 0; r->blk = blk;
+    char *p = (char*)(r + 1);
+    const char **dst[6] = { &r->a.subject, &r->a.author, &r->a.date, &r->a.message_id, &r->a.refs, &r->a.xref };
+    for (int k = 0; k < 6; ++k) { memcpy(p, src[k], len[k]); p[len[k]] = '\0'; *dst[k] = p; p += len[k] + 1; }
+    return r;
+}
+
+static void db_writer_submit(RowArena *ar, const DBArticle *a) {
+    ArticleRow *r = row_pack(ar, a);
+    if (!r) { warnf("Out of memory queueing article %d", a->artnum); return; }
+    rowq_push(arena_queue(ar, a->group), r);
+}
+
+/* queued behind every row pushed before it, so the mark lands with them */
+static void db_writer_mark(RowArena *ar, int kind, const char *group, int artnum, int hi) {
+    static const DBArticle none = { "", "", "", "", "", "", 0, 0, 0, 0, 0, 0, 0, 0, 0, "", 0 };
+    ArticleRow *r = row_pack(ar, &none);
+    if (!r) { warnf("Out of memory queueing high-water mark %d", artnum); return; }
+    r->mark = kind; r->hi = hi; r->a.group = group; r->a.artnum = artnum;
+    rowq_push(arena_queue(ar, group), r);
+}
+
+/* the slice at lo is finished: queue the high-water mark if that advanced
+   it, else journal the slice so a resumed run need not fetch it again */
+static void slice_finished(ChunkCursor *cc, RowArena *ar, const char *group, int lo) {
+    int hw = chunk_done(cc, lo);
+    if (hw) db_writer_mark(ar, 1, group, hw, 0);
+    else db_writer_mark(ar, 2, group, lo, chunk_slice_hi(cc, lo));
+}
+
+/* Progress: workers only bump atomic counters; a reporter thread redraws the
+   bar at most every PROGRESS_MS, and only when stdout is a terminal. */
+#define PROGRESS_MS 100
+
+typedef struct {
+    const char *label;
+    long long total;
+    long long done, bytes; /* articles and reply bytes, updated atomically */
+    int width;
+    int tty;
+    int stop;
+    long long t0;
+    pthread_t tid;
+} Progress;
+
+static void progress_add(Progress *p, long long bytes) {
+    __atomic_add_fetch(&p->done, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&p->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static long long progress_done(Progress *p) {
+    return __atomic_load_n(&p->done, __ATOMIC_RELAXED);
+}
+
+/* 12.3M style: rates and sizes in the status line */
+static void fmt_si(char *out, size_t cap, double v) {
+    const char *unit = "";
+    if (v >= 1e9) { v /= 1e9; unit = "G"; }
+    else if (v >= 1e6) { v /= 1e6; unit = "M"; }
+    else if (v >= 1e3) { v /= 1e3; unit = "k"; }
+    snprintf(out, cap, "%.1f%s", v, unit);
+}
+
+static void progress_draw(Progress *p) {
+    long long done = progress_done(p);
+    long long bytes = __atomic_load_n(&p->bytes, __ATOMIC_RELAXED);
+    long long total = p->total > 0 ? p->total : 1;
+    double secs = (now_ms() - p->t0) / 1000.0;
+    double rate = secs > 0 ? done / secs : 0;
+    char bar[PROGRESS_MAX + 1], arts[16], bps[16], eta[32];
+    int filled = (int)(p->width * (done / (double)total));
+    if (filled > p->width) filled = p->width;
+    for (int bi = 0; bi < p->width; ++bi) bar[bi] = (bi < filled) ? '#' : '.';
+    bar[p->width] = '\0';
+    fmt_si(arts, sizeof(arts), rate);
+    fmt_si(bps, sizeof(bps), secs > 0 ? bytes / secs : 0);
+    if (rate > 0 && done < total) {
+        long long left = (long long)((total - done) / rate);
+        snprintf(eta, sizeof(eta), "%lld:%02lld:%02lld", left / 3600, left / 60 % 60, left % 60);
+    } else {
+        snprintf(eta, sizeof(eta), "--:--:--");
+    }
+    fprintf(stdout, "\r%s: [%s] %3d%% (%lld/%lld) %s art/s %sB/s ETA %s\033[K",
+            p->label, bar, (int)(done * 100 / total), done, p->total, arts, bps, eta);
+    fflush(stdout);
+}
+
+static void *progress_main(void *arg) {
+    Progress *p = (Progress*)arg;
+    struct timespec ts = { 0, PROGRESS_MS * 1000000L };
+    while (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+        progress_draw(p);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+static void progress_start(Progress *p, const char *label, long long total, int width) {
+    memset(p, 0, sizeof(*p));
+    p->label = label; p->total = total; p->t0 = now_ms();
+    p->width = width < 5 ? 5 : width > PROGRESS_MAX ? PROGRESS_MAX : width;
+    p->tty = isatty(STDOUT_FILENO);
+    if (p->tty && pthread_create(&p->tid, NULL, progress_main, p) != 0) p->tty = 0;
+}
+
+/* stop the reporter, draw the final state and end the line */
+static void progress_finish(Progress *p) {
+    if (p->tty) {
+        __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(p->tid, NULL);
+        progress_draw(p);
+        fprintf(stdout, "\n");
+    }
+    double secs = (now_ms() - p->t0) / 1000.0;
+    infof("%s: %lld of %lld articles in %.1fs (%.0f art/s, %.0f B/s)", p->label, p->done, p->total,
+          secs, secs > 0 ? p->done / secs : 0.0, secs > 0 ? p->bytes / secs : 0.0);
+}
+
+typedef struct {
+    DB *db;
+    const char *group;
+    int retries;
+    int pipeline_depth;
+    int progress_width;
+    Progress *progress;
+    DBWriter *writer;
+    ChunkCursor *chunks; /* article ranges: XOVER chunks, or HEAD slices */
+    int overview;        /* HEAD mode: take each slice from OVER (+ HDR) first, HEAD only the rest */
+    int event_loop;      /* HEAD mode: loop threads driving the connections; 0 = one thread each */
+    int reconnects;      /* attempts to replace a lost connection before a worker gives up */
+    const char *host; const char *port; int use_ssl; int do_starttls; const char *user; const char *pass;
+} WorkerArgs;
+
+static int thread_connect(Conn *tc, const char *host, const char *port, int use_ssl, int do_starttls, const char *user, const char *pass, const char *group) {
+    conn_init(tc);
+    tc->sock = tcp_connect(host, port);
+    if (tc->sock < 0) return 0;
+    if (use_ssl && !conn_tls_connect(tc)) return 0;
+    {
+        char line[BUFSZ]; if (conn_readline(tc, line, sizeof(line)) <= 0) return 0; if (atoi(line) >= 400) return 0;
+    }
+    if (do_starttls && !use_ssl) {
+        int rcx = nntp_starttls(tc); if (rcx < 200 || rcx >= 300) return 0; if (!conn_starttls(tc)) return 0;
+    }
+    if (user && pass) { int rcx = nntp_auth(tc, user, pass); if (rcx >= 400) return 0; }
+    if (conn_compress(tc) < 0) return 0;
+    if (group) {
+        int dummyC=0,dummyF=0,dummyL=0; int rcg = nntp_group(tc, group, &dummyC, &dummyF, &dummyL); if (rcg < 200 || rcg >= 300) return 0;
+    }
+    return 1;
+}
+
+/* wait before reconnect attempt n (1-based): 0.5 s doubling up to 30 s, less
+   up to half at random so a pool of connections does not return in lockstep */
+static long long reconnect_delay_ms(int n) {
+    long long ms = 500LL << (n < 7 ? n - 1 : 6);
+    if (ms > 30000) ms = 30000;
+    return ms - (long long)(fp_mix((unsigned long long)now_us() + (unsigned long long)n) % (unsigned long long)(ms / 2 + 1));
+}
+
+/* replace the lost connection c, group selected, with backoff; *fails counts
+   the attempts since the connection last made progress. 0 when wa->reconnects
+   attempts have failed or the run is stopping. */
+static int worker_reconnect(Conn *c, WorkerArgs *wa, int *fails) {
+    conn_cleanup(c);
+    while (!g_stop && *fails < wa->reconnects) {
+        ++*fails;
+        long long until = now_ms() + reconnect_delay_ms(*fails);
+        while (!g_stop && now_ms() < until) { struct timespec ts = { 0, 50000000 }; nanosleep(&ts, NULL); }
+        if (g_stop) break;
+        STAT_ADD(reconnects, 1);
+        if (thread_connect(c, wa->host, wa->port, wa->use_ssl, wa->do_starttls, wa->user, wa->pass, wa->group)) {
+            infof("reconnected (%s, attempt %d)", wa->group ? wa->group : "no group", *fails);
+            return 1;
+        }
+        conn_cleanup(c);
+    }
+    if (!g_stop) warnf("giving up on the connection after %d reconnect attempt(s)", *fails);
+    return 0;
+}
+
+/* send HEAD for n article numbers in a single write */
+static int send_head_batch(Conn *c, const int *artnums, int n) {
+    char buf[BUFSZ];
+    size_t len = 0;
+    for (int k = 0; k < n; ++k) {
+        if (len + 24 > sizeof(buf)) { if (conn_write(c, buf, len) < 0) return 0; len = 0; }
+        len += (size_t)snprintf(buf + len, sizeof(buf) - len, "HEAD %d\r\n", artnums[k]);
+    }
+    return len == 0 || conn_write(c, buf, len) >= 0;
+}
+
+/* HEAD slot in the pipeline window */
+typedef struct {
+    int artnum;
+    int attempt;
+    int slice; /* lo of the claimed slice it belongs to */
+    long long sent_us;
+} HeadSlot;
+
+/* claimed slice with articles still outstanding */
+typedef struct {
+    int lo;
+    int left;
+} HeadSlice;
+
+/* one article of a slice is finished (stored or given up); report the slice
+   once all of it is */
+static void head_slice_done(WorkerArgs *wa, RowArena *ar, HeadSlice *act, int *nact, int lo) {
+    for (int k = 0; k < *nact; ++k) {
+        if (act[k].lo != lo) continue;
+        if (--act[k].left == 0) {
+            act[k] = act[--*nact];
+            slice_finished(wa->chunks, ar, wa->group, lo);
+        }
+        return;
+    }
+}
+
+/* Overview-first HEAD mode. A slice's OVER lines are copied here; articles
+   whose line has every column are stored from it, empty columns are filled
+   with HDR <field> over the affected range when the server has HDR, and only
+   the articles left (absent from the overview, or incomplete without HDR)
+   are marked for HEAD. */
+typedef struct {
+    int lo, n, ncap;
+    char *text;           /* copied overview lines */
+    size_t len, cap;
+    size_t *off, *llen;   /* per article: line in text; SIZE_MAX = not in the overview */
+    DBArticle *rows;
+    char *hbuf;           /* HDR values */
+    size_t hlen, hcap;
+    size_t *hoff;         /* per field and article: value in hbuf; SIZE_MAX = none */
+    int field;            /* HDR field being read */
+    int gap_lo[4], gap_hi[4]; /* per field: first/last article with the column empty */
+    int hdr_ok[4];        /* per field: HDR answered */
+    unsigned char *need;  /* per article: fetch with HEAD */
+    int nneed;
+    size_t raw;           /* reply bytes, for the transfer rate */
+} OverSlice;
+
+static const char *over_hdr_names[4] = { "Subject", "From", "Date", "Message-ID" };
+
+static int grow_text(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return 1;
+    size_t nc = *cap ? *cap : 65536;
+    while (nc < need) nc *= 2;
+    char *nb = realloc(*buf, nc);
+    if (!nb) return 0;
+    *buf = nb; *cap = nc;
+    return 1;
+}
+
+static void over_slice_line(char *line, size_t len, void *arg) {
+    OverSlice *os = (OverSlice*)arg;
+    os->raw += len + 2;
+    long i = strtol(line, NULL, 10) - os->lo;
+    if (i < 0 || i >= os->n || !grow_text(&os->text, &os->cap, os->len + len + 1)) return;
+    memcpy(os->text + os->len, line, len);
+    os->text[os->len + len] = '\0';
+    os->off[i] = os->len; os->llen[i] = len;
+    os->len += len + 1;
+}
+
+static void over_hdr_line(char *line, size_t len, void *arg) {
+    OverSlice *os = (OverSlice*)arg;
+    os->raw += len + 2;
+    char *v;
+    long i = strtol(line, &v, 10) - os->lo;
+    if (i < 0 || i >= os->n || os->off[i] == (size_t)-1) return;
+    while (*v == ' ') v++;
+    size_t vl = len - (size_t)(v - line);
+    if (!vl || !grow_text(&os->hbuf, &os->hcap, os->hlen + vl + 1)) return;
+    memcpy(os->hbuf + os->hlen, v, vl);
+    os->hbuf[os->hlen + vl] = '\0';
+    os->hoff[os->field * os->n + i] = os->hlen;
+    os->hlen += vl + 1;
+}
+
+static const char **over_field(DBArticle *a, int k, size_t **len) {
+    switch (k) {
+        case 0: *len = &a->subject_len; return &a->subject;
+        case 1: *len = &a->author_len; return &a->author;
+        case 2: *len = &a->date_len; return &a->date;
+        default: *len = &a->message_id_len; return &a->message_id;
+    }
+}
+
+/* start a slice; until its overview is in, every article needs HEAD */
+static void over_slice_begin(OverSlice *os, int lo, int hi) {
+    int n = hi - lo + 1;
+    if (n > os->ncap) {
+        free(os->off); free(os->llen); free(os->rows); free(os->hoff); free(os->need);
+        os->off = malloc(sizeof(size_t) * n); os->llen = malloc(sizeof(size_t) * n);
+        os->rows = malloc(sizeof(DBArticle) * n); os->hoff = malloc(sizeof(size_t) * 4 * n);
+        os->need = malloc(n);
+        if (!os->off || !os->llen || !os->rows || !os->hoff || !os->need) fatal(ERR_RUNTIME, "Out of memory allocating overview slice");
+        os->ncap = n;
+    }
+    os->lo = lo; os->n = n; os->len = os->hlen = 0; os->raw = 0; os->field = -1;
+    for (int i = 0; i < n; ++i) os->off[i] = (size_t)-1;
+    for (int i = 0; i < 4 * n; ++i) os->hoff[i] = (size_t)-1;
+    for (int k = 0; k < 4; ++k) { os->gap_lo[k] = n; os->gap_hi[k] = -1; os->hdr_ok[k] = 0; }
+    memset(os->need, 1, n);
+    os->nneed = n;
+}
+
+/* split the collected overview lines and note the empty columns */
+static void over_slice_parse(OverSlice *os, const char *group) {
+    for (int i = 0; i < os->n; ++i) {
+        if (os->off[i] == (size_t)-1) continue;
+        DBArticle *a = &os->rows[i];
+        a->group = group; a->group_len = strlen(group);
+        parse_xover_line(os->text + os->off[i], os->llen[i], a);
+        for (int k = 0; k < 4; ++k) {
+            size_t *fl;
+            over_field(a, k, &fl);
+            if (*fl) continue;
+            if (i < os->gap_lo[k]) os->gap_lo[k] = i;
+            os->gap_hi[k] = i;
+        }
+    }
+}
+
+/* next HDR command filling empty columns: field and article range; 0 when
+   none is left (or the server has no HDR) */
+static int over_slice_next_hdr(OverSlice *os, int *k, int *lo, int *hi) {
+    if (!g_caps.hdr) return 0;
+    for (int f = os->field + 1; f < 4; ++f) {
+        if (os->gap_hi[f] < 0) continue;
+        os->field = f; *k = f;
+        *lo = os->lo + os->gap_lo[f]; *hi = os->lo + os->gap_hi[f];
+        return 1;
+    }
+    os->field = 4;
+    return 0;
+}
+
+/* store the complete rows and mark the rest for HEAD */
+static void over_slice_finish(OverSlice *os, WorkerArgs *wa, RowArena *ar) {
+    int n = os->n;
+    for (int i = 0; i < n; ++i) {
+        if (os->off[i] == (size_t)-1) continue;
+        DBArticle *a = &os->rows[i];
+        int complete = 1;
+        for (int k = 0; k < 4; ++k) {
+            size_t *fl;
+            const char **f = over_field(a, k, &fl);
+            if (*fl) continue;
+            size_t h = os->hoff[k * n + i];
+            if (h != (size_t)-1) { *f = os->hbuf + h; *fl = strlen(*f); }
+            else if (!os->hdr_ok[k]) complete = 0; /* HDR had nothing: the header is really empty */
+        }
+        /* --dedup: a crosspost of a stored article needs no HEAD; the writer
+           records it from the Message-ID (2: it is a crossposts row already) */
+        int copy = 0;
+        if (!complete && g_dedup) copy = dedup_copy(a) ? 1 : dedup_placed(wa->group, a->artnum) ? 2 : 0;
+        if (!complete && !copy) continue;
+        if (copy) STAT_ADD(heads_skipped, 1);
+        if (copy != 2) {
+            if (g_dedup) dedup_note_xref(a);
+            db_writer_submit(ar, a);
+        }
+        progress_add(wa->progress, (long long)os->llen[i] + 2);
+        os->need[i] = 0;
+        os->nneed--;
+    }
+}
+
+/* OVER (and HDR) one slice, storing the complete rows; returns -1 if the
+   connection broke. A rejected OVER leaves the whole slice to HEAD. */
+static int over_slice(Conn *c, WorkerArgs *wa, RowArena *ar, OverSlice *os, int lo, int hi) {
+    over_slice_begin(os, lo, hi);
+    long got = nntp_xover_each(c, lo, hi, over_slice_line, os);
+    if (got == -1) return -1;
+    if (got < 0) return 0;
+    over_slice_parse(os, wa->group);
+    int k, hl, hh;
+    while (over_slice_next_hdr(os, &k, &hl, &hh)) {
+        char buf[BUFSZ];
+        conn_sendf(c, "HDR %s %d-%d", over_hdr_names[k], hl, hh);
+        if (conn_readline(c, buf, sizeof(buf)) <= 0) return -1;
+        if (atoi(buf) != 225) { warnf("HDR %s rejected: %s", over_hdr_names[k], buf); continue; }
+        if (conn_read_multiline_each(c, over_hdr_line, os) < 0) return -1;
+        os->hdr_ok[k] = 1;
+    }
+    over_slice_finish(os, wa, ar);
+    return 0;
+}
+
+/* One connection's HEAD pipeline, shared by the worker threads and the event
+   loop. Up to `depth` HEAD commands stay outstanding; replies arrive in
+   command order (RFC 3977 3.5), so the window is a FIFO ring. It is refilled
+   in batches once half of it has drained. */
+typedef struct {
+    WorkerArgs *wa;
+    int depth;
+    HeadSlot *win;
+    int *pending;      /* article numbers to send, from headpipe_fill */
+    HeadSlice *act;
+    int head, inflight, drained, nact;
+    int next, hi;      /* current claimed slice; empty until the first claim */
+    int slice;         /* its lo */
+    RowArena ar;
+    HeadParse hp;
+    OverSlice os;
+} HeadPipe;
+
+static void headpipe_init(HeadPipe *p, WorkerArgs *wa) {
+    memset(p, 0, sizeof(*p));
+    p->wa = wa;
+    p->depth = wa->pipeline_depth > 0 ? wa->pipeline_depth : 1;
+    p->win = malloc(sizeof(HeadSlot) * p->depth);
+    p->pending = malloc(sizeof(int) * p->depth);
+    p->act = malloc(sizeof(HeadSlice) * (p->depth + 1));
+    if (!p->win || !p->pending || !p->act) fatal(ERR_RUNTIME, "Out of memory allocating HEAD pipeline");
+    p->next = 1; p->hi = 0;
+    p->ar.w = wa->writer;
+    p->hp.a.group = wa->group; p->hp.a.group_len = strlen(wa->group);
+}
+
+static void headpipe_free(HeadPipe *p) {
+    arena_close(&p->ar);
+    free(p->win); free(p->pending); free(p->act); free(p->hp.buf);
+    OverSlice *os = &p->os;
+    free(os->text); free(os->off); free(os->llen); free(os->rows); free(os->hbuf); free(os->hoff); free(os->need);
+}
+
+/* the window is down to half and more work may be claimed */
+static int headpipe_wants(const HeadPipe *p) {
+    return !g_stop && !p->drained && p->inflight <= p->depth / 2;
+}
+
+/* claim articles until the window is full; returns how many numbers were put
+   in p->pending for the caller to send. In overview mode a slice is claimed
+   only with nothing outstanding (OVER is not pipelined behind HEADs) and *over
+   is set: the caller fetches its overview into p->os, then calls
+   headpipe_over_done. */
+static int headpipe_fill(HeadPipe *p, int *over) {
+    int np = 0;
+    *over = 0;
+    while (p->inflight < p->depth) {
+        if (p->next > p->hi) {
+            if (p->wa->overview && (p->inflight > 0 || np > 0)) break;
+            if (!chunk_claim(p->wa->chunks, &p->next, &p->hi)) { p->drained = 1; break; }
+            p->slice = p->next;
+            p->act[p->nact].lo = p->next; p->act[p->nact].left = p->hi - p->next + 1; p->nact++;
+            if (p->wa->overview) { *over = 1; break; }
+        }
+        if (p->wa->overview) {
+            while (p->next <= p->hi && !p->os.need[p->next - p->os.lo]) p->next++;
+            if (p->next > p->hi) continue;
+        }
+        if (g_dedup && dedup_placed(p->wa->group, p->next)) {
+            /* Xref of an article stored earlier: already a crossposts row */
+            STAT_ADD(heads_skipped, 1);
+            progress_add(p->wa->progress, 0);
+            head_slice_done(p->wa, &p->ar, p->act, &p->nact, p->slice);
+            p->next++;
+            continue;
+        }
+        HeadSlot *s = &p->win[(p->head + p->inflight++) % p->depth];
+        s->artnum = p->next; s->attempt = 0; s->slice = p->slice; s->sent_us = stat_t0();
+        p->pending[np++] = p->next++;
+    }
+    return np;
+}
+
+/* the claimed slice's overview is in p->os; only need[] articles remain */
+static void headpipe_over_done(HeadPipe *p) {
+    for (int k = 0; k < p->nact; ++k) if (p->act[k].lo == p->slice) p->act[k].left = p->os.nneed + 1;
+    head_slice_done(p->wa, &p->ar, p->act, &p->nact, p->slice);
+}
+
+/* handle the reply to the oldest outstanding HEAD; returns 0 if the
+   connection broke. A rejected HEAD that should be retried goes back into
+   the window and *resend is set to its article number. */
+static int headpipe_reply(HeadPipe *p, Conn *c, int *resend) {
+    *resend = 0;
+    HeadSlot cur = p->win[p->head];
+    p->head = (p->head + 1) % p->depth; p->inflight--;
+    int io_err = 0;
+    int ok = nntp_head_reply(c, cur.artnum, &p->hp, &io_err);
+    if (io_err) {
+        /* the slot stays at the head of the window, to be sent again */
+        p->head = (p->head + p->depth - 1) % p->depth; p->inflight++;
+        warnf("connection lost with %d HEAD replies outstanding", p->inflight);
+        return 0;
+    }
+    stat_lat(LAT_HEAD, cur.sent_us); /* send to end of reply, queueing included */
+    if (!ok) {
+        /* retry by appending to the window; the reply order still matches */
+        if (!g_stop && cur.attempt < p->wa->retries) {
+            cur.attempt++; cur.sent_us = stat_t0();
+            STAT_ADD(retries, 1);
+            p->win[(p->head + p->inflight++) % p->depth] = cur;
+            *resend = cur.artnum;
+        } else if (!g_stop) {
+            head_slice_done(p->wa, &p->ar, p->act, &p->nact, cur.slice); /* rejected for good, e.g. 423 */
+        }
+        return 1;
+    }
+    if (g_dedup) dedup_note_xref(&p->hp.a);
+    db_writer_submit(&p->ar, &p->hp.a);
+    head_slice_done(p->wa, &p->ar, p->act, &p->nact, cur.slice);
+    progress_add(p->wa->progress, (long long)p->hp.raw);
+    return 1;
+}
+
+/* the window's outstanding HEADs, oldest first, over a new connection */
+static int headpipe_resend(HeadPipe *p, Conn *c) {
+    for (int k = 0; k < p->inflight; ++k) {
+        HeadSlot *s = &p->win[(p->head + k) % p->depth];
+        s->sent_us = stat_t0();
+        p->pending[k] = s->artnum;
+    }
+    return send_head_batch(c, p->pending, p->inflight);
+}
+
+/* fetch HEADs for the slices of wa->chunks over an already selected group.
+   A lost connection is replaced (worker_reconnect) and the claimed work goes
+   on over the new one; returns 0 once that fails, leaving the unfinished
+   slices out of the high-water mark and the journal. */
+static int head_fetch(Conn *c, WorkerArgs *wa) {
+    HeadPipe p;
+    headpipe_init(&p, wa);
+    int broken = 0, over = 0, fails = 0;
+    for (;;) {
+        if (broken) {
+            if (!worker_reconnect(c, wa, &fails)) break;
+            broken = 0;
+            if (p.inflight && !headpipe_resend(&p, c)) { warnf("HEAD send failed"); broken = 1; continue; }
+        }
+        /* a slice whose overview was cut off starts over */
+        if (over && over_slice(c, wa, &p.ar, &p.os, p.next, p.hi) < 0) { warnf("connection lost fetching overview"); broken = 1; continue; }
+        if (over) { over = 0; headpipe_over_done(&p); }
+        while (headpipe_wants(&p)) {
+            int np = headpipe_fill(&p, &over);
+            if (np && !send_head_batch(c, p.pending, np)) { warnf("HEAD send failed"); broken = 1; break; }
+            if (!over) break;
+            if (over_slice(c, wa, &p.ar, &p.os, p.next, p.hi) < 0) { warnf("connection lost fetching overview"); broken = 1; break; }
+            over = 0;
+            headpipe_over_done(&p);
+            fails = 0;
+        }
+        if (broken) continue;
+        if (p.inflight == 0) break;
+        int resend;
+        if (!headpipe_reply(&p, c, &resend)) broken = 1;
+        else if (resend && !send_head_batch(c, &resend, 1)) { warnf("HEAD send failed"); broken = 1; }
+        else fails = 0;
+    }
+    headpipe_free(&p);
+    return !broken;
+}
+
+static void *head_worker(void *arg) {
+    WorkerArgs *wa = (WorkerArgs*)arg;
+    Conn tc;
+    int fails = 0;
+    if (!thread_connect(&tc, wa->host, wa->port, wa->use_ssl, wa->do_starttls, wa->user, wa->pass, wa->group) &&
+        !worker_reconnect(&tc, wa, &fails)) {
+        warnf("thread connect failed");
+        return NULL;
+    }
+    head_fetch(&tc, wa);
+    conn_cleanup(&tc);
+    return NULL;
+}
+
+/* XOVER streaming: parse and insert each overview line as it is received */
+typedef struct {
+    DB *db;
+    const char *group;
+    Progress *progress;
+    RowArena *arena;                 /* rows for the DB writer; NULL: write to db directly */
+    int last;                        /* highest article stored so far */
+} XoverIngest;
+
+static void xover_ingest_line(char *line, size_t len, void *arg) {
+    XoverIngest *xi = (XoverIngest*)arg;
+    if (g_stop) return; /* interrupted: drain the rest of the response unparsed */
+    DBArticle a;
+    a.group = xi->group; a.group_len = strlen(xi->group);
+    long long t0 = stat_t0();
+    parse_xover_line(line, len, &a);
+    stat_lat(LAT_PARSE, t0);
+    /* the direct path binds the fields where they lie in the receive buffer */
+    if (xi->arena) db_writer_submit(xi->arena, &a);
+    else db_store_article(xi->db, &a);
+    if (a.artnum > xi->last) xi->last = a.artnum;
+    progress_add(xi->progress, (long long)len + 2);
+}
+
+/* fetch one XOVER chunk, retrying a rejected command up to wa->retries times
+   and reconnecting when the connection is lost. A retry asks only for the
+   articles after the last one stored, so no row is ingested twice.
+   Returns 0, -2 if the chunk failed, -1 if the connection is gone for good. */
+static long xover_fetch_chunk(Conn *c, WorkerArgs *wa, int lo, int hi, XoverIngest *xi, int *fails) {
+    xi->last = lo - 1;
+    for (int attempt = 0; !g_stop; ) {
+        long got = nntp_xover_each(c, xi->last + 1, hi, xover_ingest_line, xi);
+        if (got >= 0) { *fails = 0; return 0; }
+        if (got == -1) {
+            warnf("connection lost during XOVER %d-%d", xi->last + 1, hi);
+            if (!worker_reconnect(c, wa, fails)) return -1;
+            if (xi->last >= hi) return 0; /* every line arrived; only the terminator was lost */
+        } else if (attempt++ >= wa->retries) {
+            break;
+        }
+        STAT_ADD(retries, 1);
+    }
+    warnf("XOVER %d-%d failed", xi->last + 1, hi);
+    return -2;
+}
+
+/* fetch XOVER chunks of wa->chunks over an already selected group; returns
+   0 if the connection was lost for good */
+static int xover_fetch(Conn *c, WorkerArgs *wa) {
+    XoverIngest xi;
+    RowArena ar = { wa->writer, NULL, NULL, NULL };
+    xi.db = wa->db; xi.group = wa->group; xi.progress = wa->progress; xi.arena = &ar;
+    int lo, hi, fails = 0, ok = 1;
+    while (!g_stop && chunk_claim(wa->chunks, &lo, &hi)) {
+        long got = xover_fetch_chunk(c, wa, lo, hi, &xi, &fails);
+        if (got == -1) { ok = 0; break; }
+        if (got < 0 || g_stop) continue;
+        slice_finished(wa->chunks, &ar, wa->group, lo);
+    }
+    arena_close(&ar);
+    return ok;
+}
+
+static void *xover_worker(void *arg) {
+    WorkerArgs *wa = (WorkerArgs*)arg;
+    Conn tc;
+    int fails = 0;
+    if (!thread_connect(&tc, wa->host, wa->port, wa->use_ssl, wa->do_starttls, wa->user, wa->pass, wa->group) &&
+        !worker_reconnect(&tc, wa, &fails)) {
+        warnf("thread connect failed");
+        return NULL;
+    }
+    xover_fetch(&tc, wa);
+    conn_cleanup(&tc);
+    return NULL;
+}
+
+/* CLI parsing - very simple */
+static void usage_and_exit(const char *prog, AppError code, const char *detail) {
+    printf("Usage: %s --host HOST [--port PORT] [--ssl] [--starttls] [--user USER --pass PASS]\n"
+           "          --db-type {sqlite|mariadb|mysql} --db-name DBNAME [--db-host HOST --db-port PORT --db-user USER --db-pass PASS]\n"
+            "          {--group GROUP|WILDMAT | --group-list FILE} [--headers-only] [--no-overview] [--incremental] [--limit N] [--progress-width N] [--init-db|--create-db]\n"
+           "          [--threads N] [--event-loop N] [--retries N] [--reconnects N] [--pipeline-depth N] [--xover-chunk N] [--compress auto|deflate|gzip|xzver|off]\n"
+           "          [--export-html --export-html-out PATH [--export-jobs N] [--export-page-size N]]\n"
+           "          [--schema-v2] [--intern-authors] [--keep-date-text] [--migrate-schema] [--dedup] [--sqlite-profile bulk|online] [--sqlite-checkpoint PAGES]\n"
+           "          [--shards N [--shard-map FILE]]\n"
+           "          [--batch-size N] [--batch-ms MS] [--bulk N] [--stats-interval SEC] [--metrics-port [ADDR:]PORT] [--conf FILE] [--write-conf FILE] [--log FILE] [--verbose] (write-conf exits after saving)\n", prog);
+    if (detail && *detail) {
+        fprintf(stderr, "Error (code %d): %s\n", code, describe_error(code));
+        fprintf(stderr, "Details: %s\n", detail);
+    }
+    exit(code);
+}
+
+/* Simple key=value config file loader */
+static void trim(char *s) {
+    char *p = s; while (*p && isspace((unsigned char)*p)) p++; if (p!=s) memmove(s,p,strlen(p)+1);
+    size_t n = strlen(s); while (n && isspace((unsigned char)s[n-1])) s[--n] = '\0';
+}
+
+static int load_conf(const char *path,
+                     const char **host, const char **port, int *use_ssl, int *do_starttls,
+                     const char **user, const char **pass,
+                     const char **db_type_s, const char **db_name, const char **db_host,
+                     const char **db_port, const char **db_user, const char **db_pass,
+                     const char **group, int *headers_only, int *limit, int *progress_width) {
+    FILE *f = fopen(path, "r");
+    if (!f) { warnf("Could not open conf: %s", path); return 0; }
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        trim(line);
+        if (!*line || *line=='#' || *line==';') continue;
+        char *eq = strchr(line,'=');
+        if (!eq) continue;
+        *eq='\0'; char *key=line; char *val=eq+1; trim(key); trim(val);
+        if (strcasecmp(key,"host")==0) *host = strdup(val);
+        else if (strcasecmp(key,"port")==0) *port = strdup(val);
+        else if (strcasecmp(key,"ssl")==0) *use_ssl = atoi(val)?1:0;
+        else if (strcasecmp(key,"starttls")==0) *do_starttls = atoi(val)?1:0;
+        else if (strcasecmp(key,"user")==0) *user = strdup(val);
+        else if (strcasecmp(key,"pass")==0) *pass = strdup(val);
+        else if (strcasecmp(key,"db_type")==0 || strcasecmp(key,"db-type")==0) *db_type_s = strdup(val);
+        else if (strcasecmp(key,"db_name")==0 || strcasecmp(key,"db-name")==0) *db_name = strdup(val);
+        else if (strcasecmp(key,"db_host")==0 || strcasecmp(key,"db-host")==0) *db_host = strdup(val);
+        else if (strcasecmp(key,"db_port")==0 || strcasecmp(key,"db-port")==0) *db_port = strdup(val);
+        else if (strcasecmp(key,"db_user")==0 || strcasecmp(key,"db-user")==0) *db_user = strdup(val);
+        else if (strcasecmp(key,"db_pass")==0 || strcasecmp(key,"db-pass")==0) *db_pass = strdup(val);
+        else if (strcasecmp(key,"group")==0) *group = strdup(val);
+        else if (strcasecmp(key,"headers_only")==0 || strcasecmp(key,"headers-only")==0) *headers_only = atoi(val)?1:0;
+        else if (strcasecmp(key,"limit")==0) *limit = atoi(val);
+        else if (strcasecmp(key,"progress_width")==0 || strcasecmp(key,"progress-width")==0) *progress_width = atoi(val);
+    }
+    fclose(f);
+    return 1;
+}
+
+static int write_conf(const char *path,
+                      const char *host, const char *port, int use_ssl, int do_starttls,
+                      const char *user, const char *pass,
+                      const char *db_type_s, const char *db_name, const char *db_host,
+                      const char *db_port, const char *db_user, const char *db_pass,
+                      const char *group, int headers_only, int limit, int progress_width) {
+    FILE *f = fopen(path, "w");
+    if (!f) { warnf("Could not write conf: %s", path); return 0; }
+    fprintf(f,"# nntp2sql configuration\n");
+    if (host) fprintf(f,"host=%s\n", host);
+    if (port) fprintf(f,"port=%s\n", port);
+    fprintf(f,"ssl=%d\n", use_ssl);
+    fprintf(f,"starttls=%d\n", do_starttls);
+    if (user) fprintf(f,"user=%s\n", user);
+    if (pass) fprintf(f,"pass=%s\n", pass);
+    if (db_type_s) fprintf(f,"db_type=%s\n", db_type_s);
+    if (db_name) fprintf(f,"db_name=%s\n", db_name);
+    if (db_host) fprintf(f,"db_host=%s\n", db_host);
+    if (db_port) fprintf(f,"db_port=%s\n", db_port);
+    if (db_user) fprintf(f,"db_user=%s\n", db_user);
+    if (db_pass) fprintf(f,"db_pass=%s\n", db_pass);
+    if (group) fprintf(f,"group=%s\n", group);
+    fprintf(f,"headers_only=%d\n", headers_only);
+    fprintf(f,"limit=%d\n", limit);
+    fprintf(f,"progress_width=%d\n", progress_width);
+    fclose(f);
+    return 1;
+}
+
+/* --shard-map FILE: "PATTERN SHARD" per line, the first matching line wins */
+static void load_shard_map(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) fatal(ERR_ARGS, "Cannot open shard map %s: %s", path, strerror(errno));
+    char line[512], pat[512];
+    int cap = 0, ln = 0;
+    while (fgets(line, sizeof(line), f)) {
+        ln++;
+        trim(line);
+        if (!*line || *line == '#') continue;
+        int k;
+        if (sscanf(line, "%511s %d", pat, &k) != 2 || k < 0) { warnf("%s:%d: expected PATTERN SHARD", path, ln); continue; }
+        if (g_shards && k >= g_shards) warnf("%s:%d: shard %d out of range (--shards %d)", path, ln, k, g_shards);
+        if (g_nshard_rules == cap) {
+            cap = cap ? cap * 2 : 16;
+            ShardRule *nr = realloc(g_shard_rules, sizeof(ShardRule) * cap);
+            if (!nr) fatal(ERR_RUNTIME, "Out of memory loading the shard map");
+            g_shard_rules = nr;
+        }
+        g_shard_rules[g_nshard_rules].pattern = strdup(pat);
+        g_shard_rules[g_nshard_rules].shard = k;
+        g_nshard_rules++;
+    }
+    fclose(f);
+}
+
+/* Multi-group ingestion (--group-list / wildmat): one process keeps a pool
+   of authenticated connections and schedules groups across it. Groups are
+   taken smallest backlog first so a few huge groups cannot hold every
+   connection while small ones wait; once no group is left unstarted, idle
+   connections join the running group with the most unclaimed articles. */
+typedef struct {
+    char *name;
+    int first, last; /* range to fetch */
+    ChunkCursor cc;
+} GroupJob;
+
+#define POOL_MAX 64
+
+typedef struct {
+    GroupJob *jobs;
+    int njobs;
+    int next_job;  /* next unstarted job, claimed with fetch-add */
+    int headers_only;
+    WorkerArgs base; /* shared settings; group/chunks are set per job */
+    pthread_mutex_t pool_m;
+    Conn idle[POOL_MAX];
+    int nidle;
+    int failed;    /* groups the server would not select */
+} GroupSched;
+
+static int pool_take(GroupSched *gs, Conn *out) {
+    int ok = 0;
+    pthread_mutex_lock(&gs->pool_m);
+    if (gs->nidle > 0) { *out = gs->idle[--gs->nidle]; ok = 1; }
+    pthread_mutex_unlock(&gs->pool_m);
+    return ok;
+}
+
+static void pool_put(GroupSched *gs, Conn *c) {
+    pthread_mutex_lock(&gs->pool_m);
+    if (gs->nidle < POOL_MAX) gs->idle[gs->nidle++] = *c;
+    else conn_cleanup(c);
+    pthread_mutex_unlock(&gs->pool_m);
+}
+
+static GroupJob *sched_next(GroupSched *gs) {
+    int k = __atomic_fetch_add(&gs->next_job, 1, __ATOMIC_RELAXED);
+    if (k < gs->njobs) return &gs->jobs[k];
+    GroupJob *best = NULL;
+    long long best_left = 0;
+    for (int j = 0; j < gs->njobs; ++j) {
+        GroupJob *jb = &gs->jobs[j];
+        long long left = (long long)jb->cc.last - __atomic_load_n(&jb->cc.next, __ATOMIC_RELAXED) + 1;
+        if (left >= jb->cc.chunk && left > best_left) { best = jb; best_left = left; }
+    }
+    return best;
+}
+
+/* the server refused to select job's group: give up on what is unclaimed so
+   sched_next stops handing the job out, and count the group once */
+static void sched_fail(GroupSched *gs, GroupJob *job) {
+    long long past = (long long)job->cc.last + 1;
+    if (__atomic_exchange_n(&job->cc.next, past, __ATOMIC_RELAXED) < past) __atomic_fetch_add(&gs->failed, 1, __ATOMIC_RELAXED);
+}
+
+static void *group_worker(void *arg) {
+    GroupSched *gs = (GroupSched*)arg;
+    WorkerArgs *b = &gs->base;
+    Conn tc;
+    int have = pool_take(gs, &tc);
+    GroupJob *job;
+    while (!g_stop && (job = sched_next(gs)) != NULL) {
+        WorkerArgs wa = *b;
+        wa.group = job->name; wa.chunks = &job->cc;
+        if (have) {
+            int cnt = 0, f = 0, l = 0;
+            int rc = nntp_group(&tc, job->name, &cnt, &f, &l);
+            if (rc < 0) { warnf("connection lost selecting %s", job->name); have = 0; }
+            else if (rc < 200 || rc >= 300) { warnf("GROUP %s failed: %d", job->name, rc); sched_fail(gs, job); continue; }
+        }
+        if (!have) {
+            int fails = 0;
+            if (!thread_connect(&tc, b->host, b->port, b->use_ssl, b->do_starttls, b->user, b->pass, job->name) &&
+                !worker_reconnect(&tc, &wa, &fails)) {
+                warnf("pool connect failed");
+                break;
+            }
+            have = 1;
+        }
+        infof("worker on %s (%d-%d)", job->name, job->first, job->last);
+        /* lost for good: what this worker had claimed is left for a resumed run */
+        if (!(gs->headers_only ? xover_fetch(&tc, &wa) : head_fetch(&tc, &wa))) { conn_cleanup(&tc); have = 0; break; }
+    }
+    if (have) pool_put(gs, &tc);
+    return NULL;
+}
+
+/* Event-loop engine (--event-loop N): the HEAD connections are driven by N
+   threads instead of one blocking thread each. Sockets and TLS are
+   non-blocking and every connection is a state machine over the same steps
+   a worker thread takes (connect, TLS, greeting, STARTTLS, AUTHINFO,
+   COMPRESS, GROUP, then the pipelined HEAD/OVER/HDR of its HeadPipe).
+   Replies are parsed only once they are completely buffered, so the
+   blocking parsers above run unchanged and never wait. Groups are taken
+   from a GroupSched like the connection pool does. */
+
+typedef struct { void *ud; int rd, wr; } PollEv;
+
+#if defined(EV_EPOLL)
+typedef struct { int fd; } Poller;
+
+static int poller_open(Poller *p) { p->fd = epoll_create(64); return p->fd >= 0; }
+static void poller_close(Poller *p) { close(p->fd); }
+
+static int poller_set(Poller *p, int fd, void *ud, int wr, int add) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (wr ? EPOLLOUT : 0);
+    ev.data.ptr = ud;
+    return epoll_ctl(p->fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+static void poller_del(Poller *p, int fd) {
+    struct epoll_event ev;
+    epoll_ctl(p->fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+static int poller_wait(Poller *p, PollEv *out, int max, int ms) {
+    struct epoll_event ev[64];
+    if (max > 64) max = 64;
+    int n = epoll_wait(p->fd, ev, max, ms);
+    for (int i = 0; i < n; ++i) {
+        out[i].ud = ev[i].data.ptr;
+        out[i].rd = (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+        out[i].wr = (ev[i].events & (EPOLLOUT | EPOLLERR)) != 0;
+    }
+    return n < 0 ? 0 : n;
+}
+#elif defined(EV_KQUEUE)
+typedef struct { int fd; } Poller;
+
+static int poller_open(Poller *p) { p->fd = kqueue(); return p->fd >= 0; }
+static void poller_close(Poller *p) { close(p->fd); }
+
+static int poller_set(Poller *p, int fd, void *ud, int wr, int add) {
+    struct kevent kv[2];
+    (void)add;
+    EV_SET(&kv[0], fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, ud);
+    EV_SET(&kv[1], fd, EVFILT_WRITE, EV_ADD | (wr ? EV_ENABLE : EV_DISABLE), 0, 0, ud);
+    return kevent(p->fd, kv, 2, NULL, 0, NULL) == 0;
+}
+
+static void poller_del(Poller *p, int fd) {
+    struct kevent kv[2];
+    EV_SET(&kv[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    EV_SET(&kv[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    kevent(p->fd, kv, 2, NULL, 0, NULL);
+}
+
+static int poller_wait(Poller *p, PollEv *out, int max, int ms) {
+    struct kevent ev[64];
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    if (max > 64) max = 64;
+    int n = kevent(p->fd, NULL, 0, ev, max, &ts);
+    for (int i = 0; i < n; ++i) {
+        out[i].ud = ev[i].udata;
+        out[i].rd = ev[i].filter == EVFILT_READ;
+        out[i].wr = ev[i].filter == EVFILT_WRITE;
+    }
+    return n < 0 ? 0 : n;
+}
+#else
+#define POLLER_MAX 1024
+typedef struct { struct pollfd fds[POLLER_MAX]; void *ud[POLLER_MAX]; int n; } Poller;
+
+static int poller_open(Poller *p) { p->n = 0; return 1; }
+static void poller_close(Poller *p) { p->n = 0; }
+
+static int poller_set(Poller *p, int fd, void *ud, int wr, int add) {
+    int k = 0;
+    while (k < p->n && p->fds[k].fd != fd) k++;
+    if (k == p->n) {
+        if (!add || p->n == POLLER_MAX) return 0;
+        p->n++;
+    }
+    p->fds[k].fd = fd; p->fds[k].events = POLLIN | (wr ? POLLOUT : 0); p->fds[k].revents = 0;
+    p->ud[k] = ud;
+    return 1;
+}
+
+static void poller_del(Poller *p, int fd) {
+    for (int k = 0; k < p->n; ++k) {
+        if (p->fds[k].fd != fd) continue;
+        p->fds[k] = p->fds[--p->n]; p->ud[k] = p->ud[p->n];
+        return;
+    }
+}
+
+static int poller_wait(Poller *p, PollEv *out, int max, int ms) {
+    if (poll(p->fds, (nfds_t)p->n, ms) <= 0) return 0;
+    int n = 0;
+    for (int k = 0; k < p->n && n < max; ++k) {
+        short re = p->fds[k].revents;
+        if (!re) continue;
+        out[n].ud = p->ud[k];
+        out[n].rd = (re & (POLLIN | POLLHUP | POLLERR)) != 0;
+        out[n].wr = (re & (POLLOUT | POLLERR)) != 0;
+        n++;
+    }
+    return n;
+}
+#endif
+
+enum { EV_CONNECT, EV_TLS, EV_GREETING, EV_STARTTLS, EV_AUTH_USER, EV_AUTH_PASS, EV_COMPRESS,
+       EV_GROUP, EV_HEAD, EV_OVER, EV_HDR, EV_WAIT, EV_CLOSED };
+
+typedef struct {
+    Conn c;
+    int state;
+    int after_tls;         /* EV_GREETING, or EV_AUTH_USER after STARTTLS */
+    struct addrinfo *ai;   /* address being connected to */
+    char *wbuf;            /* commands not yet written */
+    size_t wlen, woff, wcap;
+    int wr_blocked;        /* TLS needs the socket writable to make progress */
+    int polled_wr;
+    size_t scanned;        /* bytes of the pending reply searched for its end */
+    GroupJob *job;
+    WorkerArgs wa;
+    HeadPipe pipe;
+    int have_pipe;
+    int xz;                /* the OVER in flight was sent as XZVER */
+    long long t0;
+    /* a lost connection with claimed work waits (EV_WAIT) until retry_at,
+       reconnects and resumes its pipe: HEADs in the window, or the OVER */
+    int resume, resume_over, fails;
+    long long retry_at;
+} EvConn;
+
+typedef struct {
+    GroupSched *gs;
+    EvConn *conns;
+    int nconns, live, waiting;
+    struct addrinfo *addrs;
+    int use_ssl, do_starttls;
+    const char *user, *pass;
+} EvLoop;
+
+static int nntp_multiline(int code) {
+    return code == 100 || code == 101 || code == 215 || (code >= 220 && code <= 225) || code == 230 || code == 231;
+}
+
+/* a complete reply is buffered: its status line and, for multi-line replies,
+   everything up to the terminating "." line */
+static int ev_reply_ready(EvConn *e) {
+    Conn *c = &e->c;
+    if (!c->rbuf || c->rlen == c->rpos) return 0;
+    const char *p = c->rbuf + c->rpos;
+    size_t n = c->rlen - c->rpos;
+    const char *nl = memchr(p, '\n', n);
+    if (!nl) return 0;
+    if (!nntp_multiline(atoi(p))) return 1;
+    size_t i = (size_t)(nl - p);
+    if (e->scanned > i) i = e->scanned;
+    for (;;) {
+        /* p[i] is a '\n'; the reply ends if the next line is "." */
+        if (i + 2 < n && p[i+1] == '.' && p[i+2] == '\n') return 1;
+        if (i + 3 < n && p[i+1] == '.' && p[i+2] == '\r' && p[i+3] == '\n') return 1;
+        if (i + 3 >= n) { e->scanned = i; return 0; }
+        const char *q = memchr(p + i + 1, '\n', n - i - 1);
+        if (!q) { e->scanned = i; return 0; }
+        i = (size_t)(q - p);
+    }
+}
+
+/* non-blocking read: >0 bytes, 0 would block, -1 closed or failed */
+static ssize_t ev_recv(EvConn *e, char *buf, size_t len) {
+    Conn *c = &e->c;
+    ssize_t r = conn_recv(c, buf, len);
+    if (r > 0) return r;
+    if (c->use_ssl) {
+        int err = SSL_get_error(c->ssl, (int)r);
+        if (err == SSL_ERROR_WANT_READ) return 0;
+        if (err == SSL_ERROR_WANT_WRITE) { e->wr_blocked = 1; return 0; }
+        return -1;
+    }
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    return -1;
+}
+
+static ssize_t ev_recv_inflate(EvConn *e, char *buf, size_t len) {
+    Conn *c = &e->c;
+    for (;;) {
+        if (c->zpos == c->zlen && !c->zfull) {
+            ssize_t r = ev_recv(e, c->zbuf, CONN_ZBUFSZ);
+            if (r <= 0) return r;
+            c->zpos = 0; c->zlen = (size_t)r;
+        }
+        z_stream *z = c->zin;
+        z->next_in = (Bytef*)c->zbuf + c->zpos; z->avail_in = (uInt)(c->zlen - c->zpos);
+        z->next_out = (Bytef*)buf; z->avail_out = (uInt)len;
+        int rc = inflate(z, Z_SYNC_FLUSH);
+        c->zpos = c->zlen - z->avail_in;
+        c->zfull = z->avail_out == 0;
+        if (rc != Z_OK && rc != Z_BUF_ERROR) { warnf("COMPRESS DEFLATE stream error: %s", z->msg ? z->msg : "inflate failed"); return -1; }
+        size_t got = len - z->avail_out;
+        if (got) { STAT_ADD(bytes_inflated, got); return (ssize_t)got; }
+    }
+}
+
+/* read everything available; 0 if the connection closed or failed */
+static int ev_fill(EvConn *e) {
+    Conn *c = &e->c;
+    e->wr_blocked = 0;
+    for (;;) {
+        if (!c->rbuf) {
+            c->rbuf = malloc(CONN_RBUFSZ);
+            if (!c->rbuf) return 0;
+            c->rcap = CONN_RBUFSZ; c->rpos = c->rlen = 0;
+        }
+        if (c->rpos > 0) {
+            if (c->rlen > c->rpos) memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+            c->rlen -= c->rpos; c->rpos = 0;
+        }
+        if (c->rlen == c->rcap) {
+            char *nb = realloc(c->rbuf, c->rcap * 2);
+            if (!nb) return 0;
+            c->rbuf = nb; c->rcap *= 2;
+        }
+        size_t room = c->rcap - c->rlen;
+        ssize_t r = c->zin ? ev_recv_inflate(e, c->rbuf + c->rlen, room) : ev_recv(e, c->rbuf + c->rlen, room);
+        if (r < 0) return 0;
+        if (r == 0) return 1;
+        c->rlen += (size_t)r;
     }
-    return code;
 }
 
-/* request STARTTLS */
-static int nntp_starttls(Conn *c) {
-    char resp[BUFSZ];
-    conn_sendf(c, "STARTTLS");
-    if (conn_readline(c, resp, sizeof(resp)) <= 0) return -1;
-    return atoi(resp);
+static int ev_wroom(EvConn *e, size_t n) {
+    if (e->woff == e->wlen) e->woff = e->wlen = 0;
+    if (e->wlen + n <= e->wcap) return 1;
+    size_t cap = e->wcap ? e->wcap : 4096;
+    while (cap < e->wlen + n) cap *= 2;
+    char *nb = realloc(e->wbuf, cap);
+    if (!nb) return 0;
+    e->wbuf = nb; e->wcap = cap;
+    return 1;
 }
 
-static int nntp_group(Conn *c, const char *group, int *count, int *first, int *last) {
+/* queue a command line (deflated under COMPRESS DEFLATE) */
+static int ev_sendf(EvConn *e, const char *fmt, ...) {
     char buf[BUFSZ];
-    conn_sendf(c, "GROUP %s", group);
-    if (conn_readline(c, buf, sizeof(buf)) <= 0) return -1;
-    int code = atoi(buf);
-    if (code >= 200 && code < 300) {
-        /* parse: 211 <count> <first> <last> <groupname> */
-        int cnt=0, f=0, l=0;
-        sscanf(buf, "%*d %d %d %d", &cnt, &f, &l);
-        if (count) *count = cnt;
-        if (first) *first = f;
-        if (last) *last = l;
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf) - 2, fmt, ap);
+    va_end(ap);
+    if (len < 0 || (size_t)len >= sizeof(buf) - 2) return 0;
+    buf[len++] = '\r'; buf[len++] = '\n';
+    z_stream *z = e->c.zout;
+    if (!z) {
+        if (!ev_wroom(e, (size_t)len)) return 0;
+        memcpy(e->wbuf + e->wlen, buf, (size_t)len);
+        e->wlen += (size_t)len;
+        return 1;
     }
-    return code;
+    z->next_in = (Bytef*)buf; z->avail_in = (uInt)len;
+    do {
+        if (!ev_wroom(e, 4096)) return 0;
+        z->next_out = (Bytef*)e->wbuf + e->wlen; z->avail_out = (uInt)(e->wcap - e->wlen);
+        if (deflate(z, Z_SYNC_FLUSH) == Z_STREAM_ERROR) return 0;
+        e->wlen = e->wcap - z->avail_out;
+    } while (z->avail_out == 0);
+    return 1;
 }
 
-/* fetch XOVER for a range; returns malloc'd content with lines separated by \n */
-static char *nntp_xover(Conn *c, int first, int last) {
-    char buf[BUFSZ];
-    conn_sendf(c, "XOVER %d-%d", first, last);
-    if (conn_readline(c, buf, sizeof(buf)) <= 0) return NULL;
-    int code = atoi(buf);
-    if (code < 200 || code >= 300) {
-        warnf("XOVER rejected: %s", buf);
-        return NULL;
+/* write what the socket takes; 0 on failure */
+static int ev_flush(EvConn *e) {
+    Conn *c = &e->c;
+    while (e->woff < e->wlen) {
+        size_t n = e->wlen - e->woff;
+        if (c->use_ssl) {
+            int w = SSL_write(c->ssl, e->wbuf + e->woff, (int)n);
+            if (w <= 0) {
+                int err = SSL_get_error(c->ssl, w);
+                return err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ;
+            }
+            e->woff += (size_t)w;
+        } else {
+            ssize_t w = send(c->sock, e->wbuf + e->woff, n, 0);
+            if (w < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            e->woff += (size_t)w;
+        }
     }
-    return conn_read_multiline(c);
+    return 1;
 }
 
-/* fetch full header for article number */
-static char *nntp_head(Conn *c, int artnum) {
-    char buf[BUFSZ];
-    conn_sendf(c, "HEAD %d", artnum);
-    if (conn_readline(c, buf, sizeof(buf)) <= 0) return NULL;
-    int code = atoi(buf);
-    if (code < 200 || code >= 300) {
-        warnf("HEAD rejected for %d: %s", artnum, buf);
-        return NULL;
+/* start a non-blocking connect to e->ai or the addresses after it */
+static int ev_connect(EvConn *e) {
+    for (; e->ai; e->ai = e->ai->ai_next) {
+        int fd = socket(e->ai->ai_family, e->ai->ai_socktype, e->ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, e->ai->ai_addr, e->ai->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            e->c.sock = fd;
+            e->state = EV_CONNECT;
+            return 1;
+        }
+        close(fd);
     }
-    return conn_read_multiline(c);
-}
-
-/* parse XOVER line: fields are tab-separated. Common format:
-   article-number TAB subject TAB author TAB date TAB message-id TAB references TAB bytes TAB lines TAB xref
-   We'll read first 8 fields.
-*/
-static void parse_xover_line(const char *line, int *artnum, char **subject, char **author, char **date,
-                             char **message_id, char **references, int *bytes, int *lines) {
-    const char *p = line;
-    char *fields[9] = {0};
-    int f = 0;
-    size_t len = strlen(line);
-    char *tmp = malloc(len+1);
-    strcpy(tmp, line);
-    char *tk = tmp;
-    char *saveptr = NULL;
-    char *tok = strtok_r(tk, "\t", &saveptr);
-    while (tok && f < 9) {
-        fields[f++] = strdup(tok);
-        tok = strtok_r(NULL, "\t", &saveptr);
-    }
-    if (fields[0]) *artnum = atoi(fields[0]);
-    *subject = fields[1] ? fields[1] : strdup("");
-    *author = fields[2] ? fields[2] : strdup("");
-    *date = fields[3] ? fields[3] : strdup("");
-    *message_id = fields[4] ? fields[4] : strdup("");
-    *references = fields[5] ? fields[5] : strdup("");
-    *bytes = fields[6] ? atoi(fields[6]) : 0;
-    *lines = fields[7] ? atoi(fields[7]) : 0;
-    /* free tmp structure holders except those we returned */
-    free(tmp);
-}
-
-/* Strip header values: find "Subject: ..." lines etc. For HEAD responses, we can parse basic fields */
-static void extract_from_headers(const char *hdrs, char **subject, char **from, char **date, char **message_id, char **references, int *bytes, int *lines) {
-    *subject = strdup("");
-    *from = strdup("");
-    *date = strdup("");
-    *message_id = strdup("");
-    *references = strdup("");
-    *bytes = 0; *lines = 0;
-    char *copy = strdup(hdrs);
-    char *line = strtok(copy, "\n");
-    while (line) {
-        while (*line && isspace((unsigned char)*line)) line++;
-        if (strncasecmp(line, "Subject:", 8) == 0) {
-            free(*subject); *subject = strdup(line + 8);
-            while (**subject == ' ') memmove(*subject, *subject+1, strlen(*subject));
-        } else if (strncasecmp(line, "From:", 5) == 0) {
-            free(*from); *from = strdup(line + 5);
-            while (**from == ' ') memmove(*from, *from+1, strlen(*from));
-        } else if (strncasecmp(line, "Date:", 5) == 0) {
-            free(*date); *date = strdup(line + 5);
-            while (**date == ' ') memmove(*date, *date+1, strlen(*date));
-        } else if (strncasecmp(line, "Message-ID:", 11) == 0) {
-            free(*message_id); *message_id = strdup(line + 11);
-            while (**message_id == ' ') memmove(*message_id, *message_id+1, strlen(*message_id));
-        } else if (strncasecmp(line, "References:", 11) == 0) {
-            free(*references); *references = strdup(line + 11);
-            while (**references == ' ') memmove(*references, *references+1, strlen(*references));
-        } else if (strncasecmp(line, "Lines:", 6) == 0) {
-            *lines = atoi(line + 6);
-        } else if (strncasecmp(line, "Bytes:", 6) == 0) {
-            *bytes = atoi(line + 6);
-        }
-        line = strtok(NULL, "\n");
-    }
-    free(copy);
-}
-
-/* Work queue + threading (C99 compatible) */
-typedef struct {
-    int *items;
-    int head;
-    int tail;
-    int capacity;
-    pthread_mutex_t m;
-} WorkQueue;
+    return 0;
+}
 
-static void queue_init(WorkQueue *q, int capacity) {
-    q->items = malloc(sizeof(int) * capacity);
-    q->head = 0; q->tail = 0; q->capacity = capacity;
-    pthread_mutex_init(&q->m, NULL);
+/* advance the TLS handshake: 1 done, 0 in progress, -1 failed */
+static int ev_tls_step(EvConn *e) {
+    int r = SSL_connect(e->c.ssl);
+    if (r == 1) { conn_tls_done(&e->c); return 1; }
+    int err = SSL_get_error(e->c.ssl, r);
+    e->wr_blocked = err == SSL_ERROR_WANT_WRITE;
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) return 0;
+    ERR_print_errors_fp(stderr);
+    return -1;
 }
 
-static void queue_push(WorkQueue *q, int v) {
-    if (q->tail < q->capacity) q->items[q->tail++] = v;
+static int ev_tls_start(EvConn *e, int after) {
+    if (!conn_tls_begin(&e->c)) return 0;
+    SSL_set_mode(e->c.ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    e->state = EV_TLS;
+    e->after_tls = after;
+    return 1;
 }
 
-static int queue_pop(WorkQueue *q, int *v) {
-    int ok = 0;
-    pthread_mutex_lock(&q->m);
-    if (q->head < q->tail) { *v = q->items[q->head++]; ok = 1; }
-    pthread_mutex_unlock(&q->m);
-    return ok;
+/* select the next group with work left; 0 when there is none */
+static int ev_next_group(EvLoop *L, EvConn *e) {
+    if (e->resume) { /* reconnected: the same group again */
+        e->t0 = stat_t0();
+        e->state = EV_GROUP;
+        return ev_sendf(e, "GROUP %s", e->job->name);
+    }
+    if (e->have_pipe) { headpipe_free(&e->pipe); e->have_pipe = 0; }
+    if (g_stop || (e->job = sched_next(L->gs)) == NULL) return 0;
+    e->t0 = stat_t0();
+    e->state = EV_GROUP;
+    return ev_sendf(e, "GROUP %s", e->job->name);
 }
 
-static void queue_destroy(WorkQueue *q) {
-    if (q->items) free(q->items);
-    pthread_mutex_destroy(&q->m);
-    memset(q, 0, sizeof(*q));
+/* send the first login command from step on; straight to GROUP when none is due */
+static int ev_login(EvLoop *L, EvConn *e, int step) {
+    if (step <= EV_STARTTLS && L->do_starttls && !e->c.use_ssl) { e->state = EV_STARTTLS; return ev_sendf(e, "STARTTLS"); }
+    if (step <= EV_AUTH_USER && L->user && L->pass) { e->state = EV_AUTH_USER; return ev_sendf(e, "AUTHINFO USER %s", L->user); }
+    if (step <= EV_COMPRESS && g_compress == COMPRESS_DEFLATE) { e->state = EV_COMPRESS; return ev_sendf(e, "COMPRESS DEFLATE"); }
+    return ev_next_group(L, e);
 }
 
-typedef struct {
-    DB *db;
-    const char *group;
-    int retries;
-    int progress_width;
-    int total;
-    volatile int *processed;
-    pthread_mutex_t *progress_mutex;
-    pthread_mutex_t *db_mutex;
-    WorkQueue *queue;
-    const char *host; const char *port; int use_ssl; int do_starttls; const char *user; const char *pass;
-} WorkerArgs;
+static int ev_over_send(EvConn *e) {
+    OverSlice *os = &e->pipe.os;
+    e->xz = __atomic_load_n(&g_xzver, __ATOMIC_RELAXED);
+    e->t0 = stat_t0();
+    e->state = EV_OVER;
+    return ev_sendf(e, "%s %d-%d", e->xz ? "XZVER" : g_caps.over ? "OVER" : "XOVER", os->lo, os->lo + os->n - 1);
+}
 
-static int thread_connect(Conn *tc, const char *host, const char *port, int use_ssl, int do_starttls, const char *user, const char *pass, const char *group) {
-    conn_init(tc);
-    tc->sock = tcp_connect(host, port);
-    if (tc->sock < 0) return 0;
-    if (use_ssl) {
-        ssl_init();
-        tc->ctx = SSL_CTX_new(TLS_client_method()); if (!tc->ctx) return 0;
-        tc->ssl = SSL_new(tc->ctx); if (!tc->ssl) return 0;
-        if (!SSL_set_fd(tc->ssl, tc->sock)) return 0;
-        if (SSL_connect(tc->ssl) <= 0) { ERR_print_errors_fp(stderr); return 0; }
-        tc->use_ssl = 1;
+/* after the overview: the next HDR, or store the slice and go back to HEAD */
+static int ev_hdr_next(EvConn *e) {
+    HeadPipe *p = &e->pipe;
+    int k, lo, hi;
+    if (over_slice_next_hdr(&p->os, &k, &lo, &hi)) {
+        e->state = EV_HDR;
+        return ev_sendf(e, "HDR %s %d-%d", over_hdr_names[k], lo, hi);
     }
-    {
-        char line[BUFSZ]; if (conn_readline(tc, line, sizeof(line)) <= 0) return 0; if (atoi(line) >= 400) return 0;
+    over_slice_finish(&p->os, &e->wa, &p->ar);
+    headpipe_over_done(p);
+    e->state = EV_HEAD;
+    return 1;
+}
+
+/* after a reconnect: send the window again, or restart the cut-off overview */
+static int ev_resume(EvConn *e) {
+    HeadPipe *p = &e->pipe;
+    e->resume = 0;
+    if (e->resume_over) {
+        over_slice_begin(&p->os, p->next, p->hi);
+        return ev_over_send(e);
     }
-    if (do_starttls && !use_ssl) {
-        int rcx = nntp_starttls(tc); if (rcx < 200 || rcx >= 300) return 0; if (!conn_starttls(tc)) return 0;
+    for (int k = 0; k < p->inflight; ++k) {
+        HeadSlot *s = &p->win[(p->head + k) % p->depth];
+        s->sent_us = stat_t0();
+        if (!ev_sendf(e, "HEAD %d", s->artnum)) return 0;
     }
-    if (user && pass) { int rcx = nntp_auth(tc, user, pass); if (rcx >= 400) return 0; }
-    {
-        int dummyC=0,dummyF=0,dummyL=0; int rcg = nntp_group(tc, group, &dummyC, &dummyF, &dummyL); if (rcg < 200 || rcg >= 300) return 0;
+    e->state = EV_HEAD;
+    return 1;
+}
+
+/* top up the HEAD window, start a slice's overview, or move on to the next
+   group once this one is finished */
+static int ev_head_fill(EvLoop *L, EvConn *e) {
+    HeadPipe *p = &e->pipe;
+    if (headpipe_wants(p)) {
+        int over, np = headpipe_fill(p, &over);
+        for (int k = 0; k < np; ++k) if (!ev_sendf(e, "HEAD %d", p->pending[k])) return 0;
+        if (over) {
+            over_slice_begin(&p->os, p->next, p->hi);
+            return ev_over_send(e);
+        }
     }
+    if (p->inflight == 0 && (p->drained || g_stop)) return ev_next_group(L, e);
     return 1;
 }
 
-static void *head_worker(void *arg) {
-    WorkerArgs *wa = (WorkerArgs*)arg;
-    Conn tc;
-    if (!thread_connect(&tc, wa->host, wa->port, wa->use_ssl, wa->do_starttls, wa->user, wa->pass, wa->group)) {
-        warnf("thread connect failed");
-        return NULL;
+/* consume the buffered replies; 0 when the connection is finished or failed */
+static int ev_advance(EvLoop *L, EvConn *e) {
+    Conn *c = &e->c;
+    char line[BUFSZ];
+    for (;;) {
+        if (e->state == EV_HEAD && !ev_head_fill(L, e)) return 0;
+        if (e->state == EV_TLS || !ev_reply_ready(e)) return 1;
+        e->scanned = 0;
+        if (e->state == EV_HEAD) {
+            int resend;
+            if (!headpipe_reply(&e->pipe, c, &resend)) return 0;
+            if (resend && !ev_sendf(e, "HEAD %d", resend)) return 0;
+            e->fails = 0;
+            continue;
+        }
+        if (e->state == EV_OVER) {
+            OverSlice *os = &e->pipe.os;
+            if (conn_readline(c, line, sizeof(line)) <= 0) return 0;
+            stat_lat(LAT_XOVER, e->t0);
+            int code = atoi(line);
+            if (e->xz && code >= 500) {
+                if (__atomic_exchange_n(&g_xzver, 0, __ATOMIC_RELAXED)) warnf("XZVER rejected (%s); using XOVER", line);
+                if (!ev_over_send(e)) return 0;
+                continue;
+            }
+            if (code < 200 || code >= 300) {
+                warnf("XOVER rejected: %s", line); /* the whole slice goes to HEAD */
+                headpipe_over_done(&e->pipe);
+                e->state = EV_HEAD;
+                continue;
+            }
+            long got = e->xz ? conn_read_multiline_xzver(c, over_slice_line, os) : conn_read_multiline_each(c, over_slice_line, os);
+            if (got < 0) return 0;
+            over_slice_parse(os, e->wa.group);
+            if (!ev_hdr_next(e)) return 0;
+            continue;
+        }
+        if (e->state == EV_HDR) {
+            OverSlice *os = &e->pipe.os;
+            if (conn_readline(c, line, sizeof(line)) <= 0) return 0;
+            if (atoi(line) == 225) {
+                if (conn_read_multiline_each(c, over_hdr_line, os) < 0) return 0;
+                os->hdr_ok[os->field] = 1;
+            } else {
+                warnf("HDR %s rejected: %s", over_hdr_names[os->field], line);
+            }
+            if (!ev_hdr_next(e)) return 0;
+            continue;
+        }
+        if (conn_readline(c, line, sizeof(line)) <= 0) return 0;
+        int code = atoi(line), ok = 1;
+        switch (e->state) {
+        case EV_GREETING:
+            if (code >= 400) { warnf("Server error: %s", line); return 0; }
+            ok = ev_login(L, e, EV_STARTTLS);
+            break;
+        case EV_STARTTLS:
+            if (code < 200 || code >= 300) { warnf("STARTTLS failed: %d", code); return 0; }
+            c->rpos = c->rlen = 0; /* nothing may be buffered across the TLS upgrade */
+            ok = ev_tls_start(e, EV_AUTH_USER);
+            break;
+        case EV_AUTH_USER:
+            if (code == 381) { e->state = EV_AUTH_PASS; ok = ev_sendf(e, "AUTHINFO PASS %s", L->pass); break; }
+            /* fall through */
+        case EV_AUTH_PASS:
+            if (code >= 400) { warnf("AUTH failed: %d", code); return 0; }
+            ok = ev_login(L, e, EV_COMPRESS);
+            break;
+        case EV_COMPRESS:
+            if (code != 206) warnf("COMPRESS DEFLATE rejected: %s", line);
+            else if (!conn_deflate_start(c)) return 0;
+            e->scanned = 0;
+            ok = ev_next_group(L, e);
+            break;
+        case EV_GROUP:
+            stat_lat(LAT_GROUP, e->t0);
+            if (code < 200 || code >= 300) {
+                warnf("GROUP %s failed: %d", e->job->name, code);
+                sched_fail(L->gs, e->job); /* or sched_next hands the same job straight back */
+                e->resume = 0;
+                ok = ev_next_group(L, e);
+                break;
+            }
+            if (e->resume) { ok = ev_resume(e); break; }
+            e->wa = L->gs->base;
+            e->wa.group = e->job->name; e->wa.chunks = &e->job->cc;
+            headpipe_init(&e->pipe, &e->wa);
+            e->have_pipe = 1;
+            e->state = EV_HEAD;
+            break;
+        default:
+            return 0;
+        }
+        if (!ok) return 0;
     }
-    int artnum;
-    while (queue_pop(wa->queue, &artnum)) {
-        int attempt = 0; char *hdrs = NULL;
-        while (attempt <= wa->retries) { hdrs = nntp_head(&tc, artnum); if (hdrs) break; attempt++; }
-        if (!hdrs) continue;
-        char *subject, *from, *datev, *msgid, *refs; int bytes=0, linesz=0;
-        extract_from_headers(hdrs, &subject, &from, &datev, &msgid, &refs, &bytes, &linesz);
-        pthread_mutex_lock(wa->db_mutex);
-        db_insert_article(wa->db, wa->group, artnum, subject, from, datev, msgid, refs, bytes, linesz);
-        pthread_mutex_unlock(wa->db_mutex);
-        free(subject); free(from); free(datev); free(msgid); free(refs); free(hdrs);
-        pthread_mutex_lock(wa->progress_mutex);
-        (*wa->processed)++;
-        {
-            int local = *wa->processed; int pct = (int)((local * 100.0)/(wa->total?wa->total:1));
-            int filled = (int)(wa->progress_width * (local/(double)(wa->total?wa->total:1))); if (filled > wa->progress_width) filled = wa->progress_width;
-            char *bar = malloc(wa->progress_width + 1);
-            if (bar) {
-                int bi; for (bi = 0; bi < wa->progress_width; ++bi) bar[bi] = (bi < filled) ? '#' : '.'; bar[wa->progress_width] = '\0';
-                fprintf(stdout, "\rHeaders (HEAD MT): [%s] %3d%% (%d/%d)", bar, pct, local, wa->total);
-                free(bar);
+}
+
+static void ev_close(EvLoop *L, Poller *pl, EvConn *e) {
+    if (e->c.sock >= 0) poller_del(pl, e->c.sock);
+    if (e->have_pipe) { headpipe_free(&e->pipe); e->have_pipe = 0; }
+    conn_cleanup(&e->c);
+    free(e->wbuf); e->wbuf = NULL;
+    e->wlen = e->woff = e->wcap = 0;
+    e->state = EV_CLOSED;
+    L->live--;
+}
+
+/* e's connection failed (why; NULL once it has simply finished). A pipe
+   with claimed work keeps it and waits out a backoff before reconnecting,
+   up to the --reconnects budget; anything else closes. */
+static void ev_lost(EvLoop *L, Poller *pl, EvConn *e, const char *why) {
+    if (why) warnf("event loop: %s", why);
+    if (!why || !e->have_pipe || g_stop || e->fails >= L->gs->base.reconnects) {
+        if (why && e->have_pipe && !g_stop) warnf("giving up on the connection after %d reconnect attempt(s)", e->fails);
+        ev_close(L, pl, e);
+        return;
+    }
+    if (e->c.sock >= 0) poller_del(pl, e->c.sock);
+    conn_cleanup(&e->c);
+    e->wlen = e->woff = 0;
+    e->wr_blocked = 0; e->scanned = 0;
+    if (e->state == EV_HEAD || e->state == EV_OVER || e->state == EV_HDR) e->resume_over = e->state != EV_HEAD;
+    e->resume = 1;
+    e->fails++;
+    e->retry_at = now_ms() + reconnect_delay_ms(e->fails);
+    e->state = EV_WAIT;
+    L->waiting++;
+}
+
+static void ev_reconnect(EvLoop *L, Poller *pl, EvConn *e) {
+    L->waiting--;
+    if (g_stop) { ev_close(L, pl, e); return; }
+    STAT_ADD(reconnects, 1);
+    conn_init(&e->c);
+    e->ai = L->addrs;
+    if (!ev_connect(e)) { ev_lost(L, pl, e, "reconnect failed"); return; }
+    e->polled_wr = 1;
+    if (!poller_set(pl, e->c.sock, e, 1, 1)) ev_lost(L, pl, e, "cannot watch socket");
+}
+
+/* a readiness event for e */
+static void ev_handle(EvLoop *L, Poller *pl, EvConn *e, int rd, int wr) {
+    if (e->state == EV_CLOSED || e->state == EV_WAIT) return;
+    if (e->state == EV_CONNECT) {
+        int err = 0;
+        socklen_t el = sizeof(err);
+        if (!rd && !wr) return;
+        if (getsockopt(e->c.sock, SOL_SOCKET, SO_ERROR, &err, &el) < 0) err = errno;
+        if (err == EINPROGRESS) return;
+        if (err) {
+            poller_del(pl, e->c.sock);
+            close(e->c.sock); e->c.sock = -1;
+            e->ai = e->ai->ai_next;
+            if (!ev_connect(e)) {
+                char why[128];
+                snprintf(why, sizeof(why), "connect failed: %s", strerror(err));
+                ev_lost(L, pl, e, why);
+                return;
             }
-            fflush(stdout);
+            e->polled_wr = 1;
+            poller_set(pl, e->c.sock, e, 1, 1);
+            return;
         }
-        pthread_mutex_unlock(wa->progress_mutex);
+        STAT_ADD(connects, 1);
+        e->state = EV_GREETING;
+        if (L->use_ssl && !ev_tls_start(e, EV_GREETING)) { ev_lost(L, pl, e, "TLS setup failed"); return; }
     }
-    conn_cleanup(&tc);
+    for (;;) {
+        if (e->state == EV_TLS) {
+            int r = ev_tls_step(e);
+            if (r < 0) { ev_lost(L, pl, e, "TLS handshake failed"); return; }
+            if (r == 0) break;
+            if (e->after_tls == EV_GREETING) e->state = EV_GREETING;
+            else if (!ev_login(L, e, e->after_tls)) { ev_lost(L, pl, e, "login failed"); return; }
+        }
+        int alive = ev_fill(e);
+        /* done with its groups, or a protocol failure that cannot be resumed */
+        if (!ev_advance(L, e)) { ev_lost(L, pl, e, !e->have_pipe ? NULL : alive ? "command failed" : "connection lost"); return; }
+        if (!alive) { ev_lost(L, pl, e, "connection lost"); return; }
+        if (!ev_flush(e)) { ev_lost(L, pl, e, "send failed"); return; }
+        if (e->state != EV_TLS) break; /* STARTTLS accepted: start the handshake now */
+    }
+    int want_wr = e->woff < e->wlen || e->wr_blocked;
+    if (want_wr != e->polled_wr) {
+        e->polled_wr = want_wr;
+        poller_set(pl, e->c.sock, e, want_wr, 0);
+    }
+}
+
+static void *ev_loop_main(void *arg) {
+    EvLoop *L = (EvLoop*)arg;
+    Poller *pl = malloc(sizeof(Poller));
+    if (!pl || !poller_open(pl)) { warnf("event loop: cannot create poller"); free(pl); return NULL; }
+    for (int k = 0; k < L->nconns; ++k) {
+        EvConn *e = &L->conns[k];
+        conn_init(&e->c);
+        e->ai = L->addrs;
+        if (!ev_connect(e)) { warnf("event loop: connect failed: %s", strerror(errno)); e->state = EV_CLOSED; continue; }
+        e->polled_wr = 1;
+        if (!poller_set(pl, e->c.sock, e, 1, 1)) { warnf("event loop: cannot watch socket"); conn_cleanup(&e->c); e->state = EV_CLOSED; continue; }
+        L->live++;
+    }
+    PollEv ev[64];
+    while (L->live > 0) {
+        int n = poller_wait(pl, ev, 64, 200);
+        for (int i = 0; i < n; ++i) ev_handle(L, pl, (EvConn*)ev[i].ud, ev[i].rd, ev[i].wr);
+        if (L->waiting == 0) continue;
+        long long now = now_ms();
+        for (int k = 0; k < L->nconns; ++k)
+            if (L->conns[k].state == EV_WAIT && (g_stop || now >= L->conns[k].retry_at)) ev_reconnect(L, pl, &L->conns[k]);
+    }
+    poller_close(pl);
+    free(pl);
     return NULL;
 }
 
-/* CLI parsing - very simple */
-static void usage_and_exit(const char *prog, AppError code, const char *detail) {
-    printf("Usage: %s --host HOST [--port PORT] [--ssl] [--starttls] [--user USER --pass PASS]\n"
-           "          --db-type {sqlite|mariadb|mysql} --db-name DBNAME [--db-host HOST --db-port PORT --db-user USER --db-pass PASS]\n"
-            "          --group GROUPNAME [--headers-only] [--limit N] [--progress-width N] [--init-db|--create-db]\n"
-           "          [--threads N] [--retries N] [--conf FILE] [--write-conf FILE] [--log FILE] [--verbose] (write-conf exits after saving)\n", prog);
-    if (detail && *detail) {
-        fprintf(stderr, "Error (code %d): %s\n", code, describe_error(code));
-        fprintf(stderr, "Details: %s\n", detail);
+/* HEAD-fetch gs's groups over nconns event-driven connections on nthreads threads */
+static void ev_run(GroupSched *gs, int nconns, int nthreads, const char *host, const char *port,
+                   int use_ssl, int do_starttls, const char *user, const char *pass) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = AF_UNSPEC;
+    int gai = getaddrinfo(host, port, &hints, &res);
+    if (gai != 0) { warnf("getaddrinfo failed for %s:%s: %s", host, port, gai_strerror(gai)); return; }
+    if (nthreads > nconns) nthreads = nconns;
+    EvConn *conns = calloc(nconns, sizeof(EvConn));
+    EvLoop *loops = calloc(nthreads, sizeof(EvLoop));
+    pthread_t *tids = malloc(sizeof(pthread_t) * nthreads);
+    if (!conns || !loops || !tids) fatal(ERR_RUNTIME, "Out of memory allocating event loops");
+    infof("event loop: %d connections on %d threads", nconns, nthreads);
+    for (int t = 0, first = 0; t < nthreads; ++t) {
+        EvLoop *L = &loops[t];
+        int share = nconns / nthreads + (t < nconns % nthreads);
+        L->gs = gs; L->conns = conns + first; L->nconns = share; L->addrs = res;
+        L->use_ssl = use_ssl; L->do_starttls = do_starttls; L->user = user; L->pass = pass;
+        first += share;
+        if (pthread_create(&tids[t], NULL, ev_loop_main, L) != 0) { warnf("pthread_create failed for event loop %d", t); L->nconns = -1; }
     }
-    exit(code);
+    for (int t = 0; t < nthreads; ++t) if (loops[t].nconns >= 0) pthread_join(tids[t], NULL);
+    freeaddrinfo(res);
+    free(conns); free(loops); free(tids);
 }
 
-/* Simple key=value config file loader */
-static void trim(char *s) {
-    char *p = s; while (*p && isspace((unsigned char)*p)) p++; if (p!=s) memmove(s,p,strlen(p)+1);
-    size_t n = strlen(s); while (n && isspace((unsigned char)s[n-1])) s[--n] = '\0';
+static int has_wildmat(const char *s) {
+    return strpbrk(s, "*?[") != NULL;
 }
 
-static int load_conf(const char *path,
-                     const char **host, const char **port, int *use_ssl, int *do_starttls,
-                     const char **user, const char **pass,
-                     const char **db_type_s, const char **db_name, const char **db_host,
-                     const char **db_port, const char **db_user, const char **db_pass,
-                     const char **group, int *headers_only, int *limit, int *progress_width) {
-    FILE *f = fopen(path, "r");
-    if (!f) { warnf("Could not open conf: %s", path); return 0; }
-    char line[1024];
-    while (fgets(line, sizeof(line), f)) {
-        trim(line);
-        if (!*line || *line=='#' || *line==';') continue;
-        char *eq = strchr(line,'=');
-        if (!eq) continue;
-        *eq='\0'; char *key=line; char *val=eq+1; trim(key); trim(val);
-        if (strcasecmp(key,"host")==0) *host = strdup(val);
-        else if (strcasecmp(key,"port")==0) *port = strdup(val);
-        else if (strcasecmp(key,"ssl")==0) *use_ssl = atoi(val)?1:0;
-        else if (strcasecmp(key,"starttls")==0) *do_starttls = atoi(val)?1:0;
-        else if (strcasecmp(key,"user")==0) *user = strdup(val);
-        else if (strcasecmp(key,"pass")==0) *pass = strdup(val);
-        else if (strcasecmp(key,"db_type")==0 || strcasecmp(key,"db-type")==0) *db_type_s = strdup(val);
-        else if (strcasecmp(key,"db_name")==0 || strcasecmp(key,"db-name")==0) *db_name = strdup(val);
-        else if (strcasecmp(key,"db_host")==0 || strcasecmp(key,"db-host")==0) *db_host = strdup(val);
-        else if (strcasecmp(key,"db_port")==0 || strcasecmp(key,"db-port")==0) *db_port = strdup(val);
-        else if (strcasecmp(key,"db_user")==0 || strcasecmp(key,"db-user")==0) *db_user = strdup(val);
-        else if (strcasecmp(key,"db_pass")==0 || strcasecmp(key,"db-pass")==0) *db_pass = strdup(val);
-        else if (strcasecmp(key,"group")==0) *group = strdup(val);
-        else if (strcasecmp(key,"headers_only")==0 || strcasecmp(key,"headers-only")==0) *headers_only = atoi(val)?1:0;
-        else if (strcasecmp(key,"limit")==0) *limit = atoi(val);
-        else if (strcasecmp(key,"progress_width")==0 || strcasecmp(key,"progress-width")==0) *progress_width = atoi(val);
+typedef struct { char **v; int n, cap; } NameList;
+
+static void names_add(NameList *nl, const char *name) {
+    if (nl->n == nl->cap) {
+        int ncap = nl->cap ? nl->cap * 2 : 64;
+        char **nv = realloc(nl->v, sizeof(char*) * ncap);
+        if (!nv) fatal(ERR_RUNTIME, "Out of memory building group list");
+        nl->v = nv; nl->cap = ncap;
     }
-    fclose(f);
-    return 1;
+    nl->v[nl->n] = strdup(name);
+    if (!nl->v[nl->n]) fatal(ERR_RUNTIME, "Out of memory building group list");
+    nl->n++;
 }
 
-static int write_conf(const char *path,
-                      const char *host, const char *port, int use_ssl, int do_starttls,
-                      const char *user, const char *pass,
-                      const char *db_type_s, const char *db_name, const char *db_host,
-                      const char *db_port, const char *db_user, const char *db_pass,
-                      const char *group, int headers_only, int limit, int progress_width) {
-    FILE *f = fopen(path, "w");
-    if (!f) { warnf("Could not write conf: %s", path); return 0; }
-    fprintf(f,"# nntp2sql configuration\n");
-    if (host) fprintf(f,"host=%s\n", host);
-    if (port) fprintf(f,"port=%s\n", port);
-    fprintf(f,"ssl=%d\n", use_ssl);
-    fprintf(f,"starttls=%d\n", do_starttls);
-    if (user) fprintf(f,"user=%s\n", user);
-    if (pass) fprintf(f,"pass=%s\n", pass);
-    if (db_type_s) fprintf(f,"db_type=%s\n", db_type_s);
-    if (db_name) fprintf(f,"db_name=%s\n", db_name);
-    if (db_host) fprintf(f,"db_host=%s\n", db_host);
-    if (db_port) fprintf(f,"db_port=%s\n", db_port);
-    if (db_user) fprintf(f,"db_user=%s\n", db_user);
-    if (db_pass) fprintf(f,"db_pass=%s\n", db_pass);
-    if (group) fprintf(f,"group=%s\n", group);
-    fprintf(f,"headers_only=%d\n", headers_only);
-    fprintf(f,"limit=%d\n", limit);
-    fprintf(f,"progress_width=%d\n", progress_width);
-    fclose(f);
-    return 1;
+static void list_active_line(char *line, size_t len, void *arg) {
+    (void)len;
+    /* <group> <high> <low> <status> */
+    char *sp = strchr(line, ' ');
+    if (sp) *sp = '\0';
+    if (*line) names_add((NameList*)arg, line);
+}
+
+/* expand a wildmat with LIST ACTIVE; returns the number of groups added */
+static int nntp_list_active(Conn *c, const char *pattern, NameList *out) {
+    char buf[BUFSZ];
+    int before = out->n;
+    conn_sendf(c, "LIST ACTIVE %s", pattern);
+    if (conn_readline(c, buf, sizeof(buf)) <= 0) return -1;
+    if (atoi(buf) != 215) { warnf("LIST ACTIVE %s rejected: %s", pattern, buf); return 0; }
+    if (conn_read_multiline_each(c, list_active_line, out) < 0) return -1;
+    return out->n - before;
+}
+
+static int cmp_name(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int cmp_job_backlog(const void *a, const void *b) {
+    const GroupJob *x = (const GroupJob*)a, *y = (const GroupJob*)b;
+    long long bx = (long long)x->last - x->first, by = (long long)y->last - y->first;
+    return bx < by ? -1 : bx > by;
+}
+
+/* run a multi-group ingest on the already authenticated connection c, which
+   then joins the pool */
+static int ingest_group_list(Conn *c, DB *db, WorkerArgs *base, const char *list_path, const char *pattern,
+                             int headers_only, int limit, int incremental, int xover_chunk, int threads) {
+    NameList names = {0};
+    FILE *fp = list_path ? fopen(list_path, "r") : NULL;
+    if (list_path && !fp) fatal(ERR_ARGS, "Cannot open group list %s: %s", list_path, strerror(errno));
+    char buf[512];
+    for (int pi = 0; ; ++pi) {
+        const char *entry;
+        if (pi == 0 && pattern) entry = pattern;
+        else if (fp && fgets(buf, sizeof(buf), fp)) { trim(buf); if (!*buf || *buf == '#') continue; entry = buf; }
+        else break;
+        if (has_wildmat(entry)) {
+            if (nntp_list_active(c, entry, &names) < 0) fatal(ERR_NNTP_CMD, "LIST ACTIVE failed");
+        } else {
+            names_add(&names, entry);
+        }
+    }
+    if (fp) fclose(fp);
+    /* drop duplicates from overlapping patterns */
+    qsort(names.v, names.n, sizeof(char*), cmp_name);
+    int un = 0;
+    for (int k = 0; k < names.n; ++k) {
+        if (un && strcmp(names.v[un - 1], names.v[k]) == 0) { free(names.v[k]); continue; }
+        names.v[un++] = names.v[k];
+    }
+    names.n = un;
+    if (names.n == 0) { warnf("No groups to ingest"); free(names.v); return 0; }
+
+    /* size every group with pipelined GROUP commands on the main connection */
+    GroupJob *jobs = calloc(names.n, sizeof(GroupJob));
+    if (!jobs) fatal(ERR_RUNTIME, "Out of memory allocating group jobs");
+    int njobs = 0;
+    long long total = 0;
+    const int window = 64;
+    for (int k0 = 0; k0 < names.n; k0 += window) {
+        int k1 = k0 + window < names.n ? k0 + window : names.n;
+        char cmd[BUFSZ];
+        long long t0 = stat_t0();
+        for (int k = k0; k < k1; ++k) {
+            int n = snprintf(cmd, sizeof(cmd), "GROUP %s\r\n", names.v[k]);
+            if (n > 0 && (size_t)n < sizeof(cmd) && conn_write(c, cmd, (size_t)n) < 0) fatal(ERR_NET_CONNECT, "GROUP send failed");
+        }
+        for (int k = k0; k < k1; ++k) {
+            char line[BUFSZ];
+            if (conn_readline(c, line, sizeof(line)) <= 0) fatal(ERR_NET_CONNECT, "connection lost sizing groups");
+            stat_lat(LAT_GROUP, t0);
+            int code = atoi(line), cnt = 0, f = 0, l = 0;
+            if (code != 211 || sscanf(line, "%*d %d %d %d", &cnt, &f, &l) != 3) { warnf("GROUP %s: %s", names.v[k], line); continue; }
+            db_insert_group(db, names.v[k], cnt, f, l);
+            if (cnt == 0 || l < f) continue;
+            int ff = f;
+            if (limit > 0 && limit < l - f + 1) ff = l - limit + 1;
+            if (incremental) {
+                int hw = db_get_high_water(db, names.v[k]);
+                if (hw >= l) continue;
+                if (hw >= ff) ff = hw + 1;
+            }
+            GroupJob *jb = &jobs[njobs++];
+            jb->name = names.v[k]; jb->first = ff; jb->last = l;
+            total += l - ff + 1;
+        }
+    }
+    if (njobs == 0) {
+        fprintf(stdout, "Nothing to fetch in %d group(s)\n", names.n);
+    } else {
+        qsort(jobs, njobs, sizeof(GroupJob), cmp_job_backlog);
+        for (int j = 0; j < njobs; ++j) {
+            GroupJob *jb = &jobs[j];
+            int slice = headers_only ? xover_chunk : (jb->last - jb->first + 1) / 8;
+            if (!headers_only) { if (slice < 1) slice = 1; if (slice > 1024) slice = 1024; }
+            chunk_init(&jb->cc, jb->first, jb->last, slice);
+            if (incremental) total -= chunk_resume_group(&jb->cc, db, jb->name);
+        }
+        infof("ingesting %d of %d groups, %lld articles, over %d connections", njobs, names.n, total, threads);
+        int evloop = !headers_only && base->event_loop;
+        if (!evloop && threads > POOL_MAX) threads = POOL_MAX;
+        Progress prog;
+        GroupSched gs; memset(&gs, 0, sizeof(gs));
+        gs.jobs = jobs; gs.njobs = njobs; gs.headers_only = headers_only;
+        gs.base = *base;
+        progress_start(&prog, headers_only ? "Headers (XOVER)" : "Headers (HEAD MT)", total, base->progress_width);
+        gs.base.progress = &prog;
+        gs.base.writer = db_writer_start(db);
+        pthread_mutex_init(&gs.pool_m, NULL);
+        pool_put(&gs, c); /* the main connection is already authenticated */
+        pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+        if (!tids) fatal(ERR_RUNTIME, "Out of memory allocating threads");
+        if (evloop) {
+            ev_run(&gs, threads, base->event_loop, base->host, base->port, base->use_ssl, base->do_starttls, base->user, base->pass);
+        } else {
+            for (int ti = 0; ti < threads; ++ti) {
+                if (pthread_create(&tids[ti], NULL, group_worker, &gs) != 0) warnf("pthread_create failed for thread %d", ti);
+            }
+            for (int ti = 0; ti < threads; ++ti) pthread_join(tids[ti], NULL);
+        }
+        db_writer_stop(gs.base.writer);
+        db_commit(db); /* the pending high-water mark points at a name freed below */
+        db->hw_group = NULL;
+        progress_finish(&prog);
+        if (gs.failed) warnf("%d of %d group(s) could not be selected and were skipped", gs.failed, njobs);
+        free(tids);
+        /* c went into the pool; hand one connection back for the caller to close */
+        conn_init(c);
+        if (gs.nidle > 0) *c = gs.idle[--gs.nidle];
+        while (gs.nidle > 0) conn_cleanup(&gs.idle[--gs.nidle]);
+        pthread_mutex_destroy(&gs.pool_m);
+        for (int j = 0; j < njobs; ++j) chunk_destroy(&jobs[j].cc);
+    }
+    for (int k = 0; k < names.n; ++k) free(names.v[k]);
+    free(names.v);
+    free(jobs);
+    return 0;
 }
 
 int main(int argc, char **argv) {
@@ -1017,6 +5730,8 @@ int main(int argc, char **argv) {
     const char *db_type_s = NULL, *db_name = NULL, *db_host = NULL, *db_user = NULL, *db_pass = NULL, *db_port = NULL;
     const char *group = NULL;
     int headers_only = 0;
+    int no_overview = 0;   /* HEAD mode: ignore an advertised OVER */
+    int event_loop = 0;    /* HEAD mode: drive the --threads connections from this many loop threads */
     int limit = 0;
     int progress_width = 40; /* default bar width */
     int init_db = 0; /* create database if needed */
@@ -1025,9 +5740,20 @@ int main(int argc, char **argv) {
     const char *write_conf_path = NULL; /* save settings */
     int threads = 1; /* multithread workers for HEAD */
     int retries = 3; /* HEAD retry attempts */
+    int reconnects = 5; /* attempts to replace a lost connection */
+    int xover_chunk = 50000; /* articles per XOVER command */
+    int pipeline_depth = 1; /* HEAD commands in flight per connection */
+    int incremental = 0; /* start after the group's stored high-water mark */
+    int batch_size = 0; /* rows per transaction; 0 = autocommit */
+    int batch_ms = 500; /* also commit an open batch after this long */
+    int bulk_rows = 0; /* rows per multi-row INSERT/COPY; 0 = one statement per row */
+    int stats_interval = 0; /* seconds between JSON stats lines; 0 = off */
+    const char *metrics = NULL; /* Prometheus text endpoint, [ADDR:]PORT; NULL = off */
     const char *log_path = NULL; /* optional log file */
     /* HTML export options */
     int opt_export_html = 0; const char *opt_export_group = NULL; const char *opt_export_group_list = NULL; const char *opt_export_out = NULL;
+    const char *shard_map = NULL;
+    int export_jobs = 1, export_page_size = 0;
     int i = 1;
     while (i < argc) {
         if (strcmp(argv[i], "--host") == 0) { host = argv[++i]; }
@@ -1042,8 +5768,9 @@ int main(int argc, char **argv) {
         else if (strcmp(argv[i], "--db-port") == 0) { db_port = argv[++i]; }
         else if (strcmp(argv[i], "--db-user") == 0) { db_user = argv[++i]; }
         else if (strcmp(argv[i], "--db-pass") == 0) { db_pass = argv[++i]; }
-        else if (strcmp(argv[i], "--group") == 0) { group = argv[++i]; }
+        else if (strcmp(argv[i], "--group") == 0) { group = argv[++i]; opt_export_group = group; }
         else if (strcmp(argv[i], "--headers-only") == 0) { headers_only = 1; }
+        else if (strcmp(argv[i], "--no-overview") == 0) { no_overview = 1; }
         else if (strcmp(argv[i], "--limit") == 0) { limit = atoi(argv[++i]); }
         else if (strcmp(argv[i], "--progress-width") == 0) { progress_width = atoi(argv[++i]); }
         else if (strcmp(argv[i], "--init-db") == 0) { init_db = 1; }
@@ -1052,18 +5779,60 @@ int main(int argc, char **argv) {
         else if (strcmp(argv[i], "--write-conf") == 0) { write_conf_path = argv[++i]; }
         else if (strcmp(argv[i], "--log") == 0) { log_path = argv[++i]; }
         else if (strcmp(argv[i], "--verbose") == 0) { g_verbose = 1; }
-        else if (strcmp(argv[i], "--threads") == 0) { threads = atoi(argv[++i]); if (threads < 1) threads = 1; if (threads > 64) threads = 64; }
+        else if (strcmp(argv[i], "--threads") == 0) { threads = atoi(argv[++i]); if (threads < 1) threads = 1; }
+        else if (strcmp(argv[i], "--event-loop") == 0) { event_loop = atoi(argv[++i]); if (event_loop < 1 || event_loop > 64) usage_and_exit(argv[0], ERR_ARGS, "--event-loop expects 1..64"); }
         else if (strcmp(argv[i], "--retries") == 0) { retries = atoi(argv[++i]); if (retries < 0) retries = 0; if (retries > 10) retries = 10; }
+        else if (strcmp(argv[i], "--reconnects") == 0) { reconnects = atoi(argv[++i]); if (reconnects < 0) reconnects = 0; if (reconnects > 100) reconnects = 100; }
+        else if (strcmp(argv[i], "--stats-interval") == 0) { stats_interval = atoi(argv[++i]); if (stats_interval < 0) stats_interval = 0; }
+        else if (strcmp(argv[i], "--metrics-port") == 0) metrics = argv[++i];
+        else if (strcmp(argv[i], "--pipeline-depth") == 0) { pipeline_depth = atoi(argv[++i]); if (pipeline_depth < 1) pipeline_depth = 1; if (pipeline_depth > 256) pipeline_depth = 256; }
+        else if (strcmp(argv[i], "--compress") == 0) {
+            const char *m = argv[++i];
+            int k = 0;
+            while (k <= COMPRESS_XZVER && strcmp(m, compress_names[k]) != 0) k++;
+            if (k > COMPRESS_XZVER) usage_and_exit(argv[0], ERR_ARGS, "unknown --compress mode");
+            g_compress = k;
+        }
+        else if (strcmp(argv[i], "--xover-chunk") == 0) { xover_chunk = atoi(argv[++i]); if (xover_chunk < 1) xover_chunk = 1; }
+        else if (strcmp(argv[i], "--batch-size") == 0) { batch_size = atoi(argv[++i]); if (batch_size < 0) batch_size = 0; }
+        else if (strcmp(argv[i], "--batch-ms") == 0) { batch_ms = atoi(argv[++i]); if (batch_ms < 0) batch_ms = 0; }
+        else if (strcmp(argv[i], "--bulk") == 0) { bulk_rows = atoi(argv[++i]); if (bulk_rows < 0) bulk_rows = 0; }
         else if (strcmp(argv[i], "--upsert") == 0) { g_upsert = 1; }
+        else if (strcmp(argv[i], "--incremental") == 0) { incremental = 1; }
+        else if (strcmp(argv[i], "--schema-v2") == 0) { g_schema_v2 = 1; }
+        else if (strcmp(argv[i], "--intern-authors") == 0) { g_intern_authors = 1; }
+        else if (strcmp(argv[i], "--keep-date-text") == 0) { g_keep_date_text = 1; }
+        else if (strcmp(argv[i], "--migrate-schema") == 0) { g_migrate_schema = 1; }
+        else if (strcmp(argv[i], "--dedup") == 0) { g_dedup = 1; }
+        else if (strcmp(argv[i], "--shards") == 0) { g_shards = atoi(argv[++i]); if (g_shards < 1 || g_shards > 64) usage_and_exit(argv[0], ERR_ARGS, "--shards expects 1..64"); }
+        else if (strcmp(argv[i], "--shard-map") == 0) { shard_map = argv[++i]; }
+        else if (strcmp(argv[i], "--sqlite-profile") == 0) {
+            const char *m = argv[++i];
+            int k = SQLITE_PROFILE_BULK;
+            while (k <= SQLITE_PROFILE_ONLINE && strcmp(m, sqlite_profile_names[k]) != 0) k++;
+            if (k > SQLITE_PROFILE_ONLINE) usage_and_exit(argv[0], ERR_ARGS, "--sqlite-profile expects bulk or online");
+            g_sqlite_profile = k;
+        }
+        else if (strcmp(argv[i], "--sqlite-checkpoint") == 0) { g_sqlite_checkpoint = atoi(argv[++i]); if (g_sqlite_checkpoint < 0) usage_and_exit(argv[0], ERR_ARGS, "--sqlite-checkpoint expects PAGES >= 0"); }
         else if (strcmp(argv[i], "--export-html") == 0) { opt_export_html = 1; }
         else if (strcmp(argv[i], "--export-html-out") == 0) { opt_export_out = argv[++i]; }
+        else if (strcmp(argv[i], "--export-jobs") == 0) { export_jobs = atoi(argv[++i]); if (export_jobs < 1 || export_jobs > 64) usage_and_exit(argv[0], ERR_ARGS, "--export-jobs expects 1..64"); }
+        else if (strcmp(argv[i], "--export-page-size") == 0) { export_page_size = atoi(argv[++i]); if (export_page_size < 0) usage_and_exit(argv[0], ERR_ARGS, "--export-page-size expects N >= 0"); }
         else if (strcmp(argv[i], "--group-list") == 0) { opt_export_group_list = argv[++i]; }
-        else if (strcmp(argv[i], "--group") == 0) { group = argv[++i]; opt_export_group = group; }
         else usage_and_exit(argv[0], ERR_ARGS, "unknown option");
         i++;
     }
 
+    /* crossposts are matched across groups, which shards keep apart */
+    if (g_dedup && g_shards) usage_and_exit(argv[0], ERR_ARGS, "--dedup cannot be combined with --shards");
+    if (shard_map) load_shard_map(shard_map);
+
+    /* one thread per connection caps them at 64; the event loop takes more */
+    if (threads > (event_loop ? 1024 : 64)) threads = event_loop ? 1024 : 64;
+
     if (log_path) log_open(log_path);
+    infof("Line scanner: %s", scan_init());
+    stats_start(stats_interval, metrics);
     infof("Starting nntp2sql");
 
     /* load configuration file early (values from CLI override) */
@@ -1086,45 +5855,20 @@ int main(int argc, char **argv) {
     else fatal(ERR_ARGS, "Unknown db-type (expected sqlite|mariadb|mysql|postgres): %s", db_type_s);
 
     /* Open DB (optionally create database) */
-    if (db.type == DB_SQLITE) {
-        if (sqlite3_open(db_name, &db.sqlite) != SQLITE_OK) fatal(ERR_DB_CONNECT, "sqlite open failed: %s", sqlite3_errmsg(db.sqlite));
-    } else if (db.type == DB_MYSQL) {
-        const char *mh = db_host ? db_host : "localhost";
-        unsigned int mp = db_port ? atoi(db_port) : 3306;
-        const char *mu = db_user ? db_user : "root";
-        const char *mpass = db_pass ? db_pass : "";
-        if (init_db) {
-            MYSQL *tmp = mysql_init(NULL);
-            if (!tmp) fatal(ERR_DB_CONNECT, "mysql_init failed (init phase)");
-            if (!mysql_real_connect(tmp, mh, mu, mpass, NULL, mp, NULL, 0)) {
-                fatal(ERR_DB_CONNECT, "mysql server connect failed: %s", mysql_error(tmp));
-            }
-            char q[512];
-            snprintf(q, sizeof(q), "CREATE DATABASE IF NOT EXISTS `%s` CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci;", db_name);
-            if (mysql_query(tmp, q)) warnf("mysql create database error: %s", mysql_error(tmp));
-            mysql_close(tmp);
+    if (db.type == DB_MYSQL && init_db) {
+        MYSQL *tmp = mysql_init(NULL);
+        if (!tmp) fatal(ERR_DB_CONNECT, "mysql_init failed (init phase)");
+        if (!mysql_real_connect(tmp, db_host ? db_host : "localhost", db_user ? db_user : "root", db_pass ? db_pass : "",
+                                NULL, db_port ? atoi(db_port) : 3306, NULL, 0)) {
+            fatal(ERR_DB_CONNECT, "mysql server connect failed: %s", mysql_error(tmp));
         }
-        db.mysql = mysql_init(NULL);
-        if (!db.mysql) fatal(ERR_DB_CONNECT, "mysql_init failed");
-        if (!mysql_real_connect(db.mysql, mh, mu, mpass, db_name, mp, NULL, 0)) {
-            fatal(ERR_DB_CONNECT, "mysql connect failed: %s", mysql_error(db.mysql));
-        }
-    }
-#ifdef HAVE_PQ
-    else if (db.type == DB_POSTGRES) {
-        /* Connect via libpq */
-        char conninfo[512];
-        snprintf(conninfo, sizeof(conninfo), "host=%s port=%s dbname=%s user=%s password=%s",
-                 db_host?db_host:"localhost",
-                 db_port?db_port:"5432",
-                 db_name?db_name:"postgres",
-                 db_user?db_user:"postgres",
-                 db_pass?db_pass:"");
-        PGconn *pgc = PQconnectdb(conninfo);
-        if (PQstatus(pgc) != CONNECTION_OK) fatal(ERR_DB_CONNECT, "postgres connect failed: %s", PQerrorMessage(pgc));
-        db.impl = pgc;
+        char q[512];
+        snprintf(q, sizeof(q), "CREATE DATABASE IF NOT EXISTS `%s` CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci;", db_name);
+        if (mysql_query(tmp, q)) warnf("mysql create database error: %s", mysql_error(tmp));
+        mysql_close(tmp);
     }
-#endif
+    DBConf dbconf = { db.type, db_name, db_host, db_port, db_user, db_pass };
+    if (!db_open(&db, &dbconf)) fatal(ERR_DB_CONNECT, "Cannot open %s database %s", db_type_s, db_name);
 
     if (write_conf_path) {
         write_conf(write_conf_path, host, port, use_ssl, do_starttls,
@@ -1137,6 +5881,14 @@ int main(int argc, char **argv) {
     }
 
     db_init_schema(&db);
+    db.batch_size = batch_size;
+    db.batch_ms = batch_ms;
+    db.bulk.cap = bulk_rows;
+    for (int k = 0; k < db.nshards; ++k) {
+        db.shard[k].batch_size = batch_size;
+        db.shard[k].batch_ms = batch_ms;
+        db.shard[k].bulk.cap = bulk_rows;
+    }
 
     if (create_db_exit) {
         fprintf(stdout, "Database and schema created for '%s' (%s)\n", db_name, db_type_s);
@@ -1147,20 +5899,37 @@ int main(int argc, char **argv) {
 
     /* If export-only requested, skip NNTP connection */
     if (opt_export_html && opt_export_out) {
-        db_init_schema(&db);
         if (opt_export_group) {
-            int rcx = export_group_to_html(&db, opt_export_group, opt_export_out);
+            int rcx = export_html_run(&db, opt_export_group, NULL, opt_export_out, export_jobs, export_page_size, NULL, NULL);
             if (rcx != 0) fatal(ERR_RUNTIME, "HTML export failed (%d)", rcx);
             db_close(&db); log_close(); return 0;
         } else if (opt_export_group_list) {
-            int rcx = export_groups_from_file(&db, opt_export_group_list, opt_export_out);
+            int nexp = 0, nskip = 0;
+            int rcx = export_html_run(&db, NULL, opt_export_group_list, opt_export_out, export_jobs, export_page_size, &nexp, &nskip);
             if (rcx != 0) fatal(ERR_RUNTIME, "HTML export list failed (%d)", rcx);
+            infof("HTML export: %d group(s) written, %d unchanged", nexp, nskip);
             db_close(&db); log_close(); return 0;
         } else {
             usage_and_exit(argv[0], ERR_ARGS, "--export-html requires --group or --group-list and --export-html-out");
         }
     }
 
+    if (g_dedup) db_dedup_load(&db);
+
+    /* commit the open batch and stop cleanly on Ctrl-C / kill */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    /* a write to a connection the server dropped fails instead of killing us */
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    /* shared TLS context, set up before any worker thread exists */
+    if ((use_ssl || do_starttls) && !ssl_init(host)) fatal(ERR_TLS, "SSL_CTX_new failed");
+
     /* NNTP connection */
     Conn c;
     conn_init(&c);
@@ -1168,16 +5937,7 @@ int main(int argc, char **argv) {
     if (c.sock < 0) fatal(ERR_NET_CONNECT, "Unable to connect to %s:%s", host, port);
 
     /* SSL on connect? */
-    if (use_ssl) {
-        ssl_init();
-        c.ctx = SSL_CTX_new(TLS_client_method());
-        if (!c.ctx) fatal(ERR_TLS, "SSL_CTX_new failed");
-        c.ssl = SSL_new(c.ctx);
-        if (!c.ssl) fatal(ERR_TLS, "SSL_new failed");
-        if (!SSL_set_fd(c.ssl, c.sock)) fatal(ERR_TLS, "SSL_set_fd failed");
-        if (SSL_connect(c.ssl) <= 0) { ERR_print_errors_fp(stderr); fatal(ERR_TLS, "SSL_connect failed"); }
-        c.use_ssl = 1;
-    }
+    if (use_ssl && !conn_tls_connect(&c)) fatal(ERR_TLS, "SSL_connect failed");
 
     char line[BUFSZ];
     if (conn_readline(&c, line, sizeof(line)) <= 0) fatal(ERR_NNTP_GREETING, "No greeting from server");
@@ -1197,6 +5957,32 @@ int main(int argc, char **argv) {
         if (rc >= 400) fatal(ERR_AUTH, "AUTH failed: %d", rc);
     }
 
+    /* capabilities, then compression for this and every worker connection */
+    if (nntp_capabilities(&c) < 0) fatal(ERR_NNTP_CMD, "Connection lost reading CAPABILITIES");
+    compress_resolve();
+    if (g_compress != COMPRESS_OFF) {
+        int zc = conn_compress(&c);
+        if (zc < 0) fatal(ERR_NNTP_CMD, "Connection lost enabling compression");
+        if (zc == 0) g_compress = COMPRESS_OFF;
+        infof("Compression: %s", g_compress == COMPRESS_OFF ? "off" : compress_names[g_compress]);
+    }
+
+    /* several groups: --group-list FILE and/or a wildmat --group */
+    if (opt_export_group_list || (group && has_wildmat(group))) {
+        WorkerArgs wa; memset(&wa, 0, sizeof(wa));
+        wa.db = &db; wa.retries = retries; wa.reconnects = reconnects; wa.pipeline_depth = pipeline_depth; wa.progress_width = progress_width;
+        wa.overview = g_caps.over && !no_overview; wa.event_loop = event_loop;
+        wa.host = host; wa.port = port; wa.use_ssl = use_ssl; wa.do_starttls = do_starttls; wa.user = user; wa.pass = pass;
+        ingest_group_list(&c, &db, &wa, opt_export_group_list, group, headers_only, limit, incremental, xover_chunk, threads);
+        if (g_stop) warnf("Interrupted; committing rows received so far");
+        db_close(&db);
+        conn_cleanup(&c);
+        stats_finish();
+        ssl_cleanup();
+        log_close();
+        return 0;
+    }
+
     /* select group */
     int count=0, first=0, last=0;
     int rc = nntp_group(&c, group, &count, &first, &last);
@@ -1217,67 +6003,101 @@ int main(int argc, char **argv) {
             if (fetch_first < first) fetch_first = first;
         }
     }
-
-    /* sanitize progress width */
-    if (progress_width < 5) progress_width = 5;
-    if (progress_width > 200) progress_width = 200;
+    if (incremental) {
+        int hw = db_get_high_water(&db, group);
+        if (hw >= fetch_last) {
+            infof("%s is up to date (high-water %d, server last %d)", group, hw, last);
+            fprintf(stdout, "No new articles in %s since %d\n", group, hw);
+            db_close(&db);
+            conn_cleanup(&c);
+            stats_finish();
+            ssl_cleanup();
+            log_close();
+            return 0;
+        }
+        if (hw >= fetch_first) fetch_first = hw + 1;
+        infof("incremental: fetching %s %d-%d (high-water %d)", group, fetch_first, fetch_last, hw);
+    }
 
     if (headers_only) {
-        char *xdata = nntp_xover(&c, fetch_first, fetch_last);
-        if (!xdata) warnf("XOVER returned no data");
-        else {
-            int total = fetch_last - fetch_first + 1;
-            int processed = 0;
-            char *saveptr = NULL;
-            char *line2 = strtok_r(xdata, "\n", &saveptr);
-            while (line2) {
-                int artnum = 0; char *subject=NULL,*author=NULL,*date=NULL,*msgid=NULL,*refs=NULL; int bytes=0, linesz=0;
-                parse_xover_line(line2, &artnum, &subject, &author, &date, &msgid, &refs, &bytes, &linesz);
-                db_insert_article(&db, group, artnum, subject, author, date, msgid, refs, bytes, linesz);
-                free(subject); free(author); free(date); free(msgid); free(refs);
-                processed++;
-                int pct = (int)((processed * 100.0) / (total ? total : 1));
-                int filled = (int)(progress_width * (processed / (double)(total ? total : 1)));
-                if (filled > progress_width) filled = progress_width;
-                char *bar = malloc(progress_width + 1);
-                if (!bar) fatal(ERR_RUNTIME, "Out of memory allocating progress bar");
-                for (int bi = 0; bi < progress_width; ++bi) bar[bi] = (bi < filled) ? '#' : '.';
-                bar[progress_width] = '\0';
-                fprintf(stdout, "\rHeaders (XOVER): [%s] %3d%% (%d/%d)", bar, pct, processed, total);
-                free(bar);
-                fflush(stdout);
-                line2 = strtok_r(NULL, "\n", &saveptr);
+        /* XOVER in chunks; with --threads N, N connections fetch disjoint chunks */
+        int total = fetch_last - fetch_first + 1;
+        Progress prog;
+        ChunkCursor cc; chunk_init(&cc, fetch_first, fetch_last, xover_chunk);
+        int nchunks = (total + cc.chunk - 1) / cc.chunk;
+        progress_start(&prog, "Headers (XOVER)", total - (incremental ? chunk_resume_group(&cc, &db, group) : 0), progress_width);
+        if (threads > nchunks) threads = nchunks;
+        WorkerArgs wa; memset(&wa, 0, sizeof(wa));
+        wa.db = &db; wa.group = group; wa.retries = retries; wa.reconnects = reconnects; wa.progress_width = progress_width; wa.progress = &prog;
+        wa.chunks = &cc;
+        wa.host = host; wa.port = port; wa.use_ssl = use_ssl; wa.do_starttls = do_starttls; wa.user = user; wa.pass = pass;
+        if (threads <= 1) {
+            XoverIngest xi;
+            xi.db = &db; xi.group = group; xi.progress = &prog; xi.arena = NULL;
+            int lo, hi, fails = 0;
+            while (!g_stop && chunk_claim(&cc, &lo, &hi)) {
+                long got = xover_fetch_chunk(&c, &wa, lo, hi, &xi, &fails);
+                if (got == -1) break;
+                if (got < 0 || g_stop) continue;
+                int hw = chunk_done(&cc, lo);
+                if (hw) db_set_high_water(&db, group, hw);
+                else db_note_range(&db, group, lo, hi);
+            }
+        } else {
+            DBWriter *writer = db_writer_start(&db);
+            pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+            wa.writer = writer;
+            for (int ti = 0; ti < threads; ++ti) {
+                if (pthread_create(&tids[ti], NULL, xover_worker, &wa) != 0) warnf("pthread_create failed for thread %d", ti);
             }
-            fprintf(stdout, "\n");
-            free(xdata);
+            for (int ti = 0; ti < threads; ++ti) pthread_join(tids[ti], NULL);
+            db_writer_stop(writer);
+            free(tids);
         }
+        chunk_destroy(&cc);
+        progress_finish(&prog);
+        if (!prog.done) warnf("XOVER returned no data");
     } else {
         /* Multithread HEAD fetching (C99) */
         int total = fetch_last - fetch_first + 1;
-        volatile int processed = 0;
-        pthread_mutex_t progress_mutex; pthread_mutex_init(&progress_mutex, NULL);
-        pthread_mutex_t db_mutex; pthread_mutex_init(&db_mutex, NULL);
-        WorkQueue wq; queue_init(&wq, total);
-        for (int a = fetch_first; a <= fetch_last; ++a) queue_push(&wq, a);
+        Progress prog;
         if (threads > total) threads = total;
+        /* slices small enough to balance the tail of the run across threads */
+        int slice = total / (threads * 8);
+        if (slice < 1) slice = 1;
+        if (slice > 1024) slice = 1024;
+        /* the group as a one-job schedule, which is what the event loop takes */
+        GroupJob job; memset(&job, 0, sizeof(job));
+        job.name = (char*)group; job.first = fetch_first; job.last = fetch_last;
+        chunk_init(&job.cc, fetch_first, fetch_last, slice);
+        progress_start(&prog, "Headers (HEAD MT)", total - (incremental ? chunk_resume_group(&job.cc, &db, group) : 0), progress_width);
+        DBWriter *writer = db_writer_start(&db);
         pthread_t *tids = malloc(sizeof(pthread_t) * threads);
-        WorkerArgs wa;
-        wa.db = &db; wa.group = group; wa.retries = retries; wa.progress_width = progress_width; wa.total = total; wa.processed = &processed;
-        wa.progress_mutex = &progress_mutex; wa.db_mutex = &db_mutex; wa.queue = &wq;
+        WorkerArgs wa; memset(&wa, 0, sizeof(wa));
+        wa.db = &db; wa.group = group; wa.retries = retries; wa.reconnects = reconnects; wa.progress_width = progress_width; wa.progress = &prog;
+        wa.writer = writer; wa.chunks = &job.cc; wa.pipeline_depth = pipeline_depth; wa.overview = g_caps.over && !no_overview;
         wa.host = host; wa.port = port; wa.use_ssl = use_ssl; wa.do_starttls = do_starttls; wa.user = user; wa.pass = pass;
-        for (int ti = 0; ti < threads; ++ti) {
-            if (pthread_create(&tids[ti], NULL, head_worker, &wa) != 0) warnf("pthread_create failed for thread %d", ti);
+        if (event_loop) {
+            GroupSched gs; memset(&gs, 0, sizeof(gs));
+            gs.jobs = &job; gs.njobs = 1; gs.base = wa;
+            ev_run(&gs, threads, event_loop, host, port, use_ssl, do_starttls, user, pass);
+        } else {
+            for (int ti = 0; ti < threads; ++ti) {
+                if (pthread_create(&tids[ti], NULL, head_worker, &wa) != 0) warnf("pthread_create failed for thread %d", ti);
+            }
+            for (int ti = 0; ti < threads; ++ti) pthread_join(tids[ti], NULL);
         }
-        for (int ti = 0; ti < threads; ++ti) pthread_join(tids[ti], NULL);
-        fprintf(stdout, "\n");
+        db_writer_stop(writer);
+        progress_finish(&prog);
+        chunk_destroy(&job.cc);
         free(tids);
-        queue_destroy(&wq);
-        pthread_mutex_destroy(&db_mutex);
-        pthread_mutex_destroy(&progress_mutex);
     }
 
+    if (g_stop) warnf("Interrupted; committing rows received so far");
     db_close(&db);
     conn_cleanup(&c);
+    stats_finish();
+    ssl_cleanup();
     log_close();
     return 0;
 }
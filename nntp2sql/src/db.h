@@ -8,8 +8,49 @@
 
 typedef enum { DB_SQLITE, DB_MYSQL, DB_POSTGRES } DBType;
 
+/* bulk writer: articles accumulate here and are flushed as one multi-row
+   statement (SQLite/MySQL) or one COPY (Postgres). String fields are
+   offsets into pool so a single buffer holds the whole batch. */
 typedef struct {
+    int artnum, bytes, lines;
+    size_t group, subject, author, date, message_id, refs;
+    long long epoch; /* v2: the parsed date, when dated */
+    int dated;
+} DBBulkRow;
+
+typedef struct {
+    int cap;          /* rows per flush; 0 = bulk writer off */
+    int n;
+    DBBulkRow *rows;
+    char *pool;
+    size_t pool_len, pool_cap;
+    sqlite3_stmt *sqlite_stmt; /* cached multi-VALUES statement */
+    int sqlite_rows;           /* rows bound by sqlite_stmt */
+    int pg_staged;             /* Postgres temp staging table exists */
+    size_t mysql_packet;       /* longest MySQL statement allowed; 0 until read */
+} DBBulk;
+
+/* a finished article range of one group, for the resume journal */
+typedef struct {
+    const char *group;
+    int lo, hi;
+} DBRange;
+
+/* --shards: the shard a group's rows, high-water mark and journal live in */
+typedef struct {
+    char *group;
+    int shard;
+} DBShardGroup;
+
+/* what db_open() connects to; kept so more handles can be opened later */
+typedef struct {
+    DBType type;
+    const char *name, *host, *port, *user, *pass;
+} DBConf;
+
+typedef struct DB {
     DBType type;
+    const DBConf *conf; /* set by db_open() */
     sqlite3 *sqlite;
     MYSQL *mysql;
     void *impl; /* Postgres state pointer */
@@ -19,8 +60,67 @@ typedef struct {
     sqlite3_stmt *sqlite_article_ins;
     sqlite3_stmt *sqlite_group_ins;
     MYSQL_STMT *mysql_article_ins;
+    /* single-statement native upserts, prepared once in db_init_schema() */
+    sqlite3_stmt *sqlite_article_upsert;
+    sqlite3_stmt *sqlite_group_upsert;
+    MYSQL_STMT *mysql_article_upsert;
+    int pg_prepared; /* Postgres "article_upsert"/"group_upsert" statements exist */
+    /* articles layout, detected when the database is opened: 1 = group_name
+       and the Date: text in every row; 2 = group_id into groups and the date
+       as a UTC epoch (see db_init_schema()); 0 = no articles table yet */
+    int schema;
+    int intern_authors; /* v2: author_id into authors instead of author text */
+    sqlite3_stmt *sqlite_author_ins;
+    /* --dedup: placements of articles stored once under another group */
+    int crossposts;     /* the crossposts table exists */
+    sqlite3_stmt *sqlite_crosspost_ins;
+    int defer_indexes;  /* --sqlite-profile bulk: secondary indexes wait for db_close() */
+    /* transaction batching: 0 = autocommit every row */
+    int batch_size;
+    int batch_ms;
+    int batch_pending;
+    int in_txn;
+    long long batch_started_ms;
+    DBBulk bulk;
+    /* incremental sync: groups.high_water to store with the next commit */
+    const char *hw_group;
+    int hw_pending;
+    /* article writes that failed on this handle; once any has, no mark or
+       range is written here for the rest of the run so a rerun refetches */
+    int writes_failed;
+    int hw_held;        /* marks not written since */
+    /* ... and the finished ranges above it, journaled in fetched_ranges */
+    DBRange *ranges;
+    int nranges, ranges_cap;
+    /* sharded storage: shard[k] is a complete database holding the groups
+       given shard k (SQLite: a file the manifest opened here lists; MySQL and
+       Postgres: another connection). The group functions and the iterator
+       below go to the right shard; shard_groups is sorted by name. */
+    struct DB *shard;
+    int nshards;
+    int is_shard;       /* one of another handle's shards */
+    DBConf *shard_conf; /* SQLite: each shard's file */
+    DBShardGroup *shard_groups;
+    int nshard_groups, shard_groups_cap;
+    struct DB *q_shard; /* the shard the open iterator reads */
+    /* db_query_articles_*: the open iterator; rows stream from the server */
+    sqlite3_stmt *q_stmt;
+    MYSQL_RES *q_res;   /* mysql_use_result() handle */
+    void *q_pg;         /* PGresult of the current row (single-row mode) */
+    int q_pg_active;    /* Postgres rows still to be read */
+    int q_keys;         /* the iterator returns artnum only */
 } DB;
 
+/* one article to store: text fields are NUL-terminated views (often straight
+   into the NNTP receive buffer) with their lengths, bound without copying */
+typedef struct {
+    const char *group, *subject, *author, *date, *message_id, *refs;
+    size_t group_len, subject_len, author_len, date_len, message_id_len, refs_len;
+    int artnum, bytes, lines;
+    const char *xref; /* --dedup: the Xref: value, else "" */
+    size_t xref_len;
+} DBArticle;
+
 typedef struct {
     long long artnum;
     const char *subject;
@@ -28,16 +128,32 @@ typedef struct {
     const char *date;
 } DBRow;
 
+int db_open(DB *db, const DBConf *cf);
 void db_close(DB *db);
 void db_init_schema(DB *db);
 void db_insert_group(DB *db, const char *name, int count, int first, int last);
 void db_insert_article(DB *db, const char *group, int artnum, const char *subject,
                        const char *author, const char *date, const char *message_id,
                        const char *references, int bytes, int lines);
+void db_store_article(DB *db, const DBArticle *a);
 char *db_escape(DB *db, const char *s);
+void db_begin(DB *db);
+void db_commit(DB *db);
+void db_bulk_flush(DB *db);
+int db_get_high_water(DB *db, const char *group);
+int db_get_group_last(DB *db, const char *group);
+void db_set_high_water(DB *db, const char *group, int artnum);
+void db_note_range(DB *db, const char *group, int lo, int hi);
+/* index into db->shard of the shard that stores group; 0 when unsharded */
+int db_shard_of(DB *db, const char *group);
 
-/* Iteration helpers used by export_html */
+/* Iteration helpers used by export_html: one open iterator per DB, read
+   in constant memory; row fields stay valid until the next call */
 int db_query_articles_begin(DB *db, const char *group_name);
+/* keyset page: at most limit rows with artnum > after; limit 0 = no limit */
+int db_query_articles_page_begin(DB *db, const char *group_name, long long after, int limit);
+/* artnum only, for planning page boundaries */
+int db_query_artnums_begin(DB *db, const char *group_name);
 int db_query_articles_next(DB *db, DBRow *out);
 void db_query_articles_end(DB *db);
 
@@ -7,7 +7,7 @@
 struct PGState {
     PGconn *conn;
     PGresult *res;
-    int row_idx;
+    int row_idx; /* nonzero while a streamed query has rows left */
 };
 
 int db_pg_connect(DB *db, const char *conninfo){
@@ -33,35 +33,58 @@ void db_pg_close(DB *db){
     db->impl = NULL;
 }
 
+void db_pg_query_articles_end(DB *db);
+
+/* rows are read in single-row mode: one PGresult per row, read as the
+   caller asks, so a large group is never held in memory */
 int db_pg_query_articles_begin(DB *db, const char *group){
     struct PGState *pg = (struct PGState*)db->impl;
     if (!pg || !group) return -1;
+    db_pg_query_articles_end(db);
     const char *paramValues[1] = { group };
-    pg->res = PQexecParams(pg->conn,
+    if (!PQsendQueryParams(pg->conn,
         "SELECT artnum, subject, author, date FROM articles WHERE group_name = $1 ORDER BY artnum",
-        1, NULL, paramValues, NULL, NULL, 0);
-    if (PQresultStatus(pg->res) != PGRES_TUPLES_OK){
+        1, NULL, paramValues, NULL, NULL, 0)){
+        return -2;
+    }
+    pg->row_idx = 1; /* query in progress */
+    if (!PQsetSingleRowMode(pg->conn)){
+        db_pg_query_articles_end(db);
         return -2;
     }
-    pg->row_idx = 0;
     return 0;
 }
 
 int db_pg_query_articles_next(DB *db, DBRow *out){
     struct PGState *pg = (struct PGState*)db->impl;
-    if (!pg || !pg->res) return 0;
-    int rows = PQntuples(pg->res);
-    if (pg->row_idx >= rows) return 0;
-    int i = pg->row_idx++;
-    out->artnum = atoll(PQgetvalue(pg->res, i, 0));
-    out->subject = PQgetvalue(pg->res, i, 1);
-    out->author  = PQgetvalue(pg->res, i, 2);
-    out->date    = PQgetvalue(pg->res, i, 3);
-    return 1;
+    if (!pg || !pg->row_idx) return 0;
+    if (pg->res) { PQclear(pg->res); pg->res = NULL; }
+    PGresult *r = PQgetResult(pg->conn);
+    if (r && PQresultStatus(r) == PGRES_SINGLE_TUPLE){
+        pg->res = r;
+        out->artnum = atoll(PQgetvalue(r, 0, 0));
+        out->subject = PQgetvalue(r, 0, 1);
+        out->author  = PQgetvalue(r, 0, 2);
+        out->date    = PQgetvalue(r, 0, 3);
+        return 1;
+    }
+    /* end of the set or an error: drain what is left */
+    PQclear(r);
+    while ((r = PQgetResult(pg->conn)) != NULL) PQclear(r);
+    pg->row_idx = 0;
+    return 0;
 }
 
 void db_pg_query_articles_end(DB *db){
     struct PGState *pg = (struct PGState*)db->impl;
     if (!pg) return;
     if (pg->res) { PQclear(pg->res); pg->res = NULL; }
+    if (pg->row_idx){
+        PGcancel *cn = PQgetCancel(pg->conn);
+        char eb[256];
+        if (cn) { PQcancel(cn, eb, sizeof(eb)); PQfreeCancel(cn); }
+        PGresult *r;
+        while ((r = PQgetResult(pg->conn)) != NULL) PQclear(r);
+        pg->row_idx = 0;
+    }
 }
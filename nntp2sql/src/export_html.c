@@ -1,8 +1,11 @@
 // Minimal HTML export utility
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "db.h"
+#include "export_html.h"
 
 static void write_html_header(FILE *fp, const char *title){
     fprintf(fp, "<!doctype html>\n<html><head><meta charset=\"utf-8\"><title>%s</title>\n", title ? title : "News Group Export");
@@ -14,18 +17,169 @@ static void write_html_footer(FILE *fp){
     fprintf(fp, "</body></html>\n");
 }
 
-int export_group_to_html(DB *db, const char *group_name, const char *out_path){
-    if (!db || !group_name || !out_path) return -1;
-    FILE *fp = fopen(out_path, "w");
+/* Export engine. A run is a list of groups, each cut into pages of
+   page_size rows (or one page holding the whole group). Pages are fetched
+   by keyset -- artnum > the last artnum of the page before, LIMIT
+   page_size -- with the boundaries planned up front from an artnum-only
+   scan, so every page is an independent job. With jobs > 1 the groups and
+   then the pages are shared out over that many threads, each on its own
+   DB handle. Group-list exports keep a state file in the output directory
+   and skip groups whose groups.last is unchanged since the last run. */
+#define EXPORT_STATE ".nntp2sql-export"
+
+typedef struct {
+    char *name;
+    int last;          /* groups.last when planned */
+    int skip;          /* unchanged since the previous export */
+    int failed;        /* first error code of its pages */
+    long long *keys;   /* page k holds the rows after keys[k] */
+    int npages, cap;
+} ExpGroup;
+
+typedef struct { int g, page; } ExpPage;
+
+typedef struct {
+    char *name;
+    int last, page_size;
+} ExpState;
+
+typedef struct {
+    DB *db;            /* the caller's handle; the only one when jobs == 1 */
+    ExpGroup *groups;
+    int ngroups;
+    ExpPage *pages;
+    int npages;
+    const char *out_dir, *single_path;
+    int page_size, jobs;
+    int incremental;   /* group list: consult and rewrite the state file */
+    ExpState *state;   /* previous run, sorted by name */
+    int nstate;
+    int phase;         /* 0 = plan groups, 1 = write pages */
+    int next;          /* next item of the phase, claimed with fetch-add */
+    int open_failed;
+} ExpRun;
+
+static int cmp_state(const void *a, const void *b){
+    return strcmp(((const ExpState*)a)->name, ((const ExpState*)b)->name);
+}
+
+static const ExpState *state_find(const ExpRun *r, const char *name){
+    ExpState key = { (char*)name, 0, 0 };
+    if (!r->nstate) return NULL;
+    return bsearch(&key, r->state, r->nstate, sizeof(ExpState), cmp_state);
+}
+
+/* state file lines: last TAB page_size TAB group */
+static void state_load(ExpRun *r){
+    char path[1024], line[1024];
+    snprintf(path, sizeof(path), "%s/%s", r->out_dir, EXPORT_STATE);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+    int cap = 0;
+    while (fgets(line, sizeof(line), fp)){
+        int last, ps, off = 0;
+        if (*line == '#' || sscanf(line, "%d\t%d\t%n", &last, &ps, &off) != 2 || !off) continue;
+        char *name = line + off;
+        name[strcspn(name, "\r\n")] = '\0';
+        if (!*name) continue;
+        if (r->nstate == cap){
+            cap = cap ? cap * 2 : 64;
+            ExpState *ns = realloc(r->state, cap * sizeof(ExpState));
+            if (!ns) break;
+            r->state = ns;
+        }
+        ExpState *st = &r->state[r->nstate];
+        if (!(st->name = strdup(name))) break;
+        st->last = last; st->page_size = ps;
+        r->nstate++;
+    }
+    fclose(fp);
+    qsort(r->state, r->nstate, sizeof(ExpState), cmp_state);
+}
+
+/* the groups of this run that are now current, by replacing the file */
+static void state_save(ExpRun *r){
+    char path[1024], tmp[1040];
+    snprintf(path, sizeof(path), "%s/%s", r->out_dir, EXPORT_STATE);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return;
+    fprintf(fp, "# nntp2sql HTML export state: groups.last, page size, group\n");
+    for (int g = 0; g < r->ngroups; ++g){
+        const ExpGroup *eg = &r->groups[g];
+        if (eg->failed || eg->last <= 0) continue;
+        fprintf(fp, "%d\t%d\t%s\n", eg->last, r->page_size, eg->name);
+    }
+    if (fclose(fp) == 0) rename(tmp, path);
+    else remove(tmp);
+}
+
+static int keys_push(ExpGroup *eg, long long k){
+    if (eg->npages == eg->cap){
+        int cap = eg->cap ? eg->cap * 2 : 16;
+        long long *nk = realloc(eg->keys, cap * sizeof(long long));
+        if (!nk) return 0;
+        eg->keys = nk; eg->cap = cap;
+    }
+    eg->keys[eg->npages++] = k;
+    return 1;
+}
+
+/* page k > 0 starts after the last artnum of page k-1 */
+static void plan_pages(ExpRun *r, DB *db, ExpGroup *eg){
+    DBRow row;
+    long long n = 0, prev = 0;
+    if (!db_query_artnums_begin(db, eg->name)) { eg->failed = -3; return; }
+    while (db_query_articles_next(db, &row)){
+        if (n > 0 && n % r->page_size == 0 && !keys_push(eg, prev)) { eg->failed = -4; break; }
+        prev = row.artnum;
+        n++;
+    }
+    db_query_articles_end(db);
+}
+
+/* phase 0: decide whether the group is exported and where its pages start */
+static void plan_group(ExpRun *r, DB *db, ExpGroup *eg){
+    if (r->incremental){
+        eg->last = db_get_group_last(db, eg->name);
+        const ExpState *st = state_find(r, eg->name);
+        if (st && eg->last > 0 && st->last == eg->last && st->page_size == r->page_size) { eg->skip = 1; return; }
+    }
+    if (!keys_push(eg, 0)) { eg->failed = -4; return; }
+    if (r->page_size > 0) plan_pages(r, db, eg);
+}
+
+static void page_path(const ExpRun *r, const ExpGroup *eg, int page, char *out, size_t len){
+    if (r->single_path) snprintf(out, len, "%s", r->single_path);
+    else if (r->page_size > 0) snprintf(out, len, "%s/%s-%d.html", r->out_dir, eg->name, page + 1);
+    else snprintf(out, len, "%s/%s.html", r->out_dir, eg->name);
+}
+
+/* phase 1: one page, written under a temporary name and renamed into place
+   so an interrupted export never leaves a truncated page */
+static int write_page(ExpRun *r, DB *db, ExpGroup *eg, int page){
+    char path[1024], tmp[1040];
+    page_path(r, eg, page, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
     if (!fp) return -2;
-    write_html_header(fp, group_name);
-    fprintf(fp, "<nav>\n");
-    fprintf(fp, "</nav>\n");
+    if (r->page_size > 0){
+        char title[512];
+        snprintf(title, sizeof(title), "%s (page %d of %d)", eg->name, page + 1, eg->npages);
+        write_html_header(fp, title);
+        fprintf(fp, "<nav>");
+        if (page > 0) fprintf(fp, "<a href=\"%s-%d.html\">Prev</a>", eg->name, page);
+        if (page + 1 < eg->npages) fprintf(fp, "<a href=\"%s-%d.html\">Next</a>", eg->name, page + 2);
+        fprintf(fp, "</nav>\n");
+    } else {
+        write_html_header(fp, eg->name);
+        fprintf(fp, "<nav>\n");
+        fprintf(fp, "</nav>\n");
+    }
     fprintf(fp, "<table><thead><tr><th>ArtNum</th><th>Subject</th><th>From</th><th>Date</th></tr></thead><tbody>\n");
-
     DBRow row;
-    int rc = db_query_articles_begin(db, group_name);
-    while (rc && db_query_articles_next(db, &row)){
+    int ok = db_query_articles_page_begin(db, eg->name, eg->keys[page], r->page_size);
+    while (ok && db_query_articles_next(db, &row)){
         fprintf(fp, "<tr><td>%lld</td><td>%s</td><td>%s</td><td>%s</td></tr>\n",
                 (long long)row.artnum,
                 row.subject ? row.subject : "",
@@ -35,58 +189,140 @@ int export_group_to_html(DB *db, const char *group_name, const char *out_path){
     db_query_articles_end(db);
     fprintf(fp, "</tbody></table>\n");
     write_html_footer(fp);
-    fclose(fp);
+    if (fclose(fp) != 0 || !ok) { remove(tmp); return ok ? -2 : -3; }
+    if (rename(tmp, path) != 0) { remove(tmp); return -2; }
     return 0;
 }
 
+static void run_items(ExpRun *r, DB *db){
+    int n = r->phase == 0 ? r->ngroups : r->npages;
+    for (;;){
+        int k = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED);
+        if (k >= n) break;
+        if (r->phase == 0) { plan_group(r, db, &r->groups[k]); continue; }
+        ExpGroup *eg = &r->groups[r->pages[k].g];
+        int rc = write_page(r, db, eg, r->pages[k].page);
+        if (rc != 0) __atomic_store_n(&eg->failed, rc, __ATOMIC_RELAXED);
+    }
+}
+
+static void *export_worker(void *arg){
+    ExpRun *r = (ExpRun*)arg;
+    DB db;
+    if (!db_open(&db, r->db->conf)) { __atomic_store_n(&r->open_failed, 1, __ATOMIC_RELAXED); return NULL; }
+    run_items(r, &db);
+    db_close(&db);
+    return NULL;
+}
+
+/* run the current phase on jobs threads, or on the caller's handle */
+static void run_phase(ExpRun *r, int phase){
+    r->phase = phase;
+    r->next = 0;
+    int jobs = r->jobs;
+    if (jobs > 1 && r->db->conf){
+        pthread_t *tids = malloc(sizeof(pthread_t) * jobs);
+        int started = 0;
+        for (int t = 0; tids && t < jobs; ++t) if (pthread_create(&tids[started], NULL, export_worker, r) == 0) started++;
+        for (int t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+        free(tids);
+        if (started > 0 && !r->open_failed) return;
+    }
+    run_items(r, r->db); /* single job, or whatever the threads left */
+}
+
+int export_html_run(DB *db, const char *group_name, const char *group_list_path, const char *out,
+                    int jobs, int page_size, int *exported, int *skipped){
+    if (!db || !out || (!group_name && !group_list_path)) return -1;
+    ExpRun r;
+    memset(&r, 0, sizeof(r));
+    r.db = db; r.jobs = jobs < 1 ? 1 : jobs; r.page_size = page_size > 0 ? page_size : 0;
+    /* a single unpaginated group goes to the file named by out */
+    if (group_name && r.page_size == 0) r.single_path = out;
+    else r.out_dir = out;
+
+    int cap = 0;
+    if (group_name){
+        r.groups = calloc(1, sizeof(ExpGroup));
+        if (!r.groups || !(r.groups[0].name = strdup(group_name))) { free(r.groups); return -4; }
+        r.ngroups = 1;
+    } else {
+        FILE *fp = fopen(group_list_path, "r");
+        if (!fp) return -2;
+        char buf[512];
+        while (fgets(buf, sizeof(buf), fp)){
+            buf[strcspn(buf, "\r\n")] = '\0';
+            if (*buf == '\0') continue;
+            if (r.ngroups == cap){
+                cap = cap ? cap * 2 : 64;
+                ExpGroup *ng = realloc(r.groups, cap * sizeof(ExpGroup));
+                if (!ng) break;
+                r.groups = ng;
+            }
+            memset(&r.groups[r.ngroups], 0, sizeof(ExpGroup));
+            if (!(r.groups[r.ngroups].name = strdup(buf))) break;
+            r.ngroups++;
+        }
+        fclose(fp);
+        r.incremental = 1;
+        state_load(&r);
+    }
+
+    run_phase(&r, 0);
+    int total = 0;
+    for (int g = 0; g < r.ngroups; ++g) if (!r.groups[g].skip && !r.groups[g].failed) total += r.groups[g].npages;
+    r.pages = malloc((total ? total : 1) * sizeof(ExpPage));
+    int rc = r.pages ? 0 : -4;
+    for (int g = 0; r.pages && g < r.ngroups; ++g){
+        ExpGroup *eg = &r.groups[g];
+        if (eg->skip || eg->failed) continue;
+        for (int p = 0; p < eg->npages; ++p) { r.pages[r.npages].g = g; r.pages[r.npages].page = p; r.npages++; }
+    }
+    if (r.pages) run_phase(&r, 1);
+
+    int nexp = 0, nskip = 0;
+    for (int g = 0; g < r.ngroups; ++g){
+        if (r.groups[g].skip) nskip++;
+        else if (!r.groups[g].failed) nexp++;
+        else if (!rc) rc = r.groups[g].failed;
+    }
+    if (exported) *exported = nexp;
+    if (skipped) *skipped = nskip;
+
+    if (r.incremental){
+        /* simple index page */
+        char idx_path[1024]; snprintf(idx_path, sizeof(idx_path), "%s/index.html", out);
+        FILE *idx = fopen(idx_path, "w");
+        if (idx){
+            write_html_header(idx, "Group Index"); fprintf(idx, "<ul>\n");
+            for (int g = 0; g < r.ngroups; ++g){
+                const char *nm = r.groups[g].name;
+                if (r.page_size > 0) fprintf(idx, "<li><a href=\"%s-1.html\">%s</a></li>\n", nm, nm);
+                else fprintf(idx, "<li><a href=\"%s.html\">%s</a></li>\n", nm, nm);
+            }
+            fprintf(idx, "</ul>\n"); write_html_footer(idx); fclose(idx);
+        }
+        state_save(&r);
+    }
+
+    for (int g = 0; g < r.ngroups; ++g) { free(r.groups[g].name); free(r.groups[g].keys); }
+    for (int k = 0; k < r.nstate; ++k) free(r.state[k].name);
+    free(r.groups); free(r.pages); free(r.state);
+    return rc;
+}
+
+int export_group_to_html(DB *db, const char *group_name, const char *out_path){
+    if (!db || !group_name || !out_path) return -1;
+    return export_html_run(db, group_name, NULL, out_path, 1, 0, NULL, NULL);
+}
+
 int export_groups_from_file(DB *db, const char *group_list_path, const char *out_dir){
     if (!db || !group_list_path || !out_dir) return -1;
-    FILE *fp = fopen(group_list_path, "r");
-    if (!fp) return -2;
-    char buf[512];
-    /* simple index page */
-    char idx_path[1024]; snprintf(idx_path, sizeof(idx_path), "%s/index.html", out_dir);
-    FILE *idx = fopen(idx_path, "w"); if (idx){ write_html_header(idx, "Group Index"); fprintf(idx, "<ul>\n"); }
-    while (fgets(buf, sizeof(buf), fp)){
-        char *nl = strchr(buf, '\n'); if (nl) *nl = '\0';
-        if (*buf == '\0') continue;
-        char out_path[1024];
-        snprintf(out_path, sizeof(out_path), "%s/%s.html", out_dir, buf);
-        export_group_to_html(db, buf, out_path);
-        if (idx) fprintf(idx, "<li><a href=\"%s.html\">%s</a></li>\n", buf, buf);
-    }
-    fclose(fp);
-    if (idx){ fprintf(idx, "</ul>\n"); write_html_footer(idx); fclose(idx); }
-    return 0;
+    return export_html_run(db, NULL, group_list_path, out_dir, 1, 0, NULL, NULL);
 }
 
 /* Optional pagination: generate pages of size page_size; filenames group-N.html */
 int export_group_to_html_paginated(DB *db, const char *group_name, const char *out_dir, int page_size){
     if (!db || !group_name || !out_dir || page_size <= 0) return -1;
-    int rc = db_query_articles_begin(db, group_name); if (!rc) return -3;
-    int page = 1, count = 0;
-    FILE *fp = NULL; char path[1024];
-    DBRow row;
-    while (db_query_articles_next(db, &row)){
-        if (count % page_size == 0){
-            if (fp) { fprintf(fp, "</tbody></table>\n"); write_html_footer(fp); fclose(fp); }
-            snprintf(path, sizeof(path), "%s/%s-%d.html", out_dir, group_name, page);
-            fp = fopen(path, "w"); if (!fp) break;
-            char title[256]; snprintf(title, sizeof(title), "%s (page %d)", group_name, page);
-            write_html_header(fp, title);
-            fprintf(fp, "<nav>"); if (page>1) fprintf(fp, "<a href=\"%s-%d.html\">Prev</a>", group_name, page-1);
-            fprintf(fp, "</nav>");
-            fprintf(fp, "<table><thead><tr><th>ArtNum</th><th>Subject</th><th>From</th><th>Date</th></tr></thead><tbody>\n");
-            page++;
-        }
-        fprintf(fp, "<tr><td>%lld</td><td>%s</td><td>%s</td><td>%s</td></tr>\n",
-                (long long)row.artnum,
-                row.subject ? row.subject : "",
-                row.author ? row.author : "",
-                row.date ? row.date : "");
-        count++;
-    }
-    db_query_articles_end(db);
-    if (fp) { fprintf(fp, "</tbody></table>\n"); write_html_footer(fp); fclose(fp); }
-    return 0;
+    return export_html_run(db, group_name, NULL, out_dir, 1, page_size, NULL, NULL);
 }
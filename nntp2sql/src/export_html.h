@@ -4,4 +4,11 @@
 int export_group_to_html(DB *db, const char *group_name, const char *out_path);
 int export_groups_from_file(DB *db, const char *group_list_path, const char *out_dir);
 int export_group_to_html_paginated(DB *db, const char *group_name, const char *out_dir, int page_size);
+/* export group_name, or every group listed in group_list_path, to out:
+   jobs DB handles/threads (1 = db only), page_size rows per page (0 = one
+   file per group). A list export writes out/index.html and skips groups
+   whose groups.last is unchanged since the last export into out.
+   Returns 0 or a negative error; counts go to exported/skipped if set. */
+int export_html_run(DB *db, const char *group_name, const char *group_list_path, const char *out,
+                    int jobs, int page_size, int *exported, int *skipped);
 #endif
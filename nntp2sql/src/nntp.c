@@ -19,6 +19,7 @@ void conn_cleanup(Conn *c) {
     if (c->ssl) { SSL_shutdown(c->ssl); SSL_free(c->ssl); c->ssl = NULL; }
     if (c->ctx) { SSL_CTX_free(c->ctx); c->ctx = NULL; }
     if (c->sock >= 0) close(c->sock);
+    free(c->rbuf); c->rbuf = NULL; c->rcap = c->rpos = c->rlen = 0;
 }
 
 int tcp_connect(const char *host, const char *port) {
@@ -36,24 +37,39 @@ int tcp_connect(const char *host, const char *port) {
     return fd;
 }
 
-ssize_t conn_readline(Conn *c, char *buf, size_t bufsz) {
-    size_t pos = 0;
-    while (pos + 1 < bufsz) {
-        char ch; ssize_t r = c->use_ssl ? SSL_read(c->ssl, &ch, 1) : recv(c->sock, &ch, 1, 0);
-        if (r <= 0) return -1; buf[pos++] = ch;
-        if (pos >= 2 && buf[pos-2] == '\r' && buf[pos-1] == '\n') break;
+static ssize_t conn_fill(Conn *c) {
+    if (!c->rbuf) { c->rbuf = malloc(CONN_RBUFSZ); if (!c->rbuf) return -1; c->rcap = CONN_RBUFSZ; c->rpos = c->rlen = 0; }
+    if (c->rpos > 0) { if (c->rlen > c->rpos) memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos); c->rlen -= c->rpos; c->rpos = 0; }
+    if (c->rlen == c->rcap) { char *nb = realloc(c->rbuf, c->rcap * 2); if (!nb) return -1; c->rbuf = nb; c->rcap *= 2; }
+    size_t room = c->rcap - c->rlen;
+    ssize_t r = c->use_ssl ? SSL_read(c->ssl, c->rbuf + c->rlen, (int)room) : recv(c->sock, c->rbuf + c->rlen, room, 0);
+    if (r <= 0) return -1; c->rlen += (size_t)r; return r;
+}
+
+ssize_t conn_getline(Conn *c, const char **line) {
+    size_t scanned = 0;
+    for (;;) {
+        if (c->rbuf && c->rlen > c->rpos + scanned) {
+            char *start = c->rbuf + c->rpos; char *nl = memchr(start + scanned, '\n', c->rlen - c->rpos - scanned);
+            if (nl) { size_t l = (size_t)(nl - start); c->rpos += l + 1; if (l && start[l-1] == '\r') l--; *line = start; return (ssize_t)l; }
+            scanned = c->rlen - c->rpos;
+        }
+        if (conn_fill(c) < 0) return -1;
     }
-    buf[pos] = '\0'; return (ssize_t)pos;
+}
+
+ssize_t conn_readline(Conn *c, char *buf, size_t bufsz) {
+    const char *line; ssize_t l = conn_getline(c, &line); if (l < 0) return -1;
+    size_t n = (size_t)l; if (n + 3 > bufsz) n = bufsz > 3 ? bufsz - 3 : 0;
+    memcpy(buf, line, n); buf[n++] = '\r'; buf[n++] = '\n'; buf[n] = '\0'; return (ssize_t)n;
 }
 
 char *conn_read_multiline(Conn *c) {
     size_t cap = 8192, len = 0; char *out = malloc(cap); if (!out) return NULL; out[0] = '\0';
-    char line[BUFSZ];
     while (1) {
-        if (conn_readline(c, line, sizeof(line)) <= 0) { free(out); return NULL; }
-        size_t l = strlen(line); while (l && (line[l-1] == '\r' || line[l-1] == '\n')) line[--l] = '\0';
-        if (strcmp(line, ".") == 0) break; if (line[0] == '.') memmove(line, line+1, strlen(line));
-        size_t need = len + l + 2; if (need > cap) { cap = need * 2; out = realloc(out, cap); if (!out) return NULL; }
+        const char *line; ssize_t r = conn_getline(c, &line); if (r < 0) { free(out); return NULL; }
+        size_t l = (size_t)r; if (l == 1 && line[0] == '.') break; if (l && line[0] == '.') { line++; l--; }
+        size_t need = len + l + 2; if (need > cap) { cap = need * 2; char *g = realloc(out, cap); if (!g) { free(out); return NULL; } out = g; }
         memcpy(out + len, line, l); len += l; out[len++] = '\n'; out[len] = '\0';
     }
     return out;
@@ -69,7 +85,7 @@ ssize_t conn_sendf(Conn *c, const char *fmt, ...) {
 void ssl_init(void) { SSL_library_init(); SSL_load_error_strings(); OpenSSL_add_all_algorithms(); }
 
 int conn_starttls(Conn *c) {
-    if (c->use_ssl) return 1; ssl_init(); c->ctx = SSL_CTX_new(TLS_client_method()); if (!c->ctx) return 0;
+    if (c->use_ssl) return 1; c->rpos = c->rlen = 0; ssl_init(); c->ctx = SSL_CTX_new(TLS_client_method()); if (!c->ctx) return 0;
     c->ssl = SSL_new(c->ctx); if (!c->ssl) return 0; if (!SSL_set_fd(c->ssl, c->sock)) return 0;
     if (SSL_connect(c->ssl) <= 0) { ERR_print_errors_fp(stderr); return 0; }
     c->use_ssl = 1; return 1;
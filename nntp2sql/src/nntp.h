@@ -3,17 +3,23 @@
 #include <openssl/ssl.h>
 
 #define BUFSZ 8192
+#define CONN_RBUFSZ (128 * 1024) /* per-connection receive buffer */
 
 typedef struct {
     int sock;
     SSL_CTX *ctx;
     SSL *ssl;
     int use_ssl;
+    char *rbuf;  /* receive buffer, allocated on first read */
+    size_t rcap; /* allocated size of rbuf */
+    size_t rpos; /* first unconsumed byte */
+    size_t rlen; /* end of buffered data */
 } Conn;
 
 void conn_init(Conn *c);
 void conn_cleanup(Conn *c);
 int tcp_connect(const char *host, const char *port);
+ssize_t conn_getline(Conn *c, const char **line);
 ssize_t conn_readline(Conn *c, char *buf, size_t bufsz);
 char *conn_read_multiline(Conn *c);
 ssize_t conn_sendf(Conn *c, const char *fmt, ...);